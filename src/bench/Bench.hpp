@@ -0,0 +1,140 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <time.h>
+#include <vector>
+
+// 简单的微基准框架: 自动调整迭代次数, 统计每次迭代的耗时和本线程的CPU时间
+class BenchState {
+public:
+    explicit BenchState(uint64_t iterations) : iterations_(iterations) {}
+
+    bool KeepRunning() {
+        if (count_ == 0) {
+            start_cpu_ = ThreadCpuNs();
+            start_ = std::chrono::steady_clock::now();
+        }
+        if (count_++ < iterations_) {
+            return true;
+        }
+        stop_ = std::chrono::steady_clock::now();
+        stop_cpu_ = ThreadCpuNs();
+        return false;
+    }
+
+    uint64_t Iterations() const {
+        return iterations_;
+    }
+
+    double ElapsedNs() const {
+        return std::chrono::duration<double, std::nano>(stop_ - start_)
+                   .count() -
+               paused_ns_;
+    }
+
+    // 只算跑用例的线程, 后台线程(如LogicSystem, io线程)的不算
+    double CpuNs() const {
+        return (double)(stop_cpu_ - start_cpu_ - paused_cpu_ns_);
+    }
+
+    // 循环中不计时的部分(如等后台线程处理完一批)放在这两个调用之间
+    void PauseTiming() {
+        pause_cpu_ = ThreadCpuNs();
+        pause_ = std::chrono::steady_clock::now();
+    }
+
+    void ResumeTiming() {
+        paused_ns_ += std::chrono::duration<double, std::nano>(
+                          std::chrono::steady_clock::now() - pause_)
+                          .count();
+        paused_cpu_ns_ += ThreadCpuNs() - pause_cpu_;
+    }
+
+    // 结果不可信时调用, 输出错误而不是耗时, bench以非0退出
+    void SkipWithError(std::string const &message) {
+        error_ = message;
+    }
+
+    std::string const &GetError() const {
+        return error_;
+    }
+
+    // 计时区间内处理的条目/字节总数, 用于输出吞吐
+    void SetItemsProcessed(uint64_t items) {
+        items_ = items;
+    }
+
+    void SetBytesProcessed(uint64_t bytes) {
+        bytes_ = bytes;
+    }
+
+    uint64_t GetItemsProcessed() const {
+        return items_;
+    }
+
+    uint64_t GetBytesProcessed() const {
+        return bytes_;
+    }
+
+    // 由用例在循环结束后计算的附加指标, 原样输出
+    std::map<std::string, double> counters;
+
+private:
+    uint64_t iterations_;
+    uint64_t count_ = 0;
+    uint64_t items_ = 0;
+    uint64_t bytes_ = 0;
+    std::chrono::steady_clock::time_point start_;
+    std::chrono::steady_clock::time_point stop_;
+    int64_t start_cpu_ = 0;
+    int64_t stop_cpu_ = 0;
+    std::chrono::steady_clock::time_point pause_;
+    int64_t pause_cpu_ = 0;
+    double paused_ns_ = 0;
+    int64_t paused_cpu_ns_ = 0;
+    std::string error_;
+
+    static int64_t ThreadCpuNs() {
+        timespec ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+};
+
+using BenchFunc = std::function<void(BenchState &)>;
+
+struct BenchCase {
+    std::string name;
+    BenchFunc func;
+};
+
+class BenchRegistry {
+public:
+    static std::vector<BenchCase> &Cases() {
+        static std::vector<BenchCase> cases;
+        return cases;
+    }
+
+    static int Register(char const *name, BenchFunc func) {
+        Cases().push_back({name, std::move(func)});
+        return 0;
+    }
+};
+
+#define BENCH_CONCAT_(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT_(a, b)
+
+#define BENCHMARK(name)                                                      \
+    static void name(BenchState &state);                                     \
+    static int BENCH_CONCAT(name, _registered) =                             \
+        BenchRegistry::Register(#name, name);                                \
+    static void name(BenchState &state)
+
+// 测试数据目录, 由CMake传入
+#ifndef BENCH_DATA_DIR
+#define BENCH_DATA_DIR "."
+#endif
@@ -0,0 +1,205 @@
+#include "Bench.hpp"
+#include "Log/AsyncLog.hpp"
+#include <any>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <thread>
+
+namespace {
+
+// 改写之前的AsyncLog, 只加了WaitEmpty用来对比吞吐
+class LegacyAsyncLog {
+public:
+    struct LogTask {
+        LogLv level_;
+        std::queue<std::any> logdatas;
+    };
+
+    static LegacyAsyncLog &getInstance() {
+        static LegacyAsyncLog ins;
+        return ins;
+    }
+
+    template <typename... Args>
+    void AsyncWrite(LogLv level, Args... args) {
+        auto task = std::make_shared<LogTask>();
+        (task->logdatas.push(std::any(std::forward<Args>(args))), ...);
+        task->level_ = level;
+        std::unique_lock<std::mutex> lk(mtx_);
+        que_.push(task);
+        bool empty = que_.size() == 1;
+        lk.unlock();
+        if (empty) {
+            empty_cond_.notify_one();
+        }
+    }
+
+    void WaitEmpty() {
+        std::unique_lock<std::mutex> lk(mtx_);
+        done_cond_.wait(lk, [this] { return que_.empty() && !busy_; });
+    }
+
+    ~LegacyAsyncLog() {
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            is_stop_ = true;
+        }
+        empty_cond_.notify_one();
+        workthread_.join();
+    }
+
+private:
+    LegacyAsyncLog() : workthread_(&LegacyAsyncLog::Start, this) {}
+
+    void Start() {
+        for (;;) {
+            std::unique_lock<std::mutex> lk(mtx_);
+            busy_ = false;
+            done_cond_.notify_all();
+            empty_cond_.wait(lk, [this] { return !que_.empty() || is_stop_; });
+            if (is_stop_) {
+                return;
+            }
+            auto logtask = que_.front();
+            que_.pop();
+            busy_ = true;
+            lk.unlock();
+            processTask(logtask);
+        }
+    }
+
+    void processTask(std::shared_ptr<LogTask> task) {
+        std::cout << "[" << Priority_str[task->level_] << "] ";
+        auto head = task->logdatas.front();
+        task->logdatas.pop();
+
+        std::string formatstr = "";
+        bool success = conver2Str(head, formatstr);
+        if (!success) {
+            return;
+        }
+
+        while (!task->logdatas.empty()) {
+            auto data = task->logdatas.front();
+            formatstr = formatString(formatstr, data);
+            task->logdatas.pop();
+        }
+
+        std::cout << formatstr << std::endl;
+    }
+
+    bool conver2Str(std::any const &data, std::string &replacement) {
+        std::ostringstream ss;
+        if (data.type() == typeid(int)) {
+            ss << std::any_cast<int>(data);
+        } else if (data.type() == typeid(float)) {
+            ss << std::any_cast<float>(data);
+        } else if (data.type() == typeid(double)) {
+            ss << std::any_cast<double>(data);
+        } else if (data.type() == typeid(std::string)) {
+            ss << std::any_cast<std::string>(data);
+        } else if (data.type() == typeid(char *)) {
+            ss << std::any_cast<char *>(data);
+        } else if (data.type() == typeid(char const *)) {
+            ss << std::any_cast<char const *>(data);
+        } else {
+            return false;
+        }
+        replacement = ss.str();
+        return true;
+    }
+
+    template <typename... Args>
+    std::string formatString(std::string const &format, Args &&...args) {
+        std::string result = format;
+        size_t pos = 0;
+        auto replaceplaceHolder = [&](std::string placeholder,
+                                      std::any &replacement) {
+            std::string str_replacement = "";
+            bool success = conver2Str(replacement, str_replacement);
+            if (!success) {
+                return;
+            }
+            size_t placeholderPos = result.find(placeholder, pos);
+            if (placeholderPos != std::string::npos) {
+                result.replace(placeholderPos, placeholder.length(),
+                               str_replacement);
+                pos += placeholderPos + placeholder.length();
+            } else {
+                result = result + " " + str_replacement;
+            }
+        };
+
+        (replaceplaceHolder("{}", args), ...);
+        return result;
+    }
+
+    bool is_stop_ = false;
+    bool busy_ = false;
+    std::mutex mtx_;
+    std::condition_variable empty_cond_;
+    std::condition_variable done_cond_;
+    std::queue<std::shared_ptr<LogTask>> que_;
+    std::thread workthread_;
+
+    char const *Priority_str[4] = {"DEBUGS", "INFO", "WARNING", "ERRORS"};
+};
+
+// 丢掉写入的所有内容
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override {
+        return c;
+    }
+    std::streamsize xsputn(char const *, std::streamsize n) override {
+        return n;
+    }
+};
+
+// 每批调用之后等后台线程写完, 让计时包含格式化和写出, 新实现也不会丢
+constexpr uint64_t kBatch = 1024;
+
+} // namespace
+
+BENCHMARK(BM_AsyncLogLegacy) {
+    NullBuffer null_buffer;
+    std::streambuf *old = std::cout.rdbuf(&null_buffer);
+    LegacyAsyncLog &log = LegacyAsyncLog::getInstance();
+    std::string peer = "192.168.1.20";
+    uint64_t n = 0;
+    while (state.KeepRunning()) {
+        log.AsyncWrite(INFO, std::string("client {} channel {} rtt {} ms"),
+                       peer, (int)(n & 1), 12.5);
+        if (++n % kBatch == 0) {
+            log.WaitEmpty();
+        }
+    }
+    log.WaitEmpty();
+    std::cout.rdbuf(old);
+    state.SetItemsProcessed(state.Iterations());
+}
+
+BENCHMARK(BM_AsyncLog) {
+    AsyncLog &log = AsyncLog::getInstance();
+    log.Open("/dev/null");
+    std::string peer = "192.168.1.20";
+    uint64_t dropped = log.GetDroppedCount();
+    uint64_t n = 0;
+    while (state.KeepRunning()) {
+        ASYNC_LOG(INFO, "client {} channel {} rtt {} ms", peer, (int)(n & 1),
+                  12.5);
+        if (++n % kBatch == 0) {
+            log.Flush();
+        }
+    }
+    log.Flush();
+    log.Open(nullptr);
+    state.SetItemsProcessed(state.Iterations());
+    state.counters["dropped"] = log.GetDroppedCount() - dropped;
+}
@@ -0,0 +1,37 @@
+#include "Bench.hpp"
+#include "net/BufferPool.hpp"
+#include "net/MsgNode.hpp"
+#include <memory>
+
+namespace {
+
+void ReportPoolStats(BenchState &state, BufferPoolStats const &before) {
+    BufferPoolStats stats = BufferPool::GetInstance()->GetStats();
+    uint64_t acquired = stats.acquired - before.acquired;
+    state.counters["reuse_pct"] =
+        acquired == 0 ? 0 : 100.0 * (stats.reused - before.reused) / acquired;
+    state.counters["peak_bytes"] = stats.peak_bytes;
+}
+
+} // namespace
+
+// 每条RTSP消息交给LogicSystem时的接收节点
+BENCHMARK(BM_RecvNodePooled) {
+    BufferPoolStats before = BufferPool::GetInstance()->GetStats();
+    while (state.KeepRunning()) {
+        auto node = std::make_shared<Recv_Node>(300);
+        node->Getdata()[0] = 'O';
+    }
+    state.SetItemsProcessed(state.Iterations());
+    ReportPoolStats(state, before);
+}
+
+// 对照: 每次读都new一个2048字节的缓冲区
+BENCHMARK(BM_RecvBufferNew) {
+    while (state.KeepRunning()) {
+        std::shared_ptr<char> buf(new char[2049],
+                                  std::default_delete<char[]>());
+        buf.get()[0] = 'O';
+    }
+    state.SetItemsProcessed(state.Iterations());
+}
@@ -0,0 +1,96 @@
+#include "Bench.hpp"
+#include "net/FecEncoder.hpp"
+#include "net/H264File.hpp"
+#include "net/H264Source.hpp"
+#include "net/media.hpp"
+#include "net/Rtp.hpp"
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+// test.h264打好包后的全部RTP包
+std::vector<RtpPacket> &GetTestPackets() {
+    static std::vector<RtpPacket> packets;
+    if (!packets.empty()) {
+        return packets;
+    }
+
+    std::string h264_path = std::string(BENCH_DATA_DIR) + "/test.h264";
+    H264File h264_file;
+    h264_file.Open(h264_path.c_str());
+    std::vector<char> buf(2'000'000);
+    for (size_t n = 0; n < h264_file.GetFrameCount(); n++) {
+        int size = h264_file.ReadFrameAt(n, buf.data(), buf.size());
+        AVFrame frame(size);
+        memcpy(frame.buffer.get(), buf.data(), size);
+        frame.timestamp = (uint32_t)(n * 90000 / 25);
+        H264Source::PacketizeFrame(channel0, frame,
+                                   [](MediaChannelID, RtpPacket pkt) {
+                                       packets.push_back(pkt);
+                                       return true;
+                                   });
+    }
+    return packets;
+}
+
+void RunFecEncode(BenchState &state, uint8_t group_size) {
+    std::vector<RtpPacket> &packets = GetTestPackets();
+    FecEncoder encoder(group_size);
+    size_t n = 0;
+    uint64_t bytes = 0;
+    uint64_t fec_bytes = 0;
+    while (state.KeepRunning()) {
+        RtpPacket const &pkt = packets[n];
+        auto fec = encoder.Push(pkt, 96);
+        if (fec) {
+            fec_bytes += fec->body_size;
+        }
+        bytes += pkt.PayloadSize();
+        n = (n + 1) % packets.size();
+    }
+    state.SetItemsProcessed(state.Iterations());
+    state.SetBytesProcessed(bytes);
+    // 每保护1Mbps媒体, 每秒需要的CPU时间(微秒), 1Mbps = 125000字节/秒
+    double ns_per_byte = state.ElapsedNs() / (bytes ? bytes : 1);
+    state.counters["cpu_us_per_mbps"] = ns_per_byte * 125000 / 1e3;
+    state.counters["overhead_pct"] = bytes ? fec_bytes * 100.0 / bytes : 0;
+}
+
+void RunXor(BenchState &state,
+            void (*xor_func)(uint8_t *, uint8_t const *, size_t)) {
+    alignas(32) uint8_t dst[MAX_RTP_PAYLOAD_SIZE] = {0};
+    alignas(32) uint8_t src[MAX_RTP_PAYLOAD_SIZE];
+    for (size_t i = 0; i < sizeof(src); i++) {
+        src[i] = (uint8_t)(i * 131);
+    }
+    while (state.KeepRunning()) {
+        xor_func(dst, src, sizeof(src));
+    }
+    state.SetItemsProcessed(state.Iterations());
+    state.SetBytesProcessed(state.Iterations() * sizeof(src));
+    // 防止结果被优化掉
+    volatile uint8_t sink = dst[7];
+    (void)sink;
+}
+
+} // namespace
+
+// 一组8个包: 头部和负载异或进累加区, 满一组输出FEC包
+BENCHMARK(BM_FecEncodeGroup8) {
+    RunFecEncode(state, 8);
+}
+
+BENCHMARK(BM_FecEncodeGroup4) {
+    RunFecEncode(state, 4);
+}
+
+// 一个满负载包的异或, SIMD与逐8字节标量实现对比
+BENCHMARK(BM_FecXorSimd) {
+    RunXor(state, XorBytes);
+}
+
+BENCHMARK(BM_FecXorScalar) {
+    RunXor(state, XorBytesScalar);
+}
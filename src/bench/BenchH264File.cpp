@@ -0,0 +1,72 @@
+#include "Bench.hpp"
+#include "net/H264File.hpp"
+#include "net/media.hpp"
+#include "net/RingBuffer.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 推流线程每帧一次: 从文件顺序读出一帧, 读到结尾自动回到开头
+BENCHMARK(BM_H264ReadFrame) {
+    static H264File *file = []() {
+        H264File *f = new H264File;
+        f->Open((std::string(BENCH_DATA_DIR) + "/test.h264").c_str());
+        return f;
+    }();
+    std::vector<char> buf(2'000'000);
+    uint64_t bytes = 0;
+    while (state.KeepRunning()) {
+        bool end = false;
+        int size = file->ReadFrame(buf.data(), (int)buf.size(), &end);
+        bytes += size > 0 ? size : 0;
+    }
+    state.SetItemsProcessed(state.Iterations());
+    state.SetBytesProcessed(bytes);
+}
+
+// 按索引随机读(快进/快退和hint转换用)
+BENCHMARK(BM_H264ReadFrameAt) {
+    static H264File *file = []() {
+        H264File *f = new H264File;
+        f->Open((std::string(BENCH_DATA_DIR) + "/test.h264").c_str());
+        return f;
+    }();
+    std::vector<char> buf(2'000'000);
+    size_t n = 0;
+    uint64_t bytes = 0;
+    while (state.KeepRunning()) {
+        int size = file->ReadFrameAt(n, buf.data(), (int)buf.size());
+        bytes += size > 0 ? size : 0;
+        n = (n + 1) % file->GetFrameCount();
+    }
+    state.SetItemsProcessed(state.Iterations());
+    state.SetBytesProcessed(bytes);
+}
+
+// MediaSession里每个通道一个的帧缓冲, 元素是带shared_ptr的AVFrame
+BENCHMARK(BM_RingBufferPushPop) {
+    RingBuffer<AVFrame> ring(60);
+    AVFrame frame(1024);
+    AVFrame out;
+    while (state.KeepRunning()) {
+        ring.Push(frame);
+        ring.Pop(out);
+    }
+    state.SetItemsProcessed(state.Iterations());
+}
+
+// 半满时的批量入队出队
+BENCHMARK(BM_RingBufferBurst) {
+    RingBuffer<AVFrame> ring(60);
+    AVFrame frame(1024);
+    AVFrame out;
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 30; i++) {
+            ring.Push(frame);
+        }
+        for (int i = 0; i < 30; i++) {
+            ring.Pop(out);
+        }
+    }
+    state.SetItemsProcessed(state.Iterations() * 30);
+}
@@ -0,0 +1,25 @@
+#include "Bench.hpp"
+#include "net/LatencyTracker.hpp"
+#include <cstdint>
+
+// 关闭时每帧只有这一次判断
+BENCHMARK(BM_LatencyDisabled) {
+    LatencyTracker::Instance().SetEnabled(false);
+    uint64_t traced = 0;
+    while (state.KeepRunning()) {
+        traced += LatencyTracker::IsEnabled() ? Tsc::Now() : 0;
+    }
+    state.SetItemsProcessed(state.Iterations());
+    state.counters["traced"] = (double)traced;
+}
+
+// 打开时每个阶段读一次TSC, 记一次直方图
+BENCHMARK(BM_LatencyRecord) {
+    LatencyTracker &tracker = LatencyTracker::Instance();
+    uint64_t start = Tsc::Now();
+    while (state.KeepRunning()) {
+        start = tracker.Record(LatencyStage::UDP_SEND, start);
+    }
+    state.SetItemsProcessed(state.Iterations());
+    tracker.Reset();
+}
@@ -0,0 +1,83 @@
+#include "Bench.hpp"
+#include "Log/logger.hpp"
+#include <string>
+
+namespace {
+
+// 日志只写到/dev/null, 后台线程照常格式化
+void QuietLogger() {
+    static bool once = [] {
+        pjie::BinaryLogger::Instance().SetConsoleOutput(false);
+        pjie::BinaryLogger::Instance().OpenFile("/dev/null");
+        return true;
+    }();
+    (void)once;
+}
+
+/* 一批条数远小于每线程缓冲区(256KB)能放下的记录数, 每批之后不计时地等
+ * 后台线程写完, 这样测到的都是真正写进缓冲区的记录, 而不是缓冲区满时的
+ * 丢弃路径. 有记录被丢弃时结果作废 */
+static const uint64_t kLogBatch = 1024;
+
+void LogBatchDone(BenchState &state, uint64_t n) {
+    if (n % kLogBatch == 0) {
+        state.PauseTiming();
+        pjie::BinaryLogger::Instance().Flush();
+        state.ResumeTiming();
+    }
+}
+
+void ReportLogged(BenchState &state, uint64_t dropped_before) {
+    pjie::BinaryLogger::Instance().Flush();
+    uint64_t dropped =
+        pjie::BinaryLogger::Instance().GetDroppedCount() - dropped_before;
+    state.counters["dropped"] = (double)dropped;
+    if (dropped != 0) {
+        state.SkipWithError(std::to_string(dropped) +
+                            " records dropped, ring buffer was full");
+        return;
+    }
+    state.SetItemsProcessed(state.Iterations());
+    state.counters["ns_per_logged"] = state.ElapsedNs() / state.Iterations();
+}
+
+} // namespace
+
+// 发送失败这类典型的日志: 一个字符串参数
+BENCHMARK(BM_LogDebugString) {
+    QuietLogger();
+    std::string msg = "Resource temporarily unavailable";
+    pjie::BinaryLogger::Instance().Flush();
+    uint64_t dropped = pjie::BinaryLogger::Instance().GetDroppedCount();
+    uint64_t n = 0;
+    while (state.KeepRunning()) {
+        LOG_DEBUG("send rtp failed: %s", msg.c_str());
+        LogBatchDone(state, ++n);
+    }
+    ReportLogged(state, dropped);
+}
+
+// RR这类多个整数参数的日志
+BENCHMARK(BM_LogDebugInts) {
+    QuietLogger();
+    pjie::BinaryLogger::Instance().Flush();
+    uint64_t dropped = pjie::BinaryLogger::Instance().GetDroppedCount();
+    uint32_t n = 0;
+    while (state.KeepRunning()) {
+        LOG_DEBUG("rr channel %d: lost %u/256 total %d jitter %u rtt %u us", 0,
+                  n & 0xff, (int)n, n * 3, n * 7);
+        LogBatchDone(state, ++n);
+    }
+    ReportLogged(state, dropped);
+}
+
+// 限流的调用点在风暴中的开销, 绝大多数调用被压掉
+BENCHMARK(BM_LogWarnRateLimited) {
+    QuietLogger();
+    std::string msg = "Connection refused";
+    while (state.KeepRunning()) {
+        LOG_WARN_RATE(10, "send rtp failed: %s", msg.c_str());
+    }
+    pjie::BinaryLogger::Instance().Flush();
+    state.SetItemsProcessed(state.Iterations());
+}
@@ -0,0 +1,33 @@
+#include "Bench.hpp"
+#include "net/Metrics.hpp"
+#include <atomic>
+
+// 发送路径上每个包一次的计数
+BENCHMARK(BM_CounterAdd) {
+    static Counter counter = MetricsRegistry::Instance().AddCounter(
+        "bench_counter_total", "BenchMetrics counter");
+    while (state.KeepRunning()) {
+        counter.Add();
+    }
+    state.SetItemsProcessed(state.Iterations());
+}
+
+// 对比: 所有线程共用一个原子变量
+BENCHMARK(BM_AtomicFetchAdd) {
+    static std::atomic<uint64_t> counter{0};
+    while (state.KeepRunning()) {
+        counter.fetch_add(1, std::memory_order_relaxed);
+    }
+    state.SetItemsProcessed(state.Iterations());
+}
+
+BENCHMARK(BM_HistogramObserve) {
+    static Histogram histogram = MetricsRegistry::Instance().AddHistogram(
+        "bench_histogram_us", "BenchMetrics histogram",
+        {5, 10, 20, 50, 100, 200, 500, 1000, 5000});
+    uint64_t value = 0;
+    while (state.KeepRunning()) {
+        histogram.Observe(value++ & 255);
+    }
+    state.SetItemsProcessed(state.Iterations());
+}
@@ -0,0 +1,105 @@
+#include "Bench.hpp"
+#include "net/RtspParser.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace {
+
+// 一次典型的点播交互
+char const *kRequests[] = {
+    "OPTIONS rtsp://192.168.1.10:8554/live RTSP/1.0\r\n"
+    "CSeq: 2\r\n"
+    "User-Agent: LibVLC/3.0.18 (LIVE555 Streaming Media v2016.11.28)\r\n"
+    "\r\n",
+    "DESCRIBE rtsp://192.168.1.10:8554/live RTSP/1.0\r\n"
+    "CSeq: 3\r\n"
+    "User-Agent: LibVLC/3.0.18 (LIVE555 Streaming Media v2016.11.28)\r\n"
+    "Accept: application/sdp\r\n"
+    "\r\n",
+    "SETUP rtsp://192.168.1.10:8554/live/track0 RTSP/1.0\r\n"
+    "CSeq: 4\r\n"
+    "User-Agent: LibVLC/3.0.18 (LIVE555 Streaming Media v2016.11.28)\r\n"
+    "Transport: RTP/AVP/TCP;unicast;interleaved=0-1\r\n"
+    "\r\n",
+    "PLAY rtsp://192.168.1.10:8554/live RTSP/1.0\r\n"
+    "CSeq: 5\r\n"
+    "User-Agent: LibVLC/3.0.18 (LIVE555 Streaming Media v2016.11.28)\r\n"
+    "Session: 1234567\r\n"
+    "Range: npt=0.000-\r\n"
+    "\r\n",
+};
+
+std::string const &GetSessionStream() {
+    static std::string stream;
+    if (stream.empty()) {
+        for (char const *req : kRequests) {
+            stream += req;
+        }
+    }
+    return stream;
+}
+
+void ReportPerCore(BenchState &state, uint64_t requests) {
+    state.SetItemsProcessed(requests);
+    // 单线程解析, 每秒请求数即单核能力
+    state.counters["req_per_sec_core"] = requests / (state.ElapsedNs() / 1e9);
+}
+
+} // namespace
+
+// 已经切分好的单条请求直接解析, 不经过缓冲区
+BENCHMARK(BM_RtspParseRequest) {
+    RtspRequest req;
+    uint64_t requests = 0, bytes = 0;
+    while (state.KeepRunning()) {
+        for (char const *msg : kRequests) {
+            std::string_view data = msg;
+            if (RtspParser::Parse(data, &req) ==
+                RtspParser::Result::COMPLETE) {
+                requests++;
+            }
+            bytes += data.size();
+        }
+    }
+    state.SetBytesProcessed(bytes);
+    ReportPerCore(state, requests);
+}
+
+// pipeline: 一次收到整个交互的所有请求
+BENCHMARK(BM_RtspParserPipelined) {
+    std::string const &stream = GetSessionStream();
+    RtspParser parser;
+    RtspRequest req;
+    uint64_t requests = 0, bytes = 0;
+    while (state.KeepRunning()) {
+        parser.Append(stream.data(), stream.size());
+        while (parser.Next(&req) == RtspParser::Result::COMPLETE) {
+            requests++;
+        }
+        bytes += stream.size();
+    }
+    state.SetBytesProcessed(bytes);
+    ReportPerCore(state, requests);
+}
+
+// 数据按小段到达, 每段都尝试解析
+BENCHMARK(BM_RtspParserSplit16) {
+    std::string const &stream = GetSessionStream();
+    RtspParser parser;
+    RtspRequest req;
+    uint64_t requests = 0, bytes = 0;
+    while (state.KeepRunning()) {
+        for (size_t pos = 0; pos < stream.size(); pos += 16) {
+            parser.Append(stream.data() + pos,
+                          std::min<size_t>(16, stream.size() - pos));
+            while (parser.Next(&req) == RtspParser::Result::COMPLETE) {
+                requests++;
+            }
+        }
+        bytes += stream.size();
+    }
+    state.SetBytesProcessed(bytes);
+    ReportPerCore(state, requests);
+}
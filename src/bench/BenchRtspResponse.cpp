@@ -0,0 +1,53 @@
+#include "Bench.hpp"
+#include "net/MsgNode.hpp"
+#include "net/RtspResponse.hpp"
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+
+namespace {
+
+std::shared_ptr<std::string const> GetSdp() {
+    static auto sdp = std::make_shared<std::string const>(
+        "o=- 91792413109 1 IN IP4 127.0.0.1\r\n"
+        "t=0 0\r\n"
+        "a=control:*\r\n"
+        "m=video 0 RTP/AVP 96\r\n"
+        "a=rtpmap:96 H264/90000\r\n"
+        "a=control:track0\r\n");
+    return sdp;
+}
+
+} // namespace
+
+// 对照: 改动前的memset + snprintf + strlen, 再拷贝进Send_Node
+BENCHMARK(BM_DescribeSnprintf) {
+    std::string sdp = *GetSdp();
+    uint32_t cseq = 0;
+    while (state.KeepRunning()) {
+        char res[2048];
+        ::memset(res, 0, sizeof(res));
+        snprintf(res, sizeof(res),
+                 "RTSP/1.0 200 OK\r\n"
+                 "CSeq: %u\r\n"
+                 "Content-Length: %d\r\n"
+                 "Content-Type: application/sdp\r\n"
+                 "\r\n"
+                 "%s",
+                 cseq++, (int)strlen(sdp.c_str()), sdp.c_str());
+        auto node = std::make_shared<Send_Node>(res, strlen(res));
+    }
+    state.SetItemsProcessed(state.Iterations());
+}
+
+// 头部直接写进池化的Send_Node, SDP共享不拷贝
+BENCHMARK(BM_DescribeResponse) {
+    auto sdp = GetSdp();
+    uint32_t cseq = 0;
+    while (state.KeepRunning()) {
+        auto node = RtspResponse(RtspStatus::OK, cseq++)
+                        .Finish(sdp, "application/sdp");
+    }
+    state.SetItemsProcessed(state.Iterations());
+}
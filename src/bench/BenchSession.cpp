@@ -0,0 +1,188 @@
+#include "Bench.hpp"
+#include "BenchStream.hpp"
+#include "net/const.hpp"
+#include "net/FrameTrace.hpp"
+#include "net/H264Source.hpp"
+#include "net/IOServicePool.hpp"
+#include "net/LogicSystem.hpp"
+#include "net/media.hpp"
+#include "net/MediaSession.hpp"
+#include "net/MsgNode.hpp"
+#include "net/RtpConnection.hpp"
+#include "net/RtspConnection.hpp"
+#include "net/RtspServer.hpp"
+#include <atomic>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using boost::asio::ip::tcp;
+using boost::asio::ip::udp;
+
+/* 本机回环上的一条RTSP连接: 服务端是真实的RtspConnect, 由自己的io线程写,
+ * 客户端由一个线程一直读, 统计收到的字节数 */
+struct LoopbackRtsp {
+    IOService ioc;
+    WorkPtr work;
+    std::thread io_thread;
+    std::shared_ptr<RtspConnect> conn;
+    tcp::socket peer;
+    std::thread reader;
+    std::atomic<uint64_t> received{0};
+
+    LoopbackRtsp() : peer(ioc) {
+        tcp::acceptor acceptor(
+            ioc, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+        conn = std::make_shared<RtspConnect>(nullptr, ioc);
+        peer.connect(acceptor.local_endpoint());
+        acceptor.accept(conn->GetSocket());
+        work.reset(new Work(ioc));
+        io_thread = std::thread([this]() { ioc.run(); });
+        reader = std::thread([this]() {
+            std::vector<char> buf(256 * 1024);
+            boost::system::error_code ec;
+            for (;;) {
+                size_t n = peer.read_some(boost::asio::buffer(buf), ec);
+                if (ec) {
+                    break;
+                }
+                received.fetch_add(n, std::memory_order_release);
+            }
+        });
+    }
+
+    // 等到在途的字节不超过max_in_flight
+    void WaitReceived(uint64_t expected, uint64_t max_in_flight) {
+        while (expected - received.load(std::memory_order_acquire) >
+               max_in_flight) {
+            std::this_thread::yield();
+        }
+    }
+};
+
+// 不析构: 后台线程一直在读写
+LoopbackRtsp &GetLoopback() {
+    static LoopbackRtsp *loopback = new LoopbackRtsp();
+    return *loopback;
+}
+
+/* 一个会话带若干UDP客户端, 客户端的RTP都发到同一个不读的本机端口,
+ * 收不下的包由内核丢掉, 不影响发送 */
+struct FanoutSession {
+    std::shared_ptr<MediaSession> session;
+    udp::socket sink;
+    std::vector<std::shared_ptr<RtpConnect>> clients;
+
+    explicit FanoutSession(size_t client_count)
+        : session(MediaSession::GetInstance("bench")),
+          sink(GetLoopback().ioc,
+               udp::endpoint(boost::asio::ip::address_v4::loopback(), 0)) {
+        session->AddSource(channel0, new H264Source(GetTestStream().framerate));
+        uint16_t port = sink.local_endpoint().port();
+        for (size_t i = 0; i < client_count; i++) {
+            auto client = std::make_shared<RtpConnect>(GetLoopback().conn);
+            client->SetupRtpOverUdp(channel0, port, port + 1);
+            client->Play();
+            session->AddClient(client);
+            clients.push_back(client);
+        }
+    }
+};
+
+// MediaSession是单例, 各用例共用同一个带4个客户端的会话
+FanoutSession &GetFanout() {
+    static FanoutSession *fanout = new FanoutSession(4);
+    return *fanout;
+}
+
+// 帧轨迹回放用的RtspServer, 监听随机端口, 不接受连接
+RtspServer &GetReplayServer(MediaSessionId *session_id) {
+    static RtspServer *server = new RtspServer(GetLoopback().ioc, 0);
+    static MediaSessionId id = server->AddSession(GetFanout().session.get());
+    *session_id = id;
+    return *server;
+}
+
+// 环境变量BENCH_FRAME_TRACE指定真实编码器录下的轨迹,
+// 否则把test.h264的帧录成轨迹
+std::shared_ptr<FrameTraceReader> GetReplayTrace() {
+    static std::shared_ptr<FrameTraceReader> reader;
+    if (reader != nullptr) {
+        return reader;
+    }
+    char const *env = getenv("BENCH_FRAME_TRACE");
+    std::string path = env != nullptr ? env : "/tmp/rtsp_bench_test.frames";
+    if (env == nullptr) {
+        FrameTraceWriter writer;
+        writer.Open(path.c_str(), true);
+        for (AVFrame const &frame: GetTestStream().frames) {
+            writer.Write(0, channel0, 0, frame);
+        }
+        writer.Close();
+    }
+    reader = std::make_shared<FrameTraceReader>();
+    reader->Open(path.c_str());
+    return reader;
+}
+
+} // namespace
+
+// 推流线程每帧一次: 打包后发给所有客户端, 包括每个包的send_to
+BENCHMARK(BM_SessionFanoutUdp4) {
+    FanoutSession *fanout = &GetFanout();
+    TestStream &stream = GetTestStream();
+    size_t n = 0;
+    uint64_t bytes = 0;
+    while (state.KeepRunning()) {
+        AVFrame const &frame = stream.frames[n];
+        fanout->session->HandleFrame(channel0, frame);
+        bytes += frame.size;
+        n = (n + 1) % stream.frames.size();
+    }
+    state.SetItemsProcessed(state.Iterations());
+    state.SetBytesProcessed(bytes * fanout->clients.size());
+}
+
+// RTP over TCP的发送路径: 入LogicSystem队列, 由它的线程交给连接,
+// io线程async_write写到本机socket. 在途数据限制在4MB以内, 测的是持续吞吐
+BENCHMARK(BM_LogicSystemSend) {
+    LoopbackRtsp &loopback = GetLoopback();
+    static constexpr uint64_t kMaxInFlight = 4 << 20;
+    char payload[1400] = {0};
+    uint64_t expected = loopback.received.load(std::memory_order_acquire);
+    while (state.KeepRunning()) {
+        auto node = std::make_shared<Send_Node>(payload, sizeof(payload));
+        node->id_ = MSG_IDS::RTP_SEND_PKT;
+        LogicSystem::GetInstance()->PushMsg(
+            std::make_shared<LogicNode>(loopback.conn, node));
+        expected += sizeof(payload);
+        loopback.WaitReceived(expected, kMaxInFlight);
+    }
+    loopback.WaitReceived(expected, 0);
+    state.SetItemsProcessed(state.Iterations());
+    state.SetBytesProcessed(state.Iterations() * sizeof(payload));
+}
+
+// 帧轨迹不等待地回放一遍: PushFrame + 打包 + 发给4个UDP客户端,
+// 帧大小和类型的分布与录制时相同
+BENCHMARK(BM_FrameTraceReplayUdp4) {
+    MediaSessionId session_id = 0;
+    RtspServer &server = GetReplayServer(&session_id);
+    FrameTracePlayer player(GetReplayTrace());
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    while (state.KeepRunning()) {
+        FrameTracePlayer::Stats stats = player.Play(&server, session_id, 0);
+        frames += stats.frames;
+        bytes += stats.bytes;
+    }
+    state.SetItemsProcessed(frames);
+    state.SetBytesProcessed(bytes * GetFanout().clients.size());
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "net/HintFile.hpp"
+#include "net/media.hpp"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// 测试码流test.h264, 多个用例共用
+struct TestStream {
+    std::vector<AVFrame> frames;
+    std::shared_ptr<HintFile> hint_file;
+    uint32_t framerate = 25;
+};
+
+// 第一次调用时读入test.h264的所有帧, 并转换出对应的hint文件
+TestStream &GetTestStream();
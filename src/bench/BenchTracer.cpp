@@ -0,0 +1,37 @@
+#include "Bench.hpp"
+#include "net/Tracer.hpp"
+
+// 发送路径上每个包一个事件
+BENCHMARK(BM_TraceRecord) {
+    Tracer::Instance().SetEnabled(true);
+    uint32_t arg = 0;
+    while (state.KeepRunning()) {
+        Tracer::Record(TraceEventType::UDP_SEND, TracePhase::INSTANT, arg++);
+    }
+    state.SetItemsProcessed(state.Iterations());
+}
+
+BENCHMARK(BM_TraceDisabled) {
+    Tracer::Instance().SetEnabled(false);
+    uint32_t arg = 0;
+    while (state.KeepRunning()) {
+        Tracer::Record(TraceEventType::UDP_SEND, TracePhase::INSTANT, arg++);
+    }
+    state.SetItemsProcessed(state.Iterations());
+    Tracer::Instance().SetEnabled(true);
+}
+
+// 整个缓冲区导出一次
+BENCHMARK(BM_TraceExport) {
+    Tracer::Instance().SetEnabled(true);
+    for (size_t i = 0; i < Tracer::kBufferSize; i++) {
+        Tracer::Record(TraceEventType::TCP_ENQUEUE, TracePhase::INSTANT, 1400,
+                       Tracer::NewFlowId(), TraceFlow::START);
+    }
+    size_t bytes = 0;
+    while (state.KeepRunning()) {
+        bytes += Tracer::Instance().ExportChromeJson().size();
+    }
+    state.SetItemsProcessed(state.Iterations());
+    state.counters["json_bytes"] = (double)bytes / (double)state.Iterations();
+}
@@ -0,0 +1,191 @@
+#include "Bench.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#ifndef BENCH_BUILD_TYPE
+#define BENCH_BUILD_TYPE ""
+#endif
+
+namespace {
+
+struct BenchResult {
+    std::string name;
+    uint64_t iterations;
+    double real_ns;
+    double cpu_ns;
+    double items_per_second;
+    double bytes_per_second;
+    std::map<std::string, double> counters;
+    std::string error;
+};
+
+// JSON里不能有nan/inf
+std::string JsonNumber(double value) {
+    if (!std::isfinite(value)) {
+        return "0";
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.17g", value);
+    return buf;
+}
+
+// 与Google Benchmark的--benchmark_format=json相同的结构,
+// 可以直接用它的tools/compare.py比较两次的结果
+std::string ToJson(std::vector<BenchResult> const &results,
+                   char const *executable) {
+    char date[64];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+    char host[256] = {0};
+    gethostname(host, sizeof(host) - 1);
+#ifdef __OPTIMIZE__
+    char const *library_build_type = "release";
+#else
+    char const *library_build_type = "debug";
+#endif
+
+    std::string out = "{\n  \"context\": {\n";
+    out += "    \"date\": \"" + std::string(date) + "\",\n";
+    out += "    \"host_name\": \"" + std::string(host) + "\",\n";
+    out += "    \"executable\": \"" + std::string(executable) + "\",\n";
+    out += "    \"num_cpus\": " +
+           std::to_string(std::thread::hardware_concurrency()) + ",\n";
+    out += "    \"build_type\": \"" + std::string(BENCH_BUILD_TYPE) + "\",\n";
+    out += "    \"library_build_type\": \"" + std::string(library_build_type) +
+           "\"\n  },\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        BenchResult const &r = results[i];
+        out += i == 0 ? "\n" : ",\n";
+        out += "    {\n";
+        out += "      \"name\": \"" + r.name + "\",\n";
+        out += "      \"run_name\": \"" + r.name + "\",\n";
+        out += "      \"run_type\": \"iteration\",\n";
+        out += "      \"iterations\": " + std::to_string(r.iterations) + ",\n";
+        out += "      \"real_time\": " + JsonNumber(r.real_ns) + ",\n";
+        out += "      \"cpu_time\": " + JsonNumber(r.cpu_ns) + ",\n";
+        out += "      \"time_unit\": \"ns\"";
+        if (!r.error.empty()) {
+            out += ",\n      \"error_occurred\": true";
+            out += ",\n      \"error_message\": \"" + r.error + "\"";
+        }
+        if (r.items_per_second > 0) {
+            out += ",\n      \"items_per_second\": " +
+                   JsonNumber(r.items_per_second);
+        }
+        if (r.bytes_per_second > 0) {
+            out += ",\n      \"bytes_per_second\": " +
+                   JsonNumber(r.bytes_per_second);
+        }
+        for (auto const &counter: r.counters) {
+            out += ",\n      \"" + counter.first +
+                   "\": " + JsonNumber(counter.second);
+        }
+        out += "\n    }";
+    }
+    out += "\n  ]\n}\n";
+    return out;
+}
+
+} // namespace
+
+// 用法: bench [过滤子串] [最短运行时间(秒)] [--json=路径]
+// 路径为-时JSON写到标准输出, 表格改写到标准错误
+int main(int argc, char **argv) {
+    char const *filter = "";
+    double min_time = 0.2;
+    char const *json_path = nullptr;
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--json=", 7) == 0) {
+            json_path = argv[i] + 7;
+        } else if (positional++ == 0) {
+            filter = argv[i];
+        } else {
+            min_time = atof(argv[i]);
+        }
+    }
+    FILE *table = json_path != nullptr && strcmp(json_path, "-") == 0
+                      ? stderr
+                      : stdout;
+#ifndef __OPTIMIZE__
+    fprintf(stderr, "warning: bench built without optimization, "
+                    "configure with -DCMAKE_BUILD_TYPE=Release\n");
+#endif
+
+    std::vector<BenchResult> results;
+    bool failed = false;
+    fprintf(table, "%-32s %14s %12s %12s %14s %14s\n", "benchmark",
+            "iterations", "ns/op", "cpu ns/op", "items/s", "MB/s");
+    for (auto &bench: BenchRegistry::Cases()) {
+        if (strstr(bench.name.c_str(), filter) == nullptr) {
+            continue;
+        }
+
+        // 迭代次数从1开始倍增, 直到单次运行超过min_time
+        uint64_t iterations = 1;
+        for (;;) {
+            BenchState state(iterations);
+            bench.func(state);
+            double elapsed = state.ElapsedNs();
+            if (!state.GetError().empty()) {
+                fprintf(table, "%-32s %14llu ERROR: %s\n", bench.name.c_str(),
+                        (unsigned long long)iterations,
+                        state.GetError().c_str());
+                fflush(table);
+                BenchResult result{bench.name, iterations, 0, 0, 0, 0,
+                                   state.counters, state.GetError()};
+                results.push_back(std::move(result));
+                failed = true;
+                break;
+            }
+            if (elapsed >= min_time * 1e9 || iterations >= (1ull << 40)) {
+                double seconds = elapsed / 1e9;
+                BenchResult result{bench.name,
+                                   iterations,
+                                   elapsed / iterations,
+                                   state.CpuNs() / iterations,
+                                   state.GetItemsProcessed() / seconds,
+                                   state.GetBytesProcessed() / seconds,
+                                   state.counters,
+                                   std::string()};
+                fprintf(table, "%-32s %14llu %12.1f %12.1f %14.0f %14.1f\n",
+                        bench.name.c_str(), (unsigned long long)iterations,
+                        result.real_ns, result.cpu_ns,
+                        result.items_per_second,
+                        result.bytes_per_second / 1e6);
+                for (auto &counter: state.counters) {
+                    fprintf(table, "    %-28s %14.3f\n",
+                            counter.first.c_str(), counter.second);
+                }
+                fflush(table);
+                results.push_back(std::move(result));
+                break;
+            }
+            double scale = elapsed > 0 ? min_time * 1e9 / elapsed * 1.4 : 10;
+            scale = scale < 2 ? 2 : (scale > 100 ? 100 : scale);
+            iterations = (uint64_t)(iterations * scale);
+        }
+    }
+
+    if (json_path != nullptr) {
+        std::string json = ToJson(results, argv[0]);
+        bool to_stdout = strcmp(json_path, "-") == 0;
+        FILE *file = to_stdout ? stdout : fopen(json_path, "w");
+        if (file == nullptr) {
+            fprintf(stderr, "cannot open %s\n", json_path);
+            return 1;
+        }
+        fwrite(json.data(), 1, json.size(), file);
+        if (!to_stdout) {
+            fclose(file);
+        }
+    }
+    return failed ? 1 : 0;
+}
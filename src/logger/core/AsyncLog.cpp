@@ -0,0 +1,230 @@
+#include "Log/AsyncLog.hpp"
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <unistd.h>
+
+static char const *const kLevelNames[] = {"DEBUGS", "INFO", "WARNING",
+                                          "ERRORS"};
+
+AsyncLog &AsyncLog::getInstance() {
+    static AsyncLog ins;
+    return ins;
+}
+
+AsyncLog::AsyncLog()
+    : ring_(new AsyncLogRecord[kRingSize]), out_(new char[kWriteBuffer]) {
+    for (size_t i = 0; i < kRingSize; i++) {
+        ring_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    // 成员都初始化完了再启动后台线程
+    thread_ = std::thread([this]() { Run(); });
+}
+
+AsyncLog::~AsyncLog() {
+    Stop();
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (fd_ != 1) {
+        close(fd_);
+    }
+}
+
+bool AsyncLog::Open(char const *pathname) {
+    Flush();
+    int fd = 1;
+    if (pathname != nullptr) {
+        fd = open(pathname, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+    }
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (fd_ != 1) {
+        close(fd_);
+    }
+    fd_ = fd;
+    return true;
+}
+
+void AsyncLog::Flush() {
+    std::unique_lock<std::mutex> lk(mutex_);
+    if (stop_) {
+        return;
+    }
+    uint64_t target = ++flush_requested_;
+    cv_.notify_all();
+    cv_.wait(lk, [this, target]() { return flush_done_ >= target || stop_; });
+}
+
+void AsyncLog::Stop() {
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        if (stop_) {
+            return;
+        }
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void AsyncLog::Run() {
+    for (;;) {
+        uint64_t flush_target;
+        bool stop;
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            flush_target = flush_requested_;
+            stop = stop_;
+        }
+        size_t count = Drain();
+        WriteOut();
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            if (flush_target > flush_done_) {
+                flush_done_ = flush_target;
+                cv_.notify_all();
+            }
+        }
+        if (stop) {
+            break;
+        }
+        if (count == 0) {
+            // 生产者不唤醒后台线程, 空闲时每1ms看一次
+            std::unique_lock<std::mutex> lk(mutex_);
+            cv_.wait_for(lk, std::chrono::milliseconds(1), [this]() {
+                return stop_ || flush_requested_ > flush_done_;
+            });
+        }
+    }
+}
+
+size_t AsyncLog::Drain() {
+    size_t count = 0;
+    for (;;) {
+        AsyncLogRecord &record = ring_[dequeue_pos_ & (kRingSize - 1)];
+        size_t seq = record.sequence.load(std::memory_order_acquire);
+        if (seq != dequeue_pos_ + 1) {
+            // 还没有提交, 后面的等下一轮
+            break;
+        }
+        Format(record);
+        record.sequence.store(dequeue_pos_ + kRingSize,
+                              std::memory_order_release);
+        dequeue_pos_++;
+        count++;
+    }
+
+    uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+    if (dropped != reported_dropped_) {
+        char line[64];
+        int n = snprintf(line, sizeof(line),
+                         "[WARNING] %llu log records dropped\n",
+                         (unsigned long long)(dropped - reported_dropped_));
+        Append(line, (size_t)n);
+        reported_dropped_ = dropped;
+    }
+    return count;
+}
+
+void AsyncLog::Format(AsyncLogRecord const &record) {
+    char const *level = kLevelNames[record.level];
+    Append("[", 1);
+    Append(level, strlen(level));
+    Append("] ", 2);
+
+    // 按顺序替换{}, 多出来的参数用空格隔开接在后面
+    size_t next = 0;
+    char const *fmt = record.fmt;
+    char const *literal = fmt;
+    for (char const *p = fmt; *p != '\0'; p++) {
+        if ((p[0] == '{' && p[1] == '{') || (p[0] == '}' && p[1] == '}')) {
+            Append(literal, (size_t)(p - literal) + 1);
+            literal = ++p + 1;
+        } else if (p[0] == '{' && p[1] == '}' && next < record.arg_count) {
+            Append(literal, (size_t)(p - literal));
+            FormatArg(record, record.args[next++]);
+            literal = ++p + 1;
+        }
+    }
+    Append(literal, strlen(literal));
+    for (; next < record.arg_count; next++) {
+        Append(" ", 1);
+        FormatArg(record, record.args[next]);
+    }
+    Append("\n", 1);
+}
+
+void AsyncLog::FormatArg(AsyncLogRecord const &record,
+                         AsyncLogArg const &arg) {
+    char buf[32];
+    std::to_chars_result result{buf, std::errc()};
+    switch (arg.type) {
+    case AsyncLogArg::INT:
+        result = std::to_chars(buf, buf + sizeof(buf), arg.i);
+        break;
+    case AsyncLogArg::UINT:
+        result = std::to_chars(buf, buf + sizeof(buf), arg.u);
+        break;
+    case AsyncLogArg::DOUBLE:
+        // 与ostream默认的输出一致
+        result = std::to_chars(buf, buf + sizeof(buf), arg.d,
+                               std::chars_format::general, 6);
+        break;
+    case AsyncLogArg::BOOL:
+        Append(arg.u ? "true" : "false", arg.u ? 4 : 5);
+        return;
+    case AsyncLogArg::CHAR:
+        buf[0] = (char)arg.u;
+        result.ptr = buf + 1;
+        break;
+    case AsyncLogArg::STRING:
+        Append(record.text + arg.offset, arg.length);
+        return;
+    case AsyncLogArg::POINTER:
+        buf[0] = '0';
+        buf[1] = 'x';
+        result = std::to_chars(buf + 2, buf + sizeof(buf),
+                               (uint64_t)(uintptr_t)arg.p, 16);
+        break;
+    }
+    Append(buf, (size_t)(result.ptr - buf));
+}
+
+void AsyncLog::Append(char const *data, size_t size) {
+    while (size > 0) {
+        if (out_size_ == kWriteBuffer) {
+            WriteOut();
+        }
+        size_t n = kWriteBuffer - out_size_;
+        n = n < size ? n : size;
+        memcpy(out_.get() + out_size_, data, n);
+        out_size_ += n;
+        data += n;
+        size -= n;
+    }
+}
+
+void AsyncLog::WriteOut() {
+    if (out_size_ == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lk(mutex_);
+    size_t written = 0;
+    while (written < out_size_) {
+        ssize_t n = write(fd_, out_.get() + written, out_size_ - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        written += (size_t)n;
+    }
+    out_size_ = 0;
+}
@@ -0,0 +1,456 @@
+#include "Log/BinaryLogger.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+
+using namespace pjie;
+
+static char const *const kLevelNames[] = {"DEBUG", "CONFIG", "INFO", "WARNING",
+                                          "ERROR"};
+
+LogBuffer::LogBuffer(size_t capacity) {
+    // 容量取2的幂, 位置直接用掩码
+    capacity_ = 4096;
+    while (capacity_ < capacity) {
+        capacity_ <<= 1;
+    }
+    data_ = new uint8_t[capacity_];
+}
+
+LogBuffer::~LogBuffer() {
+    delete[] data_;
+}
+
+LogRecordHeader const *LogBuffer::Front(size_t limit) {
+    while (read_ != limit) {
+        size_t pos = read_ & (capacity_ - 1);
+        uint32_t size = 0;
+        memcpy(&size, data_ + pos, sizeof(size));
+        if (size == 0) {
+            // 回绕标记, 跳到缓冲区开头
+            read_ += capacity_ - pos;
+            continue;
+        }
+        return (LogRecordHeader const *)(data_ + pos);
+    }
+    return nullptr;
+}
+
+void LogBuffer::Pop() {
+    uint32_t size = 0;
+    memcpy(&size, data_ + (read_ & (capacity_ - 1)), sizeof(size));
+    read_ += size;
+    tail_.store(read_, std::memory_order_release);
+}
+
+// 线程退出时把缓冲区交给后台线程回收, 剩下的记录照常写出
+struct BinaryLogger::ThreadBuffer {
+    std::shared_ptr<LogBuffer> buffer;
+
+    ThreadBuffer() : buffer(BinaryLogger::Instance().RegisterThread()) {}
+
+    ~ThreadBuffer() {
+        buffer->Retire();
+    }
+};
+
+BinaryLogger &BinaryLogger::Instance() {
+    // 不析构: 其他线程和静态对象的析构函数里还可能打日志
+    static BinaryLogger *logger = []() {
+        auto *instance = new BinaryLogger();
+        std::atexit([]() { BinaryLogger::Instance().Shutdown(); });
+        return instance;
+    }();
+    return *logger;
+}
+
+BinaryLogger::BinaryLogger() {
+    out_.reserve(kOutputBatch * 2);
+    // 成员都初始化完了再启动后台线程
+    thread_ = std::thread([this]() { Run(); });
+}
+
+LogBuffer *BinaryLogger::CurrentBuffer() {
+    static thread_local ThreadBuffer thread_buffer;
+    return thread_buffer.buffer.get();
+}
+
+std::shared_ptr<LogBuffer> BinaryLogger::RegisterThread() {
+    std::lock_guard<std::mutex> lk(mutex_);
+    auto buffer = std::make_shared<LogBuffer>(buffer_size_);
+    buffers_.push_back(buffer);
+    generation_.fetch_add(1, std::memory_order_release);
+    return buffer;
+}
+
+void BinaryLogger::SetBufferSize(size_t size) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    buffer_size_ = size;
+}
+
+bool BinaryLogger::OpenFile(char const *pathname) {
+    Flush();
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (file_ != nullptr) {
+        fclose(file_);
+        file_ = nullptr;
+    }
+    if (pathname == nullptr) {
+        return true;
+    }
+    file_ = fopen(pathname, "wb");
+    return file_ != nullptr;
+}
+
+void BinaryLogger::Flush() {
+    std::unique_lock<std::mutex> lk(mutex_);
+    if (stop_) {
+        return;
+    }
+    uint64_t target = ++flush_requested_;
+    cv_.notify_all();
+    cv_.wait(lk, [this, target]() { return flush_done_ >= target || stop_; });
+}
+
+void BinaryLogger::Shutdown() {
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        if (stop_) {
+            return;
+        }
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void BinaryLogger::Run() {
+    for (;;) {
+        uint64_t flush_target;
+        bool stop;
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            flush_target = flush_requested_;
+            stop = stop_;
+        }
+        size_t count = Drain();
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            if (flush_target > flush_done_) {
+                flush_done_ = flush_target;
+                cv_.notify_all();
+            }
+        }
+        if (stop) {
+            // 停止前最后一次Drain已经取到stop_之前提交的全部记录
+            break;
+        }
+        if (count == 0) {
+            // 空闲时最多等1ms, 有Flush或者Shutdown时马上醒来
+            std::unique_lock<std::mutex> lk(mutex_);
+            cv_.wait_for(lk, std::chrono::milliseconds(1), [this]() {
+                return stop_ || flush_requested_ > flush_done_;
+            });
+        }
+    }
+}
+
+size_t BinaryLogger::Drain() {
+    uint64_t generation = generation_.load(std::memory_order_acquire);
+    if (generation != local_generation_) {
+        std::lock_guard<std::mutex> lk(mutex_);
+        local_buffers_ = buffers_;
+        local_generation_ = generation_.load(std::memory_order_relaxed);
+    }
+
+    // 只处理这一刻之前提交的记录, 各线程按时间戳归并
+    size_t n = local_buffers_.size();
+    limits_.resize(n);
+    fronts_.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        limits_[i] = local_buffers_[i]->Head();
+        fronts_[i] = local_buffers_[i]->Front(limits_[i]);
+    }
+    size_t count = 0;
+    for (;;) {
+        size_t best = n;
+        for (size_t i = 0; i < n; i++) {
+            if (fronts_[i] != nullptr &&
+                (best == n || fronts_[i]->time_ns < fronts_[best]->time_ns)) {
+                best = i;
+            }
+        }
+        if (best == n) {
+            break;
+        }
+        Format(fronts_[best]);
+        local_buffers_[best]->Pop();
+        fronts_[best] = local_buffers_[best]->Front(limits_[best]);
+        count++;
+        if (out_.size() >= kOutputBatch) {
+            WriteOut();
+        }
+    }
+
+    uint64_t dropped = 0;
+    bool retired = false;
+    for (auto &buffer: local_buffers_) {
+        dropped += buffer->TakeDropped();
+        retired = retired || (buffer->IsRetired() && buffer->IsEmpty());
+    }
+    if (dropped != 0) {
+        dropped_total_.fetch_add(dropped, std::memory_order_relaxed);
+        char line[96];
+        int len = snprintf(line, sizeof(line),
+                           "[WARNING] %llu log records dropped, buffer full\n",
+                           (unsigned long long)dropped);
+        out_.append(line, (size_t)len);
+    }
+    if (!out_.empty()) {
+        WriteOut();
+    }
+
+    if (retired) {
+        // 退出的线程的缓冲区已经写完, 回收
+        std::lock_guard<std::mutex> lk(mutex_);
+        buffers_.erase(std::remove_if(buffers_.begin(), buffers_.end(),
+                                      [](std::shared_ptr<LogBuffer> const &b) {
+                                          return b->IsRetired() && b->IsEmpty();
+                                      }),
+                       buffers_.end());
+        generation_.fetch_add(1, std::memory_order_release);
+    }
+    return count;
+}
+
+void BinaryLogger::WriteOut() {
+    if (console_.load(std::memory_order_relaxed)) {
+        fwrite(out_.data(), 1, out_.size(), stdout);
+        fflush(stdout);
+    }
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        if (file_ != nullptr) {
+            fwrite(out_.data(), 1, out_.size(), file_);
+            fflush(file_);
+        }
+    }
+    out_.clear();
+}
+
+namespace {
+
+struct LogArg {
+    LogArgType type;
+    uint64_t value;         // 整数/指针的原始位, 浮点数按double存
+    char const *str;        // type为STRING时有效
+    uint16_t len;
+};
+
+// 把一个参数按格式说明符要求的类型取出来
+int64_t ArgToInt(LogArg const &arg) {
+    if (arg.type == LogArgType::DOUBLE) {
+        double d;
+        memcpy(&d, &arg.value, sizeof(d));
+        return (int64_t)d;
+    }
+    return (int64_t)arg.value;
+}
+
+double ArgToDouble(LogArg const &arg) {
+    if (arg.type == LogArgType::DOUBLE) {
+        double d;
+        memcpy(&d, &arg.value, sizeof(d));
+        return d;
+    }
+    if (arg.type == LogArgType::INT) {
+        return (double)(int64_t)arg.value;
+    }
+    return (double)arg.value;
+}
+
+} // namespace
+
+// 逐个说明符调用snprintf, 参数按说明符的长度修饰截断, 统一用ll/double传入,
+// 记录里参数的实际类型和格式串不一致时也不会读错栈
+void BinaryLogger::Format(LogRecordHeader const *record) {
+    LogSite const *site = record->site;
+    int64_t sec = record->time_ns / 1000000000;
+    if (sec != cached_sec_) {
+        time_t tt = (time_t)sec;
+        struct tm tm;
+        localtime_r(&tt, &tm);
+        strftime(cached_time_, sizeof(cached_time_), "[%F %T]", &tm);
+        cached_sec_ = sec;
+    }
+    char prefix[512];
+    int len = snprintf(prefix, sizeof(prefix), "%s[%s][%s:%s:%d]", cached_time_,
+                       kLevelNames[std::min(std::max(site->level, 0), 4)],
+                       site->file, site->func, site->line);
+    out_.append(prefix, (size_t)std::min<int>(len, sizeof(prefix) - 1));
+
+    // 解码参数
+    LogArg args[64];
+    size_t arg_count = std::min<size_t>(record->arg_count, 64);
+    uint8_t const *p = (uint8_t const *)(record + 1);
+    for (size_t i = 0; i < arg_count; i++) {
+        args[i].type = (LogArgType)p[0];
+        if (args[i].type == LogArgType::STRING) {
+            memcpy(&args[i].len, p + 1, 2);
+            args[i].str = (char const *)(p + 3);
+            p += 3 + args[i].len;
+        } else {
+            memcpy(&args[i].value, p + 1, 8);
+            p += 9;
+        }
+    }
+
+    size_t next = 0;
+    char spec[32];
+    char buf[256];
+    for (char const *f = site->fmt; *f != '\0';) {
+        if (*f != '%') {
+            char const *end = strchr(f, '%');
+            size_t n = end ? (size_t)(end - f) : strlen(f);
+            out_.append(f, n);
+            f += n;
+            continue;
+        }
+        if (f[1] == '%') {
+            out_.push_back('%');
+            f += 2;
+            continue;
+        }
+        // %[标志][宽度][.精度][长度]转换
+        char const *start = f++;
+        size_t spec_len = 0;
+        spec[spec_len++] = '%';
+        while (*f && strchr("-+ #0", *f) && spec_len < 8) {
+            spec[spec_len++] = *f++;
+        }
+        auto copy_number = [&]() {
+            if (*f == '*') {
+                int v = next < arg_count ? (int)ArgToInt(args[next++]) : 0;
+                spec_len += (size_t)snprintf(spec + spec_len,
+                                             sizeof(spec) - spec_len, "%d", v);
+                f++;
+                return;
+            }
+            while (*f >= '0' && *f <= '9' && spec_len < 20) {
+                spec[spec_len++] = *f++;
+            }
+        };
+        copy_number();
+        if (*f == '.') {
+            spec[spec_len++] = *f++;
+            copy_number();
+        }
+        char length[3] = {0};
+        size_t length_len = 0;
+        while (*f && strchr("hlLqjzt", *f) && length_len < 2) {
+            length[length_len++] = *f++;
+        }
+        char conv = *f;
+        if (conv == '\0') {
+            out_.append(start, strlen(start));
+            break;
+        }
+        f++;
+        if (next >= arg_count) {
+            out_.append("(missing)");
+            continue;
+        }
+        LogArg const &arg = args[next++];
+        int n = 0;
+        switch (conv) {
+        case 'd':
+        case 'i': {
+            int64_t v = ArgToInt(arg);
+            if (strcmp(length, "hh") == 0) {
+                v = (signed char)v;
+            } else if (strcmp(length, "h") == 0) {
+                v = (short)v;
+            } else if (length_len == 0) {
+                v = (int)v;
+            }
+            memcpy(spec + spec_len, "lld", 4);
+            n = snprintf(buf, sizeof(buf), spec, (long long)v);
+            break;
+        }
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+        case 'c': {
+            uint64_t v = (uint64_t)ArgToInt(arg);
+            if (strcmp(length, "hh") == 0 || conv == 'c') {
+                v = (unsigned char)v;
+            } else if (strcmp(length, "h") == 0) {
+                v = (unsigned short)v;
+            } else if (length_len == 0) {
+                v = (unsigned int)v;
+            }
+            if (conv == 'c') {
+                spec[spec_len] = 'c';
+                spec[spec_len + 1] = '\0';
+                n = snprintf(buf, sizeof(buf), spec, (int)v);
+            } else {
+                spec[spec_len] = 'l';
+                spec[spec_len + 1] = 'l';
+                spec[spec_len + 2] = conv;
+                spec[spec_len + 3] = '\0';
+                n = snprintf(buf, sizeof(buf), spec, (unsigned long long)v);
+            }
+            break;
+        }
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            spec[spec_len] = conv;
+            spec[spec_len + 1] = '\0';
+            n = snprintf(buf, sizeof(buf), spec, ArgToDouble(arg));
+            break;
+        case 's':
+            if (arg.type == LogArgType::STRING) {
+                // 带宽度/精度的字符串很少, 没有时直接追加
+                if (spec_len == 1) {
+                    out_.append(arg.str, arg.len);
+                    continue;
+                }
+                std::string s(arg.str, arg.len);
+                spec[spec_len] = 's';
+                spec[spec_len + 1] = '\0';
+                n = snprintf(buf, sizeof(buf), spec, s.c_str());
+            } else {
+                n = snprintf(buf, sizeof(buf), "(bad %%s)");
+            }
+            break;
+        case 'p':
+            spec[spec_len] = 'p';
+            spec[spec_len + 1] = '\0';
+            n = snprintf(buf, sizeof(buf), spec, (void *)(uintptr_t)arg.value);
+            break;
+        default:
+            // %n等不支持
+            out_.append(start, (size_t)(f - start));
+            continue;
+        }
+        if (n > 0) {
+            out_.append(buf, std::min<size_t>((size_t)n, sizeof(buf) - 1));
+        }
+    }
+    out_.push_back('\n');
+}
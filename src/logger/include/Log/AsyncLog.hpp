@@ -1,180 +1,255 @@
-#include <any>
-#include <iostream>
-#include <memory>
-#include <mutex>
-#include <queue>
-#include <sstream>
-#include <thread>
-#include <utility>
-#include <condition_variable>
-
-enum LogLv {
-    DEBUGS = 0,
-    INFO = 1,
-    WARN = 2,
-    ERRORS = 3,
-};
-
-class LogTask {
-public:
-    LogTask() { }
-    LogTask(LogTask const& src)
-        : level_(src.level_)
-        , logdatas(src.logdatas)
-    {
-    }
-
-    LogTask(LogTask const&& src)
-        : level_(src.level_)
-        , logdatas(std::move(src.logdatas))
-    {
-    }
-    LogLv level_;
-    std::queue<std::any> logdatas;
-};
-
-class AsyncLog {
-public:
-    static AsyncLog& getInstance()
-    {
-        static AsyncLog _ins;
-        return _ins;
-    }
-
-    template <typename... Args>
-    void AsyncWrite(LogLv level, Args... args) {  
-        auto task = std::make_shared<LogTask>();
-        (task->logdatas.push(std::any(std::forward<Args>(args))), ...);
-        task->level_ = level;
-        std::unique_lock<std::mutex> lk(mtx_);
-        que_.push(task);
-        bool empty = que_.size() == 1;
-        lk.unlock();
-        if (empty) {
-            empty_cond_.notify_one();
-        }
-    }
-
-    void Start()
-    {
-        for (;;) {
-            std::unique_lock<std::mutex> lk(mtx_);
-            empty_cond_.wait(lk, [this] {
-                return !que_.empty() || is_stop_;
-            });
-
-            if (is_stop_) {
-                return;
-            }
-
-            auto logtask = que_.front();
-            que_.pop();
-            lk.unlock();
-            processTask(logtask);
-        }
-    }
-
-    void processTask(std::shared_ptr<LogTask> task)
-    {
-        std::cout << "[" << Priority_str[task->level_] << "] ";
-        auto head = task->logdatas.front();
-        task->logdatas.pop();
-
-        std::string formatstr = "";
-        bool success = conver2Str(head, formatstr);
-        if (!success) {
-            return;
-        }
-
-        while (!task->logdatas.empty()) {
-            auto data = task->logdatas.front();
-            formatstr = formatString(formatstr, data);
-            task->logdatas.pop();
-        }
-
-        std::cout << formatstr << std::endl;
-    }
-
-    bool conver2Str(const std::any& data, std::string& replacement)
-    {
-        std::ostringstream ss;
-        if (data.type() == typeid(int)) {
-            ss << std::any_cast<int>(data);
-        } else if (data.type() == typeid(float)) {
-            ss << std::any_cast<float>(data);
-        } else if (data.type() == typeid(double)) {
-            ss << std::any_cast<double>(data);
-        } else if (data.type() == typeid(std::string)) {
-            ss << std::any_cast<std::string>(data);
-        } else if (data.type() == typeid(char*)) {
-            ss << std::any_cast<char*>(data);
-        } else if (data.type() == typeid(const char*)) {
-            ss << std::any_cast<const char*>(data);
-        } else {
-            return false;
-        }
-        replacement = ss.str();
-        return true;
-    }
-
-    template <typename... Args>
-    std::string formatString(const std::string& format,
-        Args&&... args)
-    {
-        std::string result = format;
-        size_t pos = 0;
-        auto replaceplaceHolder = [&](std::string placeholder, std::any& replacement) {
-            std::string str_replacement = "";
-            bool success = conver2Str(replacement, str_replacement);
-            if (!success) {
-                return;
-            }
-            size_t placeholderPos = result.find(placeholder, pos);
-            if (placeholderPos != std::string::npos) {
-                result.replace(placeholderPos, placeholder.length(), str_replacement);
-                pos += placeholderPos + placeholder.length();
-            } else {
-                result = result + " " + str_replacement;
-            }
-        };
-
-        (replaceplaceHolder("{}", args), ...);
-        return result;
-    }
-
-    void Stop()
-    {
-        is_stop_ = true;
-        empty_cond_.notify_one();
-    }
-
-    ~AsyncLog()
-    {
-        Stop();
-        workthread->join();
-        std::cout << "destruct Log\n";
-    }
-
-private:
-    AsyncLog(AsyncLog const& others) = delete;
-    AsyncLog(AsyncLog const&& others) = delete;
-    AsyncLog& operator=(AsyncLog const& other) = delete;
-    AsyncLog()
-        : is_stop_(false)
-    {
-        workthread = new std::thread(&AsyncLog::Start, this);
-    }
-
-    bool is_stop_;
-    std::mutex mtx_;
-    std::condition_variable empty_cond_;
-    std::queue<std::shared_ptr<LogTask>> que_;
-    std::thread* workthread;
-
-    const char* Priority_str[4] = {
-        "DEBUGS",
-        "INFO",
-        "WARNING",
-        "ERRORS",
-    };
-};
\ No newline at end of file
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+enum LogLv {
+    DEBUGS = 0,
+    INFO = 1,
+    WARN = 2,
+    ERRORS = 3,
+};
+
+/* 一条日志的一个参数. 字符串复制到记录的text里, 这里只存偏移和长度 */
+struct AsyncLogArg {
+    enum Type : uint8_t {
+        INT = 0,
+        UINT,
+        DOUBLE,
+        BOOL,
+        CHAR,
+        STRING,
+        POINTER,
+    };
+
+    Type type;
+    uint16_t offset;
+    uint16_t length;
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+        void const *p;
+    };
+};
+
+/* 环中固定大小的一条记录. 参数个数和字符串总长都有上限,
+ * 字符串放不下时截断 */
+struct alignas(64) AsyncLogRecord {
+    static constexpr size_t kMaxArgs = 8;
+    static constexpr size_t kTextSize = 192;
+
+    std::atomic<size_t> sequence{0}; // 槽位的序号, 生产者和消费者靠它交接
+    LogLv level;
+    char const *fmt;
+    uint8_t arg_count;
+    uint16_t text_size;
+    AsyncLogArg args[kMaxArgs];
+    char text[kTextSize];
+};
+
+/* 异步日志, 格式串用{}占位. 调用线程把参数按类型原样存进预先分配的环,
+ * 不分配内存也不格式化; 唯一的后台线程格式化后攒成大块写到文件.
+ * 环满时丢弃并计数. 用ASYNC_LOG宏可以在编译期检查占位符和参数个数 */
+class AsyncLog {
+public:
+    static AsyncLog &getInstance();
+
+    // fmt只存地址, 必须是字符串字面量或者一直有效的字符串
+    template <typename... Args>
+    void AsyncWrite(LogLv level, char const *fmt, Args const &...args) {
+        static_assert(sizeof...(Args) <= AsyncLogRecord::kMaxArgs,
+                      "too many log arguments");
+        size_t pos;
+        AsyncLogRecord *record = Claim(&pos);
+        if (record == nullptr) {
+            return;
+        }
+        record->level = level;
+        record->fmt = fmt;
+        record->arg_count = 0;
+        record->text_size = 0;
+        (Capture(record, args), ...);
+        record->sequence.store(pos + 1, std::memory_order_release);
+    }
+
+    // 输出到文件, 默认是标准输出. 传nullptr改回标准输出
+    bool Open(char const *pathname);
+    // 等待调用之前的日志全部写出
+    void Flush();
+    // 写完剩下的日志, 停止后台线程
+    void Stop();
+
+    uint64_t GetDroppedCount() const {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+    // fmt中{}的个数, {{和}}是转义的大括号
+    static constexpr size_t CountPlaceholders(char const *fmt) {
+        size_t count = 0;
+        for (size_t i = 0; fmt[i] != '\0'; i++) {
+            if (fmt[i] == '{' && fmt[i + 1] == '{') {
+                i++;
+            } else if (fmt[i] == '{' && fmt[i + 1] == '}') {
+                count++;
+                i++;
+            }
+        }
+        return count;
+    }
+
+    // 只用于在decltype中取参数个数
+    template <typename... Args>
+    static std::integral_constant<size_t, sizeof...(Args)>
+    CountArgs(Args const &...);
+
+    ~AsyncLog();
+
+private:
+    static constexpr size_t kRingSize = 4096; // 2的幂
+    static constexpr size_t kWriteBuffer = 256 * 1024;
+
+    AsyncLog();
+    AsyncLog(AsyncLog const &others) = delete;
+    AsyncLog &operator=(AsyncLog const &other) = delete;
+
+    // 多个生产者抢槽位, 满了返回nullptr
+    AsyncLogRecord *Claim(size_t *pos) {
+        size_t p = enqueue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            AsyncLogRecord *record = &ring_[p & (kRingSize - 1)];
+            size_t seq = record->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)p;
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(
+                        p, p + 1, std::memory_order_relaxed)) {
+                    *pos = p;
+                    return record;
+                }
+            } else if (diff < 0) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            } else {
+                p = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    static AsyncLogArg &NextArg(AsyncLogRecord *record,
+                                AsyncLogArg::Type type) {
+        AsyncLogArg &arg = record->args[record->arg_count++];
+        arg.type = type;
+        return arg;
+    }
+
+    static void CaptureString(AsyncLogRecord *record, char const *s,
+                              size_t length) {
+        AsyncLogArg &arg = NextArg(record, AsyncLogArg::STRING);
+        size_t room = AsyncLogRecord::kTextSize - record->text_size;
+        length = length < room ? length : room;
+        memcpy(record->text + record->text_size, s, length);
+        arg.offset = record->text_size;
+        arg.length = (uint16_t)length;
+        record->text_size += (uint16_t)length;
+    }
+
+    static void Capture(AsyncLogRecord *record, bool v) {
+        NextArg(record, AsyncLogArg::BOOL).u = v;
+    }
+
+    static void Capture(AsyncLogRecord *record, char v) {
+        NextArg(record, AsyncLogArg::CHAR).u = (uint8_t)v;
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value>::type
+    Capture(AsyncLogRecord *record, T v) {
+        if (std::is_signed<T>::value) {
+            NextArg(record, AsyncLogArg::INT).i = (int64_t)v;
+        } else {
+            NextArg(record, AsyncLogArg::UINT).u = (uint64_t)v;
+        }
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_enum<T>::value>::type
+    Capture(AsyncLogRecord *record, T v) {
+        Capture(record, (typename std::underlying_type<T>::type)v);
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_floating_point<T>::value>::type
+    Capture(AsyncLogRecord *record, T v) {
+        NextArg(record, AsyncLogArg::DOUBLE).d = (double)v;
+    }
+
+    static void Capture(AsyncLogRecord *record, char const *s) {
+        if (s == nullptr) {
+            s = "(null)";
+        }
+        CaptureString(record, s, strnlen(s, AsyncLogRecord::kTextSize));
+    }
+
+    static void Capture(AsyncLogRecord *record, std::string const &s) {
+        CaptureString(record, s.data(), s.size());
+    }
+
+    static void Capture(AsyncLogRecord *record, std::string_view s) {
+        CaptureString(record, s.data(), s.size());
+    }
+
+    // 其他指针只记地址
+    template <typename T>
+    static typename std::enable_if<
+        !std::is_same<typename std::remove_cv<T>::type, char>::value>::type
+    Capture(AsyncLogRecord *record, T *p) {
+        NextArg(record, AsyncLogArg::POINTER).p = (void const *)p;
+    }
+
+    void Run();
+    // 处理环中已经提交的记录, 返回处理的条数
+    size_t Drain();
+    void Format(AsyncLogRecord const &record);
+    void FormatArg(AsyncLogRecord const &record, AsyncLogArg const &arg);
+    void Append(char const *data, size_t size);
+    void WriteOut();
+
+    std::unique_ptr<AsyncLogRecord[]> ring_;
+    alignas(64) std::atomic<size_t> enqueue_pos_{0};
+    std::atomic<uint64_t> dropped_{0};
+
+    std::mutex mutex_; // 保护fd_和唤醒
+    std::condition_variable cv_;
+    int fd_ = 1;
+    bool stop_ = false;
+    uint64_t flush_requested_ = 0;
+    uint64_t flush_done_ = 0;
+    std::thread thread_;
+
+    // 只在后台线程中使用
+    alignas(64) size_t dequeue_pos_ = 0;
+    uint64_t reported_dropped_ = 0;
+    std::unique_ptr<char[]> out_;
+    size_t out_size_ = 0;
+};
+
+/* 检查占位符个数和参数个数一致, 不一致编译失败 */
+#define ASYNC_LOG(level, fmt, ...)                                           \
+    do {                                                                     \
+        static_assert(AsyncLog::CountPlaceholders("" fmt) ==                 \
+                          decltype(AsyncLog::CountArgs(__VA_ARGS__))::value, \
+                      "placeholder count does not match arguments");         \
+        AsyncLog::getInstance().AsyncWrite(level, fmt, ##__VA_ARGS__);       \
+    } while (0)
+
+#endif
@@ -0,0 +1,374 @@
+#ifndef BINARY_LOGGER_H
+#define BINARY_LOGGER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <time.h>
+#include <type_traits>
+#include <vector>
+
+namespace pjie {
+
+/* 一个日志调用点的静态信息, 由宏定义为函数内的静态常量, 记录里只存它的地址 */
+struct LogSite {
+    int level;
+    char const *file;
+    char const *func;
+    int line;
+    char const *fmt;
+};
+
+enum class LogArgType : uint8_t {
+    INT = 0,
+    UINT,
+    DOUBLE,
+    STRING,
+    POINTER,
+};
+
+/* 环形缓冲区中一条记录的头部, 后面是各参数: 类型1字节 + 值8字节,
+ * 字符串是类型1字节 + 长度2字节 + 内容. size为0表示回绕到缓冲区开头 */
+struct LogRecordHeader {
+    uint32_t size;
+    uint32_t arg_count;
+    LogSite const *site;
+    int64_t time_ns; // system_clock, 纳秒
+};
+
+/* 每个线程一个的单生产者单消费者字节环. 写满时丢弃新记录并计数,
+ * 不让打日志的线程等待 */
+class LogBuffer {
+public:
+    explicit LogBuffer(size_t capacity);
+    ~LogBuffer();
+
+    // 预留size字节(已按8字节对齐), 空间不够返回nullptr
+    inline uint8_t *Reserve(size_t size) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t pos = head & (capacity_ - 1);
+        // 记录不跨越缓冲区末尾, 放不下就在末尾写回绕标记
+        size_t padding = pos + size > capacity_ ? capacity_ - pos : 0;
+        if (head + padding + size - cached_tail_ > capacity_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head + padding + size - cached_tail_ > capacity_) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+        }
+        if (padding != 0) {
+            uint32_t wrap = 0;
+            memcpy(data_ + pos, &wrap, sizeof(wrap));
+            pos = 0;
+        }
+        pending_ = head + padding + size;
+        return data_ + pos;
+    }
+
+    inline void Commit() {
+        head_.store(pending_, std::memory_order_release);
+    }
+
+    // 以下在后台线程中调用
+    // 取到limit为止的下一条记录, 没有返回nullptr
+    LogRecordHeader const *Front(size_t limit);
+    void Pop();
+    size_t Head() const {
+        return head_.load(std::memory_order_acquire);
+    }
+    uint64_t TakeDropped() {
+        return dropped_.exchange(0, std::memory_order_relaxed);
+    }
+    void Retire() {
+        retired_.store(true, std::memory_order_release);
+    }
+    bool IsRetired() const {
+        return retired_.load(std::memory_order_acquire);
+    }
+    bool IsEmpty() const {
+        return read_ == head_.load(std::memory_order_acquire);
+    }
+
+private:
+    uint8_t *data_;
+    size_t capacity_; // 2的幂
+
+    // 生产者
+    alignas(64) std::atomic<size_t> head_{0};
+    size_t cached_tail_ = 0;
+    size_t pending_ = 0;
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<bool> retired_{false};
+
+    // 消费者
+    alignas(64) std::atomic<size_t> tail_{0};
+    size_t read_ = 0;
+};
+
+namespace detail {
+
+static const size_t kMaxStringArg = 1024;
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value ||
+                                   std::is_enum<T>::value ||
+                                   std::is_floating_point<T>::value,
+                               size_t>::type
+ArgSize(T const &, size_t *) {
+    return 1 + 8;
+}
+
+inline size_t ArgSize(char const *s, size_t *len) {
+    *len = s == nullptr ? 6 : strnlen(s, kMaxStringArg);
+    return 1 + 2 + *len;
+}
+
+inline size_t ArgSize(std::string const &s, size_t *len) {
+    *len = s.size() < kMaxStringArg ? s.size() : kMaxStringArg;
+    return 1 + 2 + *len;
+}
+
+// char *按字符串处理, 其他指针只记地址
+template <typename T>
+using EnableIfNotChar = typename std::enable_if<
+    !std::is_same<typename std::remove_cv<T>::type, char>::value>::type;
+
+template <typename T, typename = EnableIfNotChar<T>>
+inline size_t ArgSize(T *const &, size_t *) {
+    return 1 + 8;
+}
+
+inline uint8_t *PutArg(uint8_t *p, LogArgType type, void const *value) {
+    p[0] = (uint8_t)type;
+    memcpy(p + 1, value, 8);
+    return p + 9;
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value, uint8_t *>::type
+EncodeArg(uint8_t *p, T const &v, size_t) {
+    if (std::is_signed<T>::value) {
+        int64_t value = (int64_t)v;
+        return PutArg(p, LogArgType::INT, &value);
+    }
+    uint64_t value = (uint64_t)v;
+    return PutArg(p, LogArgType::UINT, &value);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_enum<T>::value, uint8_t *>::type
+EncodeArg(uint8_t *p, T const &v, size_t len) {
+    return EncodeArg(p, (typename std::underlying_type<T>::type)v, len);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_floating_point<T>::value,
+                               uint8_t *>::type
+EncodeArg(uint8_t *p, T const &v, size_t) {
+    double value = (double)v;
+    return PutArg(p, LogArgType::DOUBLE, &value);
+}
+
+inline uint8_t *EncodeString(uint8_t *p, char const *s, size_t len) {
+    p[0] = (uint8_t)LogArgType::STRING;
+    uint16_t n = (uint16_t)len;
+    memcpy(p + 1, &n, 2);
+    memcpy(p + 3, s, len);
+    return p + 3 + len;
+}
+
+inline uint8_t *EncodeArg(uint8_t *p, char const *s, size_t len) {
+    return EncodeString(p, s == nullptr ? "(null)" : s, len);
+}
+
+inline uint8_t *EncodeArg(uint8_t *p, std::string const &s, size_t len) {
+    return EncodeString(p, s.data(), len);
+}
+
+template <typename T, typename = EnableIfNotChar<T>>
+inline uint8_t *EncodeArg(uint8_t *p, T *const &v, size_t) {
+    uint64_t value = (uint64_t)(uintptr_t)v;
+    return PutArg(p, LogArgType::POINTER, &value);
+}
+
+} // namespace detail
+
+/* 异步二进制日志. 调用线程只把调用点地址、时间和参数的原始值写进本线程的
+ * 环形缓冲区, 格式化和写出都在后台线程中做: 按时间合并各线程的记录,
+ * 一批写一次, 时间戳字符串每秒只生成一次 */
+class BinaryLogger {
+public:
+    static BinaryLogger &Instance();
+
+    template <typename... Args>
+    static void Log(LogSite const &site, Args const &...args) {
+        LogBuffer *buffer = CurrentBuffer();
+        size_t lens[sizeof...(Args) + 1];
+        size_t i = 0;
+        size_t size = sizeof(LogRecordHeader);
+        ((size += detail::ArgSize(args, &lens[i++])), ...);
+        size = (size + 7) & ~(size_t)7;
+        uint8_t *p = buffer->Reserve(size);
+        if (p == nullptr) {
+            return;
+        }
+        LogRecordHeader header;
+        header.size = (uint32_t)size;
+        header.arg_count = (uint32_t)sizeof...(Args);
+        header.site = &site;
+        header.time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::system_clock::now().time_since_epoch())
+                             .count();
+        memcpy(p, &header, sizeof(header));
+        p += sizeof(header);
+        i = 0;
+        ((p = detail::EncodeArg(p, args, lens[i++])), ...);
+        (void)p;
+        (void)lens;
+        buffer->Commit();
+    }
+
+    // 除了标准输出再写一份到文件, 传nullptr关闭文件
+    bool OpenFile(char const *pathname);
+    // 是否写标准输出, 默认写
+    void SetConsoleOutput(bool enable) {
+        console_.store(enable, std::memory_order_relaxed);
+    }
+    // 等待调用之前的日志全部写出
+    void Flush();
+    // 写完剩下的日志, 停止后台线程. 之后的日志不再输出
+    void Shutdown();
+
+    uint64_t GetDroppedCount() const {
+        return dropped_total_.load(std::memory_order_relaxed);
+    }
+
+    // 每个线程的缓冲区大小, 在第一次打日志之前设置
+    void SetBufferSize(size_t size);
+
+private:
+    struct ThreadBuffer;
+    static constexpr size_t kOutputBatch = 64 * 1024;
+
+    BinaryLogger();
+
+    static LogBuffer *CurrentBuffer();
+    std::shared_ptr<LogBuffer> RegisterThread();
+
+    void Run();
+    // 处理所有缓冲区中已经提交的记录, 返回处理的条数
+    size_t Drain();
+    void Format(LogRecordHeader const *record);
+    void WriteOut();
+
+    std::mutex mutex_; // 保护buffers_, file_和唤醒
+    std::condition_variable cv_;
+    std::vector<std::shared_ptr<LogBuffer>> buffers_;
+    std::atomic<uint64_t> generation_{0}; // buffers_变化时加1
+    size_t buffer_size_ = 256 * 1024;
+    std::FILE *file_ = nullptr;
+    bool stop_ = false;
+    uint64_t flush_requested_ = 0;
+    uint64_t flush_done_ = 0;
+    std::atomic<uint64_t> dropped_total_{0};
+    std::atomic<bool> console_{true};
+    std::thread thread_;
+
+    // 只在后台线程中使用
+    std::vector<std::shared_ptr<LogBuffer>> local_buffers_;
+    uint64_t local_generation_ = ~0ull;
+    std::vector<size_t> limits_;
+    std::vector<LogRecordHeader const *> fronts_;
+    std::string out_;
+    int64_t cached_sec_ = -1;
+    char cached_time_[32] = {0};
+};
+
+/* 一个调用点的限流: 每秒最多输出per_second条, 多出来的只计数,
+ * 下一条能输出的日志之前补一条被压掉多少条的汇总.
+ * 多个线程共用一个调用点, 全部用原子变量, 窗口切换时的竞争只会多放过几条 */
+class LogRateLimiter {
+public:
+    constexpr explicit LogRateLimiter(uint32_t per_second)
+        : per_second_(per_second) {}
+
+    // 允许输出返回true, *suppressed是上次汇总之后被压掉的条数
+    inline bool Allow(uint64_t *suppressed) {
+        // 窗口是1秒, 粗粒度时钟就够了, 比steady_clock便宜得多
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        int64_t sec = ts.tv_sec;
+        int64_t window = window_.load(std::memory_order_relaxed);
+        if (sec != window &&
+            window_.compare_exchange_strong(window, sec,
+                                            std::memory_order_relaxed)) {
+            count_.store(0, std::memory_order_relaxed);
+        }
+        // 超出后只改suppressed_, 不再争用count_
+        if (count_.load(std::memory_order_relaxed) >= per_second_ ||
+            count_.fetch_add(1, std::memory_order_relaxed) >= per_second_) {
+            suppressed_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        *suppressed = suppressed_.load(std::memory_order_relaxed) == 0
+                          ? 0
+                          : suppressed_.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    uint32_t const per_second_;
+    std::atomic<int64_t> window_{0}; // 当前窗口, 单调时钟的秒数
+    std::atomic<uint32_t> count_{0};
+    std::atomic<uint64_t> suppressed_{0};
+};
+
+// 只用于让编译器检查格式串和参数, 不会被调用
+inline void CheckLogFormat(char const *, ...)
+    __attribute__((format(printf, 1, 2)));
+inline void CheckLogFormat(char const *, ...) {}
+
+} // namespace pjie
+
+/* 记录里只存格式串的地址, 所以fmt必须是字符串字面量 */
+#define PJIE_LOG(level, fmt, ...)                                            \
+    do {                                                                     \
+        static pjie::LogSite const pjie_log_site_ = {                        \
+            level, __FILE__, __FUNCTION__, __LINE__, "" fmt};                \
+        if (false) {                                                         \
+            pjie::CheckLogFormat(fmt, ##__VA_ARGS__);                        \
+        }                                                                    \
+        pjie::BinaryLogger::Log(pjie_log_site_, ##__VA_ARGS__);              \
+    } while (0)
+
+/* 限流的调用点, 被压掉的日志不会求值参数 */
+#define PJIE_LOG_RATE(level, per_second, fmt, ...)                           \
+    do {                                                                     \
+        static pjie::LogRateLimiter pjie_log_limiter_(per_second);           \
+        uint64_t pjie_log_suppressed_ = 0;                                   \
+        if (pjie_log_limiter_.Allow(&pjie_log_suppressed_)) {                \
+            if (pjie_log_suppressed_ != 0) {                                 \
+                PJIE_LOG(level, "%llu similar messages suppressed",          \
+                         (unsigned long long)pjie_log_suppressed_);          \
+            }                                                                \
+            PJIE_LOG(level, fmt, ##__VA_ARGS__);                             \
+        }                                                                    \
+    } while (0)
+
+/* 编译期关掉的调用点: 只检查格式, 不生成代码, 也不求值参数 */
+#define PJIE_LOG_DISABLED(fmt, ...)                                          \
+    do {                                                                     \
+        if (false) {                                                         \
+            pjie::CheckLogFormat("" fmt, ##__VA_ARGS__);                     \
+        }                                                                    \
+    } while (0)
+
+#endif
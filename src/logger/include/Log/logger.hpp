@@ -1,92 +1,137 @@
-#ifndef LOGGER_H
-#define LOGGER_H
-
-#include "Log/Timestamp.hpp"
-#include <cstdarg>
-#include <cstring>
-#include <fstream>
-#include <iostream>
-#include <mutex>
-#include <stdio.h>
-
-namespace pjie {
-
-enum Priority {
-    LOG_DEBUG = 0,
-    LOG_STATE,
-    LOG_INFO,
-    LOG_WARINING,
-    LOG_ERROR,
-};
-
-class Logger {
-public:
-    Logger(Logger const &other) = delete;
-    Logger &operator=(Logger const &other) = delete;
-    Logger(Logger const *) = delete;
-
-    static Logger &Instance() {
-        static Logger log;
-        return log;
-    }
-
-    ~Logger() {}
-
-    void Init(char const *pathname = nullptr) {
-        std::unique_lock<std::mutex> lk(mtx_);
-        if (pathname != nullptr) {
-            ofs_.open(pathname, std::ios::out | std::ios::binary);
-            if (ofs_.fail()) {
-                std::cerr << "Fiailed to open logfile" << std::endl;
-            }
-        }
-    }
-
-    void Exit() {
-        std::unique_lock<std::mutex> lk(mtx_);
-        if (ofs_.is_open()) {
-            ofs_.close();
-        }
-    }
-
-    void log(Priority priority, char const *file, char const *func, int Line,
-             char const *fmt, ...) {
-        std::unique_lock<std::mutex> lk(mtx_);
-
-        char buf[2048] = {0};
-        snprintf(buf, sizeof(buf), "[%s][%s:%s:%d]",
-                 Priority_To_String[priority], file, func, Line);
-        va_list args;
-        va_start(args, fmt);
-        vsnprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), fmt, args);
-        va_end(args);
-        this->Write(buf);
-    }
-
-    void Write(std::string str) {
-        if (ofs_.is_open()) {
-            ofs_ << "[" << Timestamp::Localtime() << "]" << str;
-        }
-        std::cout << "[" << Timestamp::Localtime() << "]" << str << std::endl;
-    }
-
-private:
-    Logger() {}
-
-    std::mutex mtx_;
-    std::ofstream ofs_;
-
-    char const *Priority_To_String[5] = {"DEBUG", "CONFIG", "INFO", "WARNING",
-                                         "ERROR"};
-};
-
-} // namespace pjie
-
-#define LOG_DEBUG(fmt, ...) \
-    pjie::Logger::Instance().log(pjie::Priority::LOG_DEBUG, __FILE__, \
-                                 __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__)
-
-#define LOG_DEBUG(fmt, ...) \
-    pjie::Logger::Instance().log(pjie::Priority::LOG_DEBUG, __FILE__, \
-                                 __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__)
-#endif
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include "Log/BinaryLogger.hpp"
+#include "Log/Timestamp.hpp"
+#include <cstdarg>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdio.h>
+
+namespace pjie {
+
+enum Priority {
+    LOG_DEBUG = 0,
+    LOG_STATE,
+    LOG_INFO,
+    LOG_WARINING,
+    LOG_ERROR,
+};
+
+class Logger {
+public:
+    Logger(Logger const &other) = delete;
+    Logger &operator=(Logger const &other) = delete;
+    Logger(Logger const *) = delete;
+
+    static Logger &Instance() {
+        static Logger log;
+        return log;
+    }
+
+    ~Logger() {}
+
+    // 日志宏走BinaryLogger, 文件也由它写
+    void Init(char const *pathname = nullptr) {
+        std::unique_lock<std::mutex> lk(mtx_);
+        if (pathname != nullptr) {
+            ofs_.open(pathname, std::ios::out | std::ios::binary);
+            if (ofs_.fail()) {
+                std::cerr << "Fiailed to open logfile" << std::endl;
+            }
+            ofs_.close();
+            BinaryLogger::Instance().OpenFile(pathname);
+        }
+    }
+
+    void Exit() {
+        std::unique_lock<std::mutex> lk(mtx_);
+        if (ofs_.is_open()) {
+            ofs_.close();
+        }
+        BinaryLogger::Instance().OpenFile(nullptr);
+    }
+
+    // 同步写出, 每次加锁并刷新, 不要在收发路径上使用
+    void log(Priority priority, char const *file, char const *func, int Line,
+             char const *fmt, ...) {
+        std::unique_lock<std::mutex> lk(mtx_);
+
+        char buf[2048] = {0};
+        snprintf(buf, sizeof(buf), "[%s][%s:%s:%d]",
+                 Priority_To_String[priority], file, func, Line);
+        va_list args;
+        va_start(args, fmt);
+        vsnprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), fmt, args);
+        va_end(args);
+        this->Write(buf);
+    }
+
+    void Write(std::string str) {
+        if (ofs_.is_open()) {
+            ofs_ << "[" << Timestamp::Localtime() << "]" << str;
+        }
+        std::cout << "[" << Timestamp::Localtime() << "]" << str << std::endl;
+    }
+
+private:
+    Logger() {}
+
+    std::mutex mtx_;
+    std::ofstream ofs_;
+
+    char const *Priority_To_String[5] = {"DEBUG", "CONFIG", "INFO", "WARNING",
+                                         "ERROR"};
+};
+
+} // namespace pjie
+
+/* 编译期的最低日志级别, 对应Priority的值, 低于它的调用点编译为空.
+ * 由CMake的LOG_MIN_LEVEL设置 */
+#ifndef PJIE_LOG_MIN_LEVEL
+#define PJIE_LOG_MIN_LEVEL 0
+#endif
+
+/* LOG_XXX_RATE(n, fmt, ...)每秒最多输出n条, 用在可能刷屏的错误路径上 */
+#if PJIE_LOG_MIN_LEVEL <= 0
+#define LOG_DEBUG(fmt, ...) \
+    PJIE_LOG(pjie::Priority::LOG_DEBUG, fmt, ##__VA_ARGS__)
+#define LOG_DEBUG_RATE(n, fmt, ...) \
+    PJIE_LOG_RATE(pjie::Priority::LOG_DEBUG, n, fmt, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(fmt, ...)         PJIE_LOG_DISABLED(fmt, ##__VA_ARGS__)
+#define LOG_DEBUG_RATE(n, fmt, ...) PJIE_LOG_DISABLED(fmt, ##__VA_ARGS__)
+#endif
+
+#if PJIE_LOG_MIN_LEVEL <= 2
+#define LOG_INFO(fmt, ...) \
+    PJIE_LOG(pjie::Priority::LOG_INFO, fmt, ##__VA_ARGS__)
+#define LOG_INFO_RATE(n, fmt, ...) \
+    PJIE_LOG_RATE(pjie::Priority::LOG_INFO, n, fmt, ##__VA_ARGS__)
+#else
+#define LOG_INFO(fmt, ...)         PJIE_LOG_DISABLED(fmt, ##__VA_ARGS__)
+#define LOG_INFO_RATE(n, fmt, ...) PJIE_LOG_DISABLED(fmt, ##__VA_ARGS__)
+#endif
+
+#if PJIE_LOG_MIN_LEVEL <= 3
+#define LOG_WARN(fmt, ...) \
+    PJIE_LOG(pjie::Priority::LOG_WARINING, fmt, ##__VA_ARGS__)
+#define LOG_WARN_RATE(n, fmt, ...) \
+    PJIE_LOG_RATE(pjie::Priority::LOG_WARINING, n, fmt, ##__VA_ARGS__)
+#else
+#define LOG_WARN(fmt, ...)         PJIE_LOG_DISABLED(fmt, ##__VA_ARGS__)
+#define LOG_WARN_RATE(n, fmt, ...) PJIE_LOG_DISABLED(fmt, ##__VA_ARGS__)
+#endif
+
+#if PJIE_LOG_MIN_LEVEL <= 4
+#define LOG_ERROR(fmt, ...) \
+    PJIE_LOG(pjie::Priority::LOG_ERROR, fmt, ##__VA_ARGS__)
+#define LOG_ERROR_RATE(n, fmt, ...) \
+    PJIE_LOG_RATE(pjie::Priority::LOG_ERROR, n, fmt, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(fmt, ...)         PJIE_LOG_DISABLED(fmt, ##__VA_ARGS__)
+#define LOG_ERROR_RATE(n, fmt, ...) PJIE_LOG_DISABLED(fmt, ##__VA_ARGS__)
+#endif
+#endif
@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <net/BufferPool.hpp>
+
+size_t const BufferPool::kClassSizes[BufferPool::kClassCount] = {
+    512, 2048, 8192, 32768, 131072};
+
+BufferPool::~BufferPool() {
+    for (auto &list : free_lists_) {
+        for (char *buf : list) {
+            delete[] buf;
+        }
+    }
+}
+
+size_t BufferPool::RoundUp(size_t size) {
+    for (size_t cls = 0; cls < kClassCount; cls++) {
+        if (kClassSizes[cls] >= size) {
+            return kClassSizes[cls];
+        }
+    }
+    return size;
+}
+
+char *BufferPool::Acquire(size_t size, size_t *capacity) {
+    size_t cls = 0;
+    while (cls < kClassCount && kClassSizes[cls] < size) {
+        cls++;
+    }
+
+    std::lock_guard<std::mutex> lk(mtx_);
+    stats_.acquired++;
+    char *buf = nullptr;
+    if (cls == kClassCount) {
+        *capacity = size;
+    } else {
+        *capacity = kClassSizes[cls];
+        if (!free_lists_[cls].empty()) {
+            buf = free_lists_[cls].back();
+            free_lists_[cls].pop_back();
+            stats_.reused++;
+            stats_.bytes_cached -= *capacity;
+        }
+    }
+    if (buf == nullptr) {
+        buf = new char[*capacity];
+        stats_.allocated++;
+    }
+
+    stats_.bytes_in_use += *capacity;
+    stats_.peak_bytes = std::max(stats_.peak_bytes, stats_.bytes_in_use);
+    return buf;
+}
+
+void BufferPool::Release(char *buf, size_t capacity) {
+    if (buf == nullptr) {
+        return;
+    }
+
+    size_t cls = 0;
+    while (cls < kClassCount && kClassSizes[cls] != capacity) {
+        cls++;
+    }
+
+    std::lock_guard<std::mutex> lk(mtx_);
+    stats_.bytes_in_use -= capacity;
+    if (cls == kClassCount || free_lists_[cls].size() >= kMaxCached) {
+        delete[] buf;
+        return;
+    }
+    free_lists_[cls].push_back(buf);
+    stats_.bytes_cached += capacity;
+}
+
+BufferPoolStats BufferPool::GetStats() {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return stats_;
+}
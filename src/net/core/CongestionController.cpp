@@ -0,0 +1,156 @@
+#include "Log/logger.hpp"
+#include "net/CongestionController.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// 与GCC丢包控制器相同: 丢包超过10%降码率, 低于2%升码率
+static const double kHighLoss = 0.10;
+static const double kLowLoss = 0.02;
+static const double kSevereLoss = 0.25;
+static const uint32_t kOveruseDelayUs = 150000;
+static const uint32_t kNormalDelayUs = 50000;
+static const int64_t kMinLevelUpUs = 1000000;
+static const int64_t kMaxHoldUs = 60000000;
+static const int64_t kFeedbackTimeoutUs = 2000000; // 超时没有反馈就退回用RR
+
+void CongestionController::OnReport(uint8_t fraction_lost, uint32_t rtt_us,
+                                    uint64_t sent_bytes, int64_t now_us) {
+    // 排队延时 = RTT - 最近kRttWindow个RR中的最小RTT
+    uint32_t queue_delay_us = 0;
+    if (rtt_us != 0) {
+        rtts_[rtt_count_++ % kRttWindow] = rtt_us;
+        uint32_t min_rtt =
+            *std::min_element(rtts_, rtts_ + std::min(rtt_count_, kRttWindow));
+        queue_delay_us = rtt_us - min_rtt;
+    }
+    // 有transport-cc反馈时RR太粗了, 不用它
+    if (last_feedback_us_ != 0 &&
+        now_us - last_feedback_us_ < kFeedbackTimeoutUs) {
+        return;
+    }
+    Update(fraction_lost / 256.0, queue_delay_us, sent_bytes, now_us);
+}
+
+void CongestionController::OnTransportFeedback(uint32_t lost, uint32_t total,
+                                               uint32_t queue_delay_us,
+                                               uint64_t sent_bytes,
+                                               int64_t now_us) {
+    if (total == 0) {
+        return;
+    }
+    last_feedback_us_ = now_us;
+    Update((double)lost / total, queue_delay_us, sent_bytes, now_us);
+}
+
+void CongestionController::Update(double loss, uint32_t queue_delay_us,
+                                  uint64_t sent_bytes, int64_t now_us) {
+    // 两次报告之间太近的话码率不准, 沿用上一次的
+    uint32_t send_bps = send_bps_.load(std::memory_order_relaxed);
+    if (last_report_us_ != 0 && now_us - last_report_us_ >= 100000) {
+        send_bps = (uint32_t)std::min<uint64_t>(
+            (sent_bytes - last_sent_bytes_) * 8 * 1000000 /
+                (uint64_t)(now_us - last_report_us_),
+            UINT32_MAX);
+    }
+    if (last_report_us_ == 0 || now_us - last_report_us_ >= 100000) {
+        last_report_us_ = now_us;
+        last_sent_bytes_ = sent_bytes;
+    }
+    // 升码率按时间算, 每秒8%, 与报告的频率无关
+    int64_t elapsed_us = 1000000;
+    if (last_update_us_ != 0) {
+        elapsed_us = std::min<int64_t>(now_us - last_update_us_, 1000000);
+    }
+    last_update_us_ = now_us;
+
+    bool overuse = loss > kHighLoss || queue_delay_us > kOveruseDelayUs;
+    bool normal = loss < kLowLoss && queue_delay_us < kNormalDelayUs;
+
+    // 第一次过载之前不限制, 之后从过载时的发送码率开始AIMD
+    double target = target_bps_.load(std::memory_order_relaxed);
+    if (loss > kHighLoss) {
+        target = (send_bps != 0 ? send_bps : target) * (1 - 0.5 * loss);
+    } else if (normal) {
+        target *= std::pow(1.08, elapsed_us / 1000000.0);
+    }
+    if (queue_delay_us > kOveruseDelayUs && send_bps != 0) {
+        target = target == 0 ? send_bps * 0.85
+                             : std::min(target, send_bps * 0.85);
+    }
+    if (target != 0) {
+        target = std::max<double>(std::min<double>(target, kMaxBitrate),
+                                  kMinBitrate);
+    }
+    target_bps_.store((uint32_t)target, std::memory_order_relaxed);
+    send_bps_.store(send_bps, std::memory_order_relaxed);
+    loss_permille_.store((uint32_t)(loss * 1000), std::memory_order_relaxed);
+    queue_delay_us_.store(queue_delay_us, std::memory_order_relaxed);
+
+    int level = level_.load(std::memory_order_relaxed);
+    if (overuse) {
+        overuse_count_.fetch_add(1, std::memory_order_relaxed);
+        overuse_reports_++;
+        normal_since_us_ = 0;
+        if (probe_us_ != 0 && now_us - probe_us_ < hold_us_) {
+            // 刚放开就又过载, 下次多等一会
+            hold_us_ = std::min(hold_us_ * 2, kMaxHoldUs);
+            probe_us_ = 0;
+        }
+        // 连续两次报告过载, 或者一次严重丢包, 加一级
+        if ((overuse_reports_ >= 2 || loss > kSevereLoss) &&
+            level < (int)ThinningLevel::KEY_FRAME_ONLY &&
+            now_us - last_change_us_ >= kMinLevelUpUs) {
+            level_rate_[level] = send_bps;
+            SetLevel(level + 1, now_us);
+            overuse_reports_ = 0;
+        }
+        return;
+    }
+
+    overuse_reports_ = 0;
+    if (!normal) {
+        normal_since_us_ = 0;
+        return;
+    }
+    if (normal_since_us_ == 0) {
+        normal_since_us_ = now_us;
+        return;
+    }
+    if (probe_us_ != 0 && now_us - probe_us_ >= hold_us_) {
+        // 上次放开之后稳定了, 下次可以早点放开
+        hold_us_ = std::max(hold_us_ / 2, kMinHoldUs);
+        probe_us_ = 0;
+    }
+    // 估计的带宽够上一级的码率了才放开, 否则一放开马上又过载
+    if (level > 0 && now_us - normal_since_us_ >= hold_us_ &&
+        now_us - last_change_us_ >= hold_us_ &&
+        target >= level_rate_[level - 1]) {
+        SetLevel(level - 1, now_us);
+        normal_since_us_ = now_us;
+        probe_us_ = now_us;
+    }
+}
+
+void CongestionController::SetLevel(int level, int64_t now_us) {
+    LOG_INFO("congestion level %d -> %d, target %u bps, send %u bps, "
+              "loss %u/1000, queue delay %u us",
+              (int)level_.load(std::memory_order_relaxed), level,
+              target_bps_.load(std::memory_order_relaxed),
+              send_bps_.load(std::memory_order_relaxed),
+              loss_permille_.load(std::memory_order_relaxed),
+              queue_delay_us_.load(std::memory_order_relaxed));
+    level_.store((uint8_t)level, std::memory_order_relaxed);
+    last_change_us_ = now_us;
+}
+
+CongestionStats CongestionController::GetStats() const {
+    CongestionStats stats;
+    stats.level = GetLevel();
+    stats.target_bps = target_bps_.load(std::memory_order_relaxed);
+    stats.send_bps = send_bps_.load(std::memory_order_relaxed);
+    stats.loss_permille = loss_permille_.load(std::memory_order_relaxed);
+    stats.queue_delay_us = queue_delay_us_.load(std::memory_order_relaxed);
+    stats.overuse_count = overuse_count_.load(std::memory_order_relaxed);
+    return stats;
+}
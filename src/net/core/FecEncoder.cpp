@@ -0,0 +1,139 @@
+#include "net/FecEncoder.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FEC_X86 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+void XorBytesScalar(uint8_t *dst, uint8_t const *src, size_t size) {
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t a, b;
+        memcpy(&a, dst + i, 8);
+        memcpy(&b, src + i, 8);
+        a ^= b;
+        memcpy(dst + i, &a, 8);
+    }
+    for (; i < size; i++) {
+        dst[i] ^= src[i];
+    }
+}
+
+#if FEC_X86
+__attribute__((target("avx2"))) static void
+XorBytesAvx2(uint8_t *dst, uint8_t const *src, size_t size) {
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i a = _mm256_loadu_si256((__m256i const *)(dst + i));
+        __m256i b = _mm256_loadu_si256((__m256i const *)(src + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(a, b));
+    }
+    XorBytesScalar(dst + i, src + i, size - i);
+}
+
+__attribute__((target("sse2"))) static void
+XorBytesSse2(uint8_t *dst, uint8_t const *src, size_t size) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i a = _mm_loadu_si128((__m128i const *)(dst + i));
+        __m128i b = _mm_loadu_si128((__m128i const *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(a, b));
+    }
+    XorBytesScalar(dst + i, src + i, size - i);
+}
+#elif defined(__ARM_NEON)
+static void XorBytesNeon(uint8_t *dst, uint8_t const *src, size_t size) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        vst1q_u8(dst + i, veorq_u8(vld1q_u8(dst + i), vld1q_u8(src + i)));
+    }
+    XorBytesScalar(dst + i, src + i, size - i);
+}
+#endif
+
+using XorFunc = void (*)(uint8_t *, uint8_t const *, size_t);
+
+static XorFunc SelectXor() {
+#if FEC_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return XorBytesAvx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return XorBytesSse2;
+    }
+#elif defined(__ARM_NEON)
+    return XorBytesNeon;
+#endif
+    return XorBytesScalar;
+}
+
+void XorBytes(uint8_t *dst, uint8_t const *src, size_t size) {
+    static XorFunc const xor_func = SelectXor();
+    xor_func(dst, src, size);
+}
+
+FecEncoder::FecEncoder(uint8_t group_size)
+    : group_size_(group_size == 0
+                      ? 1
+                      : (group_size > FEC_MAX_GROUP ? FEC_MAX_GROUP
+                                                    : group_size)) {}
+
+std::shared_ptr<FecPacket> FecEncoder::Push(RtpPacket const &pkt,
+                                            uint8_t payload_type) {
+    uint32_t payload_size = pkt.PayloadSize();
+    if (payload_size > MAX_RTP_PAYLOAD_SIZE) {
+        payload_size = MAX_RTP_PAYLOAD_SIZE;
+    }
+
+    // 恢复字段是各媒体包对应字段的异或: P/X/CC, M/PT, 时间戳, 长度
+    uint8_t header[FEC_HEADER_SIZE] = {0};
+    header[0] = 0;
+    header[1] = (uint8_t)((pkt.last ? 0x80 : 0) | (payload_type & 0x7f));
+    header[4] = (uint8_t)(pkt.timestamp >> 24);
+    header[5] = (uint8_t)(pkt.timestamp >> 16);
+    header[6] = (uint8_t)(pkt.timestamp >> 8);
+    header[7] = (uint8_t)pkt.timestamp;
+    header[8] = (uint8_t)(payload_size >> 8);
+    header[9] = (uint8_t)payload_size;
+    XorBytesScalar(header_, header, FEC_HEADER_SIZE);
+
+    XorBytes(payload_, pkt.Payload(), payload_size);
+    if (payload_size > protect_len_) {
+        protect_len_ = (uint16_t)payload_size;
+    }
+    sizes_[count_++] = (uint16_t)payload_size;
+
+    if (count_ < group_size_) {
+        return nullptr;
+    }
+
+    auto fec = std::make_shared<FecPacket>();
+    memcpy(fec->header, header_, FEC_HEADER_SIZE);
+    fec->timestamp = pkt.timestamp;
+    fec->group_size = count_;
+    memcpy(fec->sizes, sizes_, sizeof(sizes_));
+    fec->body_size = FEC_LEVEL_HEADER_SIZE + protect_len_;
+    fec->body.reset(new uint8_t[fec->body_size],
+                    std::default_delete<uint8_t[]>());
+    uint8_t *body = fec->body.get();
+    // 掩码第i位(从最高位起)对应SN base + i
+    uint16_t mask = (uint16_t)(0xffff << (16 - count_));
+    body[0] = (uint8_t)(protect_len_ >> 8);
+    body[1] = (uint8_t)protect_len_;
+    body[2] = (uint8_t)(mask >> 8);
+    body[3] = (uint8_t)mask;
+    memcpy(body + FEC_LEVEL_HEADER_SIZE, payload_, protect_len_);
+
+    memset(header_, 0, sizeof(header_));
+    memset(payload_, 0, protect_len_);
+    protect_len_ = 0;
+    count_ = 0;
+    return fec;
+}
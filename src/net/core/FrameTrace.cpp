@@ -0,0 +1,244 @@
+#include "Log/logger.hpp"
+#include "net/H264Source.hpp"
+#include "net/RtspServer.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <net/FrameTrace.hpp>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+static int64_t NowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// 负载补齐到8字节, 映射后记录可以直接按结构体访问
+static size_t PaddedSize(size_t size) {
+    return (size + 7) & ~(size_t)7;
+}
+
+FrameTraceWriter::~FrameTraceWriter() {
+    Close();
+}
+
+bool FrameTraceWriter::Open(const char *path, bool with_payload) {
+    Close();
+    std::lock_guard<std::mutex> lk(mutex_);
+    file_ = fopen(path, "wb");
+    if (file_ == nullptr) {
+        LOG_ERROR("open frame trace failed: %s", path);
+        return false;
+    }
+    setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+
+    FrameTraceHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FRAME_TRACE_MAGIC, 4);
+    header.version = FRAME_TRACE_VERSION;
+    header.flags = with_payload ? FRAME_TRACE_PAYLOAD : 0;
+    with_payload_ = with_payload;
+    failed_ = fwrite(&header, 1, sizeof(header), file_) != sizeof(header);
+    start_us_ = NowUs();
+    frame_count_.store(0, std::memory_order_relaxed);
+    return !failed_;
+}
+
+bool FrameTraceWriter::Close() {
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (file_ == nullptr) {
+        return false;
+    }
+    bool ok = fclose(file_) == 0 && !failed_;
+    file_ = nullptr;
+    return ok;
+}
+
+bool FrameTraceWriter::Write(MediaSessionId id, MediaChannelID channel,
+                             int rendition, AVFrame const &frame) {
+    FrameTraceRecord record;
+    memset(&record, 0, sizeof(record));
+    record.time_us = (uint64_t)(NowUs() - start_us_);
+    record.size = frame.size;
+    record.timestamp = frame.timestamp;
+    record.session_id = id;
+    record.channel = (uint8_t)channel;
+    record.type = frame.type;
+    record.rendition = (uint8_t)rendition;
+    record.nal_header = frame.size > 0 ? frame.buffer.get()[0] : 0;
+
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (file_ == nullptr || failed_) {
+        return false;
+    }
+    bool ok = fwrite(&record, 1, sizeof(record), file_) == sizeof(record);
+    if (ok && with_payload_ && frame.size > 0) {
+        static char const padding[8] = {0};
+        size_t padding_size = PaddedSize(frame.size) - frame.size;
+        ok = fwrite(frame.buffer.get(), 1, frame.size, file_) == frame.size &&
+             fwrite(padding, 1, padding_size, file_) == padding_size;
+    }
+    if (!ok) {
+        // 磁盘满之类的错误只报一次, 之后的帧不再记录
+        LOG_ERROR("write frame trace failed");
+        failed_ = true;
+        return false;
+    }
+    frame_count_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool FrameTraceReader::Open(const char *path) {
+    Close();
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        (size_t)st.st_size < sizeof(FrameTraceHeader)) {
+        close(fd);
+        return false;
+    }
+
+    size_t file_size = (size_t)st.st_size;
+    void *addr = mmap(NULL, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+
+    // 回放中的AVFrame引用映射内存, 最后一帧发完才解除映射
+    addr_.reset((uint8_t *)addr,
+                [file_size](uint8_t *p) { munmap(p, file_size); });
+    file_size_ = file_size;
+    header_ = (FrameTraceHeader const *)addr_.get();
+    if (memcmp(header_->magic, FRAME_TRACE_MAGIC, 4) != 0 ||
+        header_->version != FRAME_TRACE_VERSION) {
+        LOG_WARN("invalid frame trace: %s", path);
+        Close();
+        return false;
+    }
+
+    size_t offset = sizeof(FrameTraceHeader);
+    while (file_size_ - offset >= sizeof(FrameTraceRecord)) {
+        auto record = (FrameTraceRecord const *)(addr_.get() + offset);
+        size_t record_size = sizeof(FrameTraceRecord);
+        if (HasPayload()) {
+            record_size += PaddedSize(record->size);
+        }
+        if (file_size_ - offset < record_size) {
+            break;
+        }
+        offsets_.push_back(offset);
+        offset += record_size;
+    }
+    // 记录进程被杀掉时最后一条可能不完整, 丢掉即可
+    if (offset != file_size_) {
+        LOG_WARN("frame trace %s: ignore %zu trailing bytes", path,
+                 file_size_ - offset);
+    }
+    madvise(addr_.get(), file_size_, MADV_SEQUENTIAL);
+    return true;
+}
+
+void FrameTraceReader::Close() {
+    addr_.reset();
+    file_size_ = 0;
+    header_ = nullptr;
+    offsets_.clear();
+}
+
+AVFrame FrameTraceReader::GetFrame(size_t index) const {
+    FrameTraceRecord const &record = GetRecord(index);
+    AVFrame frame(0);
+    if (HasPayload()) {
+        frame.buffer = std::shared_ptr<uint8_t>(
+            addr_, addr_.get() + offsets_[index] + sizeof(FrameTraceRecord));
+    } else {
+        // 负载全为0, 只保证打包和GOP缓存看到的NAL类型与原来一致
+        frame = AVFrame(record.size);
+        memset(frame.buffer.get(), 0, record.size);
+        if (record.size > 0) {
+            frame.buffer.get()[0] = record.nal_header;
+        }
+    }
+    frame.size = record.size;
+    frame.type = record.type;
+    frame.timestamp = record.timestamp;
+    return frame;
+}
+
+uint64_t FrameTraceReader::GetLoopDurationUs() const {
+    size_t count = offsets_.size();
+    if (count < 2) {
+        return 40000;
+    }
+    uint64_t span = GetRecord(count - 1).time_us - GetRecord(0).time_us;
+    return span + span / (count - 1);
+}
+
+FrameTracePlayer::Stats FrameTracePlayer::Play(RtspServer *server,
+                                               MediaSessionId session_id,
+                                               double speed, uint32_t loops) {
+    Stats stats;
+    size_t count = reader_->GetFrameCount();
+    if (count == 0) {
+        return stats;
+    }
+    stop_.store(false, std::memory_order_relaxed);
+
+    FrameTraceRecord const &first = reader_->GetRecord(0);
+    FrameTraceRecord const &last = reader_->GetRecord(count - 1);
+    uint64_t loop_us = reader_->GetLoopDurationUs();
+    uint64_t span_us = last.time_us - first.time_us;
+    // 时间戳按记录时的间隔延续, 每一轮整体后移, 保证单调
+    uint32_t span_ts = last.timestamp - first.timestamp;
+    uint32_t loop_ts =
+        span_us > 0 ? (uint32_t)((uint64_t)span_ts * loop_us / span_us) : 0;
+    uint32_t base_ts = H264Source::GetTimeStamp();
+
+    int64_t start_us = NowUs();
+    for (uint32_t loop = 0; loops == 0 || loop < loops; loop++) {
+        for (size_t i = 0; i < count; i++) {
+            if (stop_.load(std::memory_order_relaxed)) {
+                stats.elapsed_us = (uint64_t)(NowUs() - start_us);
+                return stats;
+            }
+            FrameTraceRecord const &record = reader_->GetRecord(i);
+            if (speed > 0) {
+                int64_t due_us =
+                    start_us +
+                    (int64_t)((loop * loop_us + record.time_us -
+                               first.time_us) /
+                              speed);
+                int64_t now_us = NowUs();
+                if (due_us > now_us) {
+                    std::this_thread::sleep_for(
+                        std::chrono::microseconds(due_us - now_us));
+                } else if ((uint64_t)(now_us - due_us) > stats.max_lag_us) {
+                    stats.max_lag_us = (uint64_t)(now_us - due_us);
+                }
+            }
+
+            AVFrame frame = reader_->GetFrame(i);
+            if (frame.timestamp != 0) {
+                frame.timestamp = base_ts + (record.timestamp - first.timestamp) +
+                                  loop * loop_ts;
+            }
+            server->PushFrame(session_id, (MediaChannelID)record.channel,
+                              frame, record.rendition);
+            stats.frames++;
+            stats.bytes += record.size;
+        }
+    }
+    stats.elapsed_us = (uint64_t)(NowUs() - start_us);
+    return stats;
+}
@@ -1,5 +1,10 @@
 #include "net/H264File.hpp"
+#include <algorithm>
 #include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 
 H264File::H264File(int buf_size)
@@ -20,6 +25,7 @@ bool H264File::Open(const char *path)
 		return false;
 	}
 
+	BuildIndex();
 	return true;
 }
 
@@ -31,6 +37,106 @@ void H264File::Close()
 		m_count = 0;
 		m_bytes_used = 0;
 	}
+	m_frames.clear();
+	m_key_frames.clear();
+}
+
+// 扫描整个文件, 按照ReadFrame相同的规则切分帧, 记录每帧的偏移和是否含IDR
+bool H264File::BuildIndex()
+{
+	m_frames.clear();
+	m_key_frames.clear();
+
+	int fd = fileno(m_file);
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size < 5) {
+		return false;
+	}
+
+	size_t file_size = (size_t)st.st_size;
+	void *addr = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(addr == MAP_FAILED) {
+		return false;
+	}
+	madvise(addr, file_size, MADV_SEQUENTIAL);
+	const unsigned char *buf = (const unsigned char *)addr;
+
+	uint64_t frame_start = 0;
+	bool has_slice = false, is_key = false;
+	for (size_t i = 0; i + 5 < file_size; i++) {
+		int start_code = 0;
+		if(buf[i] == 0 && buf[i+1] == 0 && buf[i+2] == 1) {
+			start_code = 3;
+		}
+		else if(buf[i] == 0 && buf[i+1] == 0 && buf[i+2] == 0 && buf[i+3] == 1) {
+			start_code = 4;
+		}
+		else {
+			continue;
+		}
+
+		int nal_type = buf[i+start_code] & 0x1F;
+		bool first_slice = (nal_type == 0x5 || nal_type == 0x1)
+			&& ((buf[i+start_code+1] & 0x80) == 0x80);
+
+		if(has_slice && (nal_type == 0x6 || nal_type == 0x7 || nal_type == 0x8 || first_slice)) {
+			m_frames.push_back({frame_start, (uint32_t)(i - frame_start), is_key});
+			frame_start = i;
+			has_slice = false;
+			is_key = false;
+		}
+
+		if(!has_slice && first_slice) {
+			has_slice = true;
+			is_key = (nal_type == 0x5);
+		}
+		i += start_code;
+	}
+
+	if(has_slice) {
+		m_frames.push_back({frame_start, (uint32_t)(file_size - frame_start), is_key});
+	}
+	munmap(addr, file_size);
+
+	for (size_t n = 0; n < m_frames.size(); n++) {
+		if(m_frames[n].is_key) {
+			m_key_frames.push_back(n);
+		}
+	}
+	return !m_key_frames.empty();
+}
+
+size_t H264File::FindKeyFrame(size_t frame_pos) const
+{
+	auto iter = std::upper_bound(m_key_frames.begin(), m_key_frames.end(), frame_pos);
+	if(iter == m_key_frames.begin()) {
+		return 0;
+	}
+	return (size_t)(iter - m_key_frames.begin()) - 1;
+}
+
+int H264File::ReadKeyFrame(size_t key_index, char *in_buf, int in_buf_size) const
+{
+	if(key_index >= m_key_frames.size()) {
+		return -1;
+	}
+	return ReadFrameAt(m_key_frames[key_index], in_buf, in_buf_size);
+}
+
+int H264File::ReadFrameAt(size_t frame_pos, char *in_buf, int in_buf_size) const
+{
+	if(m_file == NULL || frame_pos >= m_frames.size()) {
+		return -1;
+	}
+
+	const FrameIndex &frame = m_frames[frame_pos];
+	int size = ((int)frame.size <= in_buf_size ? (int)frame.size : in_buf_size);
+	// pread不改变文件偏移, 与ReadFrame的顺序读取互不干扰
+	ssize_t bytes_read = pread(fileno(m_file), in_buf, size, (off_t)frame.offset);
+	if(bytes_read != size) {
+		return -1;
+	}
+	return size;
 }
 
 int H264File::ReadFrame(char* in_buf, int in_buf_size, bool* end)
@@ -1,8 +1,8 @@
 #include "net/H264Source.hpp"
 #include "Log/logger.hpp"
+#include "net/Clock.hpp"
 #include "net/media.hpp"
 #include "net/Rtp.hpp"
-#include <chrono>
 #include <cstdint>
 #include <cstring>
 #include <string>
@@ -27,22 +27,27 @@ std::string H264Source::GetAttribute() {
 }
 
 uint32_t H264Source::GetTimeStamp() {
-    auto time_point = std::chrono::time_point_cast<std::chrono::microseconds>(
-        std::chrono::high_resolution_clock::now());
-    return (uint32_t)((time_point.time_since_epoch().count() + 500) / 1000 *
-                      90);
+    return (uint32_t)((Clock::WallUs() + 500) / 1000 * 90);
     // 返回时间戳单位90000hz   +500微秒弥补时间误差  /1000 微秒转毫秒  *90
     // 毫秒转90000hz
 }
 
 bool H264Source::HandleFrame(MediaChannelID channel_id, AVFrame frame) {
-    uint8_t *frame_buf = frame.buffer.get();
-    uint32_t frame_size = frame.size;
-
     if (frame.timestamp == 0) {
         frame.timestamp = GetTimeStamp();
     }
 
+    if (!send_frame_cb_) {
+        return true;
+    }
+    return PacketizeFrame(channel_id, frame, send_frame_cb_);
+}
+
+bool H264Source::PacketizeFrame(MediaChannelID channel_id, AVFrame const &frame,
+                                SendFrameCallback const &send_cb) {
+    uint8_t *frame_buf = frame.buffer.get();
+    uint32_t frame_size = frame.size;
+
     if (frame_size <= MAX_RTP_PAYLOAD_SIZE) {
         RtpPacket rtp_pkt;
         rtp_pkt.type = frame.type;
@@ -52,10 +57,8 @@ bool H264Source::HandleFrame(MediaChannelID channel_id, AVFrame frame) {
 
         memcpy(rtp_pkt.data.get() + RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE,
                frame_buf, frame_size);
-        if (send_frame_cb_) {
-            if (send_frame_cb_(channel_id, rtp_pkt) == false) {
-                return false;
-            }
+        if (send_cb(channel_id, rtp_pkt) == false) {
+            return false;
         }
     } else {
         char FU[2] ={0};
@@ -75,10 +78,8 @@ bool H264Source::HandleFrame(MediaChannelID channel_id, AVFrame frame) {
             memcpy(rtp_pkt.data.get() + RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE + 2,
                    frame_buf, MAX_RTP_PAYLOAD_SIZE - 2);
 
-            if (send_frame_cb_) {
-                if (send_frame_cb_(channel_id, rtp_pkt) == false) {
-                    return false;
-                }
+            if (send_cb(channel_id, rtp_pkt) == false) {
+                return false;
             }
             frame_buf += MAX_RTP_PAYLOAD_SIZE - 2;
             frame_size -= MAX_RTP_PAYLOAD_SIZE - 2;
@@ -101,10 +102,8 @@ bool H264Source::HandleFrame(MediaChannelID channel_id, AVFrame frame) {
             rtp_pkt.data.get()[RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE + 1] = FU[1];
             memcpy(rtp_pkt.data.get() + RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE + 2,
                    frame_buf, frame_size);
-            if (send_frame_cb_) {
-                if (send_frame_cb_(channel_id, rtp_pkt) == false) {
-                    return false;
-                }
+            if (send_cb(channel_id, rtp_pkt) == false) {
+                return false;
             }
         }
     }
@@ -0,0 +1,252 @@
+#include "Log/logger.hpp"
+#include "net/H264File.hpp"
+#include "net/H264Source.hpp"
+#include "net/media.hpp"
+#include "net/Rtp.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <net/HintFile.hpp>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+HintFile::~HintFile() {
+    Close();
+}
+
+bool HintFile::Open(const char *path) {
+    Close();
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(HintFileHeader)) {
+        close(fd);
+        return false;
+    }
+
+    size_t file_size = (size_t)st.st_size;
+    void *addr = mmap(NULL, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+
+    // 在途的RtpPacket持有映射的引用, 最后一个包发完才解除映射
+    addr_.reset((uint8_t *)addr,
+                [file_size](uint8_t *p) { munmap(p, file_size); });
+    file_size_ = file_size;
+    header_ = (HintFileHeader const *)addr_.get();
+
+    if (memcmp(header_->magic, HINT_FILE_MAGIC, 4) != 0 ||
+        header_->version != HINT_FILE_VERSION || header_->framerate == 0 ||
+        header_->clock_rate == 0 ||
+        header_->table_offset > file_size_ ||
+        (file_size_ - header_->table_offset) / sizeof(HintPacketEntry) <
+            header_->packet_count) {
+        LOG_WARN("invalid hint file: %s", path);
+        Close();
+        return false;
+    }
+
+    table_ = (HintPacketEntry const *)(addr_.get() + header_->table_offset);
+    for (size_t i = 0; i < header_->packet_count; i++) {
+        HintPacketEntry const &entry = table_[i];
+        if (entry.size < RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE ||
+            entry.offset + entry.size > header_->table_offset) {
+            LOG_WARN("invalid hint packet %zu: %s", i, path);
+            Close();
+            return false;
+        }
+        if (i == 0 || table_[i - 1].marker) {
+            frame_starts_.push_back(i);
+        }
+    }
+    madvise(addr_.get(), file_size_, MADV_SEQUENTIAL);
+    return true;
+}
+
+void HintFile::Close() {
+    addr_.reset();
+    file_size_ = 0;
+    header_ = nullptr;
+    table_ = nullptr;
+    frame_starts_.clear();
+}
+
+bool HintFile::IsHintFile(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    char magic[4] = {0};
+    bool ret = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+               memcmp(magic, HINT_FILE_MAGIC, 4) == 0;
+    fclose(file);
+    return ret;
+}
+
+void HintFile::GetFramePackets(size_t frame_pos, size_t *first,
+                               size_t *last) const {
+    *first = frame_starts_[frame_pos];
+    *last = frame_pos + 1 < frame_starts_.size() ? frame_starts_[frame_pos + 1]
+                                                 : header_->packet_count;
+}
+
+RtpPacket HintFile::GetPacket(size_t packet_index) const {
+    HintPacketEntry const &entry = table_[packet_index];
+    RtpPacket pkt(std::shared_ptr<uint8_t>(addr_, addr_.get() + entry.offset),
+                  entry.size);
+    pkt.timestamp = entry.timestamp;
+    pkt.type = entry.type;
+    pkt.last = entry.marker;
+    return pkt;
+}
+
+bool HintFile::Convert(const char *h264_path, const char *hint_path,
+                       uint32_t framerate) {
+    H264File h264_file;
+    if (!h264_file.Open(h264_path) || h264_file.GetFrameCount() == 0) {
+        LOG_ERROR("open h264 file failed: %s", h264_path);
+        return false;
+    }
+
+    FILE *out = fopen(hint_path, "wb");
+    if (out == NULL) {
+        LOG_ERROR("open hint file failed: %s", hint_path);
+        return false;
+    }
+
+    HintFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HINT_FILE_MAGIC, 4);
+    header.version = HINT_FILE_VERSION;
+    header.clock_rate = 90000;
+    header.payload_type = 96;
+    header.framerate = framerate;
+    fwrite(&header, 1, sizeof(header), out);
+
+    std::vector<HintPacketEntry> table;
+    std::vector<char> frame_buf(2'000'000);
+    uint64_t offset = sizeof(header);
+    bool ret = true;
+    for (size_t n = 0; n < h264_file.GetFrameCount() && ret; n++) {
+        int frame_size =
+            h264_file.ReadFrameAt(n, frame_buf.data(), frame_buf.size());
+        if (frame_size <= 0) {
+            ret = false;
+            break;
+        }
+
+        AVFrame frame(frame_size);
+        memcpy(frame.buffer.get(), frame_buf.data(), frame_size);
+        frame.type = h264_file.IsKeyFrame(n) ? FrameType::VIDEO_FRAME_I
+                                             : FrameType::VIDEO_FRAME_P;
+        frame.timestamp = (uint32_t)(n * header.clock_rate / framerate);
+        ret = H264Source::PacketizeFrame(
+            channel0, frame, [&](MediaChannelID, RtpPacket pkt) -> bool {
+                HintPacketEntry entry;
+                memset(&entry, 0, sizeof(entry));
+                entry.offset = offset;
+                entry.size = pkt.size;
+                entry.timestamp = pkt.timestamp;
+                entry.marker = pkt.last;
+                entry.type = pkt.type;
+                if (fwrite(pkt.data.get(), 1, pkt.size, out) != pkt.size) {
+                    return false;
+                }
+                offset += pkt.size;
+                table.push_back(entry);
+                return true;
+            });
+        header.frame_count++;
+    }
+
+    // 包表按8字节对齐, 映射后可以直接当数组访问
+    char padding[8] = {0};
+    size_t padding_size = (8 - offset % 8) % 8;
+    fwrite(padding, 1, padding_size, out);
+    header.table_offset = offset + padding_size;
+    header.packet_count = table.size();
+
+    if (ret) {
+        ret = fwrite(table.data(), sizeof(HintPacketEntry), table.size(),
+                     out) == table.size();
+    }
+    if (ret) {
+        fseek(out, 0, SEEK_SET);
+        ret = fwrite(&header, 1, sizeof(header), out) == sizeof(header);
+    }
+    if (fclose(out) != 0) {
+        ret = false;
+    }
+    if (!ret) {
+        LOG_ERROR("write hint file failed: %s", hint_path);
+    }
+    return ret;
+}
+
+HintSource::HintSource(std::shared_ptr<HintFile> file) : file_(file) {
+    payload_ = 96;
+    type_ = MediaType::H264;
+    clock_rate_ = file_->GetClockRate();
+}
+
+HintSource::~HintSource() {}
+
+std::string HintSource::GetMediaDescription(uint16_t port) {
+    char buf[100] = {0};
+    sprintf(buf, "m=video %hu RTP/AVP %u", port, payload_);
+    return std::string(buf);
+}
+
+std::string HintSource::GetAttribute() {
+    char buf[100] = {0};
+    sprintf(buf, "a=rtpmap:%u H264/%u", payload_, clock_rate_);
+    return std::string(buf);
+}
+
+bool HintSource::HandleFrame(MediaChannelID channel_id, AVFrame frame) {
+    if (file_->GetFrameCount() == 0) {
+        return false;
+    }
+    if (frame.timestamp == 0) {
+        frame.timestamp = H264Source::GetTimeStamp();
+    }
+
+    size_t first = 0, last = 0;
+    file_->GetFramePackets(frame_pos_, &first, &last);
+    frame_pos_ = (frame_pos_ + 1) % file_->GetFrameCount();
+
+    if (!send_frame_cb_) {
+        return true;
+    }
+    for (size_t i = first; i < last; i++) {
+        RtpPacket pkt = file_->GetPacket(i);
+        pkt.timestamp = frame.timestamp;
+        if (send_frame_cb_(channel_id, pkt) == false) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t HintSource::GetNextFrameDuration() const {
+    size_t frame_count = file_->GetFrameCount();
+    if (frame_count < 2 || frame_pos_ == 0) {
+        return file_->GetClockRate() / file_->GetFramerate();
+    }
+
+    size_t first = 0, last = 0, prev_first = 0;
+    file_->GetFramePackets(frame_pos_, &first, &last);
+    file_->GetFramePackets(frame_pos_ - 1, &prev_first, &last);
+    return file_->GetEntry(first).timestamp -
+           file_->GetEntry(prev_first).timestamp;
+}
@@ -1,5 +1,7 @@
 #include <memory>
 #include <net/IOServicePool.hpp>
+#include <net/Tracer.hpp>
+#include <string>
 
 IOServicePool::IOServicePool(std::size_t size)
     : services_(size),
@@ -10,13 +12,16 @@ IOServicePool::IOServicePool(std::size_t size)
     }
 
     for (int i = 0; i < size; i++) {
-        threads_.emplace_back([this, i] { services_[i].run(); });
+        threads_.emplace_back([this, i] {
+            Tracer::SetThreadName("io-" + std::to_string(i));
+            services_[i].run();
+        });
     }
 }
 
 IOService &IOServicePool::GetService() {
     auto &service = services_[next_index_];
-    if (next_index_++ == services_.size()) {
+    if (++next_index_ == services_.size()) {
         next_index_ = 0;
     }
     return service;
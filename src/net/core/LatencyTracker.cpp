@@ -0,0 +1,209 @@
+#include "net/Metrics.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <net/LatencyTracker.hpp>
+#include <string>
+#include <thread>
+
+static std::atomic<bool> tsc_calibrated{false};
+
+double Tsc::NsPerTick() {
+    static double ns_per_tick = []() {
+        double result = 1.0;
+#if defined(__x86_64__) || defined(__i386__)
+        auto start = std::chrono::steady_clock::now();
+        uint64_t start_tsc = Now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        uint64_t ticks = Now() - start_tsc;
+        double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+        if (ticks != 0) {
+            result = ns / (double)ticks;
+        }
+#endif
+        tsc_calibrated.store(true, std::memory_order_release);
+        return result;
+    }();
+    return ns_per_tick;
+}
+
+bool Tsc::IsCalibrated() {
+    return tsc_calibrated.load(std::memory_order_acquire);
+}
+
+size_t LatencyHistogram::Index(uint64_t value) {
+    if (value < (1ull << kSubBits)) {
+        return (size_t)value;
+    }
+    int bits = 63 - __builtin_clzll(value);
+    if (bits > kMaxBits) {
+        return kBucketCount - 1;
+    }
+    // 最高位之后的kSubBits位决定在这个2的幂区间中的哪一格
+    size_t group = (size_t)(bits - kSubBits + 1);
+    size_t sub = (size_t)(value >> (bits - kSubBits)) - (1ull << kSubBits);
+    return (group << kSubBits) + sub;
+}
+
+uint64_t LatencyHistogram::BucketValue(size_t index) {
+    size_t group = index >> kSubBits;
+    uint64_t sub = index & ((1ull << kSubBits) - 1);
+    if (group == 0) {
+        return sub;
+    }
+    int shift = (int)group - 1;
+    uint64_t low = ((1ull << kSubBits) + sub) << shift;
+    return low + ((1ull << shift) >> 1);
+}
+
+uint64_t LatencyHistogram::GetCount() const {
+    uint64_t count = 0;
+    for (auto const &bucket: buckets_) {
+        count += bucket.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+uint64_t LatencyHistogram::GetPercentile(double percentile) const {
+    uint64_t count = GetCount();
+    if (count == 0) {
+        return 0;
+    }
+    // 第一个累计数达到count * percentile / 100的桶
+    uint64_t target = (uint64_t)((double)count * percentile / 100.0 + 0.5);
+    target = target == 0 ? 1 : target;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBucketCount; i++) {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if (seen >= target) {
+            return BucketValue(i);
+        }
+    }
+    return BucketValue(kBucketCount - 1);
+}
+
+uint64_t LatencyHistogram::GetMax() const {
+    for (size_t i = kBucketCount; i > 0; i--) {
+        if (buckets_[i - 1].load(std::memory_order_relaxed) != 0) {
+            return BucketValue(i - 1);
+        }
+    }
+    return 0;
+}
+
+void LatencyHistogram::Reset() {
+    for (auto &bucket: buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    sum_.store(0, std::memory_order_relaxed);
+}
+
+LatencyTracker &LatencyTracker::Instance() {
+    // 不析构: 发送线程退出前还可能记录
+    static LatencyTracker *tracker = new LatencyTracker();
+    return *tracker;
+}
+
+LatencyTracker::LatencyTracker() {
+    MetricsRegistry::Instance().AddCollector(
+        [this](std::string *out) { Expose(out); });
+}
+
+void LatencyTracker::SetEnabled(bool enable) {
+    if (enable) {
+        // 校准要睡20ms, 在打开时做, 不放在记录的路径上
+        Tsc::NsPerTick();
+    }
+    enabled_.store(enable, std::memory_order_relaxed);
+}
+
+void LatencyTracker::Reset() {
+    for (auto &histogram: histograms_) {
+        histogram.Reset();
+    }
+}
+
+char const *LatencyTracker::GetStageName(LatencyStage stage) {
+    switch (stage) {
+    case LatencyStage::SESSION_LOCK:    return "session_lock";
+    case LatencyStage::PACKETIZE:       return "packetize";
+    case LatencyStage::UDP_SEND:        return "send";
+    case LatencyStage::UDP_TOTAL:       return "total";
+    case LatencyStage::TCP_ENQUEUE:     return "enqueue";
+    case LatencyStage::TCP_LOGIC_QUEUE: return "logic_queue";
+    case LatencyStage::TCP_WRITE:       return "write";
+    case LatencyStage::TCP_TOTAL:       return "total";
+    default:                            return "";
+    }
+}
+
+char const *LatencyTracker::GetTransport(LatencyStage stage) {
+    switch (stage) {
+    case LatencyStage::SESSION_LOCK:
+    case LatencyStage::PACKETIZE:
+        return "all";
+    case LatencyStage::UDP_SEND:
+    case LatencyStage::UDP_TOTAL:
+        return "udp";
+    default:
+        return "tcp";
+    }
+}
+
+std::string LatencyTracker::GetReport() const {
+    double us_per_tick = Tsc::NsPerTick() / 1000.0;
+    std::string report;
+    char line[160];
+    snprintf(line, sizeof(line), "%-14s %-5s %10s %10s %10s %10s %10s\n",
+             "stage", "trans", "count", "p50(us)", "p99(us)", "p999(us)",
+             "max(us)");
+    report += line;
+    for (int i = 0; i < (int)LatencyStage::NUM; i++) {
+        LatencyHistogram const &histogram = histograms_[i];
+        snprintf(line, sizeof(line),
+                 "%-14s %-5s %10llu %10.1f %10.1f %10.1f %10.1f\n",
+                 GetStageName((LatencyStage)i), GetTransport((LatencyStage)i),
+                 (unsigned long long)histogram.GetCount(),
+                 histogram.GetPercentile(50) * us_per_tick,
+                 histogram.GetPercentile(99) * us_per_tick,
+                 histogram.GetPercentile(99.9) * us_per_tick,
+                 histogram.GetMax() * us_per_tick);
+        report += line;
+    }
+    return report;
+}
+
+void LatencyTracker::Expose(std::string *out) const {
+    static double const kQuantiles[] = {0.5, 0.99, 0.999};
+    // 这里持有注册表的锁, 不能等校准. 打开统计时才校准, 在那之前没有数据
+    if (!Tsc::IsCalibrated()) {
+        return;
+    }
+    double us_per_tick = Tsc::NsPerTick() / 1000.0;
+    *out += "# HELP rtsp_latency_us Latency from PushFrame to each stage, "
+            "collected while tracking is enabled\n";
+    *out += "# TYPE rtsp_latency_us summary\n";
+    char line[192];
+    for (int i = 0; i < (int)LatencyStage::NUM; i++) {
+        LatencyHistogram const &histogram = histograms_[i];
+        char labels[64];
+        snprintf(labels, sizeof(labels), "stage=\"%s\",transport=\"%s\"",
+                 GetStageName((LatencyStage)i), GetTransport((LatencyStage)i));
+        for (double quantile: kQuantiles) {
+            snprintf(line, sizeof(line),
+                     "rtsp_latency_us{%s,quantile=\"%g\"} %.1f\n", labels,
+                     quantile,
+                     histogram.GetPercentile(quantile * 100) * us_per_tick);
+            *out += line;
+        }
+        snprintf(line, sizeof(line), "rtsp_latency_us_sum{%s} %.1f\n", labels,
+                 histogram.GetSum() * us_per_tick);
+        *out += line;
+        snprintf(line, sizeof(line), "rtsp_latency_us_count{%s} %llu\n",
+                 labels, (unsigned long long)histogram.GetCount());
+        *out += line;
+    }
+}
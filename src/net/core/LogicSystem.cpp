@@ -1,15 +1,26 @@
 #include "Log/logger.hpp"
 #include "net/const.hpp"
 #include <cstddef>
+#include <chrono>
 #include <cstring>
 #include <functional>
 #include <memory>
 #include <mutex>
+#include <net/LatencyTracker.hpp>
 #include <net/LogicSystem.hpp>
 #include <net/MsgNode.hpp>
 #include <net/RtspConnection.hpp>
+#include <net/Tracer.hpp>
 
 LogicSystem::LogicSystem() : b_stop(false) {
+    auto &registry = MetricsRegistry::Instance();
+    messages_metric_ = registry.AddCounter("logic_messages_total",
+                                           "Messages handled by LogicSystem");
+    queue_metric_ = registry.AddGauge("logic_queue_depth",
+                                      "Messages waiting in LogicSystem");
+    wait_metric_ = registry.AddHistogram(
+        "logic_queue_wait_us", "Time messages wait in the LogicSystem queue",
+        {10, 50, 100, 500, 1000, 5000, 10000, 50000, 100000});
     work_thread_ = std::thread(&LogicSystem::DealMsg, this);
     Register();
 }
@@ -23,15 +34,19 @@ LogicSystem::~LogicSystem() {
 void LogicSystem::Register() {
     callbacks_[MSG_IDS::REQUEST] =
         std::bind(&LogicSystem::HandleRequest, this, std::placeholders::_1,
-                  std::placeholders::_2, std::placeholders::_3);
+                  std::placeholders::_2);
     callbacks_[MSG_IDS::RTP_SEND_PKT] =
         std::bind(&LogicSystem::HandleSendPacket, this, std::placeholders::_1,
-                  std::placeholders::_2, std::placeholders::_3);
+                  std::placeholders::_2);
+    callbacks_[MSG_IDS::CLOSE] =
+        std::bind(&LogicSystem::HandleClose, this, std::placeholders::_1,
+                  std::placeholders::_2);
 }
 
 void LogicSystem::PushMsg(std::shared_ptr<LogicNode> node) {
     std::unique_lock<std::mutex> lk(mtx_);
     msg_que_.push(node);
+    queue_metric_.Set((int64_t)msg_que_.size());
 
     if (msg_que_.size() == 1) {
         lk.unlock();
@@ -40,6 +55,7 @@ void LogicSystem::PushMsg(std::shared_ptr<LogicNode> node) {
 }
 
 void LogicSystem::DealMsg() {
+    Tracer::SetThreadName("logic");
     for (;;) {
         std::unique_lock<std::mutex> lk(mtx_);
         consume_.wait(lk, [this] { return b_stop || !msg_que_.empty(); });
@@ -49,42 +65,60 @@ void LogicSystem::DealMsg() {
                 auto &msg = msg_que_.front();
                 auto iter = callbacks_.find(msg->node_->id_);
                 if (iter != callbacks_.end()) {
-                    iter->second(msg->connect_, msg->node_->Getdata(),
-                                 msg->node_->GetLen());
+                    iter->second(msg->connect_, msg->node_);
                 }
                 msg_que_.pop();
             }
             break;
         }
 
-        auto &msg = msg_que_.front();
+        // 取出后先解锁再处理: 回调里会拿MediaSession的锁, 而推流线程持有
+        // 那把锁时也会PushMsg, 持锁处理会互相等待
+        auto msg = msg_que_.front();
+        msg_que_.pop();
+        queue_metric_.Set((int64_t)msg_que_.size());
+        lk.unlock();
+        messages_metric_.Add();
+        wait_metric_.Observe(
+            (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - msg->enqueue_time_)
+                .count());
+
         auto iter = callbacks_.find(msg->node_->id_);
         if (iter == callbacks_.end()) {
-            LOG_DEBUG("callback func is invalid");
-            msg_que_.pop();
+            LOG_WARN("callback func is invalid");
             continue;
         }
-        iter->second(msg->connect_, msg->node_->Getdata(),
-                     msg->node_->GetLen());
-        msg_que_.pop();
+        iter->second(msg->connect_, msg->node_);
     }
 }
 
 void LogicSystem::HandleRequest(std::shared_ptr<RtspConnect> conn,
-                                char const *msg, size_t len) {
-    bool ret = conn->ParseRequest(msg);
-    if (!ret) {
-        LOG_DEBUG("Error:cannot parseRequest");
-        return;
-    }
-    ret = conn->HandleRequest();
+                                std::shared_ptr<msgNode> node) {
+    TraceScope trace(TraceEventType::RTSP_REQUEST, (uint32_t)node->GetLen(),
+                     node->trace_flow_, TraceFlow::END);
+    bool ret = conn->HandleRecv(node->Getdata(), node->GetLen());
     if (!ret) {
-        LOG_DEBUG("Error:cannot HandleRequest");
+        LOG_WARN("Error:cannot parseRequest");
         return;
     }
 }
 
 void LogicSystem::HandleSendPacket(std::shared_ptr<RtspConnect> conn,
-                                   char const *msg, size_t len) {    
-   conn->Send(msg, len);
+                                   std::shared_ptr<msgNode> node) {
+    // RtpConnect已经写好了Send_Node, 直接入发送队列
+    auto send_node = std::static_pointer_cast<Send_Node>(node);
+    TraceScope trace(TraceEventType::LOGIC_SEND,
+                     (uint32_t)send_node->GetLen(), send_node->trace_flow_,
+                     TraceFlow::STEP);
+    if (send_node->trace_push_ != 0) {
+        send_node->trace_queued_ = LatencyTracker::Instance().Record(
+            LatencyStage::TCP_LOGIC_QUEUE, send_node->trace_queued_);
+    }
+    conn->Send(send_node);
+}
+
+void LogicSystem::HandleClose(std::shared_ptr<RtspConnect> conn,
+                              std::shared_ptr<msgNode>) {
+    conn->HandleClose();
 }
@@ -0,0 +1,240 @@
+#include "net/Loopback.hpp"
+#include "net/Rtcp.hpp"
+#include "net/Rtp.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstring>
+#include <vector>
+
+void LoopbackReceiver::OnRtp(MediaChannelID channel_id, uint8_t const *header,
+                             size_t header_size, size_t payload_size,
+                             int64_t now_us) {
+    if (header_size < RTP_HEADER_SIZE) {
+        return;
+    }
+    uint16_t seq = (uint16_t)(header[2] << 8 | header[3]);
+    if ((header[1] & 0x7f) == RTP_RTX_PAYLOAD_BASE + channel_id) {
+        // 原始序号在负载最前面, 这里算在头部里
+        if (!has_seq_ || header_size < RTP_HEADER_SIZE + 2) {
+            return;
+        }
+        rtx_packets++;
+        if (memcmp(header + 8, &ssrc_, 4) == 0) {
+            rtx_ssrc_errors++;
+        }
+        seq = (uint16_t)(header[header_size - 2] << 8 |
+                         header[header_size - 1]);
+    }
+    if (!has_seq_) {
+        has_seq_ = true;
+        memcpy(&ssrc_, header + 8, 4);
+        base_seq_ = max_seq_ = seq;
+        SetReceived(seq);
+    } else {
+        uint32_t ext = Extend(seq);
+        if (ext > max_seq_) {
+            // 中间没收到的先标成缺失
+            uint32_t gap_begin = max_seq_ + 1;
+            for (uint32_t s = gap_begin; s < ext && s - gap_begin < kSeqWindow;
+                 s++) {
+                bits_[s % kSeqWindow / 64] &= ~(1ull << (s % 64));
+            }
+            max_seq_ = ext;
+            SetReceived(ext);
+            if (nack && ext > gap_begin) {
+                SendNack(channel_id, gap_begin, ext - gap_begin);
+            }
+        } else if (max_seq_ - ext >= kSeqWindow) {
+            return;
+        } else if (bits_[ext % kSeqWindow / 64] & (1ull << (ext % 64))) {
+            duplicates++;
+            return;
+        } else {
+            SetReceived(ext);
+            recovered++;
+        }
+    }
+    received++;
+    bytes_ += payload_size;
+    if (header[1] & 0x80) {
+        frames++;
+        if (first_frame_us == 0) {
+            first_frame_us = now_us;
+        }
+    }
+}
+
+void LoopbackReceiver::OnRtcp(MediaChannelID, uint8_t const *data, size_t size,
+                              int64_t now_us) {
+    RtcpPacketView pkt;
+    while (size > 0) {
+        size_t len = NextRtcpPacket(data, size, &pkt);
+        if (len == 0) {
+            return;
+        }
+        if (pkt.type == RTCP_SR && pkt.body_size >= 12) {
+            // LSR取NTP时间戳中间32位
+            last_sr_ = (uint32_t)(pkt.body[6] << 24 | pkt.body[7] << 16 |
+                                  pkt.body[8] << 8 | pkt.body[9]);
+            last_sr_us_ = now_us;
+        }
+        data += len;
+        size -= len;
+    }
+}
+
+void LoopbackReceiver::SendReport(MediaChannelID channel_id, int64_t now_us) {
+    if (!has_seq_) {
+        return;
+    }
+    uint32_t expected = max_seq_ - base_seq_ + 1;
+    int32_t lost = (int32_t)(expected - (uint32_t)received);
+    uint32_t expected_interval = expected - expected_prior_;
+    uint32_t received_interval = (uint32_t)(received - received_prior_);
+    expected_prior_ = expected;
+    received_prior_ = (uint32_t)received;
+    int32_t lost_interval =
+        (int32_t)expected_interval - (int32_t)received_interval;
+    uint8_t fraction = 0;
+    if (expected_interval != 0 && lost_interval > 0) {
+        fraction = (uint8_t)std::min<uint32_t>(
+            ((uint32_t)lost_interval << 8) / expected_interval, 255);
+    }
+
+    uint8_t rr[8 + RTCP_REPORT_BLOCK_SIZE];
+    rr[0] = 0x81;
+    rr[1] = RTCP_RR;
+    rr[2] = 0;
+    rr[3] = (uint8_t)(sizeof(rr) / 4 - 1);
+    uint32_t block[6];
+    block[0] = ssrc_;
+    block[1] = htonl((uint32_t)fraction << 24 |
+                     ((uint32_t)std::max(lost, 0) & 0xffffff));
+    block[2] = htonl(max_seq_);
+    block[3] = 0;
+    block[4] = htonl(last_sr_);
+    block[5] = htonl(last_sr_ ? (uint32_t)(((now_us - last_sr_us_) << 16) /
+                                           1000000)
+                              : 0);
+    uint32_t my_ssrc = htonl(0x5a5a0002);
+    memcpy(rr + 4, &my_ssrc, 4);
+    memcpy(rr + 8, block, sizeof(block));
+    link->SendToServer(channel_id, rr, sizeof(rr));
+}
+
+uint64_t LoopbackReceiver::Lost() const {
+    if (!has_seq_) {
+        return 0;
+    }
+    uint64_t expected = max_seq_ - base_seq_ + 1;
+    return expected > received ? expected - received : 0;
+}
+
+uint32_t LoopbackReceiver::Extend(uint16_t seq) const {
+    uint16_t delta = (uint16_t)(seq - (uint16_t)max_seq_);
+    if (delta < 0x8000) {
+        return max_seq_ + delta;
+    }
+    return max_seq_ - (uint16_t)((uint16_t)max_seq_ - seq);
+}
+
+// 一个缺口只请求一次, 每个FCI覆盖17个包
+void LoopbackReceiver::SendNack(MediaChannelID channel_id, uint32_t first,
+                                uint32_t count) {
+    count = std::min<uint32_t>(count, 17 * 16);
+    uint8_t fb[12 + 4 * 16];
+    size_t size = 12;
+    for (uint32_t i = 0; i < count; i += 17) {
+        uint16_t pid = (uint16_t)(first + i);
+        uint16_t blp = 0;
+        for (uint32_t j = 1; j <= 16 && i + j < count; j++) {
+            blp |= (uint16_t)(1 << (j - 1));
+        }
+        fb[size] = (uint8_t)(pid >> 8);
+        fb[size + 1] = (uint8_t)pid;
+        fb[size + 2] = (uint8_t)(blp >> 8);
+        fb[size + 3] = (uint8_t)blp;
+        size += 4;
+    }
+    fb[0] = 0x80 | RTCP_FB_NACK;
+    fb[1] = RTCP_RTPFB;
+    fb[2] = 0;
+    fb[3] = (uint8_t)(size / 4 - 1);
+    uint32_t my_ssrc = htonl(0x5a5a0002);
+    memcpy(fb + 4, &my_ssrc, 4);
+    memcpy(fb + 8, &ssrc_, 4);
+    link->SendToServer(channel_id, fb, size);
+    nacks += count;
+}
+
+bool CaptureTransport::SendRtp(MediaChannelID,
+                               boost::asio::const_buffer const *buffers,
+                               size_t count) {
+    uint8_t const *header = (uint8_t const *)buffers[0].data();
+    if (buffers[0].size() < RTP_HEADER_SIZE) {
+        return true;
+    }
+    RtpRecord record;
+    record.seq = (uint16_t)(header[2] << 8 | header[3]);
+    record.timestamp = (uint32_t)header[4] << 24 | header[5] << 16 |
+                       header[6] << 8 | header[7];
+    record.ssrc = (uint32_t)header[8] << 24 | header[9] << 16 |
+                  header[10] << 8 | header[11];
+    record.payload_type = header[1] & 0x7f;
+    record.marker = (header[1] & 0x80) != 0;
+    record.header.assign((char const *)header, buffers[0].size());
+    for (size_t i = 1; i < count; i++) {
+        record.payload.append((char const *)buffers[i].data(),
+                              buffers[i].size());
+    }
+    rtp_payload += record.payload.size();
+    rtp.push_back(std::move(record));
+    return true;
+}
+
+void CaptureTransport::SendRtcp(MediaChannelID, uint8_t const *data,
+                                size_t size) {
+    RtcpRecord record;
+    record.data.assign((char const *)data, size);
+    record.rtp_packets = rtp.size();
+    record.rtp_payload = rtp_payload;
+    rtcp.push_back(std::move(record));
+}
+
+size_t CaptureTransport::CountFrames() const {
+    size_t frames = 0;
+    for (auto const &pkt: rtp) {
+        frames += pkt.marker ? 1 : 0;
+    }
+    return frames;
+}
+
+std::vector<CaptureTransport::RtpRecord>
+CaptureTransport::WithTimestamp(uint32_t timestamp) const {
+    std::vector<RtpRecord> result;
+    for (auto const &pkt: rtp) {
+        if (pkt.timestamp == timestamp) {
+            result.push_back(pkt);
+        }
+    }
+    return result;
+}
+
+AVFrame MakeH264Frame(bool key, size_t size, uint8_t fill) {
+    static uint8_t const kSps[] = {0, 0, 0, 1, 0x67, 0x42, 0xc0, 0x1e};
+    static uint8_t const kPps[] = {0, 0, 0, 1, 0x68, 0xce, 0x3c, 0x80};
+    std::vector<uint8_t> data;
+    if (key) {
+        data.insert(data.end(), kSps, kSps + sizeof(kSps));
+        data.insert(data.end(), kPps, kPps + sizeof(kPps));
+    }
+    // first_mb_in_slice为0, 最高位是1
+    uint8_t const slice[] = {0, 0, 0, 1, (uint8_t)(key ? 0x65 : 0x41), 0x88};
+    data.insert(data.end(), slice, slice + sizeof(slice));
+    data.resize(std::max(size, data.size()), fill);
+
+    AVFrame frame((uint32_t)data.size());
+    memcpy(frame.buffer.get(), data.data(), data.size());
+    frame.type = key ? VIDEO_FRAME_I : VIDEO_FRAME_P;
+    return frame;
+}
@@ -3,12 +3,14 @@
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
-#include <forward_list>
 #include <memory>
 #include <mutex>
+#include <net/Clock.hpp>
+#include <net/LatencyTracker.hpp>
 #include <net/media.hpp>
 #include <net/MediaSession.hpp>
 #include <net/RtpConnection.hpp>
+#include <net/Tracer.hpp>
 
 std::atomic_uint MediaSession::last_session_id_(1);
 
@@ -18,7 +20,26 @@ MediaSession::MediaSession(std::string url_suffix)
       media_sources_(MAX_MEDIA_CHANNEL) {
     has_new_client_ = false;
     session_id_ = ++last_session_id_;
-    sdp_ = "";
+    for (int chn = 0; chn < MAX_MEDIA_CHANNEL; chn++) {
+        renditions_[chn].emplace_back(new Rendition);
+    }
+
+    auto &registry = MetricsRegistry::Instance();
+    std::string label = MetricsRegistry::Label("session", suffix_);
+    clients_metric_ = registry.AddGauge("rtsp_session_clients",
+                                        "Clients playing the session", label);
+    frames_metric_ = registry.AddCounter(
+        "rtsp_session_frames_total", "Frames pushed into the session", label);
+    packets_metric_ = registry.AddCounter(
+        "rtsp_session_packets_total",
+        "RTP packets produced by the session, before fan-out", label);
+    bytes_metric_ = registry.AddCounter(
+        "rtsp_session_payload_bytes_total",
+        "RTP payload bytes produced by the session, before fan-out", label);
+    fanout_metric_ = registry.AddHistogram(
+        "rtsp_session_fanout_us",
+        "Time to send one packet to every client of the session",
+        {5, 10, 20, 50, 100, 200, 500, 1000, 5000}, label);
 }
 
 MediaSession::~MediaSession() {}
@@ -27,72 +48,470 @@ bool MediaSession::AddSource(MediaChannelID media_channel_id,
                              MediaSource *source) {
     source->SetSendFrameCallback([this](MediaChannelID channel_id,
                                         RtpPacket packet) -> bool {
-        std::forward_list<std::shared_ptr<RtpConnect>> clients;
-        std::map<int, RtpPacket> packets;
-        {
-            std::lock_guard<std::mutex> lock(client_mutex_);
-            for (auto iter = clients_.begin(); iter != clients_.end();) {
-                auto conn = iter->lock();
-                if (conn == nullptr) {
-                    clients_.erase(iter++);
-                } else {
-                    int id = conn->GetRtpSessionId();
-                    // if (id >= 0) {
-                    if (packets.find(id) == packets.end()) {
-                        RtpPacket pkt;
-                        memcpy(pkt.data.get(), packet.data.get(), packet.size);
-                        pkt.size = packet.size;
-                        pkt.timestamp = packet.timestamp;
-                        pkt.type = packet.type;
-                        pkt.last = packet.last;
-                        packets.emplace(id, pkt);
+        TracePacket(packet);
+        return SendPacket(channel_id, 0, packet);
+    });
+    media_sources_[media_channel_id].reset(source);
+    return true;
+}
+
+int MediaSession::AddRendition(MediaChannelID channel_id, MediaSource *source) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    std::lock_guard<std::mutex> client_lk(client_mutex_);
+    MediaSource *primary = media_sources_[channel_id].get();
+    if (primary == nullptr || source == nullptr ||
+        source->GetPayload() != primary->GetPayload() ||
+        source->GetClockRate() != primary->GetClockRate()) {
+        LOG_DEBUG("rendition does not match source of channel %d",
+                  (int)channel_id);
+        return -1;
+    }
+
+    int rendition = (int)renditions_[channel_id].size();
+    std::unique_ptr<Rendition> rend(new Rendition);
+    rend->source.reset(source);
+    if (fec_group_size_ != 0) {
+        rend->fec.reset(new FecEncoder(fec_group_size_));
+    }
+    source->SetSendFrameCallback(
+        [this, rendition](MediaChannelID channel_id, RtpPacket packet) -> bool {
+            TracePacket(packet);
+            return SendPacket(channel_id, rendition, packet);
+        });
+    renditions_[channel_id].push_back(std::move(rend));
+    return rendition;
+}
+
+size_t MediaSession::GetRenditionCount(MediaChannelID channel_id) {
+    std::lock_guard<std::mutex> lk(client_mutex_);
+    return renditions_[channel_id].size();
+}
+
+uint32_t MediaSession::GetRenditionBitrate(MediaChannelID channel_id,
+                                           int rendition) {
+    std::lock_guard<std::mutex> lk(client_mutex_);
+    if (rendition < 0 || rendition >= (int)renditions_[channel_id].size()) {
+        return 0;
+    }
+    return renditions_[channel_id][rendition]->bitrate_bps.load(
+        std::memory_order_relaxed);
+}
+
+MediaSource *MediaSession::GetRenditionSource(MediaChannelID channel_id,
+                                              int rendition) {
+    if (rendition == 0) {
+        return media_sources_[channel_id].get();
+    }
+    if (rendition < 0 || rendition >= (int)renditions_[channel_id].size()) {
+        return nullptr;
+    }
+    return renditions_[channel_id][rendition]->source.get();
+}
+
+static int64_t NowUs() {
+    return Clock::NowUs();
+}
+
+// 跳过Annex B起始码, 返回第一个NAL的头部字节
+static uint8_t FirstNalHeader(uint8_t const *data, size_t size) {
+    size_t i = 0;
+    while (i < size && i < 3 && data[i] == 0) {
+        i++;
+    }
+    if (i >= 2 && i < size && data[i] == 1) {
+        i++;
+    } else {
+        i = 0;
+    }
+    return i < size ? data[i] : 0;
+}
+
+// 整帧带起始码打包时SPS/PPS和IDR在同一个包里, 找起始码后面的IDR片
+static bool HasIdrAfterStartCode(uint8_t const *data, size_t size) {
+    for (size_t i = 0; i + 3 < size; i++) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1 &&
+            (data[i + 3] & 0x1f) == 5) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// H264包里第一个NAL的头部字节, FU-A的后续分片和非H264返回0
+static uint8_t GetNalHeader(MediaSource *source, RtpPacket const &packet) {
+    if (source == nullptr || source->GetMediaType() != MediaType::H264 ||
+        packet.PayloadSize() < 2) {
+        return 0;
+    }
+
+    uint8_t const *payload = packet.Payload();
+    size_t size = packet.PayloadSize();
+    uint8_t nal_header = FirstNalHeader(payload, size);
+    if ((nal_header & 0x1f) == 28) {
+        // FU-A只看第一个分片. 帧带起始码时FU头里是起始码的第一个0,
+        // 真正的NAL头部在后面
+        if ((payload[1] & 0x80) == 0) {
+            return 0;
+        }
+        if ((payload[1] & 0x1f) == 0) {
+            return FirstNalHeader(payload + 2, size - 2);
+        }
+        return (uint8_t)((nal_header & 0xe0) | (payload[1] & 0x1f));
+    }
+    if ((nal_header & 0x1f) == 24 && size > 3) {
+        // STAP-A看第一个NAL
+        return payload[3];
+    }
+    return nal_header;
+}
+
+void MediaSession::TracePacket(RtpPacket &packet) {
+    if (trace_push_tsc_ == 0) {
+        return;
+    }
+    packet.trace_push = trace_push_tsc_;
+    packet.trace_ready =
+        LatencyTracker::Instance().Record(LatencyStage::PACKETIZE,
+                                          trace_lock_tsc_);
+}
+
+bool MediaSession::SendPacket(MediaChannelID channel_id, int rendition,
+                              RtpPacket const &packet) {
+    int64_t now_us = NowUs();
+    int64_t start_us = Clock::RealNowUs();
+    size_t rendition_count = 0;
+    // 要补发关键帧的客户端, 出锁后再发
+    std::vector<std::shared_ptr<RtpConnect>> replay_conns;
+    std::vector<RtpPacket> replay_packets;
+    {
+        // 包只打一次, 各客户端共享负载, 只各自生成RTP头
+        std::lock_guard<std::mutex> lock(client_mutex_);
+        rendition_count = renditions_[channel_id].size();
+        Rendition &rend = *renditions_[channel_id][rendition];
+        MediaSource *source = GetRenditionSource(channel_id, rendition);
+        uint64_t history_index = RtpHistory::kNoIndex;
+        if (histories_[channel_id]) {
+            history_index = histories_[channel_id]->Push(packet);
+        }
+        // FEC每组只算一次, 发完这个媒体包后跟着发给各客户端
+        std::shared_ptr<FecPacket> fec;
+        if (rend.fec) {
+            fec = rend.fec->Push(packet, (uint8_t)source->GetPayload());
+        }
+        UpdateBitrate(rend, packet.PayloadSize(), now_us);
+
+        KeyFrameCache &cache = rend.key_frame;
+        bool frame_start = cache.frame_done;
+        uint8_t nal_header = GetNalHeader(source, packet);
+        bool key_start = IsKeyFrameStart(cache, nal_header);
+        if (key_start) {
+            cache.packets.clear();
+            cache.caching = true;
+            cache.has_idr = false;
+            cache.valid = false;
+            OnKeyFrame(channel_id, rendition, now_us);
+        }
+        // 抽帧只针对视频: nal_ref_idc为0的片可以丢, 其余都是参考帧
+        FramePriority &priority = rend.priority;
+        if (key_start || source->GetMediaType() != MediaType::H264) {
+            priority = FramePriority::KEY;
+        } else if (frame_start) {
+            uint8_t nal_type = nal_header & 0x1f;
+            priority = (nal_type >= 1 && nal_type <= 5 &&
+                        (nal_header & 0x60) == 0)
+                           ? FramePriority::DISPOSABLE
+                           : FramePriority::REFERENCE;
+        }
+        int64_t gop_interval_us = (int64_t)keyframe_interval_ms_ * 1000;
+
+        for (auto iter = clients_.begin(); iter != clients_.end();) {
+            auto conn = iter->lock();
+            if (conn == nullptr) {
+                iter = clients_.erase(iter);
+                clients_metric_.Set((int64_t)clients_.size());
+                continue;
+            }
+            if (rendition_count > 1) {
+                int current = conn->GetRendition(channel_id);
+                int target = key_start ? ChooseRendition(channel_id, *conn)
+                                       : current;
+                if (current != rendition) {
+                    // 只在这个编码的关键帧上切过来, 并且当前编码的一帧已经发完
+                    if (target != rendition ||
+                        !renditions_[channel_id][current]
+                             ->key_frame.frame_done) {
+                        iter++;
+                        continue;
                     }
-                    clients.emplace_front(conn);
-                    //}
-                    iter++;
+                    LOG_DEBUG("client %s:%hu channel %d rendition %d -> %d",
+                              conn->GetIp().c_str(), conn->GetPort(),
+                              (int)channel_id, current, rendition);
+                } else if (target != rendition) {
+                    // 想切走的话, 请实时源尽快出一个关键帧
+                    SetKeyFramePending(channel_id, target);
                 }
+                if (key_start) {
+                    conn->SetRendition(
+                        channel_id, rendition,
+                        HasLowerRendition(channel_id, rendition));
+                }
+            }
+            // 没有编码器可以请求关键帧, 在帧边界用缓存的关键帧顶替当前帧发给
+            // 请求的客户端; 正好轮到关键帧时不用补发
+            if (key_start) {
+                conn->ClearKeyFrameReplay(channel_id);
+            } else if (frame_start && cache.valid &&
+                       conn->TakeKeyFrameReplay(channel_id, now_us,
+                                                gop_interval_us)) {
+                conn->SetFrameReplaced(channel_id, true);
+                replay_conns.push_back(conn);
+            }
+            if (conn->IsFrameReplaced(channel_id)) {
+                if (packet.last) {
+                    conn->SetFrameReplaced(channel_id, false);
+                }
+                iter++;
+                continue;
+            }
+            conn->SendRtpPacket(channel_id, packet, history_index, priority);
+            if (fec) {
+                conn->SendFecPacket(channel_id, *fec);
             }
+            iter++;
+        }
 
-            for (auto &iter: clients) {
-                int id = iter->GetRtpSessionId();
-                if (packets.find(id) != packets.end()) {
-                    int ret = iter->SendRtpPacket(channel_id, packets[id]);
-                    if (ret == 0) {
-                        break;
-                    }
+        if (!replay_conns.empty()) {
+            replay_packets = cache.packets;
+        }
+        if (cache.caching) {
+            if (cache.packets.size() < kMaxKeyFramePackets) {
+                cache.packets.push_back(packet);
+                // 补发的包不算进延时统计
+                cache.packets.back().trace_push = 0;
+                if ((nal_header & 0x1f) == 5 ||
+                    (!cache.has_idr &&
+                     HasIdrAfterStartCode(packet.Payload(),
+                                          packet.PayloadSize()))) {
+                    cache.has_idr = true;
                 }
+                // IDR所在的帧结束时缓存完成
+                if (packet.last && cache.has_idr) {
+                    cache.caching = false;
+                    cache.valid = true;
+                }
+            } else {
+                // 关键帧太大, 不再缓存, 等下一个关键帧
+                cache.packets.clear();
+                cache.caching = false;
             }
         }
-        return true;
-    });
-    media_sources_[media_channel_id].reset(source);
+        cache.frame_done = packet.last != 0;
+        packets_metric_.Add();
+        bytes_metric_.Add(packet.PayloadSize());
+        // 分发的耗时总是按真实时间统计
+        fanout_metric_.Observe((uint64_t)(Clock::RealNowUs() - start_us));
+    }
+
+    // 关键帧换成当前帧的时间戳, 时间线不回退. 各客户端的发送由自己的
+    // send_mutex_串行, 不占client_mutex_, 其他客户端的包不用等
+    for (auto &cached: replay_packets) {
+        cached.timestamp = packet.timestamp;
+    }
+    for (auto const &conn: replay_conns) {
+        for (auto const &cached: replay_packets) {
+            conn->SendRtpPacket(channel_id, cached);
+        }
+    }
+
+    // 合并期间到达的请求, 间隔到了再交给编码器
+    for (size_t r = 0; r < rendition_count; r++) {
+        if (renditions_[channel_id][r]->keyframe_pending) {
+            FlushKeyFrameRequest(channel_id, (int)r, now_us);
+        }
+    }
     return true;
 }
 
+void MediaSession::UpdateBitrate(Rendition &rendition, uint32_t size,
+                                 int64_t now_us) {
+    if (rendition.bytes_start_us == 0) {
+        rendition.bytes_start_us = now_us;
+    }
+    rendition.bytes += size;
+    int64_t elapsed_us = now_us - rendition.bytes_start_us;
+    if (elapsed_us < 1000000) {
+        return;
+    }
+    // 关键帧让每秒的码率波动很大, 按1/8平滑
+    uint64_t rate = rendition.bytes * 8 * 1000000 / (uint64_t)elapsed_us;
+    uint64_t last = rendition.bitrate_bps.load(std::memory_order_relaxed);
+    rendition.bitrate_bps.store(
+        (uint32_t)(last == 0 ? rate : (last * 7 + rate) / 8),
+        std::memory_order_relaxed);
+    rendition.bytes = 0;
+    rendition.bytes_start_us = now_us;
+}
+
+int MediaSession::ChooseRendition(MediaChannelID channel_id,
+                                  RtpConnect &rtp_conn) {
+    auto const &list = renditions_[channel_id];
+    int current = rtp_conn.GetRendition(channel_id);
+    uint32_t budget = rtp_conn.GetCongestionStats(channel_id).target_bps;
+    uint32_t current_rate =
+        list[current]->bitrate_bps.load(std::memory_order_relaxed);
+    // TCP或者还没收到RR, 没有带宽估计, 不切换
+    if (budget == 0 || current_rate == 0) {
+        return current;
+    }
+
+    int best = -1;
+    uint32_t best_rate = 0;
+    int lowest = current;
+    uint32_t lowest_rate = current_rate;
+    for (size_t r = 0; r < list.size(); r++) {
+        uint32_t rate = list[r]->bitrate_bps.load(std::memory_order_relaxed);
+        if (rate == 0) {
+            continue;
+        }
+        if (rate < lowest_rate) {
+            lowest = (int)r;
+            lowest_rate = rate;
+        }
+        // 往高切留25%余量, 避免在两个编码之间来回切
+        uint64_t need = rate > current_rate ? (uint64_t)rate * 5 / 4 : rate;
+        if (need <= budget && rate > best_rate) {
+            best = (int)r;
+            best_rate = rate;
+        }
+    }
+    return best >= 0 ? best : lowest;
+}
+
+bool MediaSession::HasLowerRendition(MediaChannelID channel_id,
+                                     int rendition) {
+    auto const &list = renditions_[channel_id];
+    uint32_t rate = list[rendition]->bitrate_bps.load(std::memory_order_relaxed);
+    for (auto const &rend: list) {
+        uint32_t other = rend->bitrate_bps.load(std::memory_order_relaxed);
+        if (other != 0 && other < rate) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MediaSession::IsKeyFrameStart(KeyFrameCache &cache,
+                                   uint8_t nal_header) {
+    if (nal_header == 0) {
+        return false;
+    }
+    uint8_t nal_type = nal_header & 0x1f;
+
+    // SPS开始一个GOP; 没有SPS/PPS在前的IDR也开始一个GOP, 同一帧的多个IDR分片除外
+    uint8_t last_nal = cache.last_nal;
+    cache.last_nal = nal_type;
+    if (nal_type == 7) {
+        return true;
+    }
+    return nal_type == 5 && last_nal != 7 && last_nal != 8 && last_nal != 5;
+}
+
+void MediaSession::RequestKeyFrame(std::shared_ptr<RtpConnect> rtp_conn,
+                                   MediaChannelID channel_id) {
+    int rendition = rtp_conn->GetRendition(channel_id);
+    MediaSource *source = GetRenditionSource(channel_id, rendition);
+    if (source == nullptr) {
+        return;
+    }
+    if (!source->HasKeyFrameRequestCallback()) {
+        rtp_conn->RequestKeyFrameReplay(channel_id);
+        return;
+    }
+    SetKeyFramePending(channel_id, rendition);
+    FlushKeyFrameRequest(channel_id, rendition, NowUs());
+}
+
+void MediaSession::SetKeyFramePending(MediaChannelID channel_id,
+                                      int rendition) {
+    MediaSource *source = GetRenditionSource(channel_id, rendition);
+    if (source != nullptr && source->HasKeyFrameRequestCallback()) {
+        renditions_[channel_id][rendition]->keyframe_pending = true;
+    }
+}
+
+void MediaSession::FlushKeyFrameRequest(MediaChannelID channel_id,
+                                        int rendition, int64_t now_us) {
+    Rendition &rend = *renditions_[channel_id][rendition];
+    {
+        std::lock_guard<std::mutex> lk(keyframe_mutex_);
+        if (!rend.keyframe_pending ||
+            now_us - rend.last_keyframe_us <
+                (int64_t)keyframe_interval_ms_ * 1000) {
+            return;
+        }
+        rend.keyframe_pending = false;
+        rend.last_keyframe_us = now_us;
+    }
+    keyframe_requests_++;
+    GetRenditionSource(channel_id, rendition)->RequestKeyFrame(channel_id);
+}
+
+void MediaSession::OnKeyFrame(MediaChannelID channel_id, int rendition,
+                              int64_t now_us) {
+    // 源自己发出了关键帧, 之前的请求都已经满足
+    Rendition &rend = *renditions_[channel_id][rendition];
+    std::lock_guard<std::mutex> lk(keyframe_mutex_);
+    rend.keyframe_pending = false;
+    rend.last_keyframe_us = now_us;
+}
+
+void MediaSession::SetKeyFrameRequestInterval(uint32_t interval_ms) {
+    keyframe_interval_ms_ = interval_ms;
+}
+
 bool MediaSession::RemoveSource(MediaChannelID media_channel_id) {
     media_sources_[media_channel_id] = nullptr;
     return true;
 }
 
 bool MediaSession::HandleFrame(MediaChannelID channel_id, AVFrame frame) {
+    return HandleFrame(channel_id, 0, frame);
+}
+
+bool MediaSession::HandleFrame(MediaChannelID channel_id, int rendition,
+                               AVFrame frame) {
     std::lock_guard<std::mutex> lk(mutex_);
-    if (media_sources_[channel_id]) {
-        media_sources_[channel_id]->HandleFrame(channel_id, frame);
-    } else {
+    MediaSource *source = GetRenditionSource(channel_id, rendition);
+    if (source == nullptr) {
         return false;
     }
-
+    frames_metric_.Add();
+    TraceScope trace(TraceEventType::PACKETIZE, (uint32_t)rendition);
+    if (frame.trace_tsc != 0) {
+        trace_push_tsc_ = frame.trace_tsc;
+        trace_lock_tsc_ = LatencyTracker::Instance().Record(
+            LatencyStage::SESSION_LOCK, frame.trace_tsc);
+    }
+    source->HandleFrame(channel_id, frame);
+    trace_push_tsc_ = 0;
     return true;
 }
 
 std::string MediaSession::GetSdpMessage(std::string ip,
                                         std::string session_name) {
-    if (sdp_ != "") {
-        return sdp_;
+    auto sdp = GetSdp(ip, session_name);
+    return sdp ? *sdp : "";
+}
+
+std::shared_ptr<std::string const>
+MediaSession::GetSdp(std::string const &ip, std::string const &session_name) {
+    auto sdp = std::atomic_load(&sdp_);
+    if (sdp != nullptr) {
+        return sdp;
     }
 
     if (media_sources_.empty()) {
-        return "";
+        return nullptr;
     }
 
     char buff[2048] = {0};
@@ -109,19 +528,56 @@ std::string MediaSession::GetSdpMessage(std::string ip,
 
     for (uint32_t chn = 0; chn < media_sources_.size(); chn++) {
         if (media_sources_[chn]) {
-            snprintf(buff + strlen(buff), sizeof(buff) - strlen(buff), "%s\r\n",
+            uint32_t payload = media_sources_[chn]->GetPayload();
+            uint32_t rtx_payload = RTP_RTX_PAYLOAD_BASE + chn;
+            uint32_t fec_payload = RTP_FEC_PAYLOAD_BASE + chn;
+            // RTX和FEC的负载类型跟在m行的格式列表后面
+            snprintf(buff + strlen(buff), sizeof(buff) - strlen(buff), "%s",
                      media_sources_[chn]->GetMediaDescription(0).c_str());
+            if (histories_[chn] && use_rtx_) {
+                snprintf(buff + strlen(buff), sizeof(buff) - strlen(buff),
+                         " %u", rtx_payload);
+            }
+            if (fec_group_size_ != 0) {
+                snprintf(buff + strlen(buff), sizeof(buff) - strlen(buff),
+                         " %u", fec_payload);
+            }
+            snprintf(buff + strlen(buff), sizeof(buff) - strlen(buff), "\r\n");
 
             snprintf(buff + strlen(buff), sizeof(buff) - strlen(buff), "%s\r\n",
                      media_sources_[chn]->GetAttribute().c_str());
 
+            if (histories_[chn]) {
+                snprintf(buff + strlen(buff), sizeof(buff) - strlen(buff),
+                         "a=rtcp-fb:%u nack\r\n", payload);
+            }
+            if (histories_[chn] && use_rtx_) {
+                snprintf(buff + strlen(buff), sizeof(buff) - strlen(buff),
+                         "a=rtpmap:%u rtx/%u\r\n"
+                         "a=fmtp:%u apt=%u\r\n",
+                         rtx_payload, media_sources_[chn]->GetClockRate(),
+                         rtx_payload, payload);
+            }
+            if (fec_group_size_ != 0) {
+                snprintf(buff + strlen(buff), sizeof(buff) - strlen(buff),
+                         "a=rtpmap:%u ulpfec/%u\r\n", fec_payload,
+                         media_sources_[chn]->GetClockRate());
+            }
+            if (extensions_.GetId(RtpExtensionType::TRANSPORT_SEQUENCE) != 0) {
+                snprintf(buff + strlen(buff), sizeof(buff) - strlen(buff),
+                         "a=rtcp-fb:%u transport-cc\r\n", payload);
+            }
+            snprintf(buff + strlen(buff), sizeof(buff) - strlen(buff), "%s",
+                     extensions_.GetSdpAttributes().c_str());
+
             snprintf(buff + strlen(buff), sizeof(buff) - strlen(buff),
                      "a=control:track%d\r\n", chn);
         }
     }
 
-    sdp_ = buff;
-    return sdp_;
+    sdp = std::make_shared<std::string const>(buff);
+    std::atomic_store(&sdp_, sdp);
+    return sdp;
 }
 
 MediaSource *MediaSession::GetMediaSource(MediaChannelID channel_id) {
@@ -131,6 +587,66 @@ MediaSource *MediaSession::GetMediaSource(MediaChannelID channel_id) {
     return nullptr;
 }
 
+void MediaSession::SetTrickPlayFile(MediaChannelID channel_id,
+                                    std::shared_ptr<H264File> file,
+                                    uint32_t framerate) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    trick_files_[channel_id] = file;
+    trick_framerates_[channel_id] = framerate;
+}
+
+std::shared_ptr<H264File>
+MediaSession::GetTrickPlayFile(MediaChannelID channel_id, uint32_t *framerate) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (framerate != nullptr) {
+        *framerate = trick_framerates_[channel_id];
+    }
+    return trick_files_[channel_id];
+}
+
+void MediaSession::EnableRetransmission(uint32_t window_ms, bool use_rtx) {
+    std::lock_guard<std::mutex> lk(client_mutex_);
+    for (int chn = 0; chn < MAX_MEDIA_CHANNEL; chn++) {
+        histories_[chn] = std::make_shared<RtpHistory>(window_ms);
+    }
+    use_rtx_ = use_rtx;
+}
+
+void MediaSession::EnableFec(uint8_t group_size) {
+    std::lock_guard<std::mutex> lk(client_mutex_);
+    fec_group_size_ = group_size;
+    for (int chn = 0; chn < MAX_MEDIA_CHANNEL; chn++) {
+        for (auto &rend: renditions_[chn]) {
+            rend->fec.reset(new FecEncoder(group_size));
+        }
+    }
+}
+
+void MediaSession::EnableCongestionControl(bool enable) {
+    congestion_control_ = enable;
+}
+
+bool MediaSession::EnableRtpExtension(RtpExtensionType type, uint8_t id) {
+    std::lock_guard<std::mutex> lk(client_mutex_);
+    return extensions_.Register(type, id);
+}
+
+RtpExtensionMap MediaSession::GetRtpExtensions() {
+    std::lock_guard<std::mutex> lk(client_mutex_);
+    return extensions_;
+}
+
+bool MediaSession::IsFecEnabled(MediaChannelID channel_id) {
+    std::lock_guard<std::mutex> lk(client_mutex_);
+    return renditions_[channel_id][0]->fec != nullptr;
+}
+
+std::shared_ptr<RtpHistory>
+MediaSession::GetRtpHistory(MediaChannelID channel_id) {
+    std::lock_guard<std::mutex> lk(client_mutex_);
+    return histories_[channel_id];
+}
+
 void MediaSession::AddNotifyConnectedCallback(
     NotifyConnectedCallback const &callback) {
     notify_connected_callbacks_.push_back(callback);
@@ -151,6 +667,11 @@ bool MediaSession::AddClient(std::shared_ptr<RtpConnect> rtp_conn) {
     std::weak_ptr<RtpConnect> rtp_conn_weak_ptr = rtp_conn;
 
     clients_.emplace_back(rtp_conn_weak_ptr);
+    clients_metric_.Set((int64_t)clients_.size());
+    rtp_conn->SetKeyFrameNeededCallback(
+        [this](std::shared_ptr<RtpConnect> conn, MediaChannelID channel_id) {
+            RequestKeyFrame(conn, channel_id);
+        });
     for (auto &callback: notify_connected_callbacks_) {
         callback(session_id_, rtp_conn->GetIp(), rtp_conn->GetPort());
     }
@@ -170,6 +691,7 @@ void MediaSession::RemoveClient(std::shared_ptr<RtpConnect> rtp_conn) {
                 }
             }
             iter = clients_.erase(iter);
+            clients_metric_.Set((int64_t)clients_.size());
             return;
         } else {
             ++iter;
@@ -0,0 +1,188 @@
+#include "net/Clock.hpp"
+#include "net/RtpConnection.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <net/MemoryTransport.hpp>
+#include <utility>
+
+// UDP/IP头部, 算瓶颈上的发送时间时带上
+static const size_t kUdpIpOverhead = 28;
+
+bool MemoryLink::SendRtp(MediaChannelID channel_id,
+                         boost::asio::const_buffer const *buffers,
+                         size_t count) {
+    if (closed_ || count == 0) {
+        // 对端已经走了, 包发出去也没人收
+        return true;
+    }
+    size_t header_size = buffers[0].size();
+    size_t payload_size = 0;
+    for (size_t i = 1; i < count; i++) {
+        payload_size += buffers[i].size();
+    }
+    int64_t now_us = Clock::NowUs();
+    size_t bytes = header_size + payload_size + kUdpIpOverhead;
+    stats_.sent_packets++;
+    stats_.sent_bytes += header_size + payload_size;
+
+    int64_t depart_us = now_us;
+    if (config_.bandwidth_kbps != 0) {
+        int64_t start_us = std::max(now_us, busy_until_us_);
+        int64_t queued_us = start_us - now_us;
+        if (!config_.reliable &&
+            (uint64_t)queued_us * config_.bandwidth_kbps / 8000 >
+                config_.queue_bytes) {
+            stats_.queue_drops++;
+            return true;
+        }
+        busy_until_us_ =
+            start_us + (int64_t)(bytes * 8000 / config_.bandwidth_kbps);
+        depart_us = busy_until_us_;
+        stats_.max_queue_us = std::max(stats_.max_queue_us, queued_us);
+    }
+    if (!config_.reliable && network_->Lose(config_.loss)) {
+        stats_.random_drops++;
+        return true;
+    }
+
+    MemoryNetwork::Event event;
+    event.arrival_us = depart_us + config_.latency_us;
+    event.link = this;
+    event.kind = MemoryNetwork::EventKind::RTP;
+    event.channel_id = channel_id;
+    event.header_size =
+        (uint16_t)std::min(header_size, MemoryNetwork::kMaxHeader);
+    event.payload_size = (uint32_t)payload_size;
+    memcpy(event.header, buffers[0].data(), event.header_size);
+    network_->Push(std::move(event));
+    return true;
+}
+
+void MemoryLink::SendRtcp(MediaChannelID channel_id, uint8_t const *data,
+                          size_t size) {
+    if (closed_ || (!config_.reliable && network_->Lose(config_.loss))) {
+        return;
+    }
+    MemoryNetwork::Event event;
+    // RTCP很小, 不计瓶颈上的排队, 但不能超过前面的RTP包
+    event.arrival_us =
+        std::max(Clock::NowUs(), busy_until_us_) + config_.latency_us;
+    event.link = this;
+    event.kind = MemoryNetwork::EventKind::RTCP;
+    event.channel_id = channel_id;
+    event.header_size = 0;
+    event.payload_size = 0;
+    event.rtcp.assign(data, data + size);
+    network_->Push(std::move(event));
+}
+
+void MemoryLink::SendToServer(MediaChannelID channel_id, uint8_t const *data,
+                              size_t size) {
+    if (closed_ || (!config_.reliable && network_->Lose(config_.loss))) {
+        return;
+    }
+    MemoryNetwork::Event event;
+    event.arrival_us = Clock::NowUs() + config_.latency_us;
+    event.link = this;
+    event.kind = MemoryNetwork::EventKind::RTCP_SERVER;
+    event.channel_id = channel_id;
+    event.header_size = 0;
+    event.payload_size = 0;
+    event.rtcp.assign(data, data + size);
+    network_->Push(std::move(event));
+}
+
+std::shared_ptr<MemoryLink>
+MemoryNetwork::CreateLink(MemoryLinkConfig const &config,
+                          MemoryEndpoint *endpoint) {
+    std::shared_ptr<MemoryLink> link(new MemoryLink(this, config, endpoint));
+    links_.push_back(link);
+    return link;
+}
+
+bool MemoryNetwork::Lose(double loss) {
+    if (loss <= 0) {
+        return false;
+    }
+    // 取高53位转成[0, 1), 不依赖标准库分布的实现
+    return (double)(rng_() >> 11) * 0x1.0p-53 < loss;
+}
+
+void MemoryNetwork::Push(Event &&event) {
+    buckets_[event.arrival_us / kBucketUs].push_back(std::move(event));
+    in_flight_++;
+}
+
+int64_t MemoryNetwork::NextArrivalUs() const {
+    if (buckets_.empty()) {
+        return -1;
+    }
+    int64_t arrival_us = INT64_MAX;
+    for (Event const &event: buckets_.begin()->second) {
+        arrival_us = std::min(arrival_us, event.arrival_us);
+    }
+    return arrival_us;
+}
+
+size_t MemoryNetwork::Deliver(int64_t now_us) {
+    size_t count = 0;
+    std::vector<Event> events;
+    std::vector<std::pair<int64_t, uint32_t>> due;
+    while (!buckets_.empty() && buckets_.begin()->first * kBucketUs <= now_us) {
+        auto iter = buckets_.begin();
+        events.swap(iter->second);
+        // 桶内是发送顺序, 按(到达时间, 下标)排序即为到达顺序
+        due.clear();
+        for (uint32_t i = 0; i < events.size(); i++) {
+            if (events[i].arrival_us <= now_us) {
+                due.emplace_back(events[i].arrival_us, i);
+            } else {
+                // 最后一个桶可能只到期了一部分, 没到的放回去
+                iter->second.push_back(std::move(events[i]));
+            }
+        }
+        if (iter->second.empty()) {
+            buckets_.erase(iter);
+        }
+        if (due.empty()) {
+            break;
+        }
+        std::sort(due.begin(), due.end());
+        in_flight_ -= due.size();
+        // 交付时发出的新包至少晚一个时延; 时延为0时会进入已经到期的桶,
+        // 由下一轮循环处理
+        for (auto const &item: due) {
+            count += DeliverEvent(events[item.second]);
+        }
+        events.clear();
+    }
+    return count;
+}
+
+bool MemoryNetwork::DeliverEvent(Event &event) {
+    MemoryLink *link = event.link;
+    if (link->closed_) {
+        return false;
+    }
+    switch (event.kind) {
+    case EventKind::RTP:
+        link->stats_.delivered_packets++;
+        link->endpoint_->OnRtp(event.channel_id, event.header,
+                               event.header_size, event.payload_size,
+                               event.arrival_us);
+        break;
+    case EventKind::RTCP:
+        link->endpoint_->OnRtcp(event.channel_id, event.rtcp.data(),
+                                event.rtcp.size(), event.arrival_us);
+        break;
+    case EventKind::RTCP_SERVER:
+        if (auto conn = link->conn_.lock()) {
+            conn->HandleTransportRtcp(event.channel_id, event.rtcp.data(),
+                                      event.rtcp.size());
+        }
+        break;
+    }
+    return true;
+}
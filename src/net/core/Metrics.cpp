@@ -0,0 +1,228 @@
+#include "Log/logger.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <net/Metrics.hpp>
+#include <string>
+#include <vector>
+
+// 线程退出后还在计数的话写到这里, 不再导出
+static std::atomic<uint64_t> exited_slots[MetricsRegistry::kMaxSlots];
+
+// 线程退出时把槽里的数累加到retired_, 再释放
+struct MetricsRegistry::ThreadSlots {
+    std::unique_ptr<std::atomic<uint64_t>[]> slots;
+
+    ThreadSlots() : slots(new std::atomic<uint64_t>[kMaxSlots]) {
+        for (size_t i = 0; i < kMaxSlots; i++) {
+            slots[i].store(0, std::memory_order_relaxed);
+        }
+        MetricsRegistry &registry = MetricsRegistry::Instance();
+        std::lock_guard<std::mutex> lk(registry.mutex_);
+        registry.threads_.push_back(slots.get());
+    }
+
+    ~ThreadSlots() {
+        MetricsRegistry &registry = MetricsRegistry::Instance();
+        std::lock_guard<std::mutex> lk(registry.mutex_);
+        for (size_t i = 0; i < kMaxSlots; i++) {
+            registry.retired_[i] += slots[i].load(std::memory_order_relaxed);
+        }
+        auto &threads = registry.threads_;
+        threads.erase(std::find(threads.begin(), threads.end(), slots.get()));
+        local_slots_ = exited_slots;
+    }
+};
+
+MetricsRegistry &MetricsRegistry::Instance() {
+    // 不析构: io线程和推流线程退出时还可能计数
+    static MetricsRegistry *registry = new MetricsRegistry();
+    return *registry;
+}
+
+std::atomic<uint64_t> *MetricsRegistry::RegisterThread() {
+    static thread_local ThreadSlots thread_slots;
+    local_slots_ = thread_slots.slots.get();
+    return local_slots_;
+}
+
+MetricsRegistry::Metric *MetricsRegistry::Find(std::string const &name,
+                                               std::string const &labels) {
+    for (auto &metric: metrics_) {
+        if (metric->name == name && metric->labels == labels) {
+            return metric.get();
+        }
+    }
+    return nullptr;
+}
+
+MetricsRegistry::Metric *
+MetricsRegistry::Add(std::string const &name, std::string const &help,
+                     std::string const &labels, Type type, size_t slots) {
+    if (next_slot_ + slots > kMaxSlots) {
+        LOG_WARN("metrics slots exhausted, %s{%s} not exported", name.c_str(),
+                 labels.c_str());
+        return nullptr;
+    }
+    std::unique_ptr<Metric> metric(new Metric);
+    metric->name = name;
+    metric->help = help;
+    metric->labels = labels;
+    metric->type = type;
+    metric->slot = next_slot_;
+    next_slot_ += (uint32_t)slots;
+    metrics_.push_back(std::move(metric));
+    return metrics_.back().get();
+}
+
+Counter MetricsRegistry::AddCounter(std::string const &name,
+                                    std::string const &help,
+                                    std::string const &labels) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    Counter counter;
+    Metric *metric = Find(name, labels);
+    if (metric == nullptr) {
+        metric = Add(name, help, labels, Type::COUNTER, 1);
+    }
+    if (metric != nullptr && metric->type == Type::COUNTER) {
+        counter.slot_ = metric->slot;
+    }
+    return counter;
+}
+
+Gauge MetricsRegistry::AddGauge(std::string const &name,
+                                std::string const &help,
+                                std::string const &labels) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    Gauge gauge;
+    Metric *metric = Find(name, labels);
+    if (metric == nullptr) {
+        metric = Add(name, help, labels, Type::GAUGE, 0);
+    }
+    if (metric != nullptr && metric->type == Type::GAUGE) {
+        gauge.value_ = &metric->gauge;
+    }
+    return gauge;
+}
+
+Histogram MetricsRegistry::AddHistogram(std::string const &name,
+                                        std::string const &help,
+                                        std::vector<uint64_t> const &bounds,
+                                        std::string const &labels) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    Histogram histogram;
+    Metric *metric = Find(name, labels);
+    if (metric == nullptr) {
+        metric = Add(name, help, labels, Type::HISTOGRAM, bounds.size() + 2);
+        if (metric != nullptr) {
+            metric->bounds = bounds;
+            std::sort(metric->bounds.begin(), metric->bounds.end());
+        }
+    }
+    if (metric != nullptr && metric->type == Type::HISTOGRAM) {
+        histogram.slot_ = metric->slot;
+        histogram.bucket_count_ = (uint32_t)metric->bounds.size();
+        histogram.bounds_ = metric->bounds.data();
+    }
+    return histogram;
+}
+
+void MetricsRegistry::AddCollector(
+    std::function<void(std::string *)> collector) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    collectors_.push_back(std::move(collector));
+}
+
+std::string MetricsRegistry::Label(std::string const &key,
+                                   std::string const &value) {
+    std::string label = key + "=\"";
+    for (char c: value) {
+        if (c == '\\' || c == '"') {
+            label += '\\';
+            label += c;
+        } else if (c == '\n') {
+            label += "\\n";
+        } else {
+            label += c;
+        }
+    }
+    label += '"';
+    return label;
+}
+
+uint64_t MetricsRegistry::Sum(uint32_t slot) const {
+    uint64_t sum = retired_[slot];
+    for (auto const *slots: threads_) {
+        sum += slots[slot].load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+void MetricsRegistry::ExposeMetric(Metric const &metric,
+                                   std::string *out) const {
+    std::string const &labels = metric.labels;
+    char value[32];
+    switch (metric.type) {
+    case Type::COUNTER:
+        snprintf(value, sizeof(value), "%llu",
+                 (unsigned long long)Sum(metric.slot));
+        *out += metric.name + (labels.empty() ? "" : "{" + labels + "}") +
+                " " + value + "\n";
+        break;
+    case Type::GAUGE:
+        snprintf(value, sizeof(value), "%lld",
+                 (long long)metric.gauge.load(std::memory_order_relaxed));
+        *out += metric.name + (labels.empty() ? "" : "{" + labels + "}") +
+                " " + value + "\n";
+        break;
+    case Type::HISTOGRAM: {
+        // 导出的桶是累计的
+        std::string prefix = labels.empty() ? "" : labels + ",";
+        size_t n = metric.bounds.size();
+        uint64_t count = 0;
+        for (size_t i = 0; i <= n; i++) {
+            count += Sum(metric.slot + (uint32_t)i);
+            std::string le =
+                i < n ? std::to_string(metric.bounds[i]) : std::string("+Inf");
+            snprintf(value, sizeof(value), "%llu", (unsigned long long)count);
+            *out += metric.name + "_bucket{" + prefix + "le=\"" + le + "\"} " +
+                    value + "\n";
+        }
+        std::string suffix = labels.empty() ? "" : "{" + labels + "}";
+        snprintf(value, sizeof(value), "%llu",
+                 (unsigned long long)Sum(metric.slot + (uint32_t)n + 1));
+        *out += metric.name + "_sum" + suffix + " " + value + "\n";
+        snprintf(value, sizeof(value), "%llu", (unsigned long long)count);
+        *out += metric.name + "_count" + suffix + " " + value + "\n";
+        break;
+    }
+    }
+}
+
+std::string MetricsRegistry::Expose() {
+    static char const *const kTypeNames[] = {"counter", "gauge", "histogram"};
+    std::lock_guard<std::mutex> lk(mutex_);
+    std::string out;
+    // 同名的指标放在一起, 只写一次HELP和TYPE
+    std::vector<bool> done(metrics_.size(), false);
+    for (size_t i = 0; i < metrics_.size(); i++) {
+        if (done[i]) {
+            continue;
+        }
+        Metric const &first = *metrics_[i];
+        out += "# HELP " + first.name + " " + first.help + "\n";
+        out += "# TYPE " + first.name + " " + kTypeNames[(int)first.type] +
+               "\n";
+        for (size_t j = i; j < metrics_.size(); j++) {
+            if (!done[j] && metrics_[j]->name == first.name) {
+                ExposeMetric(*metrics_[j], &out);
+                done[j] = true;
+            }
+        }
+    }
+    for (auto const &collector: collectors_) {
+        collector(&out);
+    }
+    return out;
+}
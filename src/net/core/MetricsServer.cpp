@@ -0,0 +1,136 @@
+#include "Log/logger.hpp"
+#include "net/LatencyTracker.hpp"
+#include "net/Metrics.hpp"
+#include "net/Tracer.hpp"
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/streambuf.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/system/error_code.hpp>
+#include <istream>
+#include <memory>
+#include <net/MetricsServer.hpp>
+#include <string>
+
+using tcp = boost::asio::ip::tcp;
+
+// 请求头的上限, 抓取请求只有几行
+static size_t const kMaxRequestSize = 8192;
+
+struct MetricsServer::HttpConnection {
+    explicit HttpConnection(boost::asio::io_context &ioc)
+        : socket(ioc),
+          request(kMaxRequestSize) {}
+
+    tcp::socket socket;
+    boost::asio::streambuf request;
+    std::string response;
+};
+
+MetricsServer::MetricsServer(std::string const &address, uint16_t port)
+    : acceptor_(ioc_),
+      address_(address),
+      port_(port) {}
+
+MetricsServer::~MetricsServer() {
+    Stop();
+}
+
+bool MetricsServer::Start() {
+    boost::system::error_code ec;
+    tcp::endpoint endpoint(boost::asio::ip::make_address(address_, ec), port_);
+    if (!ec) {
+        acceptor_.open(endpoint.protocol(), ec);
+    }
+    if (!ec) {
+        acceptor_.set_option(tcp::acceptor::reuse_address(true), ec);
+        acceptor_.bind(endpoint, ec);
+    }
+    if (!ec) {
+        acceptor_.listen(boost::asio::socket_base::max_listen_connections, ec);
+    }
+    if (ec) {
+        LOG_ERROR("metrics server listen on %s:%hu failed: %s",
+                  address_.c_str(), port_, ec.message().c_str());
+        return false;
+    }
+    StartAccept();
+    thread_ = std::thread([this]() {
+        Tracer::SetThreadName("metrics");
+        ioc_.run();
+    });
+    return true;
+}
+
+void MetricsServer::Stop() {
+    ioc_.stop();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void MetricsServer::StartAccept() {
+    auto conn = std::make_shared<HttpConnection>(ioc_);
+    acceptor_.async_accept(
+        conn->socket, [this, conn](boost::system::error_code const &ec) {
+            if (!ec) {
+                boost::asio::async_read_until(
+                    conn->socket, conn->request, "\r\n\r\n",
+                    [this, conn](boost::system::error_code const &ec,
+                                 size_t) {
+                        if (!ec) {
+                            HandleRequest(conn);
+                        }
+                    });
+            }
+            if (ec != boost::asio::error::operation_aborted) {
+                StartAccept();
+            }
+        });
+}
+
+void MetricsServer::HandleRequest(std::shared_ptr<HttpConnection> conn) {
+    std::istream stream(&conn->request);
+    std::string method;
+    std::string target;
+    stream >> method >> target;
+
+    std::string status = "200 OK";
+    std::string type = "text/plain; version=0.0.4; charset=utf-8";
+    std::string body;
+    LatencyTracker &tracker = LatencyTracker::Instance();
+    if (target == "/metrics" && method == "GET") {
+        body = MetricsRegistry::Instance().Expose();
+    } else if (target == "/latency" && method == "GET") {
+        type = "text/plain";
+        body = std::string("enabled: ") +
+               (LatencyTracker::IsEnabled() ? "true" : "false") + "\n" +
+               tracker.GetReport();
+    } else if ((target == "/latency/on" || target == "/latency/off" ||
+                target == "/latency/reset") &&
+               method == "POST") {
+        // 打开时清掉上次的数据
+        type = "text/plain";
+        if (target != "/latency/off") {
+            tracker.Reset();
+        }
+        if (target != "/latency/reset") {
+            tracker.SetEnabled(target == "/latency/on");
+        }
+        body = "ok\n";
+    } else if (target == "/metrics" || target.compare(0, 8, "/latency") == 0) {
+        status = "405 Method Not Allowed";
+        type = "text/plain";
+    } else {
+        status = "404 Not Found";
+        type = "text/plain";
+    }
+    conn->response = "HTTP/1.1 " + status + "\r\nContent-Type: " + type +
+                     "\r\nContent-Length: " + std::to_string(body.size()) +
+                     "\r\nConnection: close\r\n\r\n" + body;
+    boost::asio::async_write(
+        conn->socket, boost::asio::buffer(conn->response),
+        [conn](boost::system::error_code const &, size_t) {
+            boost::system::error_code ignored;
+            conn->socket.shutdown(tcp::socket::shutdown_both, ignored);
+        });
+}
@@ -0,0 +1,269 @@
+#include "net/Clock.hpp"
+#include "net/Rtcp.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <netinet/in.h>
+#include <random>
+#include <string>
+#include <unistd.h>
+
+// 1900-01-01 到 1970-01-01 的秒数
+static const uint64_t kNtpUnixOffset = 2208988800ull;
+
+uint64_t GetNtpTime() {
+    int64_t us = Clock::WallUs();
+    uint64_t sec = (uint64_t)us / 1000000 + kNtpUnixOffset;
+    uint64_t frac = (((uint64_t)us % 1000000) << 32) / 1000000;
+    return (sec << 32) | frac;
+}
+
+std::string const &GetRtcpCname() {
+    static std::string const cname = []() {
+        char host[64] = {0};
+        if (gethostname(host, sizeof(host) - 1) != 0 || host[0] == '\0') {
+            strcpy(host, "localhost");
+        }
+        return std::string("rtsp@") + host;
+    }();
+    return cname;
+}
+
+static inline void Put16(uint8_t *p, uint16_t v) {
+    v = htons(v);
+    memcpy(p, &v, 2);
+}
+
+static inline void Put32(uint8_t *p, uint32_t v) {
+    v = htonl(v);
+    memcpy(p, &v, 4);
+}
+
+size_t BuildSenderReport(uint8_t *buf, size_t capacity, uint32_t ssrc,
+                         uint64_t ntp_time, uint32_t rtp_ts,
+                         uint32_t packet_count, uint32_t octet_count) {
+    std::string const &cname = GetRtcpCname();
+    size_t cname_len = cname.size() > 255 ? 255 : cname.size();
+    // SDES: 头部4 + SSRC 4 + 类型1 + 长度1 + CNAME + 结束符, 补齐到4字节
+    size_t sdes_size = (4 + 4 + 2 + cname_len + 1 + 3) & ~(size_t)3;
+    if (capacity < RTCP_SR_SIZE + sdes_size) {
+        return 0;
+    }
+
+    uint8_t *p = buf;
+    p[0] = 0x80; // V=2 P=0 RC=0
+    p[1] = RTCP_SR;
+    Put16(p + 2, RTCP_SR_SIZE / 4 - 1);
+    // ssrc与RTP头部一致, 调用者传入的是网络序
+    memcpy(p + 4, &ssrc, 4);
+    Put32(p + 8, (uint32_t)(ntp_time >> 32));
+    Put32(p + 12, (uint32_t)ntp_time);
+    Put32(p + 16, rtp_ts);
+    Put32(p + 20, packet_count);
+    Put32(p + 24, octet_count);
+
+    p = buf + RTCP_SR_SIZE;
+    memset(p, 0, sdes_size);
+    p[0] = 0x81; // V=2 P=0 SC=1
+    p[1] = RTCP_SDES;
+    Put16(p + 2, (uint16_t)(sdes_size / 4 - 1));
+    memcpy(p + 4, &ssrc, 4);
+    p[8] = RTCP_SDES_CNAME;
+    p[9] = (uint8_t)cname_len;
+    memcpy(p + 10, cname.data(), cname_len);
+    // 剩下的0是item列表的结束符和填充
+
+    return RTCP_SR_SIZE + sdes_size;
+}
+
+size_t BuildXrDlrr(uint8_t *buf, size_t capacity, uint32_t ssrc,
+                   uint32_t sub_ssrc, uint32_t lrr, uint32_t dlrr) {
+    if (capacity < RTCP_DLRR_SIZE) {
+        return 0;
+    }
+    uint8_t *p = buf;
+    p[0] = 0x80;
+    p[1] = RTCP_XR;
+    Put16(p + 2, RTCP_DLRR_SIZE / 4 - 1);
+    memcpy(p + 4, &ssrc, 4);
+    p[8] = RTCP_XR_DLRR;
+    p[9] = 0;
+    Put16(p + 10, 3);
+    Put32(p + 12, sub_ssrc);
+    Put32(p + 16, lrr);
+    Put32(p + 20, dlrr);
+    return RTCP_DLRR_SIZE;
+}
+
+static inline uint32_t Get32(uint8_t const *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return ntohl(v);
+}
+
+size_t NextRtcpPacket(uint8_t const *data, size_t size, RtcpPacketView *pkt) {
+    if (size < 4 || (data[0] >> 6) != 2) {
+        return 0;
+    }
+    size_t len = ((size_t)(data[2] << 8 | data[3]) + 1) * 4;
+    if (len > size) {
+        return 0;
+    }
+    size_t padding = 0;
+    if (data[0] & 0x20) {
+        // 填充只允许出现在复合包的最后一个包
+        padding = data[len - 1];
+        if (padding == 0 || padding > len - 4) {
+            return 0;
+        }
+    }
+    pkt->type = data[1];
+    pkt->count = data[0] & 0x1f;
+    pkt->body = data + 4;
+    pkt->body_size = len - 4 - padding;
+    return len;
+}
+
+void ParseReportBlock(uint8_t const *data, RtcpReportBlock *block) {
+    block->ssrc = Get32(data);
+    block->fraction_lost = data[4];
+    // 24位有符号数
+    int32_t lost = (int32_t)(data[5] << 16 | data[6] << 8 | data[7]);
+    if (lost & 0x800000) {
+        lost |= (int32_t)0xff000000;
+    }
+    block->cumulative_lost = lost;
+    block->highest_seq = Get32(data + 8);
+    block->jitter = Get32(data + 12);
+    block->lsr = Get32(data + 16);
+    block->dlsr = Get32(data + 20);
+}
+
+bool ParseXrRrtr(uint8_t const *body, size_t size, uint32_t *ssrc,
+                 uint32_t *ntp) {
+    if (size < 4) {
+        return false;
+    }
+    size_t offset = 4;
+    while (offset + 4 <= size) {
+        uint8_t const *block = body + offset;
+        size_t block_len = ((size_t)(block[2] << 8 | block[3]) + 1) * 4;
+        if (offset + block_len > size) {
+            return false;
+        }
+        if (block[0] == RTCP_XR_RRTR && block_len == 12) {
+            *ssrc = Get32(body);
+            *ntp = Get32(block + 4) << 16 | Get32(block + 8) >> 16;
+            return true;
+        }
+        offset += block_len;
+    }
+    return false;
+}
+
+bool ParseTransportFeedback(uint8_t const *body, size_t size,
+                            TransportFeedback *fb) {
+    // 发送者SSRC 4 + 媒体SSRC 4 + 基准序号 2 + 包数 2 + 参考时间 3 + 反馈计数 1
+    if (size < 16) {
+        return false;
+    }
+    fb->media_ssrc = Get32(body + 4);
+    fb->base_seq = (uint16_t)(body[8] << 8 | body[9]);
+    fb->status_count = (uint16_t)(body[10] << 8 | body[11]);
+    // 参考时间是24位有符号数, 单位64ms
+    int32_t reference = (int32_t)(body[12] << 16 | body[13] << 8 | body[14]);
+    if (reference & 0x800000) {
+        reference |= (int32_t)0xff000000;
+    }
+    fb->reference_time_us = (int64_t)reference * 64000;
+    fb->fb_count = body[15];
+    fb->packets.clear();
+
+    // 状态块: 游程编码, 或者14个1位/7个2位的状态向量.
+    // 状态0未收到, 1收到且间隔用1字节表示, 2收到且间隔用2字节表示
+    size_t offset = 16;
+    uint16_t seq = fb->base_seq;
+    while (fb->packets.size() < fb->status_count) {
+        if (offset + 2 > size) {
+            return false;
+        }
+        uint16_t chunk = (uint16_t)(body[offset] << 8 | body[offset + 1]);
+        offset += 2;
+        size_t remain = fb->status_count - fb->packets.size();
+        if ((chunk & 0x8000) == 0) {
+            uint8_t symbol = (chunk >> 13) & 0x03;
+            size_t run = std::min<size_t>(chunk & 0x1fff, remain);
+            for (size_t i = 0; i < run; i++) {
+                fb->packets.push_back({seq++, symbol != 0, (int64_t)symbol});
+            }
+        } else if ((chunk & 0x4000) == 0) {
+            size_t n = std::min<size_t>(14, remain);
+            for (size_t i = 0; i < n; i++) {
+                uint8_t symbol = (chunk >> (13 - i)) & 0x01;
+                fb->packets.push_back({seq++, symbol != 0, (int64_t)symbol});
+            }
+        } else {
+            size_t n = std::min<size_t>(7, remain);
+            for (size_t i = 0; i < n; i++) {
+                uint8_t symbol = (chunk >> (12 - 2 * i)) & 0x03;
+                fb->packets.push_back({seq++, symbol != 0, (int64_t)symbol});
+            }
+        }
+    }
+
+    // 到达时间间隔, 单位250us, 第一个相对参考时间. 解析状态时arrival_us暂存符号
+    int64_t arrival_us = fb->reference_time_us;
+    for (auto &pkt: fb->packets) {
+        if (!pkt.received) {
+            continue;
+        }
+        if (pkt.arrival_us == 1) {
+            if (offset + 1 > size) {
+                return false;
+            }
+            arrival_us += (int64_t)body[offset] * 250;
+            offset += 1;
+        } else if (pkt.arrival_us == 2) {
+            if (offset + 2 > size) {
+                return false;
+            }
+            arrival_us +=
+                (int64_t)(int16_t)(body[offset] << 8 | body[offset + 1]) * 250;
+            offset += 2;
+        } else {
+            return false;
+        }
+        pkt.arrival_us = arrival_us;
+    }
+    return true;
+}
+
+double RtcpInterval(int members, int senders, double rtcp_bw, bool we_sent,
+                    double avg_rtcp_size, bool initial) {
+    // 随机化后期望值偏小, 除以e-3/2来补偿
+    double const compensation = 2.71828 - 1.5;
+    double rtcp_min_time = initial ? RTCP_MIN_TIME / 2 : RTCP_MIN_TIME;
+
+    // 发送者少于1/4时, 给发送者分1/4的RTCP带宽
+    int n = members;
+    if (senders <= members * 0.25) {
+        if (we_sent) {
+            rtcp_bw *= 0.25;
+            n = senders;
+        } else {
+            rtcp_bw *= 0.75;
+            n -= senders;
+        }
+    }
+
+    double t = rtcp_bw > 0 ? avg_rtcp_size * n / rtcp_bw : 0;
+    if (t < rtcp_min_time) {
+        t = rtcp_min_time;
+    }
+
+    // 虚拟时钟下用固定的种子, 仿真可以复现
+    static thread_local std::mt19937 rng(
+        Clock::IsVirtual() ? 5489u : std::random_device{}());
+    std::uniform_real_distribution<double> dist(0.5, 1.5);
+    return t * dist(rng) / compensation;
+}
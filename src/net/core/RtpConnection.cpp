@@ -1,16 +1,25 @@
 #include "Log/logger.hpp"
+#include "net/Clock.hpp"
 #include "net/const.hpp"
 #include "net/IOServicePool.hpp"
+#include "net/LatencyTracker.hpp"
 #include "net/LogicSystem.hpp"
 #include "net/media.hpp"
+#include "net/Metrics.hpp"
 #include "net/MsgNode.hpp"
+#include "net/Rtcp.hpp"
 #include "net/Rtp.hpp"
 #include "net/RtspConnection.hpp"
+#include "net/Tracer.hpp"
+#include <algorithm>
+#include <array>
 #include <boost/asio/buffer.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/ip/udp.hpp>
+#include <boost/asio/post.hpp>
 #include <boost/asio/read.hpp>
 #include <boost/asio/write.hpp>
+#include <climits>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
@@ -21,6 +30,57 @@
 #include <random>
 #include <string>
 
+namespace {
+
+// 所有RTP连接共用的指标, 在发送线程和收RTCP的线程中计数
+struct RtpMetrics {
+    Counter udp_packets;
+    Counter udp_bytes;
+    Counter tcp_packets;
+    Counter tcp_bytes;
+    Counter socket_drops;
+    Counter send_errors;
+    Counter thinned_frames;
+    Counter fec_packets;
+    Counter rtcp_packets;
+    Counter nack_packets;
+    Counter retransmits;
+
+    RtpMetrics() {
+        auto &registry = MetricsRegistry::Instance();
+        std::string udp = MetricsRegistry::Label("transport", "udp");
+        std::string tcp = MetricsRegistry::Label("transport", "tcp");
+        udp_packets = registry.AddCounter(
+            "rtp_packets_sent_total", "RTP packets sent to clients", udp);
+        tcp_packets = registry.AddCounter(
+            "rtp_packets_sent_total", "RTP packets sent to clients", tcp);
+        udp_bytes = registry.AddCounter(
+            "rtp_bytes_sent_total", "RTP bytes sent to clients", udp);
+        tcp_bytes = registry.AddCounter(
+            "rtp_bytes_sent_total", "RTP bytes sent to clients", tcp);
+        socket_drops = registry.AddCounter(
+            "rtp_socket_drops_total",
+            "RTP packets dropped because the UDP send buffer was full");
+        send_errors = registry.AddCounter("rtp_send_errors_total",
+                                          "RTP sends that failed");
+        thinned_frames = registry.AddCounter(
+            "rtp_thinned_frames_total",
+            "Frames dropped by per-client congestion control");
+        fec_packets = registry.AddCounter("rtp_fec_packets_sent_total",
+                                          "FEC packets sent to clients");
+        rtcp_packets = registry.AddCounter("rtcp_packets_received_total",
+                                           "RTCP packets received");
+        nack_packets = registry.AddCounter(
+            "rtp_nack_requests_total", "Packets requested by client NACKs");
+        retransmits = registry.AddCounter("rtp_retransmits_total",
+                                          "Packets retransmitted for NACKs");
+    }
+};
+
+RtpMetrics rtp_metrics;
+
+} // namespace
+
 RtpConnect::RtpConnect(std::shared_ptr<RtspConnect> con)
     : rtsp_con_(con),
       tcp_socket_(nullptr) {
@@ -35,9 +95,10 @@ RtpConnect::RtpConnect(std::shared_ptr<RtspConnect> con)
         media_channel_info_[chn].rtp_header.ts = htonl(rd());
         media_channel_info_[chn].rtp_header.ssrc = htonl(rd());
     }
+    // 仿真时没有RTSP连接
     auto conn = rtsp_con_.lock();
-    rtsp_ip_ = conn->GetIp();
-    rtsp_port_ = conn->GetPort();
+    rtsp_ip_ = conn ? conn->GetIp() : "";
+    rtsp_port_ = conn ? conn->GetPort() : 0;
 }
 
 bool RtpConnect::RtcpAsyncRead(MediaChannelID channel_id) {
@@ -62,23 +123,22 @@ bool RtpConnect::SetupRtpOverUdp(MediaChannelID channel_id, uint16_t rtp_port,
 
     std::random_device rd;
     for (int i = 0; i < 10; ++i) {
-        if (i == 10) {
-            return false;
-        }
         local_rtp_ports[channel_id] = rd() % 0xfffe;
         local_rtcp_ports[channel_id] = local_rtp_ports[channel_id] + 1;
 
+        // 端口可能被别的会话或本机的其他程序占用, 换一个再试
         auto &rtp_ioc = IOServicePool::GetInstance()->GetService();
         rtp_sockets_[channel_id] =
             std::make_unique<boost::asio::ip::udp::socket>(
                 rtp_ioc, boost::asio::ip::udp::v4());
         boost::system::error_code ec;
-        try {
-            rtp_sockets_[channel_id]->bind(boost::asio::ip::udp::endpoint(
-                boost::asio::ip::udp::v4(), local_rtp_ports[channel_id]));
-        } catch (boost::system::error_code &ec) {
+        rtp_sockets_[channel_id]->bind(
+            boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(),
+                                           local_rtp_ports[channel_id]),
+            ec);
+        if (ec) {
             rtp_sockets_[channel_id].reset();
-            LOG_DEBUG("bind rtp port failed: %s", ec.message().c_str());
+            LOG_ERROR("bind rtp port failed: %s", ec.message().c_str());
             continue;
         }
 
@@ -86,18 +146,23 @@ bool RtpConnect::SetupRtpOverUdp(MediaChannelID channel_id, uint16_t rtp_port,
         rtcp_sockets_[channel_id] =
             std::make_unique<boost::asio::ip::udp::socket>(
                 rtcp_ioc, boost::asio::ip::udp::v4());
-        try {
-            rtcp_sockets_[channel_id]->bind(boost::asio::ip::udp::endpoint(
-                boost::asio::ip::udp::v4(), local_rtcp_ports[channel_id]));
-        } catch (boost::system::error_code &ec) {
+        rtcp_sockets_[channel_id]->bind(
+            boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(),
+                                           local_rtcp_ports[channel_id]),
+            ec);
+        if (ec) {
             rtp_sockets_[channel_id].reset();
             rtcp_sockets_[channel_id].reset();
-            LOG_DEBUG("bind rtcp port failed: %s", ec.message().c_str());
+            LOG_ERROR("bind rtcp port failed: %s", ec.message().c_str());
             continue;
         }
         break;
     }
+    if (!rtp_sockets_[channel_id]) {
+        return false;
+    }
 
+    rtp_sockets_[channel_id]->non_blocking(true);
     peer_rtp_addr_[channel_id].addr = peer_endpoint_.address().to_v4();
     peer_rtp_addr_[channel_id].port = media_channel_info_[channel_id].rtp_port;
     peer_rtcp_addr_[channel_id].addr = peer_endpoint_.address().to_v4();
@@ -122,6 +187,17 @@ bool RtpConnect::SetupRtpOverTcp(MediaChannelID channel_id,
     return true;
 }
 
+bool RtpConnect::SetupRtpOverTransport(
+    MediaChannelID channel_id, std::shared_ptr<PacketTransport> transport) {
+    if (!transport) {
+        return false;
+    }
+    transports_[channel_id] = std::move(transport);
+    media_channel_info_[channel_id].is_setup = true;
+    transport_mode_ = TransportMode::RTP_OVER_UDP;
+    return true;
+}
+
 void RtpConnect::Play() {
     for (int i = 0; i < MAX_MEDIA_CHANNEL; i++) {
         if (media_channel_info_[i].is_setup) {
@@ -136,30 +212,254 @@ void RtpConnect::TearDown() {
         for (int chn = 0; chn < MAX_MEDIA_CHANNEL; chn++) {
             media_channel_info_[chn].is_play = false;
             media_channel_info_[chn].is_record = false;
+            // 取消挂起的RTCP读, 否则读回调持有的引用让本对象一直不释放.
+            // RTP socket可能正被推流线程使用, 随本对象析构关闭
+            if (rtcp_sockets_[chn]) {
+                auto self = shared_from_this();
+                boost::asio::post(rtcp_sockets_[chn]->get_executor(),
+                                  [self, chn]() {
+                                      boost::system::error_code ec;
+                                      self->rtcp_sockets_[chn]->close(ec);
+                                  });
+            }
         }
     }
 }
 
-int RtpConnect::SendRtpPacket(MediaChannelID channel_id, RtpPacket pkt) {
+int RtpConnect::SendRtpPacket(MediaChannelID channel_id, RtpPacket pkt,
+                              uint64_t history_index, FramePriority priority) {
+    std::lock_guard<std::mutex> lk(send_mutex_);
+    if (is_trick_play_) {
+        return -1;
+    }
+    if (cc_[channel_id].enable && ShouldDrop(channel_id, pkt, priority)) {
+        return 0;
+    }
+    return SendPacket(channel_id, pkt, history_index);
+}
+
+bool RtpConnect::ShouldDrop(MediaChannelID channel_id, RtpPacket const &pkt,
+                            FramePriority priority) {
+    auto &cc = cc_[channel_id];
+    // 整帧丢弃, 只在帧的第一个包上做决定
+    if (cc.frame_done) {
+        // 还有更低的编码可切时不抽帧
+        ThinningLevel level = has_lower_rendition_[channel_id]
+                                  ? ThinningLevel::NONE
+                                  : cc.controller.GetLevel();
+        if (priority == FramePriority::KEY) {
+            cc.need_key = false;
+            cc.dropping = false;
+        } else if (cc.need_key || level == ThinningLevel::KEY_FRAME_ONLY) {
+            // 丢了参考帧, 后面的帧在下一个关键帧之前都解不出来
+            cc.need_key = true;
+            cc.dropping = true;
+        } else {
+            cc.dropping = level == ThinningLevel::DROP_DISPOSABLE &&
+                          priority == FramePriority::DISPOSABLE;
+        }
+        if (cc.dropping) {
+            cc.dropped_frames.fetch_add(1, std::memory_order_relaxed);
+            rtp_metrics.thinned_frames.Add();
+        }
+    }
+    cc.frame_done = pkt.last != 0;
+    return cc.dropping;
+}
+
+void RtpConnect::SetCongestionControl(MediaChannelID channel_id, bool enable) {
+    cc_[channel_id].enable =
+        enable && transport_mode_ == TransportMode::RTP_OVER_UDP;
+}
+
+CongestionStats RtpConnect::GetCongestionStats(MediaChannelID channel_id) const {
+    auto const &cc = cc_[channel_id];
+    CongestionStats stats = cc.controller.GetStats();
+    stats.dropped_frames = cc.dropped_frames.load(std::memory_order_relaxed);
+    stats.socket_drops = cc.socket_drops.load(std::memory_order_relaxed);
+    return stats;
+}
+
+int RtpConnect::SendTrickPacket(MediaChannelID channel_id, RtpPacket pkt) {
+    std::lock_guard<std::mutex> lk(send_mutex_);
+    if (!is_trick_play_) {
+        return -1;
+    }
+    return SendPacket(channel_id, pkt, RtpHistory::kNoIndex);
+}
+
+void RtpConnect::SetFecEnabled(MediaChannelID channel_id, bool enable) {
+    auto &fec = fec_[channel_id];
+    if (!enable || transport_mode_ != TransportMode::RTP_OVER_UDP) {
+        fec.enable = false;
+        return;
+    }
+    std::random_device rd;
+    fec.ssrc = rd();
+    fec.seq = rd() & 0xffff;
+    fec.group_count = 0;
+    fec.enable = true;
+}
+
+int RtpConnect::SendFecPacket(MediaChannelID channel_id, FecPacket const &fec) {
+    std::lock_guard<std::mutex> lk(send_mutex_);
+    auto &state = fec_[channel_id];
+    if (!state.enable || is_closed_ || is_trick_play_) {
+        return -1;
+    }
+    // 中途加入或者这一组有包没发(还没等到关键帧), 这一组不能恢复
+    auto &ext = ext_[channel_id];
+    uint8_t ext_xor[RTP_EXT_MAX_SIZE];
+    memcpy(ext_xor, ext.ext_xor, sizeof(ext_xor));
+    memset(ext.ext_xor, 0, sizeof(ext.ext_xor));
+    uint8_t group_count = state.group_count;
+    state.group_count = 0;
+    if (group_count != fec.group_size) {
+        return -1;
+    }
+
+    // RTP头 + FEC头(填上本客户端的SN base), 后面是共享的部分
+    uint8_t header[RTP_HEADER_SIZE + FEC_HEADER_SIZE + FEC_LEVEL_HEADER_SIZE];
+    uint16_t seq = state.seq++;
+    uint16_t sn_base =
+        (uint16_t)(media_channel_info_[channel_id].packet_seq - fec.group_size);
+    header[0] = RTP_VERSION << 6;
+    header[1] = (uint8_t)((RTP_FEC_PAYLOAD_BASE + channel_id) & 0x7f);
+    header[2] = (uint8_t)(seq >> 8);
+    header[3] = (uint8_t)(seq & 0xff);
+    uint32_t ts = htonl(fec.timestamp);
+    uint32_t ssrc = htonl(state.ssrc);
+    memcpy(header + 4, &ts, 4);
+    memcpy(header + 8, &ssrc, 4);
+    memcpy(header + RTP_HEADER_SIZE, fec.header, FEC_HEADER_SIZE);
+    header[RTP_HEADER_SIZE + 2] = (uint8_t)(sn_base >> 8);
+    header[RTP_HEADER_SIZE + 3] = (uint8_t)(sn_base & 0xff);
+
+    // 带头部扩展时, 被保护的是扩展 + 负载: X恢复位、长度恢复和保护长度
+    // 都要算上扩展, 异或结果的前面是本客户端扩展的异或, 后面接共享的负载异或
+    size_t ext_size = ext.header.size;
+    size_t header_size = RTP_HEADER_SIZE + FEC_HEADER_SIZE;
+    if (ext_size != 0) {
+        uint8_t *fec_header = header + RTP_HEADER_SIZE;
+        if (fec.group_size & 1) {
+            fec_header[0] ^= 0x10;
+        }
+        uint16_t length = 0;
+        for (int i = 0; i < fec.group_size; i++) {
+            length ^= (uint16_t)(fec.sizes[i] + ext_size);
+        }
+        fec_header[8] = (uint8_t)(length >> 8);
+        fec_header[9] = (uint8_t)(length & 0xff);
+        uint8_t *level = header + header_size;
+        uint8_t const *shared_level = fec.body.get();
+        uint16_t protect_len =
+            (uint16_t)(fec.body_size - FEC_LEVEL_HEADER_SIZE + ext_size);
+        level[0] = (uint8_t)(protect_len >> 8);
+        level[1] = (uint8_t)(protect_len & 0xff);
+        level[2] = shared_level[2];
+        level[3] = shared_level[3];
+        header_size += FEC_LEVEL_HEADER_SIZE;
+    }
+    size_t skip = ext_size != 0 ? FEC_LEVEL_HEADER_SIZE : 0;
+    std::array<boost::asio::const_buffer, 3> buffers = {
+        boost::asio::buffer(header, header_size),
+        boost::asio::buffer(ext_xor, ext_size),
+        boost::asio::buffer(fec.body.get() + skip, fec.body_size - skip)};
+    boost::system::error_code ec;
+    SendDatagram(channel_id, buffers, ec);
+    if (ec && ec != boost::asio::error::would_block) {
+        rtp_metrics.send_errors.Add();
+        LOG_WARN_RATE(10, "send fec failed: %s", ec.message().c_str());
+        return -1;
+    }
+    if (!ec) {
+        rtp_metrics.fec_packets.Add();
+    }
+    return 0;
+}
+
+void RtpConnect::SetRtpHistory(MediaChannelID channel_id,
+                               std::shared_ptr<RtpHistory> history,
+                               bool use_rtx) {
+    auto &rtx = rtx_[channel_id];
+    if (!history || transport_mode_ != TransportMode::RTP_OVER_UDP) {
+        // TCP不会丢包, 不需要重传
+        return;
+    }
+    rtx.sent.reset(new std::atomic<uint64_t>[kNackSeqWindow]);
+    rtx.last_rtx_ms.reset(new uint32_t[kNackSeqWindow]());
+    for (size_t i = 0; i < kNackSeqWindow; i++) {
+        rtx.sent[i].store(0, std::memory_order_relaxed);
+    }
+    std::random_device rd;
+    rtx.use_rtx = use_rtx;
+    rtx.payload_type = media_channel_info_[channel_id].rtp_header.payload;
+    rtx.rtx_ssrc = rd();
+    rtx.rtx_seq = rd() & 0xffff;
+    rtx.history = std::move(history);
+}
+
+void RtpConnect::SetRtpExtensions(MediaChannelID channel_id,
+                                  RtpExtensionMap const &extensions) {
+    auto &ext = ext_[channel_id];
+    ext.header.Build(extensions);
+    if (ext.header.transport_seq_offset < 0 ||
+        transport_mode_ != TransportMode::RTP_OVER_UDP) {
+        // TCP不会丢包, 不需要处理反馈
+        return;
+    }
+    ext.sent.reset(new std::atomic<uint64_t>[kTransportSeqWindow]);
+    for (size_t i = 0; i < kTransportSeqWindow; i++) {
+        ext.sent[i].store(0, std::memory_order_relaxed);
+    }
+    std::random_device rd;
+    ext.transport_seq = rd() & 0xffff;
+}
+
+int RtpConnect::SendPacket(MediaChannelID channel_id, RtpPacket pkt,
+                           uint64_t history_index) {
     if (is_closed_) {
         return -1;
     }
 
-    auto rtsp_conn = rtsp_con_.lock();
-    if (!rtsp_conn) {
+    // RTSP连接断开就不再发; 仿真的传输没有RTSP连接
+    if (!transports_[channel_id] && rtsp_con_.expired()) {
         return -1;
     }
 
     this->SetFrameType(pkt.type);
-    this->SetRtpHeader(channel_id, pkt);
     int ret = 0;
     if ((media_channel_info_[channel_id].is_play ||
          media_channel_info_[channel_id].is_record) &&
         has_key_frame_) {
+        // 每个客户端只生成自己的头部, 负载由所有客户端共享
+        uint8_t
+            header[RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE + RTP_EXT_MAX_SIZE];
+        uint16_t seq = media_channel_info_[channel_id].packet_seq;
+        size_t header_size = this->SetRtpHeader(channel_id, pkt, header);
+        fec_[channel_id].group_count++;
+        auto &rtx = rtx_[channel_id];
+        if (rtx.sent && history_index != RtpHistory::kNoIndex) {
+            rtx.sent[seq % kNackSeqWindow].store(
+                (uint64_t)seq << 48 | ((history_index + 1) & 0xffffffffffffull),
+                std::memory_order_relaxed);
+        }
+        if (header_size > RTP_HEADER_SIZE) {
+            StampExtensions(channel_id, header + RTP_TCP_HEAD_SIZE,
+                            header_size + pkt.PayloadSize());
+        }
         if (transport_mode_ == TransportMode::RTP_OVER_UDP) {
-            ret = SendRtpOverUdp(channel_id, pkt);
+            ret = SendRtpOverUdp(channel_id, header, header_size, pkt);
         } else {
-            ret = SendRtpOverTcp(channel_id, pkt);
+            ret = SendRtpOverTcp(channel_id, header, header_size, pkt);
+        }
+        if (ret == 0) {
+            UpdateSenderReport(channel_id, pkt);
+            if (cc_[channel_id].enable) {
+                cc_[channel_id].sent_bytes.fetch_add(
+                    header_size + pkt.PayloadSize(),
+                    std::memory_order_relaxed);
+            }
         }
     }
 
@@ -170,15 +470,512 @@ void RtpConnect::HandleRead_Rtcp(boost::system::error_code const &ec,
                                  size_t bytes, std::shared_ptr<RtpConnect> con,
                                  MediaChannelID channel_id) {
     if (ec) {
-        LOG_DEBUG("read rtcp failed: {}", ec.message().c_str());
-        con->RtcpAsyncRead(channel_id);
+        // 关闭时取消读是正常的, 不算错误
+        if (ec == boost::asio::error::operation_aborted) {
+            return;
+        }
+        LOG_WARN_RATE(10, "read rtcp failed: %s", ec.message().c_str());
+        if (!con->is_closed_) {
+            con->RtcpAsyncRead(channel_id);
+        }
         return;
     } else {
-        LOG_DEBUG("msg is:%s", con->buffer);
+        con->HandleRtcp(channel_id, (uint8_t const *)con->buffer, bytes);
         con->RtcpAsyncRead(channel_id);
     }
 }
 
+void RtpConnect::HandleInterleaved(uint8_t channel, uint8_t const *data,
+                                   size_t size) {
+    if (transport_mode_ != TransportMode::RTP_OVER_TCP) {
+        return;
+    }
+    for (int chn = 0; chn < MAX_MEDIA_CHANNEL; chn++) {
+        if (media_channel_info_[chn].is_setup &&
+            media_channel_info_[chn].rtcp_channel == channel) {
+            HandleRtcp((MediaChannelID)chn, data, size);
+            return;
+        }
+    }
+    // 客户端发来的RTP或者未知通道, 丢弃
+}
+
+void RtpConnect::HandleTransportRtcp(MediaChannelID channel_id,
+                                     uint8_t const *data, size_t size) {
+    if (!transports_[channel_id] || is_closed_) {
+        return;
+    }
+    HandleRtcp(channel_id, data, size);
+}
+
+void RtpConnect::HandleRtcp(MediaChannelID channel_id, uint8_t const *data,
+                            size_t size) {
+    rtcp_packets_++;
+    rtp_metrics.rtcp_packets.Add();
+    auto conn = rtsp_con_.lock();
+    if (conn) {
+        conn->Touch();
+    }
+
+    RtcpPacketView pkt;
+    while (size > 0) {
+        size_t len = NextRtcpPacket(data, size, &pkt);
+        if (len == 0) {
+            LOG_WARN_RATE(10, "bad rtcp packet from channel %d",
+                          (int)channel_id);
+            return;
+        }
+        data += len;
+        size -= len;
+
+        // SR比RR多了20字节的发送者信息, 后面都是接收报告块
+        size_t offset = 0;
+        if (pkt.type == RTCP_SR) {
+            offset = 4 + 20;
+        } else if (pkt.type == RTCP_RR) {
+            offset = 4;
+        } else if (pkt.type == RTCP_XR) {
+            HandleXr(channel_id, pkt.body, pkt.body_size);
+            continue;
+        } else if (pkt.type == RTCP_RTPFB && pkt.count == RTCP_FB_NACK) {
+            HandleNack(channel_id, pkt.body, pkt.body_size);
+            continue;
+        } else if (pkt.type == RTCP_RTPFB &&
+                   pkt.count == RTCP_FB_TRANSPORT_CC) {
+            HandleTransportFeedback(channel_id, pkt.body, pkt.body_size);
+            continue;
+        } else if (pkt.type == RTCP_PSFB) {
+            HandlePsfb(channel_id, pkt.count, pkt.body, pkt.body_size);
+            continue;
+        } else {
+            continue;
+        }
+        for (int i = 0; i < pkt.count; i++) {
+            if (offset + RTCP_REPORT_BLOCK_SIZE > pkt.body_size) {
+                break;
+            }
+            RtcpReportBlock block;
+            ParseReportBlock(pkt.body + offset, &block);
+            HandleReportBlock(channel_id, block);
+            offset += RTCP_REPORT_BLOCK_SIZE;
+        }
+    }
+}
+
+void RtpConnect::HandleReportBlock(MediaChannelID channel_id,
+                                   RtcpReportBlock const &block) {
+    auto const &info = media_channel_info_[channel_id];
+    if (block.ssrc != ntohl(info.rtp_header.ssrc)) {
+        return;
+    }
+
+    auto &qos = qos_[channel_id];
+    qos.fraction_lost.store(block.fraction_lost, std::memory_order_relaxed);
+    qos.cumulative_lost.store(block.cumulative_lost,
+                              std::memory_order_relaxed);
+    qos.highest_seq.store(block.highest_seq, std::memory_order_relaxed);
+    qos.jitter.store(block.jitter, std::memory_order_relaxed);
+
+    // RTT = 收到RR的时刻 - LSR - DLSR, 单位1/65536秒
+    if (block.lsr != 0) {
+        uint32_t now = (uint32_t)(GetNtpTime() >> 16);
+        int32_t rtt = (int32_t)(now - block.lsr - block.dlsr);
+        if (rtt >= 0) {
+            qos.rtt_us.store((uint32_t)((uint64_t)rtt * 1000000 >> 16),
+                             std::memory_order_relaxed);
+        }
+    }
+    int64_t now_us = NowUs();
+    qos.last_report_us.store(now_us, std::memory_order_relaxed);
+    qos.report_count.fetch_add(1, std::memory_order_relaxed);
+
+    auto &cc = cc_[channel_id];
+    if (cc.enable) {
+        cc.controller.OnReport(block.fraction_lost,
+                               qos.rtt_us.load(std::memory_order_relaxed),
+                               cc.sent_bytes.load(std::memory_order_relaxed),
+                               now_us);
+    }
+
+    LOG_DEBUG("rr channel %d: lost %u/256 total %d jitter %u rtt %u us",
+              (int)channel_id, (unsigned)block.fraction_lost,
+              block.cumulative_lost, block.jitter,
+              qos.rtt_us.load(std::memory_order_relaxed));
+}
+
+void RtpConnect::HandleXr(MediaChannelID channel_id, uint8_t const *data,
+                          size_t size) {
+    uint32_t ssrc = 0;
+    uint32_t ntp = 0;
+    if (!ParseXrRrtr(data, size, &ssrc, &ntp)) {
+        return;
+    }
+    auto &qos = qos_[channel_id];
+    qos.rrtr_ssrc.store(ssrc, std::memory_order_relaxed);
+    qos.rrtr_ntp.store(ntp, std::memory_order_relaxed);
+    qos.rrtr_time_us.store(NowUs(), std::memory_order_release);
+}
+
+void RtpConnect::HandleNack(MediaChannelID channel_id, uint8_t const *data,
+                            size_t size) {
+    // 发送出错停掉的通道也不再重传
+    if (!rtx_[channel_id].history || is_closed_ ||
+        !media_channel_info_[channel_id].is_play) {
+        return;
+    }
+    // 发送者SSRC 4 + 媒体SSRC 4, 后面每4字节一个PID + BLP
+    uint32_t media_ssrc = 0;
+    if (size < 8) {
+        return;
+    }
+    memcpy(&media_ssrc, data + 4, 4);
+    if (media_ssrc != media_channel_info_[channel_id].rtp_header.ssrc) {
+        return;
+    }
+
+    int64_t now_us = NowUs();
+    for (size_t offset = 8; offset + 4 <= size; offset += 4) {
+        uint16_t pid = (uint16_t)(data[offset] << 8 | data[offset + 1]);
+        uint16_t blp = (uint16_t)(data[offset + 2] << 8 | data[offset + 3]);
+        Retransmit(channel_id, pid, now_us);
+        for (int i = 0; i < 16; i++) {
+            if (blp & (1 << i)) {
+                Retransmit(channel_id, (uint16_t)(pid + i + 1), now_us);
+            }
+        }
+    }
+}
+
+void RtpConnect::HandleTransportFeedback(MediaChannelID channel_id,
+                                         uint8_t const *data, size_t size) {
+    auto &ext = ext_[channel_id];
+    auto &cc = cc_[channel_id];
+    if (!ext.sent || !cc.enable || is_closed_) {
+        return;
+    }
+    if (!ParseTransportFeedback(data, size, &ext.feedback) ||
+        ext.feedback.media_ssrc !=
+            ntohl(media_channel_info_[channel_id].rtp_header.ssrc)) {
+        return;
+    }
+
+    int64_t now_us = NowUs();
+    if (!ext.has_feedback) {
+        ext.has_feedback = true;
+        ext.next_seq = ext.feedback.base_seq;
+        ext.window_start_us = now_us;
+        ext.window_min_delay_us = INT64_MAX;
+    }
+    for (auto const &pkt: ext.feedback.packets) {
+        // 反馈可能重复报告同一个包, 只统计新的
+        if ((int16_t)(pkt.seq - ext.next_seq) < 0) {
+            continue;
+        }
+        ext.next_seq = (uint16_t)(pkt.seq + 1);
+        uint64_t sent = ext.sent[pkt.seq % kTransportSeqWindow].load(
+            std::memory_order_relaxed);
+        if (sent == 0 || (uint16_t)(sent >> 48) != pkt.seq) {
+            continue;
+        }
+        ext.window_total++;
+        if (!pkt.received) {
+            ext.window_lost++;
+            continue;
+        }
+        // 发送时间只存了低32位, 按现在的时间还原.
+        // 单向延时包含两端时钟的差, 只用它相对基线的变化
+        int64_t send_us =
+            now_us - (uint32_t)((uint32_t)now_us - (uint32_t)sent);
+        int64_t delay_us = pkt.arrival_us - send_us;
+        ext.window_min_delay_us = std::min(ext.window_min_delay_us, delay_us);
+    }
+
+    if (now_us - ext.window_start_us < kTransportFeedbackWindowUs ||
+        ext.window_total == 0) {
+        return;
+    }
+    uint32_t queue_delay_us = 0;
+    if (ext.window_min_delay_us != INT64_MAX) {
+        ext.base_delays_us[ext.base_count++ % kBaseDelayWindows] =
+            ext.window_min_delay_us;
+        size_t n = std::min(ext.base_count, kBaseDelayWindows);
+        int64_t base_us = *std::min_element(ext.base_delays_us,
+                                            ext.base_delays_us + n);
+        queue_delay_us = (uint32_t)std::min<int64_t>(
+            ext.window_min_delay_us - base_us, UINT32_MAX);
+    }
+    cc.controller.OnTransportFeedback(
+        ext.window_lost, ext.window_total, queue_delay_us,
+        cc.sent_bytes.load(std::memory_order_relaxed), now_us);
+    ext.window_start_us = now_us;
+    ext.window_lost = 0;
+    ext.window_total = 0;
+    ext.window_min_delay_us = INT64_MAX;
+}
+
+bool RtpConnect::TakeKeyFrameReplay(MediaChannelID channel_id,
+                                    int64_t now_us, int64_t min_interval_us) {
+    if (!replay_requested_[channel_id].load(std::memory_order_relaxed) ||
+        !replay_requested_[channel_id].exchange(false)) {
+        return false;
+    }
+    if (cc_[channel_id].enable &&
+        cc_[channel_id].controller.GetLevel() != ThinningLevel::NONE) {
+        return false;
+    }
+    if (last_replay_us_[channel_id] != 0 &&
+        now_us - last_replay_us_[channel_id] < min_interval_us) {
+        return false;
+    }
+    last_replay_us_[channel_id] = now_us;
+    return true;
+}
+
+void RtpConnect::HandlePsfb(MediaChannelID channel_id, uint8_t fmt,
+                            uint8_t const *data, size_t size) {
+    if (size < 8 || is_closed_) {
+        return;
+    }
+    uint32_t ssrc = media_channel_info_[channel_id].rtp_header.ssrc;
+    if (fmt == RTCP_FB_PLI) {
+        if (memcmp(data + 4, &ssrc, 4) != 0) {
+            return;
+        }
+    } else if (fmt == RTCP_FB_FIR) {
+        // 媒体SSRC填0, 每8字节一个FCI: SSRC + 序号 + 保留.
+        // 重发的FIR序号不变, 只响应新的序号
+        bool is_new = false;
+        for (size_t offset = 8; offset + 8 <= size; offset += 8) {
+            if (memcmp(data + offset, &ssrc, 4) == 0 &&
+                data[offset + 4] != fir_seq_[channel_id]) {
+                fir_seq_[channel_id] = data[offset + 4];
+                is_new = true;
+            }
+        }
+        if (!is_new) {
+            return;
+        }
+    } else {
+        return;
+    }
+
+    LOG_DEBUG("keyframe request(%s) on channel %d",
+              fmt == RTCP_FB_PLI ? "PLI" : "FIR", (int)channel_id);
+    if (keyframe_needed_cb_) {
+        keyframe_needed_cb_(shared_from_this(), channel_id);
+    }
+}
+
+void RtpConnect::Retransmit(MediaChannelID channel_id, uint16_t seq,
+                            int64_t now_us) {
+    auto &rtx = rtx_[channel_id];
+    rtx.nack_count++;
+    rtp_metrics.nack_packets.Add();
+
+    size_t slot = seq % kNackSeqWindow;
+    uint64_t sent = rtx.sent[slot].load(std::memory_order_relaxed);
+    RtpPacket pkt(nullptr, 0);
+    if (sent == 0 || (uint16_t)(sent >> 48) != seq ||
+        !rtx.history->Get((sent & 0xffffffffffffull) - 1, &pkt)) {
+        rtx.miss_count++;
+        return;
+    }
+
+    // 同一个包一个RTT内只重传一次, 客户端重复的NACK直接忽略
+    uint32_t now_ms = (uint32_t)(now_us / 1000);
+    uint32_t rtt_ms =
+        qos_[channel_id].rtt_us.load(std::memory_order_relaxed) / 1000;
+    uint32_t min_gap_ms = std::max<uint32_t>(rtt_ms, 10);
+    if (rtx.last_rtx_ms[slot] != 0 &&
+        now_ms - rtx.last_rtx_ms[slot] < min_gap_ms) {
+        return;
+    }
+    rtx.last_rtx_ms[slot] = now_ms;
+
+    // 头部不能用media_channel_info_里的, 发送线程正在改它
+    uint8_t header[RTP_HEADER_SIZE + 2];
+    uint32_t ssrc = media_channel_info_[channel_id].rtp_header.ssrc;
+    uint8_t payload_type = rtx.payload_type;
+    uint16_t out_seq = seq;
+    size_t header_size = RTP_HEADER_SIZE;
+    if (rtx.use_rtx) {
+        // RFC 4588: 单独的SSRC和序号, 负载前加2字节原始序号
+        payload_type = (uint8_t)(RTP_RTX_PAYLOAD_BASE + channel_id);
+        ssrc = htonl(rtx.rtx_ssrc);
+        out_seq = rtx.rtx_seq++;
+        header[RTP_HEADER_SIZE] = (uint8_t)(seq >> 8);
+        header[RTP_HEADER_SIZE + 1] = (uint8_t)(seq & 0xff);
+        header_size += 2;
+    }
+    header[0] = RTP_VERSION << 6;
+    header[1] = (uint8_t)((pkt.last ? 0x80 : 0) | (payload_type & 0x7f));
+    header[2] = (uint8_t)(out_seq >> 8);
+    header[3] = (uint8_t)(out_seq & 0xff);
+    uint32_t ts = htonl(pkt.timestamp);
+    memcpy(header + 4, &ts, 4);
+    memcpy(header + 8, &ssrc, 4);
+
+    // 非阻塞socket上的同步send_to就是一次sendmsg, 可以和推流线程同时调用
+    std::array<boost::asio::const_buffer, 2> buffers = {
+        boost::asio::buffer(header, header_size),
+        boost::asio::buffer(pkt.Payload(), pkt.PayloadSize())};
+    boost::system::error_code ec;
+    SendDatagram(channel_id, buffers, ec);
+    if (!ec) {
+        rtx.rtx_count++;
+        rtp_metrics.retransmits.Add();
+    }
+}
+
+QosStats RtpConnect::GetQosStats(MediaChannelID channel_id) const {
+    auto const &qos = qos_[channel_id];
+    QosStats stats;
+    stats.report_count = qos.report_count.load(std::memory_order_relaxed);
+    stats.fraction_lost =
+        (uint8_t)qos.fraction_lost.load(std::memory_order_relaxed);
+    stats.cumulative_lost =
+        qos.cumulative_lost.load(std::memory_order_relaxed);
+    stats.highest_seq = qos.highest_seq.load(std::memory_order_relaxed);
+    stats.jitter = qos.jitter.load(std::memory_order_relaxed);
+    uint32_t clock_rate = media_channel_info_[channel_id].clock_rate;
+    if (clock_rate != 0) {
+        stats.jitter_us =
+            (uint32_t)((uint64_t)stats.jitter * 1000000 / clock_rate);
+    }
+    stats.rtt_us = qos.rtt_us.load(std::memory_order_relaxed);
+    stats.last_report_us = qos.last_report_us.load(std::memory_order_relaxed);
+    return stats;
+}
+
+int64_t RtpConnect::NowUs() {
+    return Clock::NowUs();
+}
+
+void RtpConnect::UpdateSenderReport(MediaChannelID channel_id,
+                                    RtpPacket const &pkt) {
+    // 调用者持有send_mutex_
+    auto &info = media_channel_info_[channel_id];
+    int64_t now_us = NowUs();
+    if (info.packet_count == 0 || info.last_rtp_ts != pkt.timestamp) {
+        info.last_rtp_ts = pkt.timestamp;
+        info.last_rtp_time_us = now_us;
+    }
+    info.packet_count++;
+    info.octet_count += pkt.PayloadSize();
+
+    if (info.next_rtcp_time_us == 0) {
+        // 第一个SR在RTCP_MIN_TIME的一半左右发出
+        info.avg_rtcp_size =
+            RTCP_SR_SIZE + 16 + GetRtcpCname().size() + RTCP_UDP_IP_OVERHEAD;
+        info.last_rtcp_time_us = now_us;
+        info.next_rtcp_time_us =
+            now_us + (int64_t)(RtcpInterval(2, 1, 0, true, info.avg_rtcp_size,
+                                            true) *
+                               1000000);
+        return;
+    }
+    if (now_us >= info.next_rtcp_time_us) {
+        SendSenderReport(channel_id, now_us);
+    }
+}
+
+void RtpConnect::SendSenderReport(MediaChannelID channel_id, int64_t now_us) {
+    auto &info = media_channel_info_[channel_id];
+
+    // NTP取当前时间, RTP时间戳按最近一帧加上经过的时间推算, 两者对应同一时刻
+    uint64_t ntp_time = GetNtpTime();
+    uint32_t rtp_ts = info.last_rtp_ts;
+    if (info.clock_rate != 0) {
+        rtp_ts += (uint32_t)((now_us - info.last_rtp_time_us) *
+                             (int64_t)info.clock_rate / 1000000);
+    }
+
+    uint8_t buf[RTP_TCP_HEAD_SIZE + 192];
+    size_t size = BuildSenderReport(
+        buf + RTP_TCP_HEAD_SIZE, sizeof(buf) - RTP_TCP_HEAD_SIZE,
+        info.rtp_header.ssrc, ntp_time, rtp_ts, (uint32_t)info.packet_count,
+        (uint32_t)info.octet_count);
+    if (size == 0) {
+        return;
+    }
+    // 客户端发过XR RRTR的话, 附带DLRR让它能算RTT
+    auto &qos = qos_[channel_id];
+    int64_t rrtr_time_us = qos.rrtr_time_us.load(std::memory_order_acquire);
+    if (rrtr_time_us != 0) {
+        uint32_t dlrr = (uint32_t)(((now_us - rrtr_time_us) << 16) / 1000000);
+        size += BuildXrDlrr(
+            buf + RTP_TCP_HEAD_SIZE + size,
+            sizeof(buf) - RTP_TCP_HEAD_SIZE - size, info.rtp_header.ssrc,
+            qos.rrtr_ssrc.load(std::memory_order_relaxed),
+            qos.rrtr_ntp.load(std::memory_order_relaxed), dlrr);
+    }
+    SendRtcp(channel_id, buf, size);
+
+    // 会话带宽按两次SR之间发出的字节估算, 成员只有服务器和这个客户端
+    double elapsed = (now_us - info.last_rtcp_time_us) / 1000000.0;
+    double session_bw =
+        elapsed > 0 ? (info.octet_count - info.last_rtcp_octets) / elapsed : 0;
+    info.avg_rtcp_size = (size + RTCP_UDP_IP_OVERHEAD) / 16.0 +
+                         info.avg_rtcp_size * 15.0 / 16.0;
+    info.last_rtcp_ntp_time = ntp_time;
+    info.last_rtcp_time_us = now_us;
+    info.last_rtcp_octets = info.octet_count;
+    info.next_rtcp_time_us =
+        now_us + (int64_t)(RtcpInterval(2, 1, session_bw * RTCP_BW_FRACTION,
+                                        true, info.avg_rtcp_size, false) *
+                           1000000);
+}
+
+// data前面留了RTP_TCP_HEAD_SIZE字节给$头
+void RtpConnect::SendRtcp(MediaChannelID channel_id, uint8_t const *data,
+                          size_t size) {
+    uint8_t const *rtcp = data + RTP_TCP_HEAD_SIZE;
+    if (transport_mode_ == TransportMode::RTP_OVER_TCP) {
+        auto conn = rtsp_con_.lock();
+        if (!conn) {
+            return;
+        }
+        uint8_t header[RTP_TCP_HEAD_SIZE];
+        header[0] = '$';
+        header[1] = (uint8_t)media_channel_info_[channel_id].rtcp_channel;
+        header[2] = (uint8_t)((size & 0xFF00) >> 8);
+        header[3] = (uint8_t)(size & 0xFF);
+        auto node = std::make_shared<Send_Node>(
+            (char const *)header, RTP_TCP_HEAD_SIZE, (char const *)rtcp, size);
+        node->id_ = MSG_IDS::RTP_SEND_PKT;
+        LogicSystem::GetInstance()->PushMsg(
+            std::make_shared<LogicNode>(conn, node));
+        return;
+    }
+
+    if (transports_[channel_id]) {
+        transports_[channel_id]->SendRtcp(channel_id, rtcp, size);
+        return;
+    }
+    if (!rtcp_sockets_[channel_id]) {
+        return;
+    }
+    // RTCP socket上挂着异步读, 发送也放到它的线程里做
+    auto node = std::make_shared<Send_Node>((char const *)rtcp, size);
+    auto self = shared_from_this();
+    boost::asio::post(
+        rtcp_sockets_[channel_id]->get_executor(), [self, node, channel_id]() {
+            if (self->is_closed_) {
+                return;
+            }
+            boost::system::error_code ec;
+            self->rtcp_sockets_[channel_id]->send_to(
+                boost::asio::buffer(node->Getdata(), node->GetLen()),
+                boost::asio::ip::udp::endpoint(
+                    self->peer_rtcp_addr_[channel_id].addr.to_v4(),
+                    self->peer_rtcp_addr_[channel_id].port),
+                0, ec);
+            if (ec) {
+                LOG_WARN_RATE(10, "send rtcp failed: %s", ec.message().c_str());
+            }
+        });
+}
+
 void RtpConnect::SetFrameType(uint8_t frame_type) {
     frame_type_ = frame_type;
     if (!has_key_frame_ &&
@@ -187,59 +984,144 @@ void RtpConnect::SetFrameType(uint8_t frame_type) {
     }
 }
 
-void RtpConnect::SetRtpHeader(MediaChannelID channel_id, RtpPacket pkt) {
-    if ((media_channel_info_[channel_id].is_play ||
-         media_channel_info_[channel_id].is_record) &&
-        has_key_frame_) {
-        media_channel_info_[channel_id].rtp_header.marker = pkt.last;
-        media_channel_info_[channel_id].rtp_header.ts = htonl(pkt.timestamp);
-        media_channel_info_[channel_id].rtp_header.seq =
-            htons(media_channel_info_[channel_id].packet_seq++);
-        memcpy(pkt.data.get() + 4, &media_channel_info_[channel_id].rtp_header,
-               RTP_HEADER_SIZE);
+size_t RtpConnect::SetRtpHeader(MediaChannelID channel_id,
+                                RtpPacket const &pkt, uint8_t *header) {
+    media_channel_info_[channel_id].rtp_header.marker = pkt.last;
+    media_channel_info_[channel_id].rtp_header.ts = htonl(pkt.timestamp);
+    media_channel_info_[channel_id].rtp_header.seq =
+        htons(media_channel_info_[channel_id].packet_seq++);
+    memcpy(header + RTP_TCP_HEAD_SIZE,
+           &media_channel_info_[channel_id].rtp_header, RTP_HEADER_SIZE);
+    auto const &ext = ext_[channel_id].header;
+    if (ext.size == 0) {
+        return RTP_HEADER_SIZE;
     }
+    // X位置1, 扩展紧跟在固定头部后面, 值在发送前再填
+    header[RTP_TCP_HEAD_SIZE] |= 0x10;
+    memcpy(header + RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE, ext.data, ext.size);
+    return RTP_HEADER_SIZE + ext.size;
 }
 
-int RtpConnect::SendRtpOverTcp(MediaChannelID channel_id, RtpPacket pkt) {
+void RtpConnect::StampExtensions(MediaChannelID channel_id, uint8_t *header,
+                                 size_t size) {
+    auto &ext = ext_[channel_id];
+    uint8_t *data = header + RTP_HEADER_SIZE;
+    int64_t now_us = NowUs();
+    if (ext.header.abs_send_time_offset >= 0) {
+        // 与SR的NTP时间无关, 接收端只用它的差值
+        uint32_t abs_send_time = ToAbsSendTime(now_us);
+        uint8_t *p = data + ext.header.abs_send_time_offset;
+        p[0] = (uint8_t)(abs_send_time >> 16);
+        p[1] = (uint8_t)(abs_send_time >> 8);
+        p[2] = (uint8_t)abs_send_time;
+    }
+    if (ext.header.transport_seq_offset >= 0) {
+        uint16_t seq = ext.transport_seq++;
+        uint8_t *p = data + ext.header.transport_seq_offset;
+        p[0] = (uint8_t)(seq >> 8);
+        p[1] = (uint8_t)(seq & 0xff);
+        if (ext.sent) {
+            ext.sent[seq % kTransportSeqWindow].store(
+                (uint64_t)seq << 48 | (uint64_t)(size & 0xffff) << 32 |
+                    (uint32_t)now_us,
+                std::memory_order_relaxed);
+        }
+    }
+    if (fec_[channel_id].enable) {
+        XorBytesScalar(ext.ext_xor, data, ext.header.size);
+    }
+}
+
+int RtpConnect::SendRtpOverTcp(MediaChannelID channel_id, uint8_t *header,
+                               size_t header_size, RtpPacket const &pkt) {
     auto conn = rtsp_con_.lock();
     if (!conn) {
         return -1;
     }
 
-    uint8_t *rtpPktPtr = pkt.data.get();
-    rtpPktPtr[0] = '$'; // 多4个byte 第一个固定为0x24  第二个为通道号  三四
-                        // 为除了前四个的长度
-    rtpPktPtr[1] = (char)(media_channel_info_[channel_id].rtp_channel);
-    rtpPktPtr[2] = (char)(((pkt.size - 4) & 0xFF00) >> 8);
-    rtpPktPtr[3] = (char)((pkt.size - 4) & 0xFF);
-    std::shared_ptr<Send_Node> node =
-        std::make_shared<Send_Node>((char *)rtpPktPtr, pkt.size);
+    uint32_t rtp_size = (uint32_t)(header_size + pkt.PayloadSize());
+    header[0] = '$'; // 多4个byte 第一个固定为0x24  第二个为通道号  三四
+                     // 为除了前四个的长度
+    header[1] = (char)(media_channel_info_[channel_id].rtp_channel);
+    header[2] = (char)((rtp_size & 0xFF00) >> 8);
+    header[3] = (char)(rtp_size & 0xFF);
+    std::shared_ptr<Send_Node> node = std::make_shared<Send_Node>(
+        (char *)header, RTP_TCP_HEAD_SIZE + header_size,
+        (char *)pkt.Payload(), pkt.PayloadSize());
     node->id_ = MSG_IDS::RTP_SEND_PKT;
+    if (Tracer::IsEnabled()) {
+        node->trace_flow_ = Tracer::NewFlowId();
+        Tracer::Record(TraceEventType::TCP_ENQUEUE, TracePhase::INSTANT,
+                       rtp_size, node->trace_flow_, TraceFlow::START);
+    }
+    if (pkt.trace_push != 0) {
+        node->trace_push_ = pkt.trace_push;
+        node->trace_queued_ = LatencyTracker::Instance().Record(
+            LatencyStage::TCP_ENQUEUE, pkt.trace_ready);
+    }
     LogicSystem::GetInstance()->PushMsg(
         std::make_shared<LogicNode>(conn, node));
-    // boost::asio::const_buffers_1 buffers(rtpPktPtr, pkt.size);
-    // conn->GetSocket().async_send(
-    //     boost::asio::buffer(rtpPktPtr, pkt.size),
-    //     [this](boost::system::error_code ec, std::size_t bytes) {
-    //         std::cout<<"send size:"<<bytes<<"non err\n";
-    //         if (ec) {
-    //             TearDown();
-    //             LOG_DEBUG("send rtp failed: %s", ec.message().c_str());
-    //         }
-    //     });
+    // TCP在这里只是入队, 按入队计数
+    rtp_metrics.tcp_packets.Add();
+    rtp_metrics.tcp_bytes.Add(RTP_TCP_HEAD_SIZE + rtp_size);
     return 0;
 }
 
-int RtpConnect::SendRtpOverUdp(MediaChannelID channel_id, RtpPacket pkt) {
-    rtp_sockets_[channel_id]->async_send_to(
-        boost::asio::buffer(pkt.data.get() + 4, pkt.size - 4),
+template <size_t N>
+void RtpConnect::SendDatagram(
+    MediaChannelID channel_id,
+    std::array<boost::asio::const_buffer, N> const &buffers,
+    boost::system::error_code &ec) {
+    if (transports_[channel_id]) {
+        if (!transports_[channel_id]->SendRtp(channel_id, buffers.data(), N)) {
+            ec = boost::asio::error::would_block;
+        }
+        return;
+    }
+    rtp_sockets_[channel_id]->send_to(
+        buffers,
         boost::asio::ip::udp::endpoint(peer_rtp_addr_[channel_id].addr.to_v4(),
                                        peer_rtp_addr_[channel_id].port),
-        [this](boost::system::error_code ec, std::size_t bytes) {
-            if (ec) {
-                TearDown();
-                LOG_DEBUG("send rtp failed: %s", ec.message().c_str());
-            }
-        });
-    return 1;
+        0, ec);
+}
+
+int RtpConnect::SendRtpOverUdp(MediaChannelID channel_id, uint8_t *header,
+                               size_t header_size, RtpPacket const &pkt) {
+    // 非阻塞同步发送, 头部和负载分散聚合(scatter-gather)一次写出,
+    // 返回时内核已经拷贝完数据, 不需要为异步发送保留缓冲区
+    std::array<boost::asio::const_buffer, 2> buffers = {
+        boost::asio::buffer(header + RTP_TCP_HEAD_SIZE, header_size),
+        boost::asio::buffer(pkt.Payload(), pkt.PayloadSize())};
+    boost::system::error_code ec;
+    SendDatagram(channel_id, buffers, ec);
+    if (ec == boost::asio::error::would_block ||
+        ec == boost::asio::error::no_buffer_space) {
+        // 发送缓冲区满, UDP直接丢弃这个包, 由RR反映出来的丢包驱动拥塞控制
+        cc_[channel_id].socket_drops.fetch_add(1, std::memory_order_relaxed);
+        rtp_metrics.socket_drops.Add();
+        return 0;
+    }
+    if (ec) {
+        // 推流线程持有client_mutex_和send_mutex_, 这里只停掉这个通道;
+        // 会话由RtspConnect在LogicSystem线程中结束并离开MediaSession
+        rtp_metrics.send_errors.Add();
+        LOG_WARN_RATE(10, "send rtp failed: %s", ec.message().c_str());
+        media_channel_info_[channel_id].is_play = false;
+        media_channel_info_[channel_id].is_record = false;
+        auto conn = rtsp_con_.lock();
+        if (conn) {
+            conn->RequestClose();
+        }
+        return -1;
+    }
+    rtp_metrics.udp_packets.Add();
+    rtp_metrics.udp_bytes.Add(header_size + pkt.PayloadSize());
+    Tracer::Record(TraceEventType::UDP_SEND, TracePhase::INSTANT,
+                   (uint32_t)(header_size + pkt.PayloadSize()));
+    if (pkt.trace_push != 0) {
+        LatencyTracker &tracker = LatencyTracker::Instance();
+        tracker.Record(LatencyStage::UDP_SEND, pkt.trace_ready);
+        tracker.Record(LatencyStage::UDP_TOTAL, pkt.trace_push);
+    }
+    return 0;
 }
@@ -0,0 +1,82 @@
+#include "net/RtpExtension.hpp"
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+bool RtpExtensionMap::Register(RtpExtensionType type, uint8_t id) {
+    // 一字节头部的ID是1~14, 15保留
+    if (type >= RtpExtensionType::NUM || id < 1 || id > 14) {
+        return false;
+    }
+    for (int i = 0; i < (int)RtpExtensionType::NUM; i++) {
+        if (i != (int)type && ids_[i] == id) {
+            return false;
+        }
+    }
+    ids_[(int)type] = id;
+    return true;
+}
+
+bool RtpExtensionMap::IsEmpty() const {
+    for (uint8_t id: ids_) {
+        if (id != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string RtpExtensionMap::GetSdpAttributes() const {
+    std::string attributes;
+    for (int i = 0; i < (int)RtpExtensionType::NUM; i++) {
+        if (ids_[i] != 0) {
+            attributes += "a=extmap:" + std::to_string(ids_[i]) + " " +
+                          GetUri((RtpExtensionType)i) + "\r\n";
+        }
+    }
+    return attributes;
+}
+
+char const *RtpExtensionMap::GetUri(RtpExtensionType type) {
+    switch (type) {
+    case RtpExtensionType::ABS_SEND_TIME:
+        return "http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time";
+    case RtpExtensionType::TRANSPORT_SEQUENCE:
+        return "http://www.ietf.org/id/"
+               "draft-holmer-rmcat-transport-wide-cc-extensions-01";
+    default:
+        return "";
+    }
+}
+
+void RtpExtensionHeader::Build(RtpExtensionMap const &map) {
+    memset(data, 0, sizeof(data));
+    size = 0;
+    abs_send_time_offset = -1;
+    transport_seq_offset = -1;
+    if (map.IsEmpty()) {
+        return;
+    }
+
+    // 0xBEDE + 以4字节为单位的长度, 后面每个元素是ID(4位) + 长度减1(4位) + 值
+    size_t offset = 4;
+    uint8_t id = map.GetId(RtpExtensionType::ABS_SEND_TIME);
+    if (id != 0) {
+        data[offset] = (uint8_t)(id << 4 | (RTP_EXT_ABS_SEND_TIME_SIZE - 1));
+        abs_send_time_offset = (int8_t)(offset + 1);
+        offset += 1 + RTP_EXT_ABS_SEND_TIME_SIZE;
+    }
+    id = map.GetId(RtpExtensionType::TRANSPORT_SEQUENCE);
+    if (id != 0) {
+        data[offset] = (uint8_t)(id << 4 | (RTP_EXT_TRANSPORT_SEQ_SIZE - 1));
+        transport_seq_offset = (int8_t)(offset + 1);
+        offset += 1 + RTP_EXT_TRANSPORT_SEQ_SIZE;
+    }
+    // 补0对齐到4字节, 0是填充字节
+    size_t words = (offset - 4 + 3) / 4;
+    data[0] = (uint8_t)(RTP_EXT_ONE_BYTE_PROFILE >> 8);
+    data[1] = (uint8_t)(RTP_EXT_ONE_BYTE_PROFILE & 0xff);
+    data[2] = (uint8_t)(words >> 8);
+    data[3] = (uint8_t)(words & 0xff);
+    size = (uint8_t)(4 + words * 4);
+}
@@ -0,0 +1,59 @@
+#include "net/Clock.hpp"
+#include "net/RtpHistory.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+RtpHistory::RtpHistory(uint32_t window_ms, size_t max_packets)
+    : entries_(max_packets),
+      window_ms_(window_ms) {}
+
+uint64_t RtpHistory::Push(RtpPacket const &pkt) {
+    int64_t now_us = Clock::NowUs();
+    std::lock_guard<std::mutex> lk(mtx_);
+    Expire(now_us);
+    if (next_index_ - first_index_ == entries_.size()) {
+        // 满了, 挤掉最旧的
+        entries_[first_index_ % entries_.size()].data.reset();
+        first_index_++;
+    }
+
+    auto &entry = entries_[next_index_ % entries_.size()];
+    entry.data = pkt.data;
+    entry.size = pkt.size;
+    entry.timestamp = pkt.timestamp;
+    entry.type = pkt.type;
+    entry.last = pkt.last;
+    entry.time_us = now_us;
+    return next_index_++;
+}
+
+bool RtpHistory::Get(uint64_t index, RtpPacket *pkt) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (index < first_index_ || index >= next_index_) {
+        return false;
+    }
+    auto const &entry = entries_[index % entries_.size()];
+    *pkt = RtpPacket(entry.data, entry.size);
+    pkt->timestamp = entry.timestamp;
+    pkt->type = entry.type;
+    pkt->last = entry.last;
+    return true;
+}
+
+size_t RtpHistory::GetSize() {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return (size_t)(next_index_ - first_index_);
+}
+
+void RtpHistory::Expire(int64_t now_us) {
+    int64_t deadline = now_us - (int64_t)window_ms_ * 1000;
+    while (first_index_ < next_index_) {
+        auto &entry = entries_[first_index_ % entries_.size()];
+        if (entry.time_us >= deadline) {
+            break;
+        }
+        entry.data.reset();
+        first_index_++;
+    }
+}
@@ -1,279 +1,244 @@
 
 #include "Log/logger.hpp"
 #include "net/const.hpp"
+#include "net/LatencyTracker.hpp"
 #include "net/LogicSystem.hpp"
 #include "net/media.hpp"
 #include "net/MediaSession.hpp"
 #include "net/MediaSource.hpp"
+#include "net/Metrics.hpp"
 #include "net/MsgNode.hpp"
 #include "net/Rtp.hpp"
+#include "net/RtspResponse.hpp"
 #include "net/RtspServer.hpp"
+#include "net/Tracer.hpp"
+#include <array>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/post.hpp>
 #include <boost/asio/read.hpp>
 #include <boost/asio/write.hpp>
-#include <boost/system/detail/error_code.hpp>
+#include <boost/system/error_code.hpp>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
 #include <memory>
 #include <mutex>
+#include <string_view>
 #include <net/RtpConnection.hpp>
 #include <net/RtspConnection.hpp>
 
 char const *MethodToString[8] = {"OPTIONS",  "DESCRIBE",      "SETUP", "PLAY",
                                  "TEARDOWN", "GET_PARAMETER", "RTCP",  "NONE"};
 
+namespace {
+
+// 所有RTSP连接共用的指标, 在io线程和LogicSystem线程中计数
+struct RtspMetrics {
+    Counter requests[8]; // 按Method
+    Counter bad_requests;
+    Counter bytes_received;
+    Counter bytes_sent;
+
+    RtspMetrics() {
+        auto &registry = MetricsRegistry::Instance();
+        for (int i = 0; i < 8; i++) {
+            requests[i] = registry.AddCounter(
+                "rtsp_requests_total", "RTSP requests handled",
+                MetricsRegistry::Label("method", MethodToString[i]));
+        }
+        bad_requests = registry.AddCounter(
+            "rtsp_bad_requests_total", "RTSP requests that failed to parse");
+        bytes_received = registry.AddCounter(
+            "rtsp_bytes_received_total",
+            "Bytes read on RTSP connections, including interleaved RTCP");
+        bytes_sent = registry.AddCounter(
+            "rtsp_bytes_sent_total",
+            "Bytes written on RTSP connections, including interleaved RTP");
+    }
+};
+
+RtspMetrics rtsp_metrics;
+
+} // namespace
+
 RtspConnect::RtspConnect(std::shared_ptr<RtspServer> server,
                          boost::asio::io_context &ioc)
     : server_(server),
       socket_(ioc) {}
 
-bool RtspConnect::ParseRequest(char const *buffer) {
-    if (buffer[0] == '$') {
-        method_ = Method::RTCP;
-        return true;
-    }
-
-    bool ret;
-    std::string message(buffer);
-    size_t pos = message.find("\r\n");
-    if (pos == std::string::npos) {
+bool RtspConnect::HandleRecv(char const *data, size_t size) {
+    LOG_DEBUG("msg is:%.*s", (int)size, data);
+    if (close_after_send_) {
         return false;
     }
-    // parse request line
-    std::string line = message.substr(0, pos);
-    ret = ParseRequestLine(line);
-    // parse header line
-    line = message.substr(pos + 2);
-    ret = ParseHeaderLine(line);
-    return ret;
-}
-
-bool RtspConnect::ParseRequestLine(std::string &line) {
-    std::string method;
-    std::string Url;
-    std::string Version;
-    std::stringstream ss(line);
-    ss >> method >> Url >> Version;
-    if (method == "OPTIONS") {
-        method_ = Method::OPTIONS;
-    } else if (method == "DESCRIBE") {
-        method_ = Method::DESCRIBE;
-    } else if (method == "SETUP") {
-        method_ = Method::SETUP;
-    } else if (method == "PLAY") {
-        method_ = Method::PLAY;
-    } else {
-        method_ = Method::NONE;
-    }
-
-    // parse url
-    if (std::strncmp(Url.c_str(), "rtsp://", 7) != 0) {
+    if (RtspParser::Parse(std::string_view(data, size), &request_) !=
+        RtspParser::Result::COMPLETE) {
+        rtsp_metrics.bad_requests.Add();
+        LOG_WARN("error:bad request");
+        // 后面的数据已经无法信任, 回400后断开
+        SendAndClose(BuildError_res(RtspStatus::BAD_REQUEST));
         return false;
     }
-    URL_ = Url.substr(7);
-
-    uint16_t port = 0;
-    char ip[64] = {0};
-    char suffix[64] = {0};
-
-    if (sscanf(URL_.c_str(), "%[^:]:%hu/%s", ip, &port, suffix) == 3) {
-    } else if (sscanf(URL_.c_str(), "%[^/]/%s", ip, suffix) == 2) {
-        port = 554;
-    } else {
+    rtsp_metrics.requests[(int)request_.method].Add();
+    if (!CheckRequest()) {
+        LOG_WARN("error:missing header, method %d", (int)request_.method);
+        Send(BuildError_res(RtspStatus::BAD_REQUEST));
         return false;
     }
-
-    Request_line_parmas_["url"] = {Url, 0};
-    Request_line_parmas_["url_ip"] = {ip, 0};
-    Request_line_parmas_["url_port"] = {"", port};
-    Request_line_parmas_["url_suffix"] = {suffix, 0};
-    Request_line_parmas_["version"] = {Version, 0};
-    Request_line_parmas_["method"] = {std::move(method), 0};
-
-    return true;
+    return HandleRequest();
 }
 
-bool RtspConnect::ParseHeaderLine(std::string &line) {
-    if (!ParseCSeq(line)) {
-        if (Header_line_parmas_.find("cseq") == Header_line_parmas_.end()) {
-            return false;
-        }
-    }
-
-    if (method_ == Method::DESCRIBE) {
-        if (ParseAccept(line)) {
+bool RtspConnect::HandleFrames() {
+    // 一次读到的数据可能包含半个消息, 也可能包含多个RTSP消息和$帧
+    RtspFrame frame;
+    for (;;) {
+        RtspParser::Result ret = parser_.NextFrame(&frame);
+        if (ret == RtspParser::Result::INCOMPLETE) {
             return true;
         }
-        LOG_DEBUG("error:parseAccept failed");
-        return false;
-    } else if (method_ == Method::SETUP) {
-        if (ParseTransport(line)) {
-            if (ParseMediaChannel(line)) {
-                return true;
-            } else {
-                LOG_DEBUG("error:ParseMediaChannel failed");
-                return false;
-            }
-        }
-        LOG_DEBUG("error:parseTransport failed");
-        return false;
-    } else if (method_ == Method::PLAY) {
-        if (ParseSessionId(line)) {
-            return true;
+        if (ret == RtspParser::Result::ERROR) {
+            // 分帧出错后找不到下一个消息的边界, 由调用者关闭连接
+            LOG_WARN("error:bad rtsp stream");
+            return false;
         }
-        return false;
-    } else if (method_ == Method::OPTIONS) {
-        return true;
-    }
-    return false;
-}
-
-bool RtspConnect::ParseCSeq(std::string &line) {
-    auto pos = line.find("CSeq");
-    uint32_t cseq;
-    if (pos != std::string::npos) {
-        sscanf(line.c_str() + pos, "%*[^:]: %u", &cseq);
-        Header_line_parmas_["cseq"] = {"", cseq};
-        return true;
-    }
-
-    return false;
-}
-
-bool RtspConnect::ParseTransport(std::string &line) {
-    std::size_t pos = line.find("Transport");
-    if (pos != std::string::npos) {
-        if ((pos = line.find("RTP/AVP/TCP")) != std::string::npos) {
-            transport_ = TransportMode::RTP_OVER_TCP;
-            uint16_t rtpChannel = 0, rtcpChannel = 0;
-            if (sscanf(line.c_str() + pos, "%*[^;];%*[^;];%*[^=]=%hu-%hu",
-                       &rtpChannel, &rtcpChannel) != 2) {
-                return false;
+        Touch();
+
+        if (frame.interleaved) {
+            // $帧直接在io线程交给RtpConnect, 数据仍在接收缓冲区中
+            auto rtp_conn = std::atomic_load(&rtp_conn_);
+            if (rtp_conn) {
+                rtp_conn->HandleInterleaved(frame.channel,
+                                            (uint8_t const *)frame.data,
+                                            frame.size);
             }
-            Header_line_parmas_["rtp_channel"] = std::make_pair("", rtpChannel);
-            Header_line_parmas_["rtcp_channel"] =
-                std::make_pair("", rtcpChannel);
-            return true;
-        } else if ((pos = line.find("RTP/AVP")) != std::string::npos) {
-            uint16_t rtp_port = 0, rtcp_port = 0;
-            if ((pos = line.find("unicast")) != std::string::npos) {
-                transport_ = TransportMode::RTP_OVER_UDP;
-                if (sscanf(line.c_str() + pos, "%*[^;];%*[^=]=%hu-%hu",
-                           &rtp_port, &rtcp_port) != 2) {
-                    return false;
-                }
-            } else {
-                return false;
-            }
-            Header_line_parmas_["rtp_port"] = {"", rtp_port};
-            Header_line_parmas_["rtcp_port"] = {"", rtcp_port};
-            return true;
+            continue;
         }
-    }
-    return false;
-}
 
-bool RtspConnect::ParseAccept(std::string &line) {
-    if (line.find("Accept") == std::string::npos ||
-        line.find("sdp") == std::string::npos) {
-        return false;
-    }
-    return true;
-}
-
-bool RtspConnect::ParseMediaChannel(std::string &line) {
-    channelid_ = MediaChannelID::channel0;
-    auto it = Request_line_parmas_.find("url");
-    if (it != Request_line_parmas_.end()) {
-        std::size_t pos = it->second.first.find("track1");
-        if (pos != std::string::npos) {
-            channelid_ = MediaChannelID::channel1;
+        // RTSP消息交给LogicSystem线程处理
+        auto node = std::make_shared<Recv_Node>(frame.size);
+        memcpy(node->Getdata(), frame.data, frame.size);
+        node->id_ = MSG_IDS::REQUEST;
+        if (Tracer::IsEnabled()) {
+            node->trace_flow_ = Tracer::NewFlowId();
+            Tracer::Record(TraceEventType::RTSP_READ, TracePhase::INSTANT,
+                           (uint32_t)frame.size, node->trace_flow_,
+                           TraceFlow::START);
         }
+        LogicSystem::GetInstance()->PushMsg(
+            std::make_shared<LogicNode>(shared_from_this(), node));
     }
-    return true;
 }
 
-bool RtspConnect::ParseSessionId(std::string &line) {
-    size_t pos = line.find("Session");
-    if (pos != std::string::npos) {
-        uint32_t session_id = 0;
-        if (sscanf(line.c_str() + pos, "%*[^:]: %u", &session_id) != 1) {
-            return false;
-        }
+bool RtspConnect::CheckRequest() const {
+    switch (request_.method) {
+    case Method::DESCRIBE:
+        return !request_.has_accept || request_.accept_sdp;
+    case Method::SETUP:
+        return request_.has_transport;
+    case Method::PLAY:
+        return request_.has_session;
+    default:
+        return true;
     }
-    return true;
 }
 
 void RtspConnect::AsyncRead() {
     auto self = shared_from_this();
-    recv_node_ = std::make_shared<Recv_Node>(2048);
+    // 直接读到解析器的缓冲区, 分帧时不再拷贝
+    char *buf = parser_.Prepare(RTSP_READ_SIZE);
     socket_.async_read_some(
-        boost::asio::buffer(recv_node_->Getdata(), recv_node_->GetLen()),
+        boost::asio::buffer(buf, parser_.Writable()),
         [self](boost::system::error_code const &ec,
                std::size_t byte_transform) {
             try {
                 if (ec) {
-                    LOG_DEBUG(ec.what().c_str());
+                    LOG_DEBUG("read rtsp failed: %s", ec.message().c_str());
+                    self->RequestClose();
+                    return;
+                }
+                rtsp_metrics.bytes_received.Add(byte_transform);
+                if (!self->parser_.Commit(byte_transform)) {
+                    LOG_WARN("error:request too large");
+                    self->RequestClose();
+                    return;
+                }
+                bool ok;
+                {
+                    TraceScope trace(TraceEventType::RTSP_READ,
+                                     (uint32_t)byte_transform);
+                    ok = self->HandleFrames();
+                }
+                if (!ok) {
+                    self->RequestClose();
                     return;
                 }
-                LOG_DEBUG("msg is:%s", self->recv_node_->Getdata());
-                self->recv_node_->id_ = MSG_IDS::REQUEST;
-                std::shared_ptr<LogicNode> node =
-                    std::make_shared<LogicNode>(self, self->recv_node_);
-                LogicSystem::GetInstance()->PushMsg(node);
                 self->AsyncRead();
             } catch (std::exception &e) {
-                LOG_DEBUG(e.what());
+                LOG_ERROR("%s", e.what());
                 return;
             }
         });
 }
 
 void RtspConnect::Send(char const *msg, size_t size) {
+    Send(std::make_shared<Send_Node>(msg, size));
+}
+
+void RtspConnect::Send(std::string const &str) {
+    Send(str.c_str(), str.length());
+}
+
+void RtspConnect::Send(std::shared_ptr<Send_Node> node) {
+    if (node == nullptr) {
+        return;
+    }
     bool pending = false;
     std::lock_guard<std::mutex> lk(send_mtx_);
     if (send_que_.size() > 0) {
         pending = true;
     }
-    send_que_.push(std::make_shared<Send_Node>(msg, size));
+    send_que_.push(node);
     if (pending) {
         return;
     }
-    // LOG_DEBUG("send msg is:%s", msg);
+    AsyncWrite(node);
+}
+
+void RtspConnect::AsyncWrite(std::shared_ptr<Send_Node> const &node) {
+    // 头部和共享的body一起写出
+    std::array<boost::asio::const_buffer, 2> buffers = {
+        boost::asio::buffer(node->data_, node->total_len_),
+        node->body_ ? boost::asio::buffer(*node->body_)
+                    : boost::asio::const_buffer()};
+    Tracer::Record(TraceEventType::WRITE_START, TracePhase::INSTANT,
+                   (uint32_t)boost::asio::buffer_size(buffers),
+                   node->trace_flow_, TraceFlow::STEP);
     boost::asio::async_write(
-        socket_, boost::asio::buffer(msg, size),
+        socket_, buffers,
         std::bind(&RtspConnect::HandleWrite, this, std::placeholders::_1,
                   std::placeholders::_2, shared_from_this()));
 }
 
-void RtspConnect::Send(std::string const &str) {
-    Send(str.c_str(), str.length());
-}
-
 uint16_t RtspConnect::GetRtpPort() {
-    uint16_t rtp_port = 0;
-    if (Header_line_parmas_.find("rtp_port") != Header_line_parmas_.end()) {
-        rtp_port = Header_line_parmas_["rtp_port"].second;
-    }
-    return rtp_port;
+    return request_.rtp_port;
 }
 
 uint16_t RtspConnect::GetRtcpPort() {
-    uint16_t rtcp_port = 0;
-    if (Header_line_parmas_.find("rtcp_port") != Header_line_parmas_.end()) {
-        rtcp_port = Header_line_parmas_["rtcp_port"].second;
-    }
-    return rtcp_port;
+    return request_.rtcp_port;
 }
 
 bool RtspConnect::HandleRequest() {
-    switch (method_) {
+    switch (request_.method) {
     case Method::RTCP:     break;
     case Method::OPTIONS:  HandleOptions(); break;
     case Method::DESCRIBE: HandleDescribe(); break;
     case Method::SETUP:    HandleSetup(); break;
     case Method::PLAY:     HandlePlay(); break;
-    default:               break;
+    case Method::TEARDOWN: HandleTeardown(); break;
+    case Method::GET_PARAMETER: HandleGetParameter(); break;
+    default:
+        Send(BuildError_res(RtspStatus::NOT_IMPLEMENTED));
+        break;
     }
 
     return true;
@@ -283,65 +248,65 @@ void RtspConnect::HandleWrite(boost::system::error_code const &ec,
                               std::size_t size,
                               std::shared_ptr<RtspConnect> self_con_) {
     if (!ec) {
+        rtsp_metrics.bytes_sent.Add(size);
         std::lock_guard<std::mutex> lk(send_mtx_);
+        auto const &node = send_que_.front();
+        TraceScope trace(TraceEventType::WRITE_COMPLETE, (uint32_t)size,
+                         node->trace_flow_, TraceFlow::END);
+        if (node->trace_push_ != 0) {
+            LatencyTracker &tracker = LatencyTracker::Instance();
+            tracker.Record(LatencyStage::TCP_WRITE, node->trace_queued_);
+            tracker.Record(LatencyStage::TCP_TOTAL, node->trace_push_);
+        }
         send_que_.pop();
         if (!send_que_.empty()) {
-            auto &msgnode = send_que_.front();
-            boost::asio::async_write(
-                socket_,
-                boost::asio::buffer(msgnode->data_, msgnode->total_len_),
-                std::bind(&RtspConnect::HandleWrite, this,
-                          std::placeholders::_1, std::placeholders::_2,
-                          self_con_));
+            AsyncWrite(send_que_.front());
+        } else if (close_after_send_) {
+            RequestClose();
         }
     } else {
-        LOG_DEBUG(ec.what().c_str());
+        LOG_WARN_RATE(10, "send rtsp failed: %s", ec.message().c_str());
         return;
     }
 }
 
 u_int32_t RtspConnect::GetCSeq() {
-    uint32_t cseq = 0;
-    if (Header_line_parmas_.find("cseq") != Header_line_parmas_.end()) {
-        cseq = Header_line_parmas_["cseq"].second;
-    }
-    return cseq;
+    return request_.cseq;
 }
 
-std::string RtspConnect::GetRtspUrl() const {
-    auto iter = Request_line_parmas_.find("url");
-    if (iter != Request_line_parmas_.end()) {
-        return iter->second.first;
-    }
+uint32_t RtspConnect::GetSessionTimeout() const {
+    auto rtsp_server = server_.lock();
+    return rtsp_server ? rtsp_server->GetIdleTimeout() : RTSP_SESSION_TIMEOUT;
+}
 
-    return "";
+std::string RtspConnect::GetRtspUrl() const {
+    return request_.url;
 }
 
 std::string RtspConnect::GetRtspUrlSuffix() const {
-    auto iter = Request_line_parmas_.find("url_suffix");
-    if (iter != Request_line_parmas_.end()) {
-        return iter->second.first;
-    }
-
-    return "";
+    return request_.url_suffix;
 }
 
 uint8_t RtspConnect::GetRtpChannel() const {
-    auto iter = Header_line_parmas_.find("rtp_channel");
-    if (iter != Header_line_parmas_.end()) {
-        return iter->second.second;
-    }
-
-    return 0;
+    return request_.rtp_channel;
 }
 
 uint8_t RtspConnect::GetRtcpChannel() const {
-    auto iter = Header_line_parmas_.find("rtcp_channel");
-    if (iter != Header_line_parmas_.end()) {
-        return iter->second.second;
+    return request_.rtcp_channel;
+}
+
+double RtspConnect::GetScale(std::string *header) const {
+    if (!request_.has_scale) {
+        return 1.0;
     }
+    if (header != nullptr) {
+        *header = request_.scale_header;
+    }
+    return request_.scale;
+}
 
-    return 0;
+double RtspConnect::GetRangeStart() const {
+    return request_.has_range ? request_.range_start : 0.0;
 }
 
 std::string RtspConnect::GetSocketIp(boost::asio::ip::tcp::socket &socket) {
@@ -351,23 +316,22 @@ std::string RtspConnect::GetSocketIp(boost::asio::ip::tcp::socket &socket) {
 }
 
 void RtspConnect::HandleOptions() {
-    char response[2048];
-    int ret = 0;
-    ret = BuildOptions_res(response, sizeof(response));
-    if (ret <= 0) {
-        LOG_DEBUG("error:buildOption failed");
+    auto response = BuildOptions_res();
+    if (response == nullptr) {
+        LOG_WARN("error:buildOption failed");
         return;
     }
-    Send(response, strlen(response));
+    Send(response);
 }
 
 void RtspConnect::HandleDescribe() {
-    char response[2048];
-    int ret = 0;
+    std::shared_ptr<Send_Node> response;
     std::shared_ptr<MediaSession> media_session = nullptr;
 
     if (rtp_conn_ == nullptr) {
-        rtp_conn_.reset(new RtpConnect(shared_from_this()));
+        // io线程会并发读取rtp_conn_来分发$帧
+        std::atomic_store(&rtp_conn_,
+                          std::make_shared<RtpConnect>(shared_from_this()));
     }
 
     auto rtsp_server = server_.lock();
@@ -375,8 +339,8 @@ void RtspConnect::HandleDescribe() {
         media_session = rtsp_server->LookMediaSession(this->GetRtspUrlSuffix());
     }
 
-    if (!rtsp_server && !media_session) {
-        ret = BuildNotFound_res(response, sizeof(response));
+    if (!rtsp_server || !media_session) {
+        response = BuildNotFound_res();
     } else {
         session_id_ = media_session->GetMediaSessionId();
         media_session->AddClient(rtp_conn_);
@@ -392,24 +356,22 @@ void RtspConnect::HandleDescribe() {
             }
         }
 
-        std::string sdp = media_session->GetSdpMessage(
-            GetSocketIp(this->GetSocket()), rtsp_server->GetVersion());
-        if (sdp == "") {
-            ret = BuildServerError_res(response, sizeof(response));
+        auto sdp = media_session->GetSdp(GetSocketIp(this->GetSocket()),
+                                         rtsp_server->GetVersion());
+        if (sdp == nullptr) {
+            response = BuildServerError_res();
         } else {
-            ret = BuildDescribe_res(response, sizeof(response), sdp.c_str());
+            response = BuildDescribe_res(sdp);
         }
     }
-    if (ret <= 0) {
-        LOG_DEBUG("error:buildOption failed");
+    if (response == nullptr) {
+        LOG_WARN("error:buildDescribe failed");
         return;
     }
-    Send(response, ret);
+    Send(response);
 }
 
 void RtspConnect::HandleSetup() {
-    char response[4096];
-    int ret = 0;
     std::shared_ptr<MediaSession> media_session = nullptr;
 
     auto rtsp_server = server_.lock();
@@ -418,94 +380,266 @@ void RtspConnect::HandleSetup() {
     }
 
     if (!rtsp_server || !media_session) {
-        LOG_DEBUG("SetUp Erorr");
-        ret = BuildServerError_res(response, sizeof(response));
-        Send(response, strlen(response));
+        LOG_WARN("SetUp Erorr");
+        Send(BuildServerError_res());
+        return;
+    }
+
+    if (rtp_conn_ == nullptr) {
+        // 没有DESCRIBE或者已经TEARDOWN
+        Send(BuildError_res(RtspStatus::METHOD_NOT_VALID));
         return;
     }
 
     if (this->GetTransport() == TransportMode::RTP_OVER_UDP) {
         uint16_t per_rtp_port = GetRtpPort();
         uint16_t per_rtcp_port = GetRtcpPort();
-        uint16_t session_id = rtp_conn_->GetRtpSessionId();
+        uint32_t session_id = rtp_conn_->GetRtpSessionId();
         auto ret =
-            rtp_conn_->SetupRtpOverUdp(channelid_, per_rtp_port, per_rtcp_port);
+            rtp_conn_->SetupRtpOverUdp(request_.channel_id, per_rtp_port, per_rtcp_port);
         if (ret) {
-            uint16_t ser_rtp_port = rtp_conn_->GetRtpPort(channelid_);
-            uint16_t ser_rtcp_port = rtp_conn_->GetRtcpPort(channelid_);
-            ret = BuildSetupUdp_res(response, sizeof(response), ser_rtp_port,
-                                    ser_rtcp_port, session_id);
-            if (ret <= 0) {
-                LOG_DEBUG("error:BuildSetupUdp failed");
+            uint16_t ser_rtp_port = rtp_conn_->GetRtpPort(request_.channel_id);
+            uint16_t ser_rtcp_port = rtp_conn_->GetRtcpPort(request_.channel_id);
+            auto response =
+                BuildSetupUdp_res(ser_rtp_port, ser_rtcp_port, session_id);
+            if (response == nullptr) {
+                LOG_WARN("error:BuildSetupUdp failed");
                 return;
             }
-            rtp_conn_->RtcpAsyncRead(channelid_);
-            Send(response, strlen(response));
+            rtp_conn_->SetRtpExtensions(request_.channel_id,
+                                        media_session->GetRtpExtensions());
+            rtp_conn_->SetFecEnabled(
+                request_.channel_id,
+                media_session->IsFecEnabled(request_.channel_id));
+            rtp_conn_->SetCongestionControl(
+                request_.channel_id,
+                media_session->IsCongestionControlEnabled());
+            rtp_conn_->SetRtpHistory(
+                request_.channel_id,
+                media_session->GetRtpHistory(request_.channel_id),
+                media_session->IsRtxEnabled());
+            rtp_conn_->RtcpAsyncRead(request_.channel_id);
+            Send(response);
             return;
         } else {
-            LOG_DEBUG("error:setup rtp over udp failed");
+            LOG_ERROR("error:setup rtp over udp failed");
             // handleServererror
-            ret = BuildServerError_res(response, sizeof(response));
-            Send(response, strlen(response));
+            Send(BuildServerError_res());
             return;
         }
     }
 
     uint16_t rtp_channel = GetRtpChannel();
     uint16_t rtcp_channel = GetRtcpChannel();
-    uint16_t session_id = rtp_conn_->GetRtpSessionId();
-    rtp_conn_->SetupRtpOverTcp(channelid_, rtp_channel, rtcp_channel);
-    ret = BuildSetupTcp_res(response, sizeof(response), rtp_channel,
-                            rtcp_channel, session_id);
-    if (ret <= 0) {
-        LOG_DEBUG("error:buildOption failed");
+    uint32_t session_id = rtp_conn_->GetRtpSessionId();
+    rtp_conn_->SetupRtpOverTcp(request_.channel_id, rtp_channel, rtcp_channel);
+    rtp_conn_->SetRtpExtensions(request_.channel_id,
+                                media_session->GetRtpExtensions());
+    auto response = BuildSetupTcp_res(rtp_channel, rtcp_channel, session_id);
+    if (response == nullptr) {
+        LOG_WARN("error:buildSetupTcp failed");
         return;
     }
-    Send(response, strlen(response));
+    Send(response);
 }
 
 void RtspConnect::HandlePlay() {
     if (rtp_conn_ == nullptr) {
+        Send(BuildError_res(RtspStatus::METHOD_NOT_VALID));
         return;
     }
 
     conn_state_ = ConnectionState::START_PLAY;
+    std::string scale_header;
+    double scale = GetScale(&scale_header);
+    if (!StartTrickPlay(scale)) {
+        scale_header.clear();
+    }
     rtp_conn_->Play();
 
-    uint16_t session_id = rtp_conn_->GetRtpSessionId();
-    char response[2048];
-
-    int size = BuildPlay_res(response, sizeof(response), nullptr, session_id);
-    Send(response, strlen(response));
+    uint32_t session_id = rtp_conn_->GetRtpSessionId();
+    Send(BuildPlay_res(nullptr, session_id,
+                       scale_header.empty() ? nullptr : scale_header.c_str(),
+                       scale));
 }
 
 void RtspConnect::HandleRtcp() {}
 
-int RtspConnect::BuildOptions_res(char const *buf, size_t buf_size) {
-    ::memset((void *)buf, 0, buf_size);
-    snprintf((char *)buf, buf_size,
-             "RTSP/1.0 200 OK\r\n"
-             "CSeq: %u\r\n"
-             "Public: OPTIONS, DESCRIBE, SETUP, TEARDOWN, PLAY\r\n"
-             "\r\n",
-             this->GetCSeq());
+void RtspConnect::HandleTeardown() {
+    if (!CheckSession(false)) {
+        Send(BuildError_res(RtspStatus::SESSION_NOT_FOUND));
+        return;
+    }
+    TearDownSession();
+    Send(BuildTeardown_res());
+}
+
+void RtspConnect::HandleGetParameter() {
+    if (!CheckSession(true)) {
+        Send(BuildError_res(RtspStatus::SESSION_NOT_FOUND));
+        return;
+    }
+    // 唯一的参数为trace时返回追踪缓冲区中的事件(Chrome trace JSON),
+    // 用来现场排查卡顿
+    std::string_view param = request_.body;
+    while (!param.empty() && (param.back() == '\r' || param.back() == '\n')) {
+        param.remove_suffix(1);
+    }
+    if (param == "trace") {
+        SendTraceDump();
+        return;
+    }
+    // 客户端用来保活, 空闲计时在收到时已经刷新
+    Send(BuildGetParameter_res(rtp_conn_ ? rtp_conn_->GetRtpSessionId() : 0));
+}
+
+void RtspConnect::SendTraceDump() {
+    auto rtsp_server = server_.lock();
+    if (!rtsp_server || !rtsp_server->trace_dump_enabled_) {
+        Send(BuildError_res(RtspStatus::PARAMETER_NOT_UNDERSTOOD));
+        return;
+    }
+    // 只给已经建立会话的客户端, 请求必须带本连接的Session
+    if (!request_.has_session || rtp_conn_ == nullptr) {
+        Send(BuildError_res(RtspStatus::SESSION_NOT_FOUND));
+        return;
+    }
+    // 导出在服务器的导出线程里做, RTSP请求和TCP上的RTP照常处理
+    uint32_t cseq = GetCSeq();
+    auto self = shared_from_this();
+    bool posted = rtsp_server->PostTraceDump([self, cseq]() {
+        auto json = std::make_shared<std::string const>(
+            Tracer::Instance().ExportChromeJson());
+        self->Send(RtspResponse(RtspStatus::OK, cseq)
+                       .Finish(std::move(json), "application/json"));
+    });
+    if (!posted) {
+        Send(BuildError_res(RtspStatus::SERVICE_UNAVAILABLE));
+    }
+}
+
+bool RtspConnect::CheckSession(bool allow_missing) const {
+    if (!request_.has_session) {
+        return allow_missing;
+    }
+    return rtp_conn_ != nullptr &&
+           request_.session_id == rtp_conn_->GetRtpSessionId();
+}
+
+void RtspConnect::TearDownSession() {
+    if (trick_player_) {
+        trick_player_->Stop();
+        trick_player_.reset();
+    }
+
+    auto rtp_conn =
+        std::atomic_exchange(&rtp_conn_, std::shared_ptr<RtpConnect>());
+    if (rtp_conn == nullptr) {
+        return;
+    }
+    rtp_conn->TearDown();
+    auto rtsp_server = server_.lock();
+    if (rtsp_server) {
+        auto media_session = rtsp_server->LookMediaSession(session_id_);
+        if (media_session) {
+            media_session->RemoveClient(rtp_conn);
+        }
+    }
+    conn_state_ = ConnectionState::START_CONNECT;
+}
+
+void RtspConnect::RequestClose() {
+    if (is_closed_ || close_requested_.exchange(true)) {
+        return;
+    }
+    auto node = std::make_shared<Recv_Node>(0);
+    node->id_ = MSG_IDS::CLOSE;
+    LogicSystem::GetInstance()->PushMsg(
+        std::make_shared<LogicNode>(shared_from_this(), node));
+}
 
-    return (int)strlen(buf);
+void RtspConnect::SendAndClose(std::shared_ptr<Send_Node> node) {
+    // 先停掉RTP, 发送队列才能排空
+    TearDownSession();
+    Send(std::move(node));
+    // 标记和出队在同一把锁下, 写完成时一定能看到
+    std::lock_guard<std::mutex> lk(send_mtx_);
+    close_after_send_ = true;
+    if (send_que_.empty()) {
+        RequestClose();
+    }
 }
 
-int RtspConnect::BuildDescribe_res(char const *res, size_t size,
-                                   std::string sdp) {
-    ::memset((void *)res, 0, size);
+void RtspConnect::HandleClose() {
+    if (is_closed_.exchange(true)) {
+        return;
+    }
+    TearDownSession();
+
+    // socket在io线程中关闭, 与未完成的读写串行
+    auto self = shared_from_this();
+    boost::asio::post(socket_.get_executor(), [self]() {
+        boost::system::error_code ec;
+        self->socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both,
+                               ec);
+        self->socket_.close(ec);
+    });
 
-    snprintf((char *)res, size,
-             "RTSP/1.0 200 OK\r\n"
-             "CSeq: %u\r\n"
-             "Content-Length: %d\r\n"
-             "Content-Type: application/sdp\r\n"
-             "\r\n"
-             "%s",
-             this->GetCSeq(), (int)strlen(sdp.c_str()), sdp.c_str());
-    return (int)strlen(res);
+    auto rtsp_server = server_.lock();
+    if (rtsp_server) {
+        rtsp_server->RemoveConnection(conn_slot_);
+    }
+}
+
+bool RtspConnect::StartTrickPlay(double scale) {
+    if (trick_player_) {
+        trick_player_->Stop();
+        trick_player_.reset();
+    }
+    rtp_conn_->SetTrickPlay(false);
+
+    if (!TrickPlayer::IsTrickScale(scale)) {
+        return false;
+    }
+
+    auto rtsp_server = server_.lock();
+    if (!rtsp_server) {
+        return false;
+    }
+    auto media_session = rtsp_server->LookMediaSession(session_id_);
+    if (!media_session) {
+        return false;
+    }
+
+    for (int chn = 0; chn < MAX_MEDIA_CHANNEL; chn++) {
+        uint32_t framerate = 0;
+        auto file =
+            media_session->GetTrickPlayFile((MediaChannelID)chn, &framerate);
+        if (file == nullptr || file->GetKeyFrameCount() == 0) {
+            continue;
+        }
+        trick_player_ = std::make_shared<TrickPlayer>(
+            socket_.get_executor(), file, rtp_conn_, (MediaChannelID)chn,
+            framerate);
+        rtp_conn_->SetTrickPlay(true);
+        trick_player_->Start(scale, (size_t)(GetRangeStart() * framerate));
+        return true;
+    }
+
+    LOG_DEBUG("trick play: session has no key frame index");
+    return false;
+}
+
+std::shared_ptr<Send_Node> RtspConnect::BuildOptions_res() {
+    return RtspResponse(RtspStatus::OK, GetCSeq())
+        .Header("Public", "OPTIONS, DESCRIBE, SETUP, TEARDOWN, PLAY, GET_PARAMETER")
+        .Finish();
+}
+
+std::shared_ptr<Send_Node>
+RtspConnect::BuildDescribe_res(std::shared_ptr<std::string const> sdp) {
+    return RtspResponse(RtspStatus::OK, GetCSeq())
+        .Finish(std::move(sdp), "application/sdp");
 }
 
 /*在 TCP 承载 RTSP 的情况下，RTP 和 RTCP 数据与 RTSP 数据共享 TCP
@@ -515,72 +649,77 @@ RTP 和 RTCP 数据会以$符号＋1 个字节的通道编号＋2 个字节的
 数据的包头可能是$00xxxx（其中$是标识符，00是偶数信道编号，表示数据信道，xxxx表示数据长度）；
 RTCP 数据的包头可能是$01yyyy（其中$是标识符，01是奇数信道编号，即数据信道 0 加
 1，表示控制信道，yyyy表示数据长度）*/
-int RtspConnect::BuildSetupTcp_res(char const *res, size_t size,
-                                   uint16_t rtp_chn, uint16_t rtcp_chn,
-                                   uint32_t session_id) {
-    ::memset((void *)res, 0, size);
-    snprintf((char *)res, size,
-             "RTSP/1.0 200 OK\r\n"
-             "CSeq: %u\r\n"
-             "Transport: RTP/AVP/TCP;unicast;interleaved=%d-%d\r\n"
-             "Session: %u\r\n"
-             "\r\n",
-             this->GetCSeq(), rtp_chn, rtcp_chn, session_id);
-    return (int)strlen(res);
-}
-
-int RtspConnect::BuildSetupUdp_res(char const *res, size_t size,
-                                   uint16_t rtp_chn, uint16_t rtcp_chn,
-                                   uint32_t session_id) {
-    ::memset((void *)res, 0, size);
-    snprintf((char *)res, size,
-             "RTSP/1.0 200 OK\r\n"
-             "CSeq: %u\r\n"
-             "Transport: RTP/AVP;unicast;client_port=%u-%u;server_port"
-             "=%u-%u\r\n"
-             "Session: %u\r\n"
-             "\r\n",
-             this->GetCSeq(), this->GetRtpPort(), this->GetRtcpPort(), rtp_chn,
-             rtcp_chn, session_id);
-    return (int)strlen(res);
-}
-
-int RtspConnect::BuildPlay_res(char const *res, size_t size,
-                               char const *rtpInfo, uint32_t session_id) {
-    ::memset((void *)res, 0, size);
-    snprintf((char *)res, size,
-             "RTSP/1.0 200 OK\r\n"
-             "CSeq: %d\r\n"
-             "Range: npt=0.00-\r\n"
-             "Session: %u;timeout=60\r\n",
-             this->GetCSeq(), session_id);
-
+std::shared_ptr<Send_Node> RtspConnect::BuildSetupTcp_res(uint16_t rtp_chn,
+                                                          uint16_t rtcp_chn,
+                                                          uint32_t session_id) {
+    return RtspResponse(RtspStatus::OK, GetCSeq())
+        .Begin("Transport")
+        .Append("RTP/AVP/TCP;unicast;interleaved=")
+        .Append((uint64_t)rtp_chn)
+        .Append("-")
+        .Append((uint64_t)rtcp_chn)
+        .End()
+        .Header("Session", (uint64_t)session_id)
+        .Finish();
+}
+
+std::shared_ptr<Send_Node> RtspConnect::BuildSetupUdp_res(uint16_t rtp_chn,
+                                                          uint16_t rtcp_chn,
+                                                          uint32_t session_id) {
+    return RtspResponse(RtspStatus::OK, GetCSeq())
+        .Begin("Transport")
+        .Append("RTP/AVP;unicast;client_port=")
+        .Append((uint64_t)GetRtpPort())
+        .Append("-")
+        .Append((uint64_t)GetRtcpPort())
+        .Append(";server_port=")
+        .Append((uint64_t)rtp_chn)
+        .Append("-")
+        .Append((uint64_t)rtcp_chn)
+        .End()
+        .Header("Session", (uint64_t)session_id)
+        .Finish();
+}
+
+std::shared_ptr<Send_Node>
+RtspConnect::BuildPlay_res(char const *rtpInfo, uint32_t session_id,
+                           char const *scale_header, double scale) {
+    RtspResponse response(RtspStatus::OK, GetCSeq());
+    response.Begin("Range").Append("npt=").Append(GetRangeStart(), 3)
+        .Append("-").End();
+    response.Begin("Session").Append((uint64_t)session_id)
+        .Append(";timeout=").Append((uint64_t)GetSessionTimeout()).End();
+    if (scale_header != nullptr) {
+        response.Begin(scale_header).Append(scale, 3).End();
+    }
     if (rtpInfo != nullptr) {
-        snprintf((char *)res + strlen(res), size - strlen(res), "%s\r\n",
-                 rtpInfo);
+        response.Append(rtpInfo).End();
     }
-    snprintf((char *)res + strlen(res), size - strlen(res), "\r\n");
-    return (int)strlen(res);
+    return response.Finish();
 }
 
-int RtspConnect::BuildNotFound_res(char const *res, int size) {
-    memset((void *)res, 0, size);
-    snprintf((char *)res, size,
-             "RTSP/1.0 404 Stream Not Found\r\n"
-             "CSeq: %u\r\n"
-             "\r\n",
-             this->GetCSeq());
+std::shared_ptr<Send_Node> RtspConnect::BuildNotFound_res() {
+    return RtspResponse(RtspStatus::NOT_FOUND, GetCSeq()).Finish();
+}
+
+std::shared_ptr<Send_Node> RtspConnect::BuildServerError_res() {
+    return RtspResponse(RtspStatus::SERVER_ERROR, GetCSeq()).Finish();
+}
 
-    return (int)strlen(res);
+std::shared_ptr<Send_Node> RtspConnect::BuildTeardown_res() {
+    return RtspResponse(RtspStatus::OK, GetCSeq()).Finish();
 }
 
-int RtspConnect::BuildServerError_res(char const *res, int size) {
-    memset((void *)res, 0, size);
-    snprintf((char *)res, size,
-             "RTSP/1.0 500 Internal Server Error\r\n"
-             "CSeq: %u\r\n"
-             "\r\n",
-             this->GetCSeq());
+std::shared_ptr<Send_Node>
+RtspConnect::BuildGetParameter_res(uint32_t session_id) {
+    RtspResponse response(RtspStatus::OK, GetCSeq());
+    if (session_id != 0) {
+        response.Begin("Session").Append((uint64_t)session_id)
+            .Append(";timeout=").Append((uint64_t)GetSessionTimeout()).End();
+    }
+    return response.Finish();
+}
 
-    return (int)strlen(res);
+std::shared_ptr<Send_Node> RtspConnect::BuildError_res(RtspStatus status) {
+    return RtspResponse(status, GetCSeq()).Finish();
 }
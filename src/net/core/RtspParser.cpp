@@ -0,0 +1,428 @@
+#include "net/media.hpp"
+#include "net/Rtp.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <net/RtspParser.hpp>
+#include <string_view>
+
+namespace {
+
+std::string_view Trim(std::string_view str) {
+    while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) {
+        str.remove_prefix(1);
+    }
+    while (!str.empty() && (str.back() == ' ' || str.back() == '\t' ||
+                            str.back() == '\r')) {
+        str.remove_suffix(1);
+    }
+    return str;
+}
+
+bool IEquals(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if ((a[i] | 0x20) != (b[i] | 0x20)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename T>
+bool ParseUint(std::string_view str, T *value) {
+    auto ret = std::from_chars(str.data(), str.data() + str.size(), *value);
+    return ret.ec == std::errc() && ret.ptr != str.data();
+}
+
+bool ParseDouble(std::string_view str, double *value) {
+    // strtod需要以'\0'结尾, 拷到栈上
+    char buf[32];
+    if (str.empty() || str.size() >= sizeof(buf)) {
+        return false;
+    }
+    memcpy(buf, str.data(), str.size());
+    buf[str.size()] = '\0';
+    char *end = nullptr;
+    *value = strtod(buf, &end);
+    return end != buf;
+}
+
+bool CopyField(char *dst, size_t capacity, std::string_view src) {
+    if (src.size() >= capacity) {
+        return false;
+    }
+    memcpy(dst, src.data(), src.size());
+    dst[src.size()] = '\0';
+    return true;
+}
+
+Method ParseMethod(std::string_view method) {
+    if (method == "OPTIONS") {
+        return Method::OPTIONS;
+    } else if (method == "DESCRIBE") {
+        return Method::DESCRIBE;
+    } else if (method == "SETUP") {
+        return Method::SETUP;
+    } else if (method == "PLAY") {
+        return Method::PLAY;
+    } else if (method == "TEARDOWN") {
+        return Method::TEARDOWN;
+    } else if (method == "GET_PARAMETER") {
+        return Method::GET_PARAMETER;
+    }
+    return Method::NONE;
+}
+
+// rtsp://ip[:port][/suffix]
+bool ParseUrl(std::string_view url, RtspRequest *req) {
+    if (!CopyField(req->url, sizeof(req->url), url)) {
+        return false;
+    }
+    if (url == "*") {
+        return true;
+    }
+    if (url.substr(0, 7) != "rtsp://") {
+        return false;
+    }
+    url.remove_prefix(7);
+
+    size_t slash = url.find('/');
+    std::string_view host = url.substr(0, slash);
+    std::string_view suffix = slash == std::string_view::npos
+                                  ? std::string_view()
+                                  : url.substr(slash + 1);
+
+    req->url_port = 554;
+    size_t colon = host.find(':');
+    if (colon != std::string_view::npos) {
+        if (!ParseUint(host.substr(colon + 1), &req->url_port)) {
+            return false;
+        }
+        host = host.substr(0, colon);
+    }
+
+    if (!CopyField(req->url_ip, sizeof(req->url_ip), host) ||
+        !CopyField(req->url_suffix, sizeof(req->url_suffix), suffix)) {
+        return false;
+    }
+    req->channel_id = suffix.find("track1") != std::string_view::npos
+                          ? MediaChannelID::channel1
+                          : MediaChannelID::channel0;
+    return true;
+}
+
+// a-b, 只有a时b取a+1
+bool ParseRange(std::string_view value, uint16_t *first, uint16_t *second) {
+    size_t dash = value.find('-');
+    if (!ParseUint(value.substr(0, dash), first)) {
+        return false;
+    }
+    if (dash == std::string_view::npos) {
+        *second = *first + 1;
+        return true;
+    }
+    return ParseUint(value.substr(dash + 1), second);
+}
+
+// RTP/AVP/TCP;unicast;interleaved=0-1 或 RTP/AVP;unicast;client_port=a-b
+bool ParseTransport(std::string_view value, RtspRequest *req) {
+    bool is_tcp = false, has_ports = false;
+    while (!value.empty()) {
+        size_t semi = value.find(';');
+        std::string_view param = Trim(value.substr(0, semi));
+        value = semi == std::string_view::npos ? std::string_view()
+                                               : value.substr(semi + 1);
+
+        if (param == "RTP/AVP/TCP") {
+            is_tcp = true;
+        } else if (param.substr(0, 12) == "interleaved=") {
+            uint16_t rtp_channel = 0, rtcp_channel = 0;
+            if (!ParseRange(param.substr(12), &rtp_channel, &rtcp_channel)) {
+                return false;
+            }
+            req->rtp_channel = (uint8_t)rtp_channel;
+            req->rtcp_channel = (uint8_t)rtcp_channel;
+            has_ports = true;
+        } else if (param.substr(0, 12) == "client_port=") {
+            if (!ParseRange(param.substr(12), &req->rtp_port,
+                            &req->rtcp_port)) {
+                return false;
+            }
+            has_ports = true;
+        }
+    }
+
+    req->transport =
+        is_tcp ? TransportMode::RTP_OVER_TCP : TransportMode::RTP_OVER_UDP;
+    req->has_transport = has_ports;
+    return has_ports;
+}
+
+bool ParseHeader(std::string_view name, std::string_view value,
+                 RtspRequest *req) {
+    if (IEquals(name, "CSeq")) {
+        req->has_cseq = ParseUint(value, &req->cseq);
+        return req->has_cseq;
+    } else if (IEquals(name, "Transport")) {
+        return ParseTransport(value, req);
+    } else if (IEquals(name, "Accept")) {
+        req->has_accept = true;
+        req->accept_sdp = value.find("sdp") != std::string_view::npos;
+    } else if (IEquals(name, "Session")) {
+        req->has_session =
+            ParseUint(value.substr(0, value.find(';')), &req->session_id);
+    } else if (IEquals(name, "Scale") || IEquals(name, "Speed")) {
+        req->has_scale = ParseDouble(value, &req->scale);
+        CopyField(req->scale_header, sizeof(req->scale_header), name);
+    } else if (IEquals(name, "Range")) {
+        if (value.substr(0, 4) == "npt=") {
+            req->has_range = ParseDouble(value.substr(4), &req->range_start);
+        }
+    } else if (IEquals(name, "Content-Length")) {
+        return ParseUint(value, &req->content_length);
+    }
+    return true;
+}
+
+// 只确定消息边界, 不解析内容. scanned返回查找头部结束标记时已经扫描过的长度
+RtspParser::Result FindMessage(std::string_view data, size_t scan_from,
+                               RtspFrame *frame, size_t *scanned) {
+    if (data.empty()) {
+        return RtspParser::Result::INCOMPLETE;
+    }
+
+    // $ + 1字节通道号 + 2字节长度 + 数据
+    if (data[0] == '$') {
+        if (data.size() < RTP_TCP_HEAD_SIZE) {
+            return RtspParser::Result::INCOMPLETE;
+        }
+        size_t size = ((uint8_t)data[2] << 8) | (uint8_t)data[3];
+        if (data.size() < RTP_TCP_HEAD_SIZE + size) {
+            return RtspParser::Result::INCOMPLETE;
+        }
+        frame->interleaved = true;
+        frame->channel = (uint8_t)data[1];
+        frame->data = data.data() + RTP_TCP_HEAD_SIZE;
+        frame->size = size;
+        frame->consumed = RTP_TCP_HEAD_SIZE + size;
+        return RtspParser::Result::COMPLETE;
+    }
+
+    size_t head_end = data.find("\r\n\r\n", scan_from);
+    if (head_end == std::string_view::npos) {
+        *scanned = data.size();
+        return data.size() >= RTSP_MAX_MESSAGE_SIZE
+                   ? RtspParser::Result::ERROR
+                   : RtspParser::Result::INCOMPLETE;
+    }
+
+    // 只关心Content-Length
+    uint32_t content_length = 0;
+    std::string_view head = data.substr(0, head_end + 2);
+    while (!head.empty()) {
+        size_t line_end = head.find("\r\n");
+        std::string_view line = head.substr(0, line_end);
+        head.remove_prefix(line_end + 2);
+
+        size_t colon = line.find(':');
+        if (colon != std::string_view::npos &&
+            IEquals(Trim(line.substr(0, colon)), "Content-Length") &&
+            !ParseUint(Trim(line.substr(colon + 1)), &content_length)) {
+            return RtspParser::Result::ERROR;
+        }
+    }
+
+    size_t total = head_end + 4 + content_length;
+    if (total > RTSP_MAX_MESSAGE_SIZE) {
+        return RtspParser::Result::ERROR;
+    }
+    if (data.size() < total) {
+        return RtspParser::Result::INCOMPLETE;
+    }
+    frame->interleaved = false;
+    frame->channel = 0;
+    frame->data = data.data();
+    frame->size = total;
+    frame->consumed = total;
+    return RtspParser::Result::COMPLETE;
+}
+
+// 解析一个完整的RTSP请求, data为FindMessage切出的整条消息
+RtspParser::Result ParseMessage(std::string_view data, RtspRequest *req) {
+    req->Reset();
+    size_t head_end = data.find("\r\n\r\n");
+    if (head_end == std::string_view::npos) {
+        return RtspParser::Result::ERROR;
+    }
+    std::string_view head = data.substr(0, head_end + 2);
+
+    // 请求行: METHOD URL RTSP/1.0
+    size_t line_end = head.find("\r\n");
+    std::string_view line = head.substr(0, line_end);
+    head.remove_prefix(line_end + 2);
+
+    size_t sp1 = line.find(' ');
+    size_t sp2 = sp1 == std::string_view::npos ? sp1 : line.find(' ', sp1 + 1);
+    if (sp2 == std::string_view::npos ||
+        line.substr(sp2 + 1, 5) != "RTSP/") {
+        return RtspParser::Result::ERROR;
+    }
+    req->method = ParseMethod(line.substr(0, sp1));
+    if (!ParseUrl(line.substr(sp1 + 1, sp2 - sp1 - 1), req)) {
+        return RtspParser::Result::ERROR;
+    }
+
+    while (!head.empty()) {
+        line_end = head.find("\r\n");
+        line = head.substr(0, line_end);
+        head.remove_prefix(line_end + 2);
+
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos) {
+            continue;
+        }
+        if (!ParseHeader(Trim(line.substr(0, colon)),
+                         Trim(line.substr(colon + 1)), req)) {
+            return RtspParser::Result::ERROR;
+        }
+    }
+
+    if (!req->has_cseq) {
+        return RtspParser::Result::ERROR;
+    }
+    req->body = data.substr(head_end + 4, req->content_length);
+    return RtspParser::Result::COMPLETE;
+}
+
+} // namespace
+
+void RtspRequest::Reset() {
+    method = Method::NONE;
+    cseq = 0;
+    has_cseq = false;
+    url[0] = url_ip[0] = url_suffix[0] = '\0';
+    url_port = 0;
+    channel_id = channel0;
+    has_transport = false;
+    transport = TransportMode::RTP_OVER_TCP;
+    rtp_port = rtcp_port = 0;
+    rtp_channel = rtcp_channel = 0;
+    has_accept = accept_sdp = false;
+    has_session = false;
+    session_id = 0;
+    has_scale = false;
+    scale = 1.0;
+    scale_header[0] = '\0';
+    has_range = false;
+    range_start = 0.0;
+    content_length = 0;
+    body = std::string_view();
+    interleaved_channel = 0;
+}
+
+RtspParser::RtspParser(size_t capacity)
+    : pool_(BufferPool::GetInstance()),
+      init_capacity_(BufferPool::RoundUp(capacity)) {}
+
+RtspParser::~RtspParser() {
+    pool_->Release(buf_, capacity_);
+}
+
+void RtspParser::Reserve(size_t capacity) {
+    size_t new_capacity = 0;
+    char *buf = pool_->Acquire(capacity, &new_capacity);
+    if (buf_ != nullptr) {
+        memcpy(buf, buf_ + read_pos_, Pending());
+        pool_->Release(buf_, capacity_);
+    }
+    write_pos_ -= read_pos_;
+    read_pos_ = 0;
+    buf_ = buf;
+    capacity_ = new_capacity;
+}
+
+char *RtspParser::Prepare(size_t size) {
+    if (read_pos_ == write_pos_) {
+        read_pos_ = write_pos_ = 0;
+        // 大消息处理完后缩回初始大小
+        if (capacity_ > init_capacity_ && size <= init_capacity_) {
+            pool_->Release(buf_, capacity_);
+            buf_ = nullptr;
+            capacity_ = 0;
+        }
+    }
+    if (buf_ == nullptr) {
+        Reserve(std::max(size, init_capacity_));
+    } else if (capacity_ - write_pos_ < size) {
+        // 先把未处理的数据移到头部, 还不够才换更大的缓冲区
+        memmove(buf_, buf_ + read_pos_, Pending());
+        write_pos_ -= read_pos_;
+        read_pos_ = 0;
+        if (capacity_ - write_pos_ < size) {
+            Reserve(write_pos_ + size);
+        }
+    }
+    return buf_ + write_pos_;
+}
+
+bool RtspParser::Commit(size_t size) {
+    write_pos_ += size;
+    return Pending() <= RTSP_MAX_PENDING_SIZE;
+}
+
+bool RtspParser::Append(char const *data, size_t size) {
+    if (Pending() + size > RTSP_MAX_PENDING_SIZE) {
+        return false;
+    }
+    memcpy(Prepare(size), data, size);
+    return Commit(size);
+}
+
+RtspParser::Result RtspParser::NextFrame(RtspFrame *frame) {
+    size_t scanned = 0;
+    size_t scan_from = scan_pos_ > 3 ? scan_pos_ - 3 : 0;
+    Result ret = FindMessage(std::string_view(buf_ + read_pos_, Pending()),
+                             scan_from, frame, &scanned);
+    if (ret == Result::COMPLETE) {
+        read_pos_ += frame->consumed;
+        scan_pos_ = 0;
+    } else {
+        // 还没有找到头部结束标记时, 下次从这里继续找
+        scan_pos_ = scanned;
+    }
+    return ret;
+}
+
+RtspParser::Result RtspParser::Next(RtspRequest *req) {
+    RtspFrame frame;
+    Result ret = NextFrame(&frame);
+    if (ret != Result::COMPLETE) {
+        return ret;
+    }
+    if (frame.interleaved) {
+        req->Reset();
+        req->method = Method::RTCP;
+        req->interleaved_channel = frame.channel;
+        req->body = std::string_view(frame.data, frame.size);
+        return Result::COMPLETE;
+    }
+    return ParseMessage(std::string_view(frame.data, frame.size), req);
+}
+
+void RtspParser::Clear() {
+    read_pos_ = write_pos_ = scan_pos_ = 0;
+    if (capacity_ > init_capacity_) {
+        pool_->Release(buf_, capacity_);
+        buf_ = nullptr;
+        capacity_ = 0;
+    }
+}
+
+RtspParser::Result RtspParser::Parse(std::string_view data, RtspRequest *req) {
+    return ParseMessage(data, req);
+}
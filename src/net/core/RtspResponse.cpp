@@ -0,0 +1,105 @@
+#include "net/MsgNode.hpp"
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <net/RtspResponse.hpp>
+#include <string>
+#include <string_view>
+
+namespace {
+
+// 与RtspStatus一一对应
+std::string_view const kStatusLines[] = {
+    "RTSP/1.0 200 OK\r\n",
+    "RTSP/1.0 400 Bad Request\r\n",
+    "RTSP/1.0 404 Stream Not Found\r\n",
+    "RTSP/1.0 454 Session Not Found\r\n",
+    "RTSP/1.0 455 Method Not Valid in This State\r\n",
+    "RTSP/1.0 461 Unsupported Transport\r\n",
+    "RTSP/1.0 500 Internal Server Error\r\n",
+    "RTSP/1.0 501 Not Implemented\r\n",
+    "RTSP/1.0 451 Parameter Not Understood\r\n",
+    "RTSP/1.0 503 Service Unavailable\r\n",
+};
+
+} // namespace
+
+std::string_view RtspResponse::StatusLine(RtspStatus status) {
+    return kStatusLines[(int)status];
+}
+
+RtspResponse::RtspResponse(RtspStatus status, uint32_t cseq,
+                           size_t capacity)
+    : node_(std::make_shared<Send_Node>(capacity)) {
+    pos_ = node_->Getdata();
+    end_ = pos_ + node_->GetCapacity();
+    Append(StatusLine(status));
+    Header("CSeq", cseq);
+}
+
+RtspResponse &RtspResponse::Append(std::string_view str) {
+    if ((size_t)(end_ - pos_) < str.size()) {
+        overflow_ = true;
+        return *this;
+    }
+    memcpy(pos_, str.data(), str.size());
+    pos_ += str.size();
+    return *this;
+}
+
+RtspResponse &RtspResponse::Append(uint64_t value) {
+    auto ret = std::to_chars(pos_, end_, value);
+    if (ret.ec != std::errc()) {
+        overflow_ = true;
+        return *this;
+    }
+    pos_ = ret.ptr;
+    return *this;
+}
+
+RtspResponse &RtspResponse::Append(double value, int precision) {
+    auto ret = std::to_chars(pos_, end_, value, std::chars_format::fixed,
+                             precision);
+    if (ret.ec != std::errc()) {
+        overflow_ = true;
+        return *this;
+    }
+    pos_ = ret.ptr;
+    return *this;
+}
+
+RtspResponse &RtspResponse::Begin(std::string_view name) {
+    return Append(name).Append(": ");
+}
+
+RtspResponse &RtspResponse::End() {
+    return Append("\r\n");
+}
+
+RtspResponse &RtspResponse::Header(std::string_view name,
+                                   std::string_view value) {
+    return Begin(name).Append(value).End();
+}
+
+RtspResponse &RtspResponse::Header(std::string_view name, uint64_t value) {
+    return Begin(name).Append(value).End();
+}
+
+std::shared_ptr<Send_Node>
+RtspResponse::Finish(std::shared_ptr<std::string const> body,
+                     std::string_view content_type) {
+    if (body != nullptr) {
+        Header("Content-Length", (uint64_t)body->size());
+        if (!content_type.empty()) {
+            Header("Content-Type", content_type);
+        }
+    }
+    End();
+    if (overflow_) {
+        return nullptr;
+    }
+    node_->SetLen(pos_ - node_->Getdata());
+    node_->body_ = std::move(body);
+    return node_;
+}
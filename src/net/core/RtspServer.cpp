@@ -1,12 +1,14 @@
 #include "Log/logger.hpp"
 #include "net/IOServicePool.hpp"
+#include "net/LatencyTracker.hpp"
+#include "net/Tracer.hpp"
 #include "net/media.hpp"
 #include "net/MediaSession.hpp"
 #include "net/RtspConnection.hpp"
 #include <boost/asio/buffer.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/read.hpp>
-#include <boost/system/detail/error_code.hpp>
+#include <boost/system/error_code.hpp>
 #include <iostream>
 #include <memory>
 #include <mutex>
@@ -15,32 +17,85 @@
 
 RtspServer::RtspServer(boost::asio::io_context &ioc, short port)
     : acceptor_(ioc, tcp::endpoint(tcp::v4(), port)),
-      ioc_(ioc) {}
+      ioc_(ioc),
+      idle_wheel_(new TimingWheel(ioc, RTSP_SESSION_TIMEOUT)) {
+    auto &registry = MetricsRegistry::Instance();
+    accepted_metric_ = registry.AddCounter("rtsp_connections_accepted_total",
+                                           "RTSP connections accepted");
+    connections_metric_ = registry.AddGauge("rtsp_connections",
+                                            "Open RTSP connections");
+}
+
+void RtspServer::SetIdleTimeout(uint32_t timeout_sec) {
+    idle_wheel_.reset(new TimingWheel(ioc_, timeout_sec));
+}
 
 void RtspServer::Start() {
+    idle_wheel_->Start();
+    StartAccept();
+}
+
+void RtspServer::StartAccept() {
     auto self = shared_from_this();
     auto &ioc = IOServicePool::GetInstance()->GetService();
-    std::shared_ptr<RtspConnect> new_con =
-        std::make_shared<RtspConnect>(shared_from_this(), ioc);
-    connections_.emplace_back(new_con);
+    // 不用make_shared: 空闲轮里的weak_ptr会让合并分配的对象内存
+    // 一直保留到转到它那一格, 分开分配时只保留控制块
+    std::shared_ptr<RtspConnect> new_con(
+        new RtspConnect(shared_from_this(), ioc));
     acceptor_.async_accept(
         new_con->GetSocket(),
         [new_con, self](boost::system::error_code const &ec) {
             try {
                 if (ec) {
-                    self->Start();
+                    self->StartAccept();
                     return;
                 }
                 LOG_DEBUG("new connection");
+                self->accepted_metric_.Add();
+                new_con->SetConnectionSlot(self->AddConnection(new_con));
+                self->idle_wheel_->Add(new_con);
+                new_con->Touch();
                 new_con->AsyncRead();
-                self->Start();
+                self->StartAccept();
             } catch (std::exception &exp) {
                 std::cout << "error:" << exp.what() << std::endl;
-                self->Start();
+                self->StartAccept();
             }
         });
 }
 
+size_t RtspServer::AddConnection(std::shared_ptr<RtspConnect> conn) {
+    std::lock_guard<std::mutex> lk(conn_mtx_);
+    size_t slot = 0;
+    if (free_slots_.empty()) {
+        slot = connections_.size();
+        connections_.emplace_back(std::move(conn));
+    } else {
+        slot = free_slots_.back();
+        free_slots_.pop_back();
+        connections_[slot] = std::move(conn);
+    }
+    conn_count_++;
+    connections_metric_.Set((int64_t)conn_count_);
+    return slot;
+}
+
+void RtspServer::RemoveConnection(size_t slot) {
+    std::lock_guard<std::mutex> lk(conn_mtx_);
+    if (slot >= connections_.size() || connections_[slot] == nullptr) {
+        return;
+    }
+    connections_[slot].reset();
+    free_slots_.push_back(slot);
+    conn_count_--;
+    connections_metric_.Set((int64_t)conn_count_);
+}
+
+size_t RtspServer::GetConnectionCount() {
+    std::lock_guard<std::mutex> lk(conn_mtx_);
+    return conn_count_;
+}
+
 MediaSessionId RtspServer::AddSession(MediaSession *session) {
     std::lock_guard<std::mutex> lk(mtx_);
     if (rtsp_suffix_map_.find(session->GetRtspUrlSuffix()) !=
@@ -66,8 +121,9 @@ void RtspServer::RemoveSession(MediaSessionId id) {
 }
 
 bool RtspServer::PushFrame(MediaSessionId id, MediaChannelID channel,
-                           AVFrame frame) {
+                           AVFrame frame, int rendition) {
     std::shared_ptr<MediaSession> session = nullptr;
+    std::shared_ptr<FrameTraceWriter> writer = nullptr;
     {
         std::lock_guard<std::mutex> lk(mtx_);
         auto iter = media_sessions_.find(id);
@@ -76,14 +132,45 @@ bool RtspServer::PushFrame(MediaSessionId id, MediaChannelID channel,
         } else {
             return false;
         }
+        writer = frame_writer_;
+    }
+    // 没有客户端时也记录, 回放时的节奏与推流端一致
+    if (writer != nullptr) {
+        writer->Write(id, channel, rendition, frame);
     }
 
     if (session != nullptr && session->GetNumClient() != 0) {
-        return session->HandleFrame(channel, frame);
+        TraceScope trace(TraceEventType::FRAME_INGEST, frame.size);
+        frame.trace_tsc = LatencyTracker::IsEnabled() ? Tsc::Now() : 0;
+        return session->HandleFrame(channel, rendition, frame);
     }
     return false;
 }
 
+bool RtspServer::StartFrameRecording(std::string const &path,
+                                     bool with_payload) {
+    auto writer = std::make_shared<FrameTraceWriter>();
+    if (!writer->Open(path.c_str(), with_payload)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lk(mtx_);
+    frame_writer_ = writer;
+    return true;
+}
+
+void RtspServer::StopFrameRecording() {
+    std::shared_ptr<FrameTraceWriter> writer;
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        writer.swap(frame_writer_);
+    }
+    // 正在写的推流线程还持有引用, 最后一个引用释放时关闭文件
+    if (writer != nullptr) {
+        LOG_INFO("frame recording stopped, %llu frames",
+                 (unsigned long long)writer->GetFrameCount());
+    }
+}
+
 std::shared_ptr<MediaSession>
 RtspServer::LookMediaSession(std::string const &suffix) {
     std::lock_guard<std::mutex> lk(mtx_);
@@ -107,4 +194,51 @@ std::shared_ptr<MediaSession> RtspServer ::LookMediaSession(MediaSessionId id) {
     return nullptr;
 }
 
-RtspServer ::~RtspServer() {}
+bool RtspServer::PostTraceDump(std::function<void()> task) {
+    std::lock_guard<std::mutex> lk(dump_mtx_);
+    if (dump_stopped_ || dump_busy_) {
+        return false;
+    }
+    if (!dump_thread_.joinable()) {
+        dump_thread_ = std::thread(&RtspServer::TraceDumpLoop, this);
+    }
+    dump_busy_ = true;
+    dump_task_ = std::move(task);
+    dump_cv_.notify_one();
+    return true;
+}
+
+void RtspServer::TraceDumpLoop() {
+    Tracer::SetThreadName("trace-dump");
+    std::unique_lock<std::mutex> lk(dump_mtx_);
+    while (true) {
+        dump_cv_.wait(lk, [this]() { return dump_task_ || dump_stopped_; });
+        if (!dump_task_) {
+            return;
+        }
+        auto task = std::move(dump_task_);
+        dump_task_ = nullptr;
+        lk.unlock();
+        task();
+        // 任务里持有的连接在锁外释放
+        task = nullptr;
+        lk.lock();
+        dump_busy_ = false;
+    }
+}
+
+void RtspServer::Shutdown() {
+    {
+        std::lock_guard<std::mutex> lk(dump_mtx_);
+        dump_stopped_ = true;
+    }
+    dump_cv_.notify_one();
+    if (dump_thread_.joinable()) {
+        dump_thread_.join();
+    }
+    StopFrameRecording();
+}
+
+RtspServer ::~RtspServer() {
+    Shutdown();
+}
@@ -0,0 +1,76 @@
+#include "Log/logger.hpp"
+#include "net/RtspConnection.hpp"
+#include <boost/asio/error.hpp>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <net/TimingWheel.hpp>
+#include <utility>
+#include <vector>
+
+TimingWheel::TimingWheel(boost::asio::io_context &ioc, uint32_t timeout_sec)
+    : timer_(ioc),
+      timeout_sec_(timeout_sec),
+      buckets_(timeout_sec + 1) {}
+
+void TimingWheel::Start() {
+    if (is_running_) {
+        return;
+    }
+    is_running_ = true;
+    timer_.expires_after(std::chrono::seconds(1));
+    timer_.async_wait([this](boost::system::error_code const &ec) {
+        if (ec == boost::asio::error::operation_aborted) {
+            return;
+        }
+        OnTick();
+    });
+}
+
+void TimingWheel::Stop() {
+    is_running_ = false;
+    timer_.cancel();
+}
+
+void TimingWheel::Add(std::shared_ptr<RtspConnect> const &conn) {
+    Place(conn, timeout_sec_);
+}
+
+void TimingWheel::Place(std::weak_ptr<RtspConnect> conn, uint32_t delay_sec) {
+    buckets_[(cursor_ + delay_sec) % buckets_.size()].push_back(
+        std::move(conn));
+    size_++;
+}
+
+void TimingWheel::OnTick() {
+    cursor_ = (cursor_ + 1) % buckets_.size();
+    std::vector<std::weak_ptr<RtspConnect>> expired;
+    expired.swap(buckets_[cursor_]);
+    size_ -= expired.size();
+
+    uint64_t timeout_ms = timeout_sec_ * 1000ull;
+    for (auto &weak_conn : expired) {
+        auto conn = weak_conn.lock();
+        if (!conn || conn->IsClosed()) {
+            continue;
+        }
+        uint64_t idle_ms = conn->GetIdleTime();
+        if (idle_ms >= timeout_ms) {
+            LOG_DEBUG("rtsp connection idle for %lu ms, close it",
+                      (unsigned long)idle_ms);
+            conn->RequestClose();
+            continue;
+        }
+        // 按剩余时间向上取整放到后面的格
+        uint32_t delay = (uint32_t)((timeout_ms - idle_ms + 999) / 1000);
+        Place(std::move(weak_conn), delay);
+    }
+    // 复用这一格的内存
+    expired.clear();
+    if (buckets_[cursor_].empty()) {
+        buckets_[cursor_].swap(expired);
+    }
+
+    is_running_ = false;
+    Start();
+}
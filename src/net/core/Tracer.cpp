@@ -0,0 +1,172 @@
+#include "Log/logger.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <net/Tracer.hpp>
+#include <pthread.h>
+#include <string>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct TraceTypeInfo {
+    char const *name;
+    char const *arg;
+};
+
+TraceTypeInfo const kTypeInfos[] = {
+    {"frame_ingest", "bytes"},   {"packetize", "rendition"},
+    {"udp_send", "bytes"},       {"tcp_enqueue", "bytes"},
+    {"logic_send", "bytes"},     {"write_start", "bytes"},
+    {"write_complete", "bytes"}, {"rtsp_read", "bytes"},
+    {"rtsp_request", "bytes"},
+};
+static_assert(sizeof(kTypeInfos) / sizeof(kTypeInfos[0]) ==
+                  (size_t)TraceEventType::NUM,
+              "trace type table out of sync");
+
+} // namespace
+
+Tracer &Tracer::Instance() {
+    // 不析构: 各线程退出前还可能记录
+    static Tracer *tracer = new Tracer();
+    return *tracer;
+}
+
+Tracer::Buffer *Tracer::RegisterThread() {
+    Tracer &tracer = Instance();
+    Buffer *buffer = new Buffer;
+    buffer->tid = (int)syscall(SYS_gettid);
+    std::lock_guard<std::mutex> lk(tracer.mutex_);
+    buffer->index = (uint32_t)tracer.buffers_.size();
+    buffer->name = "thread-" + std::to_string(buffer->index);
+    tracer.buffers_.push_back(buffer);
+    local_buffer_ = buffer;
+    return buffer;
+}
+
+void Tracer::SetThreadName(std::string const &name) {
+    Buffer *buffer = local_buffer_;
+    if (buffer == nullptr) {
+        buffer = RegisterThread();
+    }
+    // 主线程的名字就是进程名, 不改
+    if (buffer->tid != (int)getpid()) {
+        pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+    }
+    Tracer &tracer = Instance();
+    std::lock_guard<std::mutex> lk(tracer.mutex_);
+    buffer->name = name;
+}
+
+std::string Tracer::ExportChromeJson() {
+    struct ThreadEvents {
+        int tid;
+        std::string name;
+        std::vector<TraceEvent> events;
+    };
+    std::vector<ThreadEvents> threads;
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        for (Buffer *buffer: buffers_) {
+            ThreadEvents thread{buffer->tid, buffer->name, {}};
+            uint64_t head = buffer->head.load(std::memory_order_acquire);
+            uint64_t begin = head > kBufferSize ? head - kBufferSize : 0;
+            thread.events.reserve(head - begin);
+            for (uint64_t i = begin; i < head; i++) {
+                thread.events.push_back(buffer->events[i & (kBufferSize - 1)]);
+            }
+            // 拷贝期间写线程可能覆盖了最旧的几个事件(包括正在写的那个), 丢掉
+            uint64_t now_head = buffer->head.load(std::memory_order_acquire);
+            if (now_head + 1 > begin + kBufferSize) {
+                size_t stale = (size_t)std::min<uint64_t>(
+                    now_head + 1 - kBufferSize - begin, thread.events.size());
+                thread.events.erase(thread.events.begin(),
+                                    thread.events.begin() + stale);
+            }
+            threads.push_back(std::move(thread));
+        }
+    }
+
+    uint64_t base = UINT64_MAX;
+    for (auto const &thread: threads) {
+        for (auto const &event: thread.events) {
+            base = std::min(base, event.tsc);
+        }
+    }
+    double us_per_tick = Tsc::NsPerTick() / 1000.0;
+    int pid = (int)getpid();
+
+    std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    char line[256];
+    snprintf(line, sizeof(line),
+             "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+             "\"args\":{\"name\":\"RTSPServer\"}}",
+             pid);
+    out += line;
+    static char const kPhases[] = {'B', 'E', 'i'};
+    static char const kFlows[] = {0, 's', 't', 'f'};
+    for (auto const &thread: threads) {
+        // 线程名是程序里设置的, 不含需要转义的字符
+        snprintf(line, sizeof(line),
+                 ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+                 "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                 pid, thread.tid, thread.name.c_str());
+        out += line;
+        for (auto const &event: thread.events) {
+            if ((size_t)event.type >= (size_t)TraceEventType::NUM) {
+                continue;
+            }
+            TraceTypeInfo const &info = kTypeInfos[(int)event.type];
+            double ts = (double)(event.tsc - base) * us_per_tick;
+            if (event.phase == TracePhase::END) {
+                snprintf(line, sizeof(line),
+                         ",\n{\"name\":\"%s\",\"cat\":\"rtsp\",\"ph\":\"E\","
+                         "\"ts\":%.3f,\"pid\":%d,\"tid\":%d}",
+                         info.name, ts, pid, thread.tid);
+            } else {
+                // 瞬时事件只画在本线程上
+                char const *scope =
+                    event.phase == TracePhase::INSTANT ? "\"s\":\"t\"," : "";
+                snprintf(line, sizeof(line),
+                         ",\n{\"name\":\"%s\",\"cat\":\"rtsp\",\"ph\":\"%c\","
+                         "%s\"ts\":%.3f,\"pid\":%d,\"tid\":%d,"
+                         "\"args\":{\"%s\":%u}}",
+                         info.name, kPhases[(int)event.phase], scope, ts, pid,
+                         thread.tid, info.arg, event.arg);
+            }
+            out += line;
+            if (event.flow != TraceFlow::NONE && event.flow_id != 0) {
+                // 绑定到所在的slice上
+                snprintf(line, sizeof(line),
+                         ",\n{\"name\":\"handoff\",\"cat\":\"flow\","
+                         "\"ph\":\"%c\",\"bp\":\"e\",\"id\":\"0x%llx\","
+                         "\"ts\":%.3f,\"pid\":%d,\"tid\":%d}",
+                         kFlows[(int)event.flow],
+                         (unsigned long long)event.flow_id, ts, pid,
+                         thread.tid);
+                out += line;
+            }
+        }
+    }
+    out += "\n]}\n";
+    return out;
+}
+
+bool Tracer::Dump(std::string const &path) {
+    std::string json = ExportChromeJson();
+    FILE *file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        LOG_WARN("open trace file %s failed", path.c_str());
+        return false;
+    }
+    bool ok = fwrite(json.data(), 1, json.size(), file) == json.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        LOG_WARN("write trace file %s failed", path.c_str());
+    }
+    return ok;
+}
@@ -0,0 +1,109 @@
+#include "Log/logger.hpp"
+#include "net/H264Source.hpp"
+#include "net/media.hpp"
+#include "net/Rtp.hpp"
+#include <algorithm>
+#include <boost/asio/post.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <net/RtpConnection.hpp>
+#include <net/TrickPlay.hpp>
+
+TrickPlayer::TrickPlayer(boost::asio::steady_timer::executor_type executor,
+                         std::shared_ptr<H264File> file,
+                         std::shared_ptr<RtpConnect> rtp_conn,
+                         MediaChannelID channel_id, uint32_t framerate)
+    : timer_(executor),
+      file_(file),
+      rtp_conn_(rtp_conn),
+      channel_id_(channel_id),
+      framerate_(framerate == 0 ? 25 : framerate),
+      frame_buf_(2'000'000) {}
+
+void TrickPlayer::Start(double scale, size_t start_frame) {
+    auto self = shared_from_this();
+    boost::asio::post(timer_.get_executor(), [self, scale, start_frame] {
+        if (self->file_->GetKeyFrameCount() == 0) {
+            LOG_DEBUG("trick play: file has no key frame index");
+            return;
+        }
+        self->scale_ = scale;
+        self->key_index_ = self->file_->FindKeyFrame(start_frame);
+        // 与直播帧使用同一个时间基, 退出快进后时间戳仍然连续
+        self->timestamp_ = H264Source::GetTimeStamp();
+        self->is_running_ = true;
+        self->SendKeyFrame();
+    });
+}
+
+void TrickPlayer::Stop() {
+    auto self = shared_from_this();
+    boost::asio::post(timer_.get_executor(), [self] {
+        self->is_running_ = false;
+        self->timer_.cancel();
+    });
+}
+
+void TrickPlayer::SendKeyFrame() {
+    auto rtp_conn = rtp_conn_.lock();
+    if (!is_running_ || !rtp_conn) {
+        return;
+    }
+
+    int frame_size =
+        file_->ReadKeyFrame(key_index_, frame_buf_.data(), frame_buf_.size());
+    if (frame_size <= 0) {
+        LOG_DEBUG("trick play: read key frame %zu failed", key_index_);
+        return;
+    }
+
+    AVFrame frame(frame_size);
+    memcpy(frame.buffer.get(), frame_buf_.data(), frame_size);
+    frame.type = FrameType::VIDEO_FRAME_I;
+    frame.timestamp = timestamp_;
+    H264Source::PacketizeFrame(
+        channel_id_, frame,
+        [&rtp_conn](MediaChannelID channel_id, RtpPacket pkt) -> bool {
+            rtp_conn->SendTrickPacket(channel_id, pkt);
+            return true;
+        });
+
+    // 当前GOP的帧数决定发送间隔, 发送间隔又决定时间戳增量
+    size_t key_count = file_->GetKeyFrameCount();
+    size_t pos = file_->GetKeyFramePosition(key_index_);
+    size_t next_pos = key_index_ + 1 < key_count
+                          ? file_->GetKeyFramePosition(key_index_ + 1)
+                          : file_->GetFrameCount();
+    size_t gop_frames = next_pos > pos ? next_pos - pos : framerate_;
+    timestamp_ += (uint32_t)(gop_frames * 90000 / framerate_);
+
+    // 快进到最后一个IDR(快退到第一个)后停在那里, 不绕回文件另一头
+    size_t step = (size_t)std::max(1L, std::lround(std::fabs(scale_)));
+    if (scale_ > 0) {
+        if (key_index_ + 1 >= key_count) {
+            LOG_DEBUG("trick play: reached the last key frame");
+            is_running_ = false;
+            return;
+        }
+        key_index_ = std::min(key_index_ + step, key_count - 1);
+    } else {
+        if (key_index_ == 0) {
+            LOG_DEBUG("trick play: reached the first key frame");
+            is_running_ = false;
+            return;
+        }
+        key_index_ = key_index_ > step ? key_index_ - step : 0;
+    }
+
+    auto self = shared_from_this();
+    timer_.expires_after(
+        std::chrono::milliseconds(gop_frames * 1000 / framerate_));
+    timer_.async_wait([self](boost::system::error_code const &ec) {
+        if (ec) {
+            return;
+        }
+        self->SendKeyFrame();
+    });
+}
@@ -1,24 +1,84 @@
+#include "net/FrameTrace.hpp"
 #include "net/H264File.hpp"
 #include "net/H264Source.hpp"
+#include "net/HintFile.hpp"
 #include "net/media.hpp"
+#include "net/MetricsServer.hpp"
+#include "net/RtpExtension.hpp"
 #include "net/RtspServer.hpp"
+#include "net/Tracer.hpp"
+#include <algorithm>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/signal_set.hpp>
+#include <cstring>
+#include <functional>
 #include <iostream>
 #include <Log/logger.hpp>
 #include <memory>
+#include <string>
 #include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
 
 void SendFrameThread(RtspServer *rtsp_server, MediaSessionId session_id,
-                     H264File *h264_file);
+                     H264File *h264_file, int rendition);
+void SendHintThread(RtspServer *rtsp_server, MediaSessionId session_id,
+                    HintSource *hint_source);
+void ReplayThread(RtspServer *rtsp_server, MediaSessionId session_id,
+                  std::shared_ptr<FrameTraceReader> reader, double speed);
 
-int main() {
+int main(int argc, char **argv) {
     try {
+        // --record=文件 记录推流的帧轨迹(带负载), --record-sizes=文件 只记大小;
+        // --replay=文件 用帧轨迹代替文件推流, --speed=倍速(0为尽快推送);
+        // --trace-dump 允许客户端用GET_PARAMETER trace导出追踪缓冲区;
+        // --idle-timeout=秒 空闲连接的回收时间, 浸泡测试时调小
+        std::string record_path;
+        bool record_payload = true;
+        std::string replay_path;
+        double replay_speed = 1;
+        bool trace_dump = false;
+        uint32_t idle_timeout = 0;
+        std::vector<char *> args;
+        for (int i = 0; i < argc; i++) {
+            if (strncmp(argv[i], "--record=", 9) == 0) {
+                record_path = argv[i] + 9;
+            } else if (strncmp(argv[i], "--record-sizes=", 15) == 0) {
+                record_path = argv[i] + 15;
+                record_payload = false;
+            } else if (strncmp(argv[i], "--replay=", 9) == 0) {
+                replay_path = argv[i] + 9;
+            } else if (strncmp(argv[i], "--speed=", 8) == 0) {
+                replay_speed = atof(argv[i] + 8);
+            } else if (strcmp(argv[i], "--trace-dump") == 0) {
+                trace_dump = true;
+            } else if (strncmp(argv[i], "--idle-timeout=", 15) == 0) {
+                idle_timeout = (uint32_t)atoi(argv[i] + 15);
+            } else {
+                args.push_back(argv[i]);
+            }
+        }
+        argc = (int)args.size();
+        argv = args.data();
+
+        auto replay_reader = std::make_shared<FrameTraceReader>();
+        if (!replay_path.empty() && !replay_reader->Open(replay_path.c_str())) {
+            LOG_ERROR("打开帧轨迹失败: %s", replay_path.c_str());
+            return 0;
+        }
+        bool is_replay = replay_reader->IsOpen();
+
+        char const *file_path =
+            argc > 1 ? argv[1]
+                     : "/home/jie/workspace/cpp/RTSP/src/net/core/test.h264";
+        // HintConverter生成的预打包文件直接映射发送, 否则按裸H264文件实时打包
+        bool is_hint = HintFile::IsHintFile(file_path);
         H264File h264_file;
-        if (h264_file.Open(
-                "/home/jie/workspace/cpp/RTSP/src/net/core/test.h264") ==
-            false) {
-            LOG_DEBUG("打开文件失败");
+        auto hint_file = std::make_shared<HintFile>();
+        if (!is_replay && (is_hint ? !hint_file->Open(file_path)
+                                   : !h264_file.Open(file_path))) {
+            LOG_ERROR("打开文件失败");
             return 0;
         }
 
@@ -37,13 +97,76 @@ int main() {
                 }
                 ioc.stop();
             });
-
         std::shared_ptr<RtspServer> server =
             std::make_shared<RtspServer>(ioc, 8554);
+        server->SetTraceDumpEnabled(trace_dump);
+        if (idle_timeout > 0) {
+            server->SetIdleTimeout(idle_timeout);
+        }
         server->Start();
 
+        // kill -USR1 把追踪缓冲区导出成Chrome trace JSON, 写文件在服务器的导出线程
+        Tracer::SetThreadName("rtsp-main");
+        std::string trace_path =
+            "/tmp/rtsp_trace_" + std::to_string(getpid()) + ".json";
+        boost::asio::signal_set trace_signals(ioc, SIGUSR1);
+        std::function<void(boost::system::error_code const &, int)> on_trace =
+            [&](boost::system::error_code const &error, int) {
+                if (error) {
+                    return;
+                }
+                bool posted = server->PostTraceDump([trace_path]() {
+                    if (Tracer::Instance().Dump(trace_path)) {
+                        std::cout << "Trace dumped: " << trace_path
+                                  << std::endl;
+                    }
+                });
+                if (!posted) {
+                    std::cout << "Trace dump already running" << std::endl;
+                }
+                trace_signals.async_wait(on_trace);
+            };
+        trace_signals.async_wait(on_trace);
+
         auto session = MediaSession::GetInstance("live");
-        session->AddSource(channel0, H264Source::GetInstance().get());
+        HintSource *hint_source = nullptr;
+        if (is_hint) {
+            hint_source = new HintSource(hint_file);
+            session->AddSource(channel0, hint_source);
+        } else {
+            session->AddSource(channel0, H264Source::GetInstance().get());
+            // 快进/快退使用单独的文件句柄, 与推流线程的顺序读取互不影响
+            auto trick_file = std::make_shared<H264File>();
+            if (trick_file->Open(file_path)) {
+                session->SetTrickPlayFile(
+                    channel0, trick_file,
+                    H264Source::GetInstance()->GetFramerate());
+            }
+        }
+        // 后面的参数是同一内容的其他编码(裸H264), 客户端按带宽在它们之间切换
+        std::vector<std::pair<std::unique_ptr<H264File>, int>> renditions;
+        for (int i = 2; i < argc && !is_hint && !is_replay; i++) {
+            std::unique_ptr<H264File> file(new H264File);
+            if (!file->Open(argv[i])) {
+                LOG_ERROR("打开文件失败: %s", argv[i]);
+                continue;
+            }
+            int rendition = session->AddRendition(
+                channel0,
+                new H264Source(H264Source::GetInstance()->GetFramerate()));
+            if (rendition > 0) {
+                renditions.emplace_back(std::move(file), rendition);
+            }
+        }
+        // UDP客户端丢包时按NACK重传最近1秒内的包
+        session->EnableRetransmission(1000);
+        // UDP客户端链路拥塞时抽帧
+        session->EnableCongestionControl();
+        // 发送时刻和传输序号扩展, 客户端回transport-cc反馈时按它估计排队延时
+        session->EnableRtpExtension(RtpExtensionType::ABS_SEND_TIME, 1);
+        session->EnableRtpExtension(RtpExtensionType::TRANSPORT_SEQUENCE, 2);
+        // 单向链路可以再加FEC, 每8个包多发一个
+        // session->EnableFec(8);
         // session->StartMulticast();
         session->AddNotifyConnectedCallback([](MediaSessionId sessionId,
                                                std::string peer_ip,
@@ -59,14 +182,55 @@ int main() {
                    peer_ip.c_str(), peer_port);
         });
 
+        // 回放时轨迹里用到的编码都要有对应的源
+        int replay_renditions = 0;
+        for (size_t i = 0; i < replay_reader->GetFrameCount(); i++) {
+            replay_renditions = std::max<int>(
+                replay_renditions, replay_reader->GetRecord(i).rendition);
+        }
+        for (int i = 1; i <= replay_renditions; i++) {
+            session->AddRendition(
+                channel0,
+                new H264Source(H264Source::GetInstance()->GetFramerate()));
+        }
+
         MediaSessionId session_id = server->AddSession(session.get());
+        if (!record_path.empty() &&
+            server->StartFrameRecording(record_path, record_payload)) {
+            std::cout << "Recording frames: " << record_path << std::endl;
+        }
 
-        std::thread t1(SendFrameThread, server.get(), session_id, &h264_file);
-        t1.detach();
+        if (is_replay) {
+            std::thread t1(ReplayThread, server.get(), session_id,
+                           replay_reader, replay_speed);
+            t1.detach();
+        } else if (is_hint) {
+            std::thread t1(SendHintThread, server.get(), session_id,
+                           hint_source);
+            t1.detach();
+        } else {
+            std::thread t1(SendFrameThread, server.get(), session_id,
+                           &h264_file, 0);
+            t1.detach();
+            for (auto &rendition: renditions) {
+                std::thread t(SendFrameThread, server.get(), session_id,
+                              rendition.first.get(), rendition.second);
+                t.detach();
+            }
+        }
+
+        // Prometheus抓取地址, 只监听本机
+        MetricsServer metrics_server("127.0.0.1", 9100);
+        if (metrics_server.Start()) {
+            std::cout << "Metrics URL: http://127.0.0.1:9100/metrics"
+                      << std::endl;
+        }
 
         std::cout << "Play URL: " << rtsp_url << std::endl;
 
         ioc.run();
+        // 退出前等追踪导出做完, 关闭轨迹文件, 写缓冲中的帧落盘
+        server->Shutdown();
 
         return 0;
 
@@ -77,7 +241,8 @@ int main() {
 }
 
 void SendFrameThread(RtspServer *rtsp_server, MediaSessionId session_id,
-                     H264File *h264_file) {
+                     H264File *h264_file, int rendition) {
+    Tracer::SetThreadName("producer-" + std::to_string(rendition));
     int buf_size = 2'000'000;
     std::unique_ptr<uint8_t> frame_buf(new uint8_t[buf_size]);
 
@@ -92,7 +257,7 @@ void SendFrameThread(RtspServer *rtsp_server, MediaSessionId session_id,
             videoFrame.timestamp = H264Source::GetTimeStamp();
             videoFrame.buffer.reset(new uint8_t[videoFrame.size]);
             memcpy(videoFrame.buffer.get(), frame_buf.get(), videoFrame.size);
-            rtsp_server->PushFrame(session_id, channel0, videoFrame);
+            rtsp_server->PushFrame(session_id, channel0, videoFrame, rendition);
         } else {
             break;
         }
@@ -100,3 +265,26 @@ void SendFrameThread(RtspServer *rtsp_server, MediaSessionId session_id,
         std::this_thread::sleep_for(std::chrono::milliseconds(40));
     };
 }
+
+void SendHintThread(RtspServer *rtsp_server, MediaSessionId session_id,
+                    HintSource *hint_source) {
+    Tracer::SetThreadName("producer-hint");
+    while (1) {
+        // hint文件已经打好包, AVFrame只携带时间戳
+        AVFrame frame;
+        frame.timestamp = H264Source::GetTimeStamp();
+        rtsp_server->PushFrame(session_id, channel0, frame);
+
+        uint64_t duration = hint_source->GetNextFrameDuration();
+        std::this_thread::sleep_for(std::chrono::microseconds(
+            duration * 1000000 / hint_source->GetClockRate()));
+    };
+}
+
+void ReplayThread(RtspServer *rtsp_server, MediaSessionId session_id,
+                  std::shared_ptr<FrameTraceReader> reader, double speed) {
+    Tracer::SetThreadName("producer-replay");
+    // 一直循环回放, 时间戳在各轮之间保持连续
+    FrameTracePlayer player(reader);
+    player.Play(rtsp_server, session_id, speed, 0);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "net/SingleTon.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+struct BufferPoolStats {
+    uint64_t acquired = 0;  // Acquire调用次数
+    uint64_t reused = 0;    // 其中直接从空闲链表取到的次数
+    uint64_t allocated = 0; // 向系统申请的次数
+    size_t bytes_in_use = 0;
+    size_t peak_bytes = 0; // bytes_in_use的峰值
+    size_t bytes_cached = 0;
+};
+
+/* 按大小分级的缓冲区池, 接收缓冲区和跨线程传递的消息都从这里取.
+ * 归还的缓冲区挂在对应级别的空闲链表上, 超过最大级别的直接new/delete */
+class BufferPool : public SingleTon<BufferPool> {
+    friend class SingleTon<BufferPool>;
+
+public:
+    ~BufferPool();
+
+    // 返回至少size字节的缓冲区, capacity返回实际大小, 归还时原样传回
+    char *Acquire(size_t size, size_t *capacity);
+
+    // 实际大小为RoundUp(size)
+    char *Acquire(size_t size) {
+        size_t capacity = 0;
+        return Acquire(size, &capacity);
+    }
+    void Release(char *buf, size_t capacity);
+
+    // 申请size字节时实际得到的大小
+    static size_t RoundUp(size_t size);
+
+    BufferPoolStats GetStats();
+
+    static size_t const kClassCount = 5;
+    static size_t const kClassSizes[kClassCount];
+    // 每一级最多缓存的空闲缓冲区个数
+    static size_t const kMaxCached = 64;
+
+private:
+    BufferPool() = default;
+
+    std::mutex mtx_;
+    std::vector<char *> free_lists_[kClassCount];
+    BufferPoolStats stats_;
+};
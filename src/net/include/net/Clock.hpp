@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/* 发送节奏、RTCP间隔、重传和拥塞控制的窗口、空闲超时等都从这里取时间.
+ * 默认是steady_clock; 仿真时切换成虚拟时钟, 只由驱动线程推进,
+ * 跑多快只取决于机器, 结果不取决于机器 */
+class Clock {
+public:
+    static int64_t NowUs() {
+        if (is_virtual_.load(std::memory_order_relaxed)) {
+            return virtual_us_.load(std::memory_order_relaxed);
+        }
+        return RealNowUs();
+    }
+
+    // 1970年起的微秒, 用于NTP时间和RTP时间戳. 虚拟时钟下从固定的时刻开始
+    static int64_t WallUs() {
+        if (is_virtual_.load(std::memory_order_relaxed)) {
+            return kVirtualEpochUs + virtual_us_.load(std::memory_order_relaxed);
+        }
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::system_clock::now().time_since_epoch())
+            .count();
+    }
+
+    // 总是真实时间, 用于统计耗时
+    static int64_t RealNowUs() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    static bool IsVirtual() {
+        return is_virtual_.load(std::memory_order_relaxed);
+    }
+
+    // 切换到虚拟时钟. 不从0开始, 很多地方用0表示"还没有"
+    static void UseVirtual(int64_t start_us = 1000000) {
+        virtual_us_.store(start_us, std::memory_order_relaxed);
+        is_virtual_.store(true, std::memory_order_relaxed);
+    }
+
+    static void UseReal() {
+        is_virtual_.store(false, std::memory_order_relaxed);
+    }
+
+    // 只能往前走
+    static void AdvanceTo(int64_t now_us) {
+        if (now_us > virtual_us_.load(std::memory_order_relaxed)) {
+            virtual_us_.store(now_us, std::memory_order_relaxed);
+        }
+    }
+
+    static void Advance(int64_t delta_us) {
+        AdvanceTo(virtual_us_.load(std::memory_order_relaxed) + delta_us);
+    }
+
+private:
+    static constexpr int64_t kVirtualEpochUs = 1700000000LL * 1000000; // 2023-11
+
+    inline static std::atomic<bool> is_virtual_{false};
+    inline static std::atomic<int64_t> virtual_us_{0};
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/* 抽帧级别, 越大丢得越多 */
+enum class ThinningLevel : uint8_t {
+    NONE = 0,           // 全部发送
+    DROP_DISPOSABLE,    // 丢不被参考的帧(nal_ref_idc == 0)
+    KEY_FRAME_ONLY,     // 只发关键帧
+};
+
+/* 帧对解码的重要程度, 由MediaSession在帧的第一个包上判断, 所有客户端共用 */
+enum class FramePriority : uint8_t {
+    KEY = 0,
+    REFERENCE,
+    DISPOSABLE,
+};
+
+struct CongestionStats {
+    ThinningLevel level = ThinningLevel::NONE;
+    uint32_t target_bps = 0;     // 估计的可用带宽, 0表示还没有过载过, 不限制
+    uint32_t send_bps = 0;       // 最近两次报告之间的发送码率
+    uint32_t loss_permille = 0;  // 最近一次报告的丢包率, 千分比
+    uint32_t queue_delay_us = 0; // RTT超出最小RTT或者单向延时超出基线的部分
+    uint64_t overuse_count = 0;  // 判断为过载的报告数
+    uint64_t dropped_frames = 0; // 抽掉的帧数
+    uint64_t socket_drops = 0;   // 发送缓冲区满丢掉的包数
+};
+
+/* 单个UDP客户端的拥塞控制, 由RTCP RR或者transport-cc反馈驱动.
+ * 丢包率和排队延时判断链路是否过载:
+ * 目标码率按丢包做AIMD(与GCC的丢包控制器相同的阈值), 排队延时过大时压到发送码率以下;
+ * 过载持续时逐级抽帧, 链路正常一段时间后再逐级放开.
+ * 客户端发transport-cc反馈时用它逐包算出的单向排队延时, RR只在没有反馈时使用.
+ * OnReport/OnTransportFeedback只在收RTCP的线程中调用, 其他接口任何线程都可以调用 */
+class CongestionController {
+public:
+    // sent_bytes是到现在为止这个通道发出的总字节数
+    void OnReport(uint8_t fraction_lost, uint32_t rtt_us, uint64_t sent_bytes,
+                  int64_t now_us);
+
+    // 一段时间内的transport-cc反馈汇总: 丢了lost个/共total个,
+    // queue_delay_us是单向延时超出基线的部分
+    void OnTransportFeedback(uint32_t lost, uint32_t total,
+                             uint32_t queue_delay_us, uint64_t sent_bytes,
+                             int64_t now_us);
+
+    ThinningLevel GetLevel() const {
+        return (ThinningLevel)level_.load(std::memory_order_relaxed);
+    }
+
+    uint32_t GetTargetBitrate() const {
+        return target_bps_.load(std::memory_order_relaxed);
+    }
+
+    CongestionStats GetStats() const;
+
+    static constexpr uint32_t kMinBitrate = 64000;
+    static constexpr uint32_t kMaxBitrate = 100000000;
+
+private:
+    static constexpr size_t kRttWindow = 16;
+
+    void Update(double loss, uint32_t queue_delay_us, uint64_t sent_bytes,
+                int64_t now_us);
+    void SetLevel(int level, int64_t now_us);
+
+    static constexpr int64_t kMinHoldUs = 5000000;
+
+    // 只在收RTCP的线程中使用
+    int64_t last_report_us_ = 0;
+    int64_t last_update_us_ = 0;
+    int64_t last_feedback_us_ = 0; // 最近一次transport-cc反馈, 0表示没有
+    uint64_t last_sent_bytes_ = 0;
+    uint32_t rtts_[kRttWindow] = {0};
+    size_t rtt_count_ = 0;
+    int overuse_reports_ = 0;    // 连续过载的报告数
+    int64_t normal_since_us_ = 0; // 从什么时候开始链路正常, 0表示当前不正常
+    int64_t last_change_us_ = 0;
+    // 放开一级前链路要正常这么久; 放开后很快又过载就加倍, 稳定住就减半
+    int64_t hold_us_ = kMinHoldUs;
+    int64_t probe_us_ = 0;        // 最近一次放开的时间, 0表示已经有结论
+    uint32_t level_rate_[3] = {0}; // 离开各级时的发送码率
+
+    std::atomic<uint8_t> level_{0};
+    std::atomic<uint32_t> target_bps_{0};
+    std::atomic<uint32_t> send_bps_{0};
+    std::atomic<uint32_t> loss_permille_{0};
+    std::atomic<uint32_t> queue_delay_us_{0};
+    std::atomic<uint64_t> overuse_count_{0};
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "net/Rtp.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#define FEC_HEADER_SIZE       10 // RFC 5109 FEC头部
+#define FEC_LEVEL_HEADER_SIZE 4  // L=0时的ULP level头部: 保护长度 + 16位掩码
+#define FEC_MAX_GROUP         16
+#define RTP_FEC_PAYLOAD_BASE  116 // FEC的负载类型, 通道n用116+n
+
+/* dst ^= src, 按CPU支持的指令集选择AVX2/SSE2/NEON实现 */
+void XorBytes(uint8_t *dst, uint8_t const *src, size_t size);
+void XorBytesScalar(uint8_t *dst, uint8_t const *src, size_t size);
+
+/* 一组媒体包生成的FEC包. header里的SN base要由各客户端按自己的序号填写,
+ * body(ULP level头部 + 异或后的负载)所有客户端共享 */
+struct FecPacket {
+    uint8_t header[FEC_HEADER_SIZE];
+    std::shared_ptr<uint8_t> body;
+    uint32_t body_size = 0;
+    uint32_t timestamp = 0;
+    uint8_t group_size = 0; // 保护的媒体包数, 从SN base开始连续
+    // 各媒体包的负载长度, 客户端带头部扩展时按它重新算长度恢复字段
+    uint16_t sizes[FEC_MAX_GROUP] = {0};
+};
+
+/* ULPFEC(RFC 5109)编码器, 每个会话的每个通道一个, 在推流线程中使用.
+ * 每group_size个包输出一个FEC包, 保护这一组的全部媒体包,
+ * 带宽开销是1/group_size */
+class FecEncoder {
+public:
+    explicit FecEncoder(uint8_t group_size);
+
+    // 这个包结束一组时返回FEC包, 否则返回nullptr
+    std::shared_ptr<FecPacket> Push(RtpPacket const &pkt, uint8_t payload_type);
+
+    uint8_t GetGroupSize() const {
+        return group_size_;
+    }
+
+private:
+    uint8_t group_size_;
+    uint8_t count_ = 0;
+    uint8_t header_[FEC_HEADER_SIZE] = {0};
+    uint16_t protect_len_ = 0;
+    uint16_t sizes_[FEC_MAX_GROUP] = {0};
+    alignas(32) uint8_t payload_[MAX_RTP_PAYLOAD_SIZE + 64] = {0};
+};
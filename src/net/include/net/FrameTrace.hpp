@@ -0,0 +1,135 @@
+#pragma once
+
+#include "net/media.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class RtspServer;
+
+/* 帧轨迹文件: 按顺序记录RtspServer::PushFrame的调用, 用于回放出可复现的
+ * 吞吐/延时测试. 真实编码器输出的I帧大小和间隔是突发的, 合成的固定码流测不出来.
+ *
+ * 文件布局(小端), 边推流边追加, 没有尾部索引:
+ *   FrameTraceHeader
+ *   (FrameTraceRecord + 负载) * N, 只记大小时没有负载
+ */
+struct FrameTraceHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t reserved;
+};
+
+struct FrameTraceRecord {
+    uint64_t time_us;   // 相对开始记录的时刻
+    uint32_t size;      // 帧大小
+    uint32_t timestamp; // AVFrame::timestamp
+    uint32_t session_id;
+    uint8_t channel;
+    uint8_t type;       // AVFrame::type
+    uint8_t rendition;
+    uint8_t nal_header; // 帧的第一个字节, 只记大小时回放用它还原NAL类型
+};
+
+static const char FRAME_TRACE_MAGIC[4] = {'R', 'T', 'F', 'T'};
+static const uint32_t FRAME_TRACE_VERSION = 1;
+static const uint32_t FRAME_TRACE_PAYLOAD = 0x1; // 记录中带负载
+
+/* 记录端, 可以由多个推流线程同时调用 */
+class FrameTraceWriter {
+public:
+    FrameTraceWriter() = default;
+    ~FrameTraceWriter();
+    FrameTraceWriter(FrameTraceWriter const &) = delete;
+    FrameTraceWriter &operator=(FrameTraceWriter const &) = delete;
+
+    // with_payload为false时只记大小等元数据, 文件小, 可以长时间记录
+    bool Open(const char *path, bool with_payload);
+    bool Close();
+    bool Write(MediaSessionId id, MediaChannelID channel, int rendition,
+               AVFrame const &frame);
+
+    uint64_t GetFrameCount() const {
+        return frame_count_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::mutex mutex_;
+    FILE *file_ = nullptr;
+    bool with_payload_ = false;
+    bool failed_ = false;
+    int64_t start_us_ = 0;
+    std::atomic<uint64_t> frame_count_{0};
+};
+
+/* 读取端, 整个文件映射到内存 */
+class FrameTraceReader {
+public:
+    FrameTraceReader() = default;
+    FrameTraceReader(FrameTraceReader const &) = delete;
+    FrameTraceReader &operator=(FrameTraceReader const &) = delete;
+
+    bool Open(const char *path);
+    void Close();
+
+    bool IsOpen() const {
+        return addr_ != nullptr;
+    }
+
+    bool HasPayload() const {
+        return (header_->flags & FRAME_TRACE_PAYLOAD) != 0;
+    }
+
+    size_t GetFrameCount() const {
+        return offsets_.size();
+    }
+
+    FrameTraceRecord const &GetRecord(size_t index) const {
+        return *(FrameTraceRecord const *)(addr_.get() + offsets_[index]);
+    }
+
+    // 带负载时直接引用映射内存, 否则生成同样大小、同样NAL头的帧
+    AVFrame GetFrame(size_t index) const;
+
+    // 记录的时长, 加上平均帧间隔, 循环回放时作为一轮的长度
+    uint64_t GetLoopDurationUs() const;
+
+private:
+    std::shared_ptr<uint8_t> addr_;
+    size_t file_size_ = 0;
+    FrameTraceHeader const *header_ = nullptr;
+    std::vector<size_t> offsets_;
+};
+
+/* 回放驱动: 把轨迹中的帧按原来的节奏(或speed倍速)推给RtspServer.
+ * 所有记录都推到同一个会话, 通道和编码号保持不变 */
+class FrameTracePlayer {
+public:
+    struct Stats {
+        uint64_t frames = 0;
+        uint64_t bytes = 0;
+        uint64_t elapsed_us = 0;
+        uint64_t max_lag_us = 0; // 实际推送落后于计划的最大值
+    };
+
+    explicit FrameTracePlayer(std::shared_ptr<FrameTraceReader> reader)
+        : reader_(reader) {}
+
+    // speed为回放倍速, <=0时不等待, 尽快推送. loops为0时一直循环到Stop
+    Stats Play(RtspServer *server, MediaSessionId session_id, double speed,
+               uint32_t loops = 1);
+
+    void Stop() {
+        stop_.store(true, std::memory_order_relaxed);
+    }
+
+private:
+    std::shared_ptr<FrameTraceReader> reader_;
+    std::atomic<bool> stop_{false};
+};
@@ -1,7 +1,17 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <cstdio>
+#include <vector>
+
+// 文件中一帧(与ReadFrame的切分方式一致)的位置信息
+struct FrameIndex {
+    uint64_t offset;
+    uint32_t size;
+    bool is_key;
+};
+
 class H264File {
 public:
     H264File(int buffersize = 500000);
@@ -15,10 +25,41 @@ public:
 
     int ReadFrame(char *in_buf, int in_buf_size, bool *end);
 
+    // IDR索引, Open时建立, 之后只读, 可以被多个线程同时使用
+    size_t GetFrameCount() const {
+        return m_frames.size();
+    }
+
+    size_t GetKeyFrameCount() const {
+        return m_key_frames.size();
+    }
+
+    // 第key_index个关键帧在帧序列中的位置
+    size_t GetKeyFramePosition(size_t key_index) const {
+        return m_key_frames[key_index];
+    }
+
+    // 离帧位置frame_pos最近的(不晚于它的)关键帧序号
+    size_t FindKeyFrame(size_t frame_pos) const;
+
+    bool IsKeyFrame(size_t frame_pos) const {
+        return m_frames[frame_pos].is_key;
+    }
+
+    // 按索引读取第frame_pos帧, 不影响ReadFrame的读取位置
+    int ReadFrameAt(size_t frame_pos, char *in_buf, int in_buf_size) const;
+
+    int ReadKeyFrame(size_t key_index, char *in_buf, int in_buf_size) const;
+
 private:
+    bool BuildIndex();
+
     FILE *m_file = NULL;
     char *m_buf = nullptr;
     int m_buf_size = 0;
     int m_bytes_used = 0;
     int m_count = 0;
-};
\ No newline at end of file
+
+    std::vector<FrameIndex> m_frames;
+    std::vector<size_t> m_key_frames;
+};
@@ -9,6 +9,8 @@ class H264Source : public MediaSource, public SingleTon<H264Source> {
     friend class SingleTon<H264Source>;
 
 public:
+    // 单例之外的实例用于同一会话的其他编码(MediaSession::AddRendition)
+    H264Source(uint32_t framerate = 25);
     ~H264Source();
 
     void SetFramerate(uint32_t framerate) {
@@ -24,7 +26,10 @@ public:
     virtual bool HandleFrame(MediaChannelID channel_id, AVFrame frame) override;
     static uint32_t GetTimeStamp();
 
+    // 把一帧切分成RTP包(单包或FU-A分片), 逐个交给send_cb
+    static bool PacketizeFrame(MediaChannelID channel_id, AVFrame const &frame,
+                               SendFrameCallback const &send_cb);
+
 private:
-    H264Source(uint32_t framerate = 25);
     uint32_t framerate_;
 };
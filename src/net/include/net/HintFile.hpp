@@ -0,0 +1,115 @@
+#pragma once
+
+#include "net/media.hpp"
+#include "net/MediaSource.hpp"
+#include "net/Rtp.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* 预打包(hint)文件: 离线完成NAL解析和FU-A分片, 播放时只需要生成RTP头,
+ * 负载直接从映射的文件发出.
+ *
+ * 文件布局(小端):
+ *   HintFileHeader
+ *   包记录 * packet_count: 预留RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE字节头部空间 + 负载
+ *   HintPacketEntry * packet_count (从table_offset开始)
+ */
+struct HintFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t clock_rate;
+    uint32_t payload_type;
+    uint32_t framerate;
+    uint32_t frame_count;
+    uint64_t packet_count;
+    uint64_t table_offset;
+};
+
+struct HintPacketEntry {
+    uint64_t offset;    // 包记录起点(头部预留空间)
+    uint32_t size;      // 预留空间 + 负载, 与RtpPacket::size含义相同
+    uint32_t timestamp; // 相对第一帧的时间戳, clock_rate为单位
+    uint8_t marker;
+    uint8_t type;
+    uint8_t reserved[6];
+};
+
+static const char HINT_FILE_MAGIC[4] = {'R', 'T', 'P', 'H'};
+static const uint32_t HINT_FILE_VERSION = 1;
+
+class HintFile {
+public:
+    HintFile() = default;
+    ~HintFile();
+    HintFile(HintFile const &) = delete;
+    HintFile &operator=(HintFile const &) = delete;
+
+    bool Open(const char *path);
+    void Close();
+
+    bool IsOpen() const {
+        return addr_ != nullptr;
+    }
+
+    // 用与直播相同的H264Source::PacketizeFrame把裸H264文件转换成hint文件
+    static bool Convert(const char *h264_path, const char *hint_path,
+                        uint32_t framerate = 25);
+
+    // 只检查文件头, 用来区分hint文件和裸H264文件
+    static bool IsHintFile(const char *path);
+
+    uint32_t GetFramerate() const {
+        return header_->framerate;
+    }
+
+    uint32_t GetClockRate() const {
+        return header_->clock_rate;
+    }
+
+    size_t GetFrameCount() const {
+        return frame_starts_.size();
+    }
+
+    size_t GetPacketCount() const {
+        return header_->packet_count;
+    }
+
+    // 第frame_pos帧的包在表中的范围[first, last)
+    void GetFramePackets(size_t frame_pos, size_t *first, size_t *last) const;
+
+    HintPacketEntry const &GetEntry(size_t packet_index) const {
+        return table_[packet_index];
+    }
+
+    // 直接引用映射内存构造RtpPacket, 不拷贝负载
+    RtpPacket GetPacket(size_t packet_index) const;
+
+private:
+    std::shared_ptr<uint8_t> addr_;
+    size_t file_size_ = 0;
+    HintFileHeader const *header_ = nullptr;
+    HintPacketEntry const *table_ = nullptr;
+    std::vector<size_t> frame_starts_;
+};
+
+/* 从hint文件供流的媒体源. 推流线程仍然通过RtspServer::PushFrame驱动,
+ * 但AVFrame只携带时间戳, 每次调用发出文件中的下一帧 */
+class HintSource : public MediaSource {
+public:
+    HintSource(std::shared_ptr<HintFile> file);
+    ~HintSource();
+
+    virtual std::string GetMediaDescription(uint16_t port) override;
+    virtual std::string GetAttribute() override;
+    virtual bool HandleFrame(MediaChannelID channel_id, AVFrame frame) override;
+
+    // 下一帧相对上一帧的时间间隔(clock_rate为单位), 供推流线程控制节奏
+    uint32_t GetNextFrameDuration() const;
+
+private:
+    std::shared_ptr<HintFile> file_;
+    size_t frame_pos_ = 0;
+};
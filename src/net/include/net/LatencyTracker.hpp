@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/* 时间戳计数器. x86上直接读TSC, 要求CPU有constant_tsc/nonstop_tsc,
+ * 各核的TSC同步, 这样不同线程打的时间戳可以相减 */
+class Tsc {
+public:
+    static inline uint64_t Now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+#endif
+    }
+
+    // 每个tick多少纳秒, 第一次调用时对着steady_clock校准(睡20ms)
+    static double NsPerTick();
+    // 已经校准过, NsPerTick不会再阻塞
+    static bool IsCalibrated();
+};
+
+/* 对数分桶的直方图(HdrHistogram的做法): 每个2的幂区间再等分32格,
+ * 相对误差不超过1/32, 桶数固定, 记录时只做一次原子加 */
+class LatencyHistogram {
+public:
+    static constexpr int kSubBits = 5;
+    static constexpr int kMaxBits = 47; // 更大的值记在最后一格
+    static constexpr size_t kBucketCount =
+        (size_t)(kMaxBits - kSubBits + 2) << kSubBits;
+
+    void Record(uint64_t value) {
+        buckets_[Index(value)].fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    // 各分位数的值, 单位与记录的一致, 没有数据时返回0
+    uint64_t GetPercentile(double percentile) const;
+    uint64_t GetCount() const;
+    uint64_t GetSum() const {
+        return sum_.load(std::memory_order_relaxed);
+    }
+    uint64_t GetMax() const;
+    void Reset();
+
+    static size_t Index(uint64_t value);
+    // 桶的中间值
+    static uint64_t BucketValue(size_t index);
+
+private:
+    std::atomic<uint64_t> buckets_[kBucketCount] = {};
+    std::atomic<uint64_t> sum_{0};
+};
+
+/* 一帧从PushFrame到发出socket的各阶段 */
+enum class LatencyStage : uint8_t {
+    SESSION_LOCK = 0, // PushFrame到拿到会话锁
+    PACKETIZE,        // 拿到锁到打出这个包
+    UDP_SEND,         // 打出包到send_to返回
+    UDP_TOTAL,        // PushFrame到send_to返回
+    TCP_ENQUEUE,      // 打出包到放进LogicSystem队列
+    TCP_LOGIC_QUEUE,  // 在LogicSystem队列里等待
+    TCP_WRITE,        // 放进asio发送队列到写完
+    TCP_TOTAL,        // PushFrame到写完
+    NUM,
+};
+
+/* 端到端延时统计. 运行时开关, 关闭时PushFrame不打时间戳, 后面各阶段
+ * 看到时间戳为0就什么都不做. 时间戳和直方图都用TSC的tick, 报告时换成微秒.
+ * 通过MetricsRegistry导出为summary, 也可以用GetReport取文本 */
+class LatencyTracker {
+public:
+    static LatencyTracker &Instance();
+
+    static bool IsEnabled() {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    void SetEnabled(bool enable);
+
+    // 返回现在的时间戳, 方便接着算下一阶段
+    uint64_t Record(LatencyStage stage, uint64_t start_tsc) {
+        uint64_t now = Tsc::Now();
+        if (now > start_tsc) {
+            histograms_[(int)stage].Record(now - start_tsc);
+        }
+        return now;
+    }
+
+    void Reset();
+
+    // 每个阶段一行, p50/p99/p999和最大值, 单位微秒
+    std::string GetReport() const;
+
+    static char const *GetStageName(LatencyStage stage);
+    static char const *GetTransport(LatencyStage stage);
+
+private:
+    LatencyTracker();
+    void Expose(std::string *out) const;
+
+    inline static std::atomic<bool> enabled_{false};
+    LatencyHistogram histograms_[(int)LatencyStage::NUM];
+};
@@ -1,8 +1,10 @@
 #pragma once
 
 #include "const.hpp"
+#include "net/Metrics.hpp"
 #include "net/MsgNode.hpp"
 #include "net/SingleTon.hpp"
+#include <chrono>
 #include <condition_variable>
 #include <cstddef>
 #include <functional>
@@ -19,13 +21,16 @@ class LogicNode {
 public:
     LogicNode(std::shared_ptr<RtspConnect> connect, std::shared_ptr<msgNode> node)
         : connect_(connect),
-          node_(node) {}
+          node_(node),
+          enqueue_time_(std::chrono::steady_clock::now()) {}
 
     std::shared_ptr<RtspConnect> connect_;
     std::shared_ptr<msgNode> node_;
+    std::chrono::steady_clock::time_point enqueue_time_; // 用于统计排队时间
 };
 
-using callbackfunc = std::function<void(std::shared_ptr<RtspConnect> , char const *,size_t)>;
+using callbackfunc = std::function<void(std::shared_ptr<RtspConnect>,
+                                        std::shared_ptr<msgNode>)>;
 
 class LogicSystem : public SingleTon<LogicSystem> {
     friend class SingleTon<LogicSystem>;
@@ -39,8 +44,12 @@ public:
 private:
     LogicSystem();
     void DealMsg();
-    void HandleRequest(std::shared_ptr<RtspConnect> connect, char const *msg,size_t size);
-    void HandleSendPacket(std::shared_ptr<RtspConnect> connect, char const *msg,size_t size);
+    void HandleRequest(std::shared_ptr<RtspConnect> connect,
+                       std::shared_ptr<msgNode> node);
+    void HandleSendPacket(std::shared_ptr<RtspConnect> connect,
+                          std::shared_ptr<msgNode> node);
+    void HandleClose(std::shared_ptr<RtspConnect> connect,
+                     std::shared_ptr<msgNode> node);
 
     std::mutex mtx_;
     bool b_stop;
@@ -49,4 +58,8 @@ private:
 
     std::map<MSG_IDS, callbackfunc> callbacks_;
     std::queue<std::shared_ptr<LogicNode>> msg_que_;
+
+    Counter messages_metric_;
+    Gauge queue_metric_;
+    Histogram wait_metric_;
 };
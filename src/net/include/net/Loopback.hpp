@@ -0,0 +1,103 @@
+#pragma once
+
+#include "net/media.hpp"
+#include "net/MemoryTransport.hpp"
+#include "net/PacketTransport.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* 内存网络上的接收端, FanoutSim和单元测试共用.
+ * 按扩展序号在kSeqWindow个包的窗口里记收到的包, 出现缺口时可以发一次
+ * 通用NACK; RTX包(RFC 4588)按头部后面的原始序号补缺口. 每秒一次的RR
+ * 由调用者按自己的节奏调SendReport */
+class LoopbackReceiver : public MemoryEndpoint {
+public:
+    static constexpr size_t kSeqWindow = 1024;
+
+    bool nack = false;
+    std::shared_ptr<MemoryLink> link;
+
+    uint64_t received = 0;  // 不重复的包
+    uint64_t duplicates = 0;
+    uint64_t recovered = 0; // 出现缺口之后才到的包, 一般是重传
+    uint64_t frames = 0;
+    uint64_t nacks = 0;     // NACK请求过的包数
+    uint64_t rtx_packets = 0;
+    uint64_t rtx_ssrc_errors = 0; // RTX包用了媒体流的SSRC
+    int64_t first_frame_us = 0;
+
+    void OnRtp(MediaChannelID channel_id, uint8_t const *header,
+               size_t header_size, size_t payload_size,
+               int64_t now_us) override;
+    void OnRtcp(MediaChannelID channel_id, uint8_t const *data, size_t size,
+                int64_t now_us) override;
+
+    // RFC 3550 A.3的RR, 和RtpShaper的一样
+    void SendReport(MediaChannelID channel_id, int64_t now_us);
+
+    uint64_t Lost() const;
+
+    uint64_t Bytes() const {
+        return bytes_;
+    }
+
+private:
+    uint32_t Extend(uint16_t seq) const;
+
+    void SetReceived(uint32_t ext) {
+        bits_[ext % kSeqWindow / 64] |= 1ull << (ext % 64);
+    }
+
+    void SendNack(MediaChannelID channel_id, uint32_t first, uint32_t count);
+
+    bool has_seq_ = false;
+    uint32_t ssrc_ = 0; // 网络字节序
+    uint32_t base_seq_ = 0;
+    uint32_t max_seq_ = 0; // 扩展序号
+    uint64_t bits_[kSeqWindow / 64] = {0};
+    uint64_t bytes_ = 0;
+    uint32_t expected_prior_ = 0;
+    uint32_t received_prior_ = 0;
+    uint32_t last_sr_ = 0;
+    int64_t last_sr_us_ = 0;
+};
+
+/* 直接接在RtpConnect下面, 按顺序记下发出的每个RTP/RTCP包.
+ * 不需要时延和丢包的单元测试用它代替MemoryLink */
+class CaptureTransport : public PacketTransport {
+public:
+    struct RtpRecord {
+        uint16_t seq = 0;
+        uint32_t timestamp = 0;
+        uint32_t ssrc = 0;
+        uint8_t payload_type = 0;
+        bool marker = false;
+        std::string header; // 含扩展
+        std::string payload;
+    };
+
+    struct RtcpRecord {
+        std::string data;
+        size_t rtp_packets = 0;   // 此前已经发出的RTP包数
+        uint64_t rtp_payload = 0; // 此前已经发出的RTP负载字节数
+    };
+
+    std::vector<RtpRecord> rtp;
+    std::vector<RtcpRecord> rtcp;
+    uint64_t rtp_payload = 0;
+
+    bool SendRtp(MediaChannelID channel_id,
+                 boost::asio::const_buffer const *buffers,
+                 size_t count) override;
+    void SendRtcp(MediaChannelID channel_id, uint8_t const *data,
+                  size_t size) override;
+
+    size_t CountFrames() const; // 带marker的包数
+    std::vector<RtpRecord> WithTimestamp(uint32_t timestamp) const;
+};
+
+// 合成的一帧H264: 带起始码, 关键帧前面带SPS/PPS, 其余用fill填满size字节
+AVFrame MakeH264Frame(bool key, size_t size, uint8_t fill = 0xaa);
@@ -1,12 +1,19 @@
 #pragma once
 
 #include "media.hpp"
+#include "net/CongestionController.hpp"
+#include "net/FecEncoder.hpp"
+#include "net/H264File.hpp"
+#include "net/Metrics.hpp"
+#include "net/RtpExtension.hpp"
+#include "net/RtpHistory.hpp"
 #include "net/SingleTon.hpp"
 #include <boost/asio/ip/tcp.hpp>
 #include <net/MediaSource.hpp>
 #include <net/RingBuffer.hpp>
 #include <atomic>
 #include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 #include <mutex>
@@ -46,20 +53,120 @@ public:
 
 	std::string GetSdpMessage(std::string ip, std::string session_name ="");
 
+	// 第一次调用时生成并缓存, 之后所有客户端共享同一份, 发送时不拷贝
+	std::shared_ptr<std::string const> GetSdp(std::string const &ip,
+	                                          std::string const &session_name = "");
+
 	MediaSource* GetMediaSource(MediaChannelID channel_id);
 
 	bool HandleFrame(MediaChannelID channel_id, AVFrame frame);
 
+	// 同一内容的其他编码(不同分辨率/码率), 返回编号, AddSource添加的是0号.
+	// 负载类型和时钟频率要和0号一样, 时间戳用同一个时钟, 这样客户端切换时
+	// 不用重新协商, SSRC和序号也是连续的. 需要在推流之前调用
+	int AddRendition(MediaChannelID channel_id, MediaSource *source);
+	size_t GetRenditionCount(MediaChannelID channel_id);
+	// 实测的码率, 还没测出来时返回0
+	uint32_t GetRenditionBitrate(MediaChannelID channel_id, int rendition);
+	bool HandleFrame(MediaChannelID channel_id, int rendition, AVFrame frame);
+
+	// 文件源的IDR索引, 用于快进/快退时只发送关键帧
+	void SetTrickPlayFile(MediaChannelID channel_id,
+	                      std::shared_ptr<H264File> file, uint32_t framerate);
+	std::shared_ptr<H264File> GetTrickPlayFile(MediaChannelID channel_id,
+	                                           uint32_t *framerate);
+
+	// 开启NACK重传, 保留最近window_ms内发出的包. use_rtx为true时按RFC 4588
+	// 用单独的SSRC重传. 需要在客户端连接之前调用
+	void EnableRetransmission(uint32_t window_ms = 1000, bool use_rtx = false);
+	std::shared_ptr<RtpHistory> GetRtpHistory(MediaChannelID channel_id);
+	bool IsRtxEnabled() const { return use_rtx_; }
+
+	// 开启ULPFEC(RFC 5109), 每group_size个包(最多16个)生成一个FEC包,
+	// 发给所有UDP客户端. 需要在客户端连接之前调用
+	void EnableFec(uint8_t group_size = 8);
+	bool IsFecEnabled(MediaChannelID channel_id);
+
+	// UDP客户端按RR反映的丢包和延时抽帧: 先丢非参考帧, 再只发关键帧.
+	// 需要在客户端连接之前调用
+	void EnableCongestionControl(bool enable = true);
+	bool IsCongestionControlEnabled() const { return congestion_control_; }
+
+	// RTP头部扩展(RFC 8285), 通过SDP的extmap告诉客户端, 所有通道共用.
+	// 带传输序号时客户端可以发transport-cc反馈, 拥塞控制改用它. 需要在客户端连接之前调用
+	bool EnableRtpExtension(RtpExtensionType type, uint8_t id);
+	RtpExtensionMap GetRtpExtensions();
+
+	// 客户端PLI/FIR请求关键帧的最小间隔, 所有客户端的请求在间隔内合并成一个
+	void SetKeyFrameRequestInterval(uint32_t interval_ms);
+	uint64_t GetKeyFrameRequestCount() const { return keyframe_requests_; }
+
 	bool AddClient(std::shared_ptr<RtpConnect> rtp_conn);
 	void RemoveClient(std::shared_ptr<RtpConnect> rtp_conn);
 
 private:
     MediaSession(std::string url_suffix);
+    bool SendPacket(MediaChannelID channel_id, int rendition,
+                    RtpPacket const &packet);
+    // 正在打包的帧的延时时间戳, 持有mutex_时使用
+    void TracePacket(RtpPacket &packet);
+
+    // 最近一个关键帧(含前面的SPS/PPS)的包, 只在推流线程中(持有client_mutex_)使用
+    static const size_t kMaxKeyFramePackets = 1024;
+    struct KeyFrameCache {
+        std::vector<RtpPacket> packets;
+        bool caching = false;   // 正在缓存关键帧的包
+        bool has_idr = false;   // 已经缓存到IDR片, SPS/PPS可能单独成帧
+        bool valid = false;     // 缓存了一个完整的关键帧
+        bool frame_done = true; // 上一个包是帧的最后一个包
+        uint8_t last_nal = 0;
+    };
+    bool IsKeyFrameStart(KeyFrameCache &cache, uint8_t nal_header);
+
+    // 一个编码的发送状态, 除了注明的字段都只在推流线程中(持有client_mutex_)使用
+    struct Rendition {
+        std::unique_ptr<MediaSource> source; // 0号为空, 源在media_sources_里
+        KeyFrameCache key_frame;
+        std::unique_ptr<FecEncoder> fec;
+        FramePriority priority = FramePriority::KEY;
+        // 每秒统计一次实际码率, 平滑后给客户端选编码用
+        uint64_t bytes = 0;
+        int64_t bytes_start_us = 0;
+        std::atomic<uint32_t> bitrate_bps{0};
+        // 关键帧请求, 由keyframe_mutex_保护
+        std::atomic<bool> keyframe_pending{false};
+        int64_t last_keyframe_us = 0;
+    };
+    MediaSource *GetRenditionSource(MediaChannelID channel_id, int rendition);
+    void UpdateBitrate(Rendition &rendition, uint32_t size, int64_t now_us);
+    // 按客户端估计的带宽选编码, 往高切要多留一些余量
+    int ChooseRendition(MediaChannelID channel_id, RtpConnect &rtp_conn);
+    bool HasLowerRendition(MediaChannelID channel_id, int rendition);
+
+    void RequestKeyFrame(std::shared_ptr<RtpConnect> rtp_conn,
+                         MediaChannelID channel_id);
+    void SetKeyFramePending(MediaChannelID channel_id, int rendition);
+    void FlushKeyFrameRequest(MediaChannelID channel_id, int rendition,
+                              int64_t now_us);
+    void OnKeyFrame(MediaChannelID channel_id, int rendition, int64_t now_us);
+
     MediaSessionId session_id_ = 0;
     std::string suffix_;
-    std::string sdp_;
+    std::shared_ptr<std::string const> sdp_;
     std::vector<std::unique_ptr<MediaSource>> media_sources_;
 	std::vector<RingBuffer<AVFrame>> buffer_;
+	std::shared_ptr<H264File> trick_files_[MAX_MEDIA_CHANNEL];
+	uint32_t trick_framerates_[MAX_MEDIA_CHANNEL] = {0};
+	std::shared_ptr<RtpHistory> histories_[MAX_MEDIA_CHANNEL];
+	bool use_rtx_ = false;
+	std::vector<std::unique_ptr<Rendition>> renditions_[MAX_MEDIA_CHANNEL];
+	uint8_t fec_group_size_ = 0;
+	RtpExtensionMap extensions_;
+	std::atomic<bool> congestion_control_{false};
+
+	std::mutex keyframe_mutex_;
+	std::atomic<uint32_t> keyframe_interval_ms_{1000};
+	std::atomic<uint64_t> keyframe_requests_{0};
 	std::vector<NotifyConnectedCallback> notify_connected_callbacks_;
 	std::vector<NotifyDisconnectedCallback> notify_disconnected_callbacks_;
     std::atomic<bool> has_new_client_;
@@ -67,7 +174,16 @@ private:
 
 
     std::mutex mutex_;
+	uint64_t trace_push_tsc_ = 0;
+	uint64_t trace_lock_tsc_ = 0;
 	std::mutex client_mutex_;
 	std::vector< std::weak_ptr<RtpConnect>> clients_;
+
+	// 按会话(标签session)统计, 客户端数在持有client_mutex_时更新
+	Gauge clients_metric_;
+	Counter frames_metric_;
+	Counter packets_metric_;
+	Counter bytes_metric_;
+	Histogram fanout_metric_;
     
 };
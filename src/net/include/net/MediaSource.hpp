@@ -5,6 +5,9 @@
 #include <cstdint>
 #include <functional>
 using SendFrameCallback = std::function<bool(MediaChannelID, RtpPacket)>;
+// 客户端请求关键帧(PLI/FIR), 已经在MediaSession中合并和限频.
+// 在推流线程或者收RTCP的线程中调用, 不能在回调里同步推帧
+using KeyFrameRequestCallback = std::function<void(MediaChannelID)>;
 
 class MediaSource {
 public:
@@ -24,6 +27,22 @@ public:
         send_frame_cb_ = cb;
     }
 
+    // 实时编码器订阅后, 客户端丢了参考帧时会收到请求. 没有订阅的源(文件)
+    // 由MediaSession补发缓存的关键帧
+    virtual void SetKeyFrameRequestCallback(KeyFrameRequestCallback const &cb) {
+        keyframe_request_cb_ = cb;
+    }
+
+    virtual bool HasKeyFrameRequestCallback() const {
+        return keyframe_request_cb_ != nullptr;
+    }
+
+    virtual void RequestKeyFrame(MediaChannelID channel_id) {
+        if (keyframe_request_cb_) {
+            keyframe_request_cb_(channel_id);
+        }
+    }
+
     virtual uint32_t GetClockRate() const {
         return clock_rate_;
     }
@@ -40,4 +59,5 @@ protected:
     uint32_t clock_rate_;
     MediaChannelID channel_id_;
     SendFrameCallback send_frame_cb_;
+    KeyFrameRequestCallback keyframe_request_cb_;
 };
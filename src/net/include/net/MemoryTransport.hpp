@@ -0,0 +1,145 @@
+#pragma once
+
+#include "net/media.hpp"
+#include "net/PacketTransport.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <map>
+#include <random>
+#include <vector>
+
+class RtpConnect;
+
+/* 一个客户端的链路: 单向时延, 瓶颈带宽和它前面的队列, 随机丢包 */
+struct MemoryLinkConfig {
+    int64_t latency_us = 5000;
+    uint32_t bandwidth_kbps = 0;     // 0为不限
+    size_t queue_bytes = 256 * 1024; // 瓶颈队列满了丢包, reliable时不限
+    double loss = 0;                 // 两个方向都按这个比例随机丢包
+    bool reliable = false;           // 模拟RTP over TCP: 不丢包, 慢了只排队
+};
+
+struct MemoryLinkStats {
+    uint64_t sent_packets = 0; // 服务器发出的RTP包
+    uint64_t sent_bytes = 0;
+    uint64_t delivered_packets = 0;
+    uint64_t queue_drops = 0;  // 瓶颈队列满丢掉的RTP包
+    uint64_t random_drops = 0; // 随机丢掉的RTP包
+    int64_t max_queue_us = 0;  // 在瓶颈队列中等待的最长时间
+};
+
+/* 客户端一侧, 由MemoryNetwork::Deliver调用 */
+class MemoryEndpoint {
+public:
+    virtual ~MemoryEndpoint() = default;
+
+    // 负载不拷贝, 只交出RTP头部(含扩展)和负载长度
+    virtual void OnRtp(MediaChannelID channel_id, uint8_t const *header,
+                       size_t header_size, size_t payload_size,
+                       int64_t now_us) = 0;
+    virtual void OnRtcp(MediaChannelID channel_id, uint8_t const *data,
+                        size_t size, int64_t now_us) = 0;
+};
+
+class MemoryNetwork;
+
+class MemoryLink : public PacketTransport {
+public:
+    bool SendRtp(MediaChannelID channel_id,
+                 boost::asio::const_buffer const *buffers,
+                 size_t count) override;
+    void SendRtcp(MediaChannelID channel_id, uint8_t const *data,
+                  size_t size) override;
+
+    // 客户端发给服务器的RTCP(RR/NACK/PLI等), 经过时延后交给绑定的RtpConnect
+    void SendToServer(MediaChannelID channel_id, uint8_t const *data,
+                      size_t size);
+
+    void Attach(std::shared_ptr<RtpConnect> conn) {
+        conn_ = conn;
+    }
+
+    // 客户端离开, 之后两个方向的包都丢掉
+    void Close() {
+        closed_ = true;
+    }
+
+    MemoryLinkStats const &GetStats() const {
+        return stats_;
+    }
+
+private:
+    friend class MemoryNetwork;
+    MemoryLink(MemoryNetwork *network, MemoryLinkConfig const &config,
+               MemoryEndpoint *endpoint)
+        : network_(network),
+          config_(config),
+          endpoint_(endpoint) {}
+
+    MemoryNetwork *network_;
+    MemoryLinkConfig config_;
+    MemoryEndpoint *endpoint_;
+    std::weak_ptr<RtpConnect> conn_;
+    bool closed_ = false;
+    int64_t busy_until_us_ = 0; // 瓶颈上最后一个包发完的时刻
+    MemoryLinkStats stats_;
+};
+
+/* 内存中的网络: 所有链路共用一个按到达时间排序的事件队列, 时间取自Clock.
+ * 只能在一个线程中使用(发送、Deliver都在驱动线程中), 丢包由固定种子的
+ * 随机数决定, 同样的输入得到同样的结果 */
+class MemoryNetwork {
+public:
+    explicit MemoryNetwork(uint64_t seed = 1) : rng_(seed) {}
+    MemoryNetwork(MemoryNetwork const &) = delete;
+    MemoryNetwork &operator=(MemoryNetwork const &) = delete;
+
+    // 链路由网络持有, endpoint要比网络活得久
+    std::shared_ptr<MemoryLink> CreateLink(MemoryLinkConfig const &config,
+                                           MemoryEndpoint *endpoint);
+
+    // 按到达顺序交付到达时间不晚于now_us的包, 返回交付的包数
+    size_t Deliver(int64_t now_us);
+
+    // 最早的到达时间, 没有在途的包时返回-1
+    int64_t NextArrivalUs() const;
+
+    size_t GetInFlight() const {
+        return in_flight_;
+    }
+
+private:
+    friend class MemoryLink;
+
+    enum class EventKind : uint8_t {
+        RTP = 0,     // 服务器到客户端
+        RTCP,        // 服务器到客户端
+        RTCP_SERVER, // 客户端到服务器
+    };
+
+    // RTP只保存头部
+    static constexpr size_t kMaxHeader = 48;
+    struct Event {
+        int64_t arrival_us;
+        MemoryLink *link;
+        EventKind kind;
+        MediaChannelID channel_id;
+        uint16_t header_size;
+        uint32_t payload_size;
+        uint8_t header[kMaxHeader];
+        std::vector<uint8_t> rtcp;
+    };
+    // 上万个客户端时在途的包有几十万个, 放在一个堆里排序太慢.
+    // 按到达时间分到1ms的桶里, 桶内按发送顺序追加, 到期时才排序
+    static constexpr int64_t kBucketUs = 1000;
+
+    bool Lose(double loss);
+    void Push(Event &&event);
+    bool DeliverEvent(Event &event);
+
+    std::mt19937_64 rng_;
+    std::vector<std::shared_ptr<MemoryLink>> links_;
+    std::map<int64_t, std::vector<Event>> buckets_;
+    size_t in_flight_ = 0;
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* 计数器. 每个线程有自己的一组槽, 加法只读写本线程的槽, 不用带锁前缀的指令,
+ * 导出时把所有线程的槽加起来. 默认构造的句柄写到不导出的槽里 */
+class Counter {
+public:
+    inline void Add(uint64_t n = 1) const;
+
+private:
+    friend class MetricsRegistry;
+    uint32_t slot_ = 0;
+};
+
+/* 瞬时值, 如连接数和队列长度, 直接是一个共享的原子变量 */
+class Gauge {
+public:
+    void Set(int64_t value) const {
+        value_->store(value, std::memory_order_relaxed);
+    }
+
+    void Add(int64_t n) const {
+        value_->fetch_add(n, std::memory_order_relaxed);
+    }
+
+private:
+    friend class MetricsRegistry;
+    inline static std::atomic<int64_t> discard_{0};
+    std::atomic<int64_t> *value_ = &discard_;
+};
+
+/* 直方图, 桶的计数和总和也放在每个线程的槽里.
+ * 桶按上界升序排列, 多出一个+Inf桶 */
+class Histogram {
+public:
+    inline void Observe(uint64_t value) const;
+
+private:
+    friend class MetricsRegistry;
+    // 依次是各桶、+Inf桶和总和, 默认句柄只有+Inf桶和总和, 都是不导出的槽
+    uint32_t slot_ = 0;
+    uint32_t bucket_count_ = 0;
+    uint64_t const *bounds_ = nullptr;
+};
+
+/* 指标注册表, 以Prometheus文本格式导出.
+ * 同名同标签的指标只注册一次, 再注册返回同一个句柄.
+ * 标签是已经拼好的 key="value",... , 值用Label转义 */
+class MetricsRegistry {
+public:
+    static MetricsRegistry &Instance();
+
+    Counter AddCounter(std::string const &name, std::string const &help,
+                       std::string const &labels = "");
+    Gauge AddGauge(std::string const &name, std::string const &help,
+                   std::string const &labels = "");
+    Histogram AddHistogram(std::string const &name, std::string const &help,
+                           std::vector<uint64_t> const &bounds,
+                           std::string const &labels = "");
+
+    // 导出时追加自己的指标(如分位数), 在Expose中持锁调用, 不能再注册指标
+    void AddCollector(std::function<void(std::string *)> collector);
+
+    // Prometheus text format 0.0.4
+    std::string Expose();
+
+    static std::string Label(std::string const &key, std::string const &value);
+
+    // 本线程的槽, 第一次调用时分配
+    static std::atomic<uint64_t> *LocalSlots() {
+        std::atomic<uint64_t> *slots = local_slots_;
+        if (__builtin_expect(slots == nullptr, 0)) {
+            slots = RegisterThread();
+        }
+        return slots;
+    }
+
+    static constexpr size_t kMaxSlots = 2048;
+
+private:
+    struct ThreadSlots;
+    enum class Type : uint8_t {
+        COUNTER = 0,
+        GAUGE,
+        HISTOGRAM,
+    };
+    struct Metric {
+        std::string name;
+        std::string help;
+        std::string labels;
+        Type type;
+        uint32_t slot = 0;
+        std::vector<uint64_t> bounds;
+        std::atomic<int64_t> gauge{0};
+    };
+    // 0和1号槽给默认句柄用, 不导出
+    static constexpr uint32_t kReservedSlots = 2;
+
+    MetricsRegistry() = default;
+
+    static std::atomic<uint64_t> *RegisterThread();
+    Metric *Find(std::string const &name, std::string const &labels);
+    Metric *Add(std::string const &name, std::string const &help,
+                std::string const &labels, Type type, size_t slots);
+    // 所有线程(包括已经退出的)这个槽的和, 持有mutex_时调用
+    uint64_t Sum(uint32_t slot) const;
+    void ExposeMetric(Metric const &metric, std::string *out) const;
+
+    inline static thread_local std::atomic<uint64_t> *local_slots_ = nullptr;
+
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Metric>> metrics_;
+    std::vector<std::function<void(std::string *)>> collectors_;
+    uint32_t next_slot_ = kReservedSlots;
+    std::vector<std::atomic<uint64_t> *> threads_;
+    uint64_t retired_[kMaxSlots] = {0}; // 已经退出的线程的累计
+};
+
+inline void Counter::Add(uint64_t n) const {
+    std::atomic<uint64_t> &slot = MetricsRegistry::LocalSlots()[slot_];
+    slot.store(slot.load(std::memory_order_relaxed) + n,
+               std::memory_order_relaxed);
+}
+
+inline void Histogram::Observe(uint64_t value) const {
+    std::atomic<uint64_t> *slots = MetricsRegistry::LocalSlots() + slot_;
+    uint32_t i = 0;
+    while (i < bucket_count_ && value > bounds_[i]) {
+        i++;
+    }
+    slots[i].store(slots[i].load(std::memory_order_relaxed) + 1,
+                   std::memory_order_relaxed);
+    std::atomic<uint64_t> &sum = slots[bucket_count_ + 1];
+    sum.store(sum.load(std::memory_order_relaxed) + value,
+              std::memory_order_relaxed);
+}
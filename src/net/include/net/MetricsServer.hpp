@@ -0,0 +1,34 @@
+#pragma once
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+/* 导出指标的HTTP服务, GET /metrics返回MetricsRegistry::Expose的内容.
+ * GET /latency返回各阶段延时的文本报告, POST /latency/on|off|reset开关和清空.
+ * 用自己的io_context和线程, 抓取慢或者卡住不影响RTSP和RTP的io线程.
+ * 每个连接只处理一个请求, 回复后关闭 */
+class MetricsServer {
+public:
+    // 默认只监听本机
+    MetricsServer(std::string const &address, uint16_t port);
+    ~MetricsServer();
+
+    bool Start();
+    void Stop();
+
+private:
+    struct HttpConnection;
+
+    void StartAccept();
+    void HandleRequest(std::shared_ptr<HttpConnection> conn);
+
+    boost::asio::io_context ioc_;
+    boost::asio::ip::tcp::acceptor acceptor_;
+    std::string address_;
+    uint16_t port_;
+    std::thread thread_;
+};
@@ -1,9 +1,12 @@
 #pragma once
 
 #include "const.hpp"
+#include "net/BufferPool.hpp"
 #include <cstddef>
 #include <cstdio>
 #include <cstring>
+#include <memory>
+#include <string>
 
 class RtspConnect;
 enum class Method;
@@ -15,22 +18,34 @@ static void MyPrintf(char const *msg) {
     printf("%x\n", *(msg + 3));
 }
 
+// pooled时缓冲区从BufferPool取, 析构时归还; 否则直接new
 class msgNode {
     friend class RtspConnect;
 
 public:
-    msgNode(size_t size) : current_len_(0), total_len_(size) {
-        data_ = new char[size + 1];
+    msgNode(size_t size, bool pooled = true)
+        : current_len_(0), total_len_(size) {
+        if (pooled) {
+            pool_ = BufferPool::GetInstance();
+            data_ = pool_->Acquire(size + 1, &capacity_);
+        } else {
+            capacity_ = size + 1;
+            data_ = new char[capacity_];
+        }
         data_[size] = '\0';
     }
 
     void Clear() {
         current_len_ = 0;
-        memset(data_, 0, total_len_);
+        data_[0] = '\0';
     }
 
     ~msgNode() {
-        delete[] data_;
+        if (pool_) {
+            pool_->Release(data_, capacity_);
+        } else {
+            delete[] data_;
+        }
     }
 
     inline char *Getdata() {
@@ -41,12 +56,28 @@ public:
         return total_len_;
     }
 
+    // 可写入的最大长度
+    inline size_t GetCapacity() const {
+        return capacity_ - 1;
+    }
+
+    // 直接写入Getdata()后设置实际长度, 不超过GetCapacity()
+    inline void SetLen(size_t len) {
+        total_len_ = len;
+        data_[len] = '\0';
+    }
+
     MSG_IDS id_;
+    // 追踪中跨线程交接的流id, 0为不追踪
+    uint64_t trace_flow_ = 0;
 
 protected:
     size_t current_len_;
     size_t total_len_;
     char *data_;
+    size_t capacity_ = 0;
+    // 持有引用, 保证析构时池还在; 不用池时为空
+    std::shared_ptr<BufferPool> pool_;
 };
 
 class Recv_Node : public msgNode {
@@ -54,9 +85,27 @@ public:
     Recv_Node(size_t size) : msgNode(size) {}
 };
 
+/* 应答由RtspResponse写进池里的缓冲区(Send_Node(size)).
+ * 拷贝数据的构造函数用于RTP/RTCP包, 每包每客户端一个, 在推流线程分配,
+ * io线程释放, 直接new以免所有连接争用池的全局锁 */
 class Send_Node : public msgNode {
 public:
-    Send_Node(char const *data, size_t size) : msgNode(size) {
+    Send_Node(size_t size) : msgNode(size) {}
+
+    Send_Node(char const *data, size_t size) : msgNode(size, false) {
         memcpy(data_, data, size);
     }
+
+    Send_Node(char const *head, size_t head_size, char const *body,
+              size_t body_size)
+        : msgNode(head_size + body_size, false) {
+        memcpy(data_, head, head_size);
+        memcpy(data_ + head_size, body, body_size);
+    }
+
+    // 跟在data_后面一起发送的共享数据(如缓存的SDP), 不拷贝
+    std::shared_ptr<std::string const> body_;
+    // RTP包的延时统计: 帧进入PushFrame的时刻和进入上一个队列的时刻, 0为不统计
+    uint64_t trace_push_ = 0;
+    uint64_t trace_queued_ = 0;
 };
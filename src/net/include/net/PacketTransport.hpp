@@ -0,0 +1,24 @@
+#pragma once
+
+#include "net/media.hpp"
+#include <boost/asio/buffer.hpp>
+#include <cstddef>
+#include <cstdint>
+
+/* RtpConnect下面的数据报传输. 没有设置时走UDP socket; 仿真时换成内存中的
+ * 实现(MemoryNetwork), 包的丢失、排队和到达时间都由实现决定.
+ * 在发送线程中同步调用, 返回后缓冲区可以复用 */
+class PacketTransport {
+public:
+    virtual ~PacketTransport() = default;
+
+    // 与UDP的分散聚合发送相同, buffers[0]是RTP头部(含扩展),
+    // 后面是负载(RTP包的负载, FEC包的保护数据等).
+    // 返回false表示发送缓冲区满, 按UDP的would_block处理
+    virtual bool SendRtp(MediaChannelID channel_id,
+                         boost::asio::const_buffer const *buffers,
+                         size_t count) = 0;
+
+    virtual void SendRtcp(MediaChannelID channel_id, uint8_t const *data,
+                          size_t size) = 0;
+};
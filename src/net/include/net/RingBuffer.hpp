@@ -17,7 +17,7 @@ public:
     ~RingBuffer() = default;
 
     bool Push(const T& item) {
-        return PushData(std::forward<T>(item));
+        return PushData(item);
     }
     bool Push(T&& item) {
         return PushData(item);
@@ -59,5 +59,5 @@ private:
     size_t get_index_;
     size_t put_index_;
     size_t capacity_;
-    std::atomic<int> nums_data_;
+    std::atomic<size_t> nums_data_;
 };
\ No newline at end of file
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* RTCP(RFC 3550)的包类型 */
+enum RtcpType {
+    RTCP_SR = 200,
+    RTCP_RR = 201,
+    RTCP_SDES = 202,
+    RTCP_BYE = 203,
+    RTCP_APP = 204,
+    RTCP_RTPFB = 205,
+    RTCP_PSFB = 206,
+    RTCP_XR = 207,
+};
+
+/* XR(RFC 3611)的报告块类型 */
+enum RtcpXrType {
+    RTCP_XR_RRTR = 4, // 接收者参考时间
+    RTCP_XR_DLRR = 5, // 对RRTR的回应, 接收者用来算RTT
+};
+
+#define RTCP_SDES_CNAME      1
+#define RTCP_FB_NACK         1 // RTPFB的FMT, 通用NACK(RFC 4585)
+#define RTCP_FB_PLI          1 // PSFB的FMT, 图像丢失指示(RFC 4585)
+#define RTCP_FB_FIR          4 // PSFB的FMT, 完整帧内请求(RFC 5104)
+#define RTCP_FB_TRANSPORT_CC 15 // RTPFB的FMT, 传输层反馈(transport-cc)
+#define RTCP_SR_SIZE         28 // 头部4 + SSRC 4 + 发送者信息20, 不带接收报告块
+#define RTCP_MIN_TIME        5.0
+#define RTCP_BW_FRACTION     0.05 // RTCP带宽占会话带宽的5%
+#define RTCP_UDP_IP_OVERHEAD 28
+#define RTCP_REPORT_BLOCK_SIZE 24
+#define RTCP_DLRR_SIZE       24 // XR头部8 + 块头4 + 一个子块12
+
+/* 复合包中的一个RTCP包, body指向公共头部之后 */
+struct RtcpPacketView {
+    uint8_t type;
+    uint8_t count; // RC/SC/FMT
+    uint8_t const *body;
+    size_t body_size;
+};
+
+/* SR/RR中的接收报告块 */
+struct RtcpReportBlock {
+    uint32_t ssrc;
+    uint8_t fraction_lost;
+    int32_t cumulative_lost;
+    uint32_t highest_seq;
+    uint32_t jitter;
+    uint32_t lsr;
+    uint32_t dlsr;
+};
+
+/* 每个客户端每个通道的接收质量, 来自RR/XR, 是某一时刻的快照 */
+struct QosStats {
+    uint32_t report_count = 0;   // 收到的接收报告数
+    uint8_t fraction_lost = 0;   // 最近一个报告间隔的丢包率, x/256
+    int32_t cumulative_lost = 0;
+    uint32_t highest_seq = 0;    // 扩展的最高序号
+    uint32_t jitter = 0;         // 到达间隔抖动, 时间戳单位
+    uint32_t jitter_us = 0;
+    uint32_t rtt_us = 0;         // 0表示还没有算出来
+    int64_t last_report_us = 0;  // Clock::NowUs, 微秒
+
+    double LossRate() const {
+        return fraction_lost / 256.0;
+    }
+};
+
+/* transport-cc反馈中的一个包 */
+struct TransportFeedbackPacket {
+    uint16_t seq;
+    bool received;
+    int64_t arrival_us; // 接收端时钟, 只有received时有效
+};
+
+/* transport-cc反馈, 列出从base_seq开始的连续status_count个包的到达情况 */
+struct TransportFeedback {
+    uint32_t media_ssrc = 0;
+    uint16_t base_seq = 0;
+    uint16_t status_count = 0;
+    int64_t reference_time_us = 0;
+    uint8_t fb_count = 0;
+    std::vector<TransportFeedbackPacket> packets; // 复用, 解析时不重新分配
+};
+
+/* 64位NTP时间, 高32位是1900年起的秒数, 低32位是秒的小数部分 */
+uint64_t GetNtpTime();
+
+// 本机的CNAME, 所有通道共用
+std::string const &GetRtcpCname();
+
+/* 生成SR + SDES(CNAME)复合包, 返回写入的字节数, 空间不够返回0 */
+size_t BuildSenderReport(uint8_t *buf, size_t capacity, uint32_t ssrc,
+                         uint64_t ntp_time, uint32_t rtp_ts,
+                         uint32_t packet_count, uint32_t octet_count);
+
+/* 在SR后面追加一个XR DLRR块, 回应接收者的RRTR. lrr是RRTR中NTP的中间32位,
+ * dlrr是从收到RRTR到现在的时间, 单位1/65536秒 */
+size_t BuildXrDlrr(uint8_t *buf, size_t capacity, uint32_t ssrc,
+                   uint32_t sub_ssrc, uint32_t lrr, uint32_t dlrr);
+
+/* 取复合包中的下一个RTCP包, 返回这个包的长度, 格式不对返回0 */
+size_t NextRtcpPacket(uint8_t const *data, size_t size, RtcpPacketView *pkt);
+
+// data至少RTCP_REPORT_BLOCK_SIZE字节
+void ParseReportBlock(uint8_t const *data, RtcpReportBlock *block);
+
+/* 在XR包体中找RRTR块, 取出发送者SSRC和NTP时间的中间32位 */
+bool ParseXrRrtr(uint8_t const *body, size_t size, uint32_t *ssrc,
+                 uint32_t *ntp);
+
+/* 解析RTPFB FMT=15的包体(从发送者SSRC开始), 格式不对返回false */
+bool ParseTransportFeedback(uint8_t const *body, size_t size,
+                            TransportFeedback *fb);
+
+/* RFC 3550 附录A.7的发送间隔计算, 返回秒数(已经随机化并做了补偿) */
+double RtcpInterval(int members, int senders, double rtcp_bw, bool we_sent,
+                    double avg_rtcp_size, bool initial);
@@ -11,6 +11,7 @@
 #define RTP_VPX_HEAD_SIZE	   1
 
 #define RTP_HEADER_BIG_ENDIAN  0
+#define RTP_RTX_PAYLOAD_BASE   110 // RTX的负载类型, 通道n用110+n
 
 enum class TransportMode {
     RTP_OVER_TCP = 0,
@@ -51,11 +52,34 @@ struct RtpPacket
 		last = 0;
 	}
 
+	/* 引用外部已打包好的数据(如映射的hint文件), 不分配也不拷贝;
+	 * buffer前RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE字节是预留的头部空间 */
+	RtpPacket(std::shared_ptr<uint8_t> buffer, uint32_t buffer_size)
+		: data(std::move(buffer))
+	{
+		type = 0;
+		size = buffer_size;
+		timestamp = 0;
+		last = 0;
+	}
+
+	// 负载与头部分开发送, 同一个包可以被所有客户端共享, 发送路径只读
+	inline uint8_t *Payload() const {
+		return data.get() + RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE;
+	}
+
+	inline uint32_t PayloadSize() const {
+		return size - RTP_TCP_HEAD_SIZE - RTP_HEADER_SIZE;
+	}
+
 	std::shared_ptr<uint8_t> data;
 	uint32_t size;
 	uint32_t timestamp;
 	uint8_t  type;
 	uint8_t  last;
+	// 延时统计的TSC时间戳, 帧进入PushFrame和这个包打好的时刻, 0为不统计
+	uint64_t trace_push = 0;
+	uint64_t trace_ready = 0;
 };
 
 struct mediaChannelInfo {
@@ -74,10 +98,16 @@ struct mediaChannelInfo {
     uint32_t clock_rate;
 
 
-    // rtcp
+    // rtcp, 只在发送线程中读写
     uint64_t packet_count;
     uint64_t octet_count;
     uint64_t last_rtcp_ntp_time;
+    uint32_t last_rtp_ts;       // 最近一帧的RTP时间戳
+    int64_t last_rtp_time_us;   // 这一帧第一个包发出的时间, 用来推算SR中的RTP时间戳
+    int64_t next_rtcp_time_us;  // 下一个SR的发送时间, 0表示还没发过RTP
+    int64_t last_rtcp_time_us;
+    uint64_t last_rtcp_octets;  // 上一个SR时的octet_count, 估算会话带宽
+    double avg_rtcp_size;
 
     bool is_setup;
     bool is_play;
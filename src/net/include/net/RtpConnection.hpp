@@ -1,16 +1,26 @@
 #pragma once
 
+#include "net/CongestionController.hpp"
 #include "net/LogicSystem.hpp"
+#include "net/FecEncoder.hpp"
 #include "net/media.hpp"
+#include "net/PacketTransport.hpp"
+#include "net/Rtcp.hpp"
 #include "net/Rtp.hpp"
+#include "net/RtpExtension.hpp"
+#include "net/RtpHistory.hpp"
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/ip/address.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/ip/udp.hpp>
-#include <boost/system/detail/error_code.hpp>
+#include <boost/system/error_code.hpp>
+#include <array>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <mutex>
 
 
 class RtspConnect;
@@ -21,6 +31,10 @@ struct endpoint {
 
 using UdpSocketPtr = std::unique_ptr<boost::asio::ip::udp::socket>;
 
+class RtpConnect;
+using KeyFrameNeededCallback =
+    std::function<void(std::shared_ptr<RtpConnect>, MediaChannelID)>;
+
 class RtpConnect : public std::enable_shared_from_this<RtpConnect> {
     friend class LogicSystem;
 public:
@@ -64,10 +78,95 @@ public:
                          uint16_t rtcp_port);
 
     bool SetupRtpOverTcp(MediaChannelID channel_id,uint16_t rtp_channel, uint16_t rtcp_channel);
+
+    // 不经过socket, RTP/RTCP交给transport(比如MemoryNetwork的链路).
+    // 按UDP对待: NACK重传、FEC、拥塞控制都照常生效. 不需要RtspConnect
+    bool SetupRtpOverTransport(MediaChannelID channel_id,
+                               std::shared_ptr<PacketTransport> transport);
     void Play();
     void TearDown();
 
-    int SendRtpPacket(MediaChannelID channel_id, RtpPacket pkt);
+    // history_index是包在会话RtpHistory中的编号, 用于NACK重传;
+    // priority是包所在帧的重要程度, 开启拥塞控制时按它抽帧
+    int SendRtpPacket(MediaChannelID channel_id, RtpPacket pkt,
+                      uint64_t history_index = RtpHistory::kNoIndex,
+                      FramePriority priority = FramePriority::KEY);
+
+    // 发送会话共享的FEC包, 只有完整收到这一组媒体包的UDP客户端才发
+    int SendFecPacket(MediaChannelID channel_id, FecPacket const &fec);
+    void SetFecEnabled(MediaChannelID channel_id, bool enable);
+
+    // UDP通道开启NACK重传, history为空时不开启. 在Play之前调用
+    void SetRtpHistory(MediaChannelID channel_id,
+                       std::shared_ptr<RtpHistory> history, bool use_rtx);
+
+    // UDP通道开启拥塞控制, 由RR驱动抽帧. 在Play之前调用
+    void SetCongestionControl(MediaChannelID channel_id, bool enable);
+    CongestionStats GetCongestionStats(MediaChannelID channel_id) const;
+
+    // 按会话的映射给这个通道的RTP包加头部扩展, 在Setup之后、Play之前调用.
+    // UDP通道带传输序号时记录每个包的发送时间, 用于处理transport-cc反馈
+    void SetRtpExtensions(MediaChannelID channel_id,
+                          RtpExtensionMap const &extensions);
+
+    // 多码率会话中客户端当前收的编码, 由MediaSession在推流线程中切换.
+    // has_lower为true时拥塞先由MediaSession往低切, 不抽帧
+    inline int GetRendition(MediaChannelID channel_id) const {
+        return rendition_[channel_id].load(std::memory_order_relaxed);
+    }
+
+    inline void SetRendition(MediaChannelID channel_id, int rendition,
+                             bool has_lower) {
+        rendition_[channel_id].store(rendition, std::memory_order_relaxed);
+        has_lower_rendition_[channel_id] = has_lower;
+    }
+
+    // 快进/快退期间直播包被丢弃, 只发送TrickPlayer提供的关键帧
+    inline void SetTrickPlay(bool enable) {
+        is_trick_play_ = enable;
+    }
+
+    // 在io线程中调用, 与推流线程的直播包由send_mutex_互斥
+    int SendTrickPacket(MediaChannelID channel_id, RtpPacket pkt);
+
+    // RTSP连接上收到的$帧, 在io线程中调用, data只在调用期间有效
+    void HandleInterleaved(uint8_t channel, uint8_t const *data, size_t size);
+
+    // transport收到的客户端RTCP, 在驱动transport的线程中调用
+    void HandleTransportRtcp(MediaChannelID channel_id, uint8_t const *data,
+                             size_t size);
+
+    // 收到PLI/FIR时调用, 由MediaSession在AddClient时设置
+    inline void SetKeyFrameNeededCallback(KeyFrameNeededCallback cb) {
+        keyframe_needed_cb_ = std::move(cb);
+    }
+
+    // 取走等待补发关键帧的标记, 在推流线程中调用. 距上次补发不到
+    // min_interval_us的请求直接丢掉, 一个客户端不能反复触发补发;
+    // 正在抽帧的客户端也不补发, 等下一个关键帧
+    bool TakeKeyFrameReplay(MediaChannelID channel_id, int64_t now_us,
+                            int64_t min_interval_us);
+
+    inline void RequestKeyFrameReplay(MediaChannelID channel_id) {
+        replay_requested_[channel_id] = true;
+    }
+
+    inline void ClearKeyFrameReplay(MediaChannelID channel_id) {
+        replay_requested_[channel_id] = false;
+    }
+
+    // 补发的关键帧顶替了当前帧, 当前帧剩下的包不再发给这个客户端.
+    // 在推流线程中(持有会话的client_mutex_)使用
+    inline void SetFrameReplaced(MediaChannelID channel_id, bool replaced) {
+        frame_replaced_[channel_id] = replaced;
+    }
+
+    inline bool IsFrameReplaced(MediaChannelID channel_id) const {
+        return frame_replaced_[channel_id];
+    }
+
+    // 客户端RR/XR反映的接收质量, 任何线程都可以调用
+    QosStats GetQosStats(MediaChannelID channel_id) const;
 
 private:
     char buffer[2048];
@@ -80,6 +179,8 @@ private:
     uint16_t local_rtcp_ports[MAX_MEDIA_CHANNEL];
     UdpSocketPtr rtp_sockets_[MAX_MEDIA_CHANNEL];
     UdpSocketPtr rtcp_sockets_[MAX_MEDIA_CHANNEL];
+    // 设置了就代替上面的socket
+    std::shared_ptr<PacketTransport> transports_[MAX_MEDIA_CHANNEL];
     //tcp
     std::unique_ptr<boost::asio::ip::tcp::socket> tcp_socket_;
 
@@ -90,20 +191,150 @@ private:
     uint16_t rtsp_port_;
 
     bool is_multicast_ = false;
-    bool is_closed_ = false;
+    std::atomic<bool> is_closed_{false};
     bool has_key_frame_ = false;
+    std::atomic<bool> is_trick_play_{false};
+    // 媒体包的发送状态(序号、SR计数、FEC分组、头部扩展、抽帧)只在持有它时修改.
+    // 直播包在推流线程发, 快进包在io线程发; 平常只有推流线程在用, 不会争用
+    std::mutex send_mutex_;
 
     uint8_t frame_type_ = 0;
+    std::atomic<uint64_t> rtcp_packets_{0};
+
+    // 收RTCP的线程写, 其他线程只读, 各字段单独原子读写, 不加锁
+    struct QosState {
+        std::atomic<uint32_t> report_count{0};
+        std::atomic<uint32_t> fraction_lost{0};
+        std::atomic<int32_t> cumulative_lost{0};
+        std::atomic<uint32_t> highest_seq{0};
+        std::atomic<uint32_t> jitter{0};
+        std::atomic<uint32_t> rtt_us{0};
+        std::atomic<int64_t> last_report_us{0};
+        // 最近一个XR RRTR, 在下一个SR中用DLRR回应
+        std::atomic<uint32_t> rrtr_ssrc{0};
+        std::atomic<uint32_t> rrtr_ntp{0};
+        std::atomic<int64_t> rrtr_time_us{0};
+    };
+    QosState qos_[MAX_MEDIA_CHANNEL];
+
+    // NACK重传. sent按序号低位索引, 存(序号 << 48 | 编号 + 1), 发送线程写,
+    // 收RTCP的线程读; 其余字段只在收RTCP的线程中使用
+    static const size_t kNackSeqWindow = 1024;
+    struct RetransmitState {
+        std::shared_ptr<RtpHistory> history;
+        std::unique_ptr<std::atomic<uint64_t>[]> sent;
+        std::unique_ptr<uint32_t[]> last_rtx_ms;
+        bool use_rtx = false;
+        uint8_t payload_type = 0;
+        uint32_t rtx_ssrc = 0;
+        uint16_t rtx_seq = 0;
+        uint64_t nack_count = 0;   // 客户端请求重传的包数
+        uint64_t rtx_count = 0;    // 实际重传的包数
+        uint64_t miss_count = 0;   // 已经过期或者没发过的包数
+    };
+    RetransmitState rtx_[MAX_MEDIA_CHANNEL];
+
+    // FEC, 只在发送线程中使用
+    struct FecState {
+        bool enable = false;
+        uint8_t group_count = 0; // 上一个FEC包之后发出的媒体包数
+        uint32_t ssrc = 0;
+        uint16_t seq = 0;
+    };
+    FecState fec_[MAX_MEDIA_CHANNEL];
+
+    // 头部扩展. 模板、传输序号和ext_xor只在发送线程中使用; sent按传输序号
+    // 低位索引, 存(序号 << 48 | 包长 << 32 | 发送时间的低32位微秒), 发送线程写,
+    // 收RTCP的线程读; 其余字段只在收RTCP的线程中使用
+    static constexpr size_t kTransportSeqWindow = 4096;
+    static constexpr size_t kBaseDelayWindows = 64;
+    static constexpr int64_t kTransportFeedbackWindowUs = 250000;
+    struct ExtensionState {
+        RtpExtensionHeader header;
+        uint16_t transport_seq = 0;
+        // 这一组FEC保护的包的扩展头部的异或, 这部分每个客户端都不一样
+        uint8_t ext_xor[RTP_EXT_MAX_SIZE] = {0};
+        std::unique_ptr<std::atomic<uint64_t>[]> sent;
+        TransportFeedback feedback;
+        bool has_feedback = false;
+        uint16_t next_seq = 0;      // 还没统计过的最小传输序号
+        // 每个统计窗口汇总一次给拥塞控制, 单向延时减去最近几个窗口的最小值是排队延时
+        int64_t window_start_us = 0;
+        uint32_t window_lost = 0;
+        uint32_t window_total = 0;
+        int64_t window_min_delay_us = 0;
+        int64_t base_delays_us[kBaseDelayWindows] = {0};
+        size_t base_count = 0;
+    };
+    ExtensionState ext_[MAX_MEDIA_CHANNEL];
+
+    // 拥塞控制. sent_bytes由发送线程写, 收RTCP的线程读;
+    // 抽帧状态只在发送线程中使用
+    struct CongestionState {
+        bool enable = false;
+        CongestionController controller;
+        std::atomic<uint64_t> sent_bytes{0};
+        std::atomic<uint64_t> dropped_frames{0};
+        std::atomic<uint64_t> socket_drops{0};
+        bool frame_done = true; // 上一个包是帧的最后一个包
+        bool dropping = false;  // 当前帧正在被丢弃
+        bool need_key = false;  // 丢过参考帧, 要等到关键帧才能继续发
+    };
+    CongestionState cc_[MAX_MEDIA_CHANNEL];
+    std::atomic<int> rendition_[MAX_MEDIA_CHANNEL] = {};
+    bool has_lower_rendition_[MAX_MEDIA_CHANNEL] = {false};
+
+    // 关键帧请求, fir_seq_只在收RTCP的线程中使用
+    KeyFrameNeededCallback keyframe_needed_cb_;
+    std::atomic<bool> replay_requested_[MAX_MEDIA_CHANNEL] = {};
+    int64_t last_replay_us_[MAX_MEDIA_CHANNEL] = {0};
+    bool frame_replaced_[MAX_MEDIA_CHANNEL] = {false};
+    int fir_seq_[MAX_MEDIA_CHANNEL] = {-1, -1};
 
 private:
     void HandleRead_Rtcp(boost::system::error_code const &ec, size_t bytes,
                          std::shared_ptr<RtpConnect> con,
                          MediaChannelID channel_id);
+    // UDP和TCP收到的RTCP包都在这里处理
+    void HandleRtcp(MediaChannelID channel_id, uint8_t const *data,
+                    size_t size);
+    void HandleReportBlock(MediaChannelID channel_id,
+                           RtcpReportBlock const &block);
+    void HandleXr(MediaChannelID channel_id, uint8_t const *data, size_t size);
+    void HandleNack(MediaChannelID channel_id, uint8_t const *data,
+                    size_t size);
+    void HandleTransportFeedback(MediaChannelID channel_id,
+                                 uint8_t const *data, size_t size);
+    void HandlePsfb(MediaChannelID channel_id, uint8_t fmt,
+                    uint8_t const *data, size_t size);
+    void Retransmit(MediaChannelID channel_id, uint16_t seq, int64_t now_us);
 
-
+    // 按拥塞级别决定这个包所在的帧是否丢弃, 在发送线程中调用
+    bool ShouldDrop(MediaChannelID channel_id, RtpPacket const &pkt,
+                    FramePriority priority);
     void SetFrameType(uint8_t frame_type);
-    void SetRtpHeader(MediaChannelID channel_id, RtpPacket pkt);
-    int SendRtpOverTcp(MediaChannelID channel_id, RtpPacket pkt);
-    int SendRtpOverUdp(MediaChannelID channel_id, RtpPacket pkt);
+    // 返回RTP头部(含扩展)的长度
+    size_t SetRtpHeader(MediaChannelID channel_id, RtpPacket const &pkt,
+                        uint8_t *header);
+    // 发送前填扩展的值, 记录传输序号对应的发送时间
+    void StampExtensions(MediaChannelID channel_id, uint8_t *header,
+                         size_t size);
+    int SendPacket(MediaChannelID channel_id, RtpPacket pkt,
+                   uint64_t history_index);
+    int SendRtpOverTcp(MediaChannelID channel_id, uint8_t *header,
+                       size_t header_size, RtpPacket const &pkt);
+    int SendRtpOverUdp(MediaChannelID channel_id, uint8_t *header,
+                       size_t header_size, RtpPacket const &pkt);
+    // RTP、FEC和重传包的出口: 设置了transport就交给它, 否则用UDP socket发送
+    template <size_t N>
+    void SendDatagram(MediaChannelID channel_id,
+                      std::array<boost::asio::const_buffer, N> const &buffers,
+                      boost::system::error_code &ec);
+
+    // 发送路径上更新SR计数, 到了RTCP间隔就发送SR + SDES
+    void UpdateSenderReport(MediaChannelID channel_id, RtpPacket const &pkt);
+    void SendSenderReport(MediaChannelID channel_id, int64_t now_us);
+    void SendRtcp(MediaChannelID channel_id, uint8_t const *data, size_t size);
+    static int64_t NowUs();
     
 };
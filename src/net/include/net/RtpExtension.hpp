@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#define RTP_EXT_ONE_BYTE_PROFILE 0xBEDE // RFC 8285一字节头部的profile
+#define RTP_EXT_MAX_SIZE         32     // 扩展头部(含4字节profile和长度)的上限
+#define RTP_EXT_ABS_SEND_TIME_SIZE  3
+#define RTP_EXT_TRANSPORT_SEQ_SIZE  2
+
+/* 支持的RTP头部扩展 */
+enum class RtpExtensionType : uint8_t {
+    ABS_SEND_TIME = 0,       // 发送时刻, 6.18定点秒, 接收端做基于延时的带宽估计
+    TRANSPORT_SEQUENCE,      // 传输层序号, 接收端用transport-cc反馈每个包的到达时间
+    NUM,
+};
+
+/* 扩展类型到一字节头部ID(1~14)的映射, 通过SDP的extmap告诉客户端 */
+class RtpExtensionMap {
+public:
+    bool Register(RtpExtensionType type, uint8_t id);
+
+    uint8_t GetId(RtpExtensionType type) const {
+        return ids_[(int)type];
+    }
+
+    bool IsEmpty() const;
+
+    // extmap行, 每行以\r\n结尾
+    std::string GetSdpAttributes() const;
+
+    static char const *GetUri(RtpExtensionType type);
+
+private:
+    uint8_t ids_[(int)RtpExtensionType::NUM] = {0};
+};
+
+/* 一个客户端通道的扩展头部模板. 建立时按映射生成一次, 发送时复制到RTP头后面,
+ * 只改各扩展的值, 不用每个包重新编码 */
+struct RtpExtensionHeader {
+    uint8_t data[RTP_EXT_MAX_SIZE] = {0};
+    uint8_t size = 0;                 // 0表示不带扩展
+    int8_t abs_send_time_offset = -1; // 值在data中的偏移, -1表示没有这个扩展
+    int8_t transport_seq_offset = -1;
+
+    void Build(RtpExtensionMap const &map);
+};
+
+// 微秒时间转成abs-send-time的24位6.18定点秒
+inline uint32_t ToAbsSendTime(int64_t time_us) {
+    return (uint32_t)((((uint64_t)time_us << 18) / 1000000) & 0xffffff);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "net/Rtp.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/* 一个通道最近发出的RTP包, 供NACK重传. 包只打一次, 所有客户端共享这一份,
+ * 每个包按推入顺序编号, 客户端自己记录序号到编号的对应关系.
+ * 超过时间窗口或者超过最大包数的旧包会被丢弃, 内存有上限 */
+class RtpHistory {
+public:
+    RtpHistory(uint32_t window_ms, size_t max_packets = 4096);
+
+    static const uint64_t kNoIndex = UINT64_MAX;
+
+    // 在推流线程中调用, 返回包的编号
+    uint64_t Push(RtpPacket const &pkt);
+
+    // 包已经过期或者编号不对时返回false
+    bool Get(uint64_t index, RtpPacket *pkt);
+
+    uint32_t GetWindow() const {
+        return window_ms_;
+    }
+
+    size_t GetSize();
+
+private:
+    // 不直接存RtpPacket, 它的默认构造会分配内存
+    struct Entry {
+        std::shared_ptr<uint8_t> data;
+        uint32_t size = 0;
+        uint32_t timestamp = 0;
+        uint8_t type = 0;
+        uint8_t last = 0;
+        int64_t time_us = 0;
+    };
+
+    void Expire(int64_t now_us);
+
+    std::mutex mtx_;
+    std::vector<Entry> entries_;
+    uint64_t first_index_ = 0; // 最旧的包的编号
+    uint64_t next_index_ = 0;
+    uint32_t window_ms_;
+};
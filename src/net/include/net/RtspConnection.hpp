@@ -1,10 +1,15 @@
 #pragma once
+#include "net/Clock.hpp"
 #include "net/MsgNode.hpp"
 #include "net/RtpConnection.hpp"
+#include "net/RtspParser.hpp"
+#include "net/RtspResponse.hpp"
+#include "net/TrickPlay.hpp"
 #include "Rtp.hpp"
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/ip/tcp.hpp>
-#include <boost/system/detail/error_code.hpp>
+#include <boost/system/error_code.hpp>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <memory>
@@ -13,19 +18,12 @@
 #include <queue>
 #include <string>
 #include <sys/types.h>
-#include <unordered_map>
-#include <utility>
 class RtspServer;
-enum class Method {
-    OPTIONS = 0,
-    DESCRIBE,
-    SETUP,
-    PLAY,
-    TEARDOWN,
-    GET_PARAMETER,
-    RTCP,
-    NONE,
-};
+
+// 每次读socket至少预留的空间
+static const size_t RTSP_READ_SIZE = 2048;
+// 默认的会话超时(秒), 在PLAY应答的Session头中告知客户端
+static const uint32_t RTSP_SESSION_TIMEOUT = 60;
 
 enum class ConnectionState {
     START_CONNECT,
@@ -39,31 +37,61 @@ public:
                 boost::asio::io_context &ioc);
 
     void AsyncRead();
-    bool ParseRequest(char const *buffer);
+    // 在LogicSystem线程中调用, 数据为分帧后的一条完整RTSP消息
+    bool HandleRecv(char const *data, size_t size);
     bool HandleRequest();
     void HandleWrite(boost::system::error_code const &ec, std::size_t size,
                      std::shared_ptr<RtspConnect> con_);
     void Send(char const *buffer, size_t size);
     void Send(std::string const &str);
+    // 直接发送已经写好的节点(含共享body), 不再拷贝
+    void Send(std::shared_ptr<Send_Node> node);
     uint16_t GetRtpPort();
     uint16_t GetRtcpPort();
 
+    // 收到RTSP或RTCP时调用, 刷新空闲计时, 可以在任意线程调用
+    inline void Touch() {
+        last_active_ms_ = NowMs();
+    }
+
+    // 距离上次Touch的毫秒数
+    inline uint64_t GetIdleTime() const {
+        return NowMs() - last_active_ms_;
+    }
+
+    inline bool IsClosed() const {
+        return is_closed_;
+    }
+
+    // 在任意线程调用, 实际的关闭在LogicSystem线程中进行
+    void RequestClose();
+    // 在LogicSystem线程中调用: 结束会话, 关闭socket, 从服务器的连接表删除
+    void HandleClose();
+    // 在LogicSystem线程中调用: 结束会话, 发完node后关闭连接
+    void SendAndClose(std::shared_ptr<Send_Node> node);
+
+    inline void SetConnectionSlot(size_t slot) {
+        conn_slot_ = slot;
+    }
+
     u_int32_t GetCSeq();
+    // 服务器实际的空闲超时, Session头中的timeout要和它一致
+    uint32_t GetSessionTimeout() const;
 
     inline boost::asio::ip::tcp::socket &GetSocket() {
         return socket_;
     }
 
     inline Method GetMethod() {
-        return method_;
+        return request_.method;
     }
 
     inline TransportMode GetTransport() {
-        return transport_;
+        return request_.transport;
     }
 
     inline MediaChannelID GetChannelId() {
-        return channelid_;
+        return request_.channel_id;
     }
 
     inline std::string GetIp() const {
@@ -81,59 +109,85 @@ public:
     u_int8_t GetRtpChannel() const;
     u_int8_t GetRtcpChannel() const;
 
+    // PLAY请求的Scale/Speed, 没有时为1.0; header返回客户端使用的头名称
+    double GetScale(std::string *header = nullptr) const;
+    double GetRangeStart() const;
+
     std::string GetSocketIp(boost::asio::ip::tcp::socket &socket);
 
 private:
+    static uint64_t NowMs() {
+        return (uint64_t)Clock::NowUs() / 1000;
+    }
+
     friend class RtpConnect;
     std::weak_ptr<RtspServer> server_;
     boost::asio::ip::tcp::socket socket_;
 
-    std::queue<std::shared_ptr<msgNode>> send_que_;
+    std::queue<std::shared_ptr<Send_Node>> send_que_;
     std::queue<std::shared_ptr<msgNode>> recv_que_;
-    std::shared_ptr<Recv_Node> recv_node_;
     std::shared_ptr<Send_Node> send_node_;
     std::mutex send_mtx_;
 
     // rtp
     std::shared_ptr<RtpConnect> rtp_conn_;
+    std::shared_ptr<TrickPlayer> trick_player_;
 
-    std::unordered_map<std::string, std::pair<std::string, int>>
-        Request_line_parmas_;
-    std::unordered_map<std::string, std::pair<std::string, int>>
-        Header_line_parmas_;
-    Method method_;
-    std::string URL_;
-    TransportMode transport_;
-    MediaChannelID channelid_;
+    RtspParser parser_;
+    RtspRequest request_;
 
     ConnectionState conn_state_ = ConnectionState::START_CONNECT;
+    std::atomic<uint64_t> last_active_ms_{NowMs()};
+    std::atomic<bool> is_closed_{false};
+    std::atomic<bool> close_requested_{false};
+    // 发送队列清空后关闭连接, 之后的请求不再处理
+    std::atomic<bool> close_after_send_{false};
+    size_t conn_slot_ = 0;
     MediaSessionId session_id_ = 0;
 
 private:
-    bool ParseRequestLine(std::string &line);
-    bool ParseHeaderLine(std::string &line);
-    bool ParseTransport(std::string &line);
-    bool ParseCSeq(std::string &line);
-    bool ParseAccept(std::string &line);
-    bool ParseMediaChannel(std::string &line);
-    bool ParseSessionId(std::string &line);
+    // 在io线程中把接收缓冲区切成RTSP消息和$帧
+    bool HandleFrames();
+
+    // 检查各方法必需的头部
+    bool CheckRequest() const;
 
     // handle Rtsp_cmd
     void HandleOptions();
     void HandleDescribe();
     void HandleSetup();
     void HandlePlay();
+    void HandleTeardown();
+    void HandleGetParameter();
+    // 在单独的线程中导出追踪缓冲区并回复, 不占LogicSystem线程
+    void SendTraceDump();
+    // 结束RTP会话: 停止发送, 离开MediaSession, 释放UDP端口
+    void TearDownSession();
+    // 请求带的Session是否是本连接的. RFC 2326要求TEARDOWN带Session,
+    // 只有GET_PARAMETER保活(ping)可以不带
+    bool CheckSession(bool allow_missing) const;
     void HandleRtcp();
+    bool StartTrickPlay(double scale);
 
     // build response
-    int BuildOptions_res(char const *res, size_t size);
-    int BuildDescribe_res(char const *res, size_t size, std::string sdp);
-    int BuildSetupTcp_res(char const *res, size_t size, uint16_t rtp_chn,
-                          uint16_t rtcp_chn, uint32_t session_id);
-    int BuildSetupUdp_res(char const *res, size_t size, uint16_t rtp_chn,
-                          uint16_t rtcp_chn, uint32_t session_id);
-    int BuildPlay_res(char const *res, size_t size, char const *rtpInfo,
-                      uint32_t session_id);
-    int BuildNotFound_res(char const *res, int size);
-    int BuildServerError_res(char const *res, int size);
+    std::shared_ptr<Send_Node> BuildOptions_res();
+    std::shared_ptr<Send_Node>
+    BuildDescribe_res(std::shared_ptr<std::string const> sdp);
+    std::shared_ptr<Send_Node> BuildSetupTcp_res(uint16_t rtp_chn,
+                                                 uint16_t rtcp_chn,
+                                                 uint32_t session_id);
+    std::shared_ptr<Send_Node> BuildSetupUdp_res(uint16_t rtp_chn,
+                                                 uint16_t rtcp_chn,
+                                                 uint32_t session_id);
+    std::shared_ptr<Send_Node> BuildPlay_res(char const *rtpInfo,
+                                             uint32_t session_id,
+                                             char const *scale_header = nullptr,
+                                             double scale = 1.0);
+    std::shared_ptr<Send_Node> BuildNotFound_res();
+    std::shared_ptr<Send_Node> BuildTeardown_res();
+    std::shared_ptr<Send_Node> BuildGetParameter_res(uint32_t session_id);
+    std::shared_ptr<Send_Node> BuildError_res(RtspStatus status);
+    std::shared_ptr<Send_Node> BuildServerError_res();
+
+    void AsyncWrite(std::shared_ptr<Send_Node> const &node);
 };
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "net/BufferPool.hpp"
+#include "net/media.hpp"
+#include "net/Rtp.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+enum class Method {
+    OPTIONS = 0,
+    DESCRIBE,
+    SETUP,
+    PLAY,
+    TEARDOWN,
+    GET_PARAMETER,
+    RTCP,
+    NONE,
+};
+
+static const size_t RTSP_MAX_URL_LEN = 256;
+static const size_t RTSP_MAX_HOST_LEN = 64;
+// 单个请求(含body)的上限, 超过时认为是错误的请求
+static const size_t RTSP_MAX_MESSAGE_SIZE = 64 * 1024;
+// 最大的$帧: 4字节头 + 65535字节数据, 只受长度字段限制
+static const size_t RTSP_MAX_FRAME_SIZE = RTP_TCP_HEAD_SIZE + 0xffff;
+// 未处理数据的上限: 一个没切完的最大帧加上一次读入
+static const size_t RTSP_MAX_PENDING_SIZE = 2 * RTSP_MAX_FRAME_SIZE;
+
+/* 解析结果, 固定大小的扁平结构, 解析时不分配内存.
+ * body指向解析器的缓冲区, 只在处理本请求期间有效 */
+struct RtspRequest {
+    Method method = Method::NONE;
+    uint32_t cseq = 0;
+    bool has_cseq = false;
+
+    char url[RTSP_MAX_URL_LEN] = {0};
+    char url_ip[RTSP_MAX_HOST_LEN] = {0};
+    uint16_t url_port = 0;
+    char url_suffix[RTSP_MAX_URL_LEN] = {0};
+    MediaChannelID channel_id = channel0;
+
+    // Transport
+    bool has_transport = false;
+    TransportMode transport = TransportMode::RTP_OVER_TCP;
+    uint16_t rtp_port = 0;
+    uint16_t rtcp_port = 0;
+    uint8_t rtp_channel = 0;
+    uint8_t rtcp_channel = 0;
+
+    bool has_accept = false;
+    bool accept_sdp = false;
+
+    bool has_session = false;
+    uint32_t session_id = 0;
+
+    // Scale/Speed
+    bool has_scale = false;
+    double scale = 1.0;
+    char scale_header[8] = {0};
+
+    bool has_range = false;
+    double range_start = 0.0;
+
+    uint32_t content_length = 0;
+    std::string_view body;
+
+    // interleaved帧($ + 通道 + 长度)
+    uint8_t interleaved_channel = 0;
+
+    void Reset();
+};
+
+/* 分帧结果: 一条完整的RTSP消息, 或者一个$通道帧的负载.
+ * data指向解析器的缓冲区, 在下一次Prepare/Append之前有效 */
+struct RtspFrame {
+    bool interleaved = false;
+    uint8_t channel = 0;
+    char const *data = nullptr;
+    size_t size = 0;
+    size_t consumed = 0;
+};
+
+/* 增量解析器: 数据可以分多次追加, 一次追加也可以包含多个请求(pipeline).
+ * 缓冲区从BufferPool取, 只在请求比当前容量大时才增长, 数据处理完后缩回初始大小 */
+class RtspParser {
+public:
+    enum class Result {
+        COMPLETE,
+        INCOMPLETE,
+        ERROR,
+    };
+
+    RtspParser(size_t capacity = 4096);
+    ~RtspParser();
+    RtspParser(RtspParser const &) = delete;
+    RtspParser &operator=(RtspParser const &) = delete;
+
+    // 返回至少size字节的可写空间, socket可以直接读到这里, 读完后Commit
+    char *Prepare(size_t size);
+
+    size_t Writable() const {
+        return capacity_ - write_pos_;
+    }
+
+    // 未处理的数据超过RTSP_MAX_PENDING_SIZE时返回false,
+    // 单个RTSP消息的上限由NextFrame检查
+    bool Commit(size_t size);
+
+    // 追加收到的数据, 超过RTSP_MAX_PENDING_SIZE时返回false
+    bool Append(char const *data, size_t size);
+
+    // 切出下一个消息或$帧并消费掉它, 不拷贝; INCOMPLETE表示需要更多数据
+    Result NextFrame(RtspFrame *frame);
+
+    // 切出并解析下一个消息; $帧以Method::RTCP返回, body为负载
+    Result Next(RtspRequest *req);
+
+    // 丢弃所有未处理的数据, 并把缓冲区缩回初始大小
+    void Clear();
+
+    size_t Capacity() const {
+        return capacity_;
+    }
+
+    size_t Pending() const {
+        return write_pos_ - read_pos_;
+    }
+
+    // 解析NextFrame切出的一条完整RTSP消息
+    static Result Parse(std::string_view data, RtspRequest *req);
+
+private:
+    void Reserve(size_t capacity);
+
+    // 持有引用, 保证析构时池还在
+    std::shared_ptr<BufferPool> pool_;
+    size_t init_capacity_;
+    char *buf_ = nullptr;
+    size_t capacity_ = 0;
+    size_t read_pos_ = 0;
+    size_t write_pos_ = 0;
+    // 上次没有找到头部结束标记时已经扫描到的位置, 避免重复扫描
+    size_t scan_pos_ = 0;
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "net/MsgNode.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+enum class RtspStatus {
+    OK = 0,
+    BAD_REQUEST,
+    NOT_FOUND,
+    SESSION_NOT_FOUND,
+    METHOD_NOT_VALID,
+    UNSUPPORTED_TRANSPORT,
+    SERVER_ERROR,
+    NOT_IMPLEMENTED,
+    PARAMETER_NOT_UNDERSTOOD,
+    SERVICE_UNAVAILABLE,
+};
+
+/* RTSP应答生成器: 直接写进从BufferPool取的Send_Node, 状态行和头部名称
+ * 都是预先写好的常量, 数字用to_chars格式化. body以共享指针挂在节点上,
+ * 发送时和头部一起gather写出, 不拷贝 */
+class RtspResponse {
+public:
+    // capacity只需容纳头部
+    RtspResponse(RtspStatus status, uint32_t cseq, size_t capacity = 512);
+
+    RtspResponse &Header(std::string_view name, std::string_view value);
+    RtspResponse &Header(std::string_view name, uint64_t value);
+
+    // 逐段拼一个头部的值: Begin写"name: ", 之后Append, 最后End写"\r\n"
+    RtspResponse &Begin(std::string_view name);
+    RtspResponse &Append(std::string_view str);
+    RtspResponse &Append(uint64_t value);
+    // 定点小数, precision为小数位数
+    RtspResponse &Append(double value, int precision);
+    RtspResponse &End();
+
+    // 写入空行结束头部, 有body时加上Content-Length; 空间不够时返回nullptr
+    std::shared_ptr<Send_Node>
+    Finish(std::shared_ptr<std::string const> body = nullptr,
+           std::string_view content_type = std::string_view());
+
+    static std::string_view StatusLine(RtspStatus status);
+
+private:
+    std::shared_ptr<Send_Node> node_;
+    char *pos_;
+    char *end_;
+    bool overflow_ = false;
+};
@@ -1,12 +1,19 @@
 #pragma once
 
+#include "net/FrameTrace.hpp"
 #include "net/MediaSession.hpp"
+#include "net/Metrics.hpp"
 #include "net/media.hpp"
+#include "net/TimingWheel.hpp"
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 class RtspConnect;
@@ -20,7 +27,9 @@ public:
     void Start();
     MediaSessionId AddSession(MediaSession *session);
     void RemoveSession(MediaSessionId id);
-    bool PushFrame(MediaSessionId id, MediaChannelID channel, AVFrame frame);
+    // rendition是MediaSession::AddRendition返回的编号
+    bool PushFrame(MediaSessionId id, MediaChannelID channel, AVFrame frame,
+                   int rendition = 0);
 
     inline void SetVersion(std::string const &version) { //SDP session name
         version_ = version;
@@ -28,6 +37,30 @@ public:
 
     inline std::string GetVersion() { return version_; }
 
+    // 空闲超时(秒), 需要在Start之前设置
+    void SetIdleTimeout(uint32_t timeout_sec);
+
+    inline uint32_t GetIdleTimeout() const {
+        return idle_wheel_->GetTimeout();
+    }
+
+    size_t GetConnectionCount();
+
+    // 允许带会话的GET_PARAMETER trace导出追踪缓冲区, 默认关闭
+    inline void SetTraceDumpEnabled(bool enable) {
+        trace_dump_enabled_ = enable;
+    }
+
+    // 把之后所有PushFrame的调用记录到帧轨迹文件, 供FrameTracePlayer回放
+    bool StartFrameRecording(std::string const &path, bool with_payload);
+    void StopFrameRecording();
+
+    // 追踪导出交给服务器的导出线程执行, 同一时刻只做一次, 正忙时返回false
+    bool PostTraceDump(std::function<void()> task);
+
+    // ioc_停止之后调用: 等正在进行的导出做完再回收导出线程, 关闭轨迹文件
+    void Shutdown();
+
 
     
     ~RtspServer();
@@ -35,14 +68,39 @@ public:
 private:
     std::shared_ptr<MediaSession> LookMediaSession(const std::string& suffix);
     std::shared_ptr<MediaSession> LookMediaSession(MediaSessionId id);
+    void StartAccept();
+    // 连接表按槽位存放, 删除时槽位放回空闲列表, 增删都是O(1)
+    size_t AddConnection(std::shared_ptr<RtspConnect> conn);
+    void RemoveConnection(size_t slot);
+    void TraceDumpLoop();
+
     tcp::acceptor acceptor_;
     boost::asio::io_context &ioc_;
+
+    std::mutex conn_mtx_;
     std::vector<std::shared_ptr<RtspConnect>> connections_;
+    std::vector<size_t> free_slots_;
+    size_t conn_count_ = 0;
+    Counter accepted_metric_;
+    Gauge connections_metric_;
+
+    // 在ioc_的线程中运行
+    std::unique_ptr<TimingWheel> idle_wheel_;
 
     std::mutex mtx_;
     std::unordered_map<MediaSessionId, std::shared_ptr<MediaSession>>
         media_sessions_;
     std::unordered_map<std::string, MediaSessionId> rtsp_suffix_map_;
+    std::shared_ptr<FrameTraceWriter> frame_writer_; // 由mtx_保护
 
     std::string version_;
+
+    std::atomic<bool> trace_dump_enabled_{false};
+    // 导出有几MB, 不占ioc_和连接的线程; 第一次导出时启动, Shutdown时回收
+    std::thread dump_thread_;
+    std::mutex dump_mtx_;
+    std::condition_variable dump_cv_;
+    std::function<void()> dump_task_; // 以下由dump_mtx_保护
+    bool dump_busy_ = false;
+    bool dump_stopped_ = false;
 };
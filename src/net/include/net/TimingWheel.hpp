@@ -0,0 +1,45 @@
+#pragma once
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class RtspConnect;
+
+/* 空闲连接回收: 每秒转一格, 共timeout+1格. 连接放在自己的到期格里,
+ * 收到RTSP/RTCP时只更新连接上的时间戳(RtspConnect::Touch), 不动轮子.
+ * 转到某一格时检查其中的连接, 真正超时的关闭, 其余按剩余时间挪到后面的格.
+ * 所有操作都在ioc的线程中进行, 不需要加锁 */
+class TimingWheel {
+public:
+    TimingWheel(boost::asio::io_context &ioc, uint32_t timeout_sec);
+
+    void Start();
+    void Stop();
+
+    // 只能在ioc的线程中调用
+    void Add(std::shared_ptr<RtspConnect> const &conn);
+
+    uint32_t GetTimeout() const {
+        return timeout_sec_;
+    }
+
+    size_t GetSize() const {
+        return size_;
+    }
+
+private:
+    void OnTick();
+    void Place(std::weak_ptr<RtspConnect> conn, uint32_t delay_sec);
+
+    boost::asio::steady_timer timer_;
+    uint32_t timeout_sec_;
+    std::vector<std::vector<std::weak_ptr<RtspConnect>>> buckets_;
+    size_t cursor_ = 0;
+    // 轮子上的连接数(含已经关闭但还没转到的)
+    size_t size_ = 0;
+    bool is_running_ = false;
+};
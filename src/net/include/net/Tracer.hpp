@@ -0,0 +1,143 @@
+#pragma once
+
+#include "net/LatencyTracker.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* 热路径上的事件 */
+enum class TraceEventType : uint8_t {
+    FRAME_INGEST = 0, // PushFrame, 参数为帧大小
+    PACKETIZE,        // 会话内打包并分发一帧, 参数为编码号
+    UDP_SEND,         // send_to一个RTP包, 参数为字节数
+    TCP_ENQUEUE,      // RTP包放进LogicSystem队列, 参数为字节数
+    LOGIC_SEND,       // LogicSystem把RTP包交给连接, 参数为字节数
+    WRITE_START,      // 发起async_write, 参数为字节数
+    WRITE_COMPLETE,   // async_write完成, 参数为字节数
+    RTSP_READ,        // io线程读到RTSP数据并分帧, 参数为字节数
+    RTSP_REQUEST,     // LogicSystem处理一个RTSP请求, 参数为字节数
+    NUM,
+};
+
+enum class TracePhase : uint8_t {
+    BEGIN = 0,
+    END,
+    INSTANT,
+};
+
+// 跨线程交接: 同一id的事件在导出时用箭头连起来
+enum class TraceFlow : uint8_t {
+    NONE = 0,
+    START,
+    STEP,
+    END,
+};
+
+// 定长的二进制事件, 记录时不格式化
+struct TraceEvent {
+    uint64_t tsc;
+    uint64_t flow_id;
+    uint32_t arg;
+    TraceEventType type;
+    TracePhase phase;
+    TraceFlow flow;
+    uint8_t reserved;
+};
+
+/* 飞行记录器式的追踪: 每个线程一个定长的环形缓冲区, 写满后覆盖最旧的事件,
+ * 记录时只写本线程的缓冲区, 不加锁. 导出为Chrome/Perfetto的JSON
+ * (chrome://tracing 或 ui.perfetto.dev 打开). 默认打开, 关闭时每个事件只有
+ * 一次判断 */
+class Tracer {
+public:
+    static constexpr size_t kBufferSize = 16384; // 每个线程的事件数, 2的幂
+
+    static Tracer &Instance();
+
+    static bool IsEnabled() {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    void SetEnabled(bool enable) {
+        enabled_.store(enable, std::memory_order_relaxed);
+    }
+
+    static void Record(TraceEventType type, TracePhase phase, uint32_t arg = 0,
+                       uint64_t flow_id = 0, TraceFlow flow = TraceFlow::NONE) {
+        if (!IsEnabled()) {
+            return;
+        }
+        Buffer *buffer = local_buffer_;
+        if (__builtin_expect(buffer == nullptr, 0)) {
+            buffer = RegisterThread();
+        }
+        uint64_t head = buffer->head.load(std::memory_order_relaxed);
+        TraceEvent &event = buffer->events[head & (kBufferSize - 1)];
+        event.tsc = Tsc::Now();
+        event.flow_id = flow_id;
+        event.arg = arg;
+        event.type = type;
+        event.phase = phase;
+        event.flow = flow;
+        buffer->head.store(head + 1, std::memory_order_release);
+    }
+
+    // 本线程内唯一的流id, 高位是线程编号
+    static uint64_t NewFlowId() {
+        Buffer *buffer = local_buffer_;
+        if (__builtin_expect(buffer == nullptr, 0)) {
+            buffer = RegisterThread();
+        }
+        return ((uint64_t)buffer->index << 40) | ++buffer->next_flow;
+    }
+
+    // 在导出中显示的线程名, 除主线程外同时设置系统的线程名(截断到15个字符)
+    static void SetThreadName(std::string const &name);
+
+    // 所有线程缓冲区中的事件, Chrome trace event format
+    std::string ExportChromeJson();
+    bool Dump(std::string const &path);
+
+private:
+    struct Buffer {
+        TraceEvent events[kBufferSize];
+        std::atomic<uint64_t> head{0};
+        uint64_t next_flow = 0;
+        uint32_t index = 0;
+        int tid = 0;
+        std::string name; // 由mutex_保护
+    };
+
+    Tracer() = default;
+    static Buffer *RegisterThread();
+
+    inline static std::atomic<bool> enabled_{true};
+    inline static thread_local Buffer *local_buffer_ = nullptr;
+
+    std::mutex mutex_;
+    // 不释放, 线程退出后最后的事件还能导出
+    std::vector<Buffer *> buffers_;
+};
+
+/* 作用域内的BEGIN/END事件, 可以在BEGIN上带一个流 */
+class TraceScope {
+public:
+    explicit TraceScope(TraceEventType type, uint32_t arg = 0,
+                        uint64_t flow_id = 0, TraceFlow flow = TraceFlow::NONE)
+        : type_(type) {
+        Tracer::Record(type, TracePhase::BEGIN, arg, flow_id, flow);
+    }
+
+    ~TraceScope() {
+        Tracer::Record(type_, TracePhase::END);
+    }
+
+    TraceScope(TraceScope const &) = delete;
+    TraceScope &operator=(TraceScope const &) = delete;
+
+private:
+    TraceEventType type_;
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "net/H264File.hpp"
+#include "net/media.hpp"
+#include <boost/asio/steady_timer.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class RtpConnect;
+
+/* 快进/快退(PLAY携带Scale/Speed)时为单个客户端供流:
+ * 按文件的IDR索引只发送关键帧, 每个GOP时长发送一帧, 每次跳过|scale|个GOP,
+ * 时间戳按实际发送间隔重写, 因此码率和包速率大约降为原来的1/GOP长度.
+ * 到达文件末尾(快退时开头)的关键帧后停止发送, 直到下一个PLAY */
+class TrickPlayer : public std::enable_shared_from_this<TrickPlayer> {
+public:
+    TrickPlayer(boost::asio::steady_timer::executor_type executor,
+                std::shared_ptr<H264File> file,
+                std::shared_ptr<RtpConnect> rtp_conn,
+                MediaChannelID channel_id, uint32_t framerate);
+
+    void Start(double scale, size_t start_frame);
+    void Stop();
+
+    // scale落在这个范围外时才需要切到只发关键帧
+    static bool IsTrickScale(double scale) {
+        return scale > 1.0 || scale < 0.0;
+    }
+
+private:
+    void SendKeyFrame();
+
+    boost::asio::steady_timer timer_;
+    std::shared_ptr<H264File> file_;
+    std::weak_ptr<RtpConnect> rtp_conn_;
+    MediaChannelID channel_id_;
+    uint32_t framerate_;
+
+    double scale_ = 1.0;
+    size_t key_index_ = 0;
+    uint32_t timestamp_ = 0;
+    bool is_running_ = false;
+    std::vector<char> frame_buf_;
+};
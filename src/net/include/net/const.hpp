@@ -4,4 +4,5 @@ enum class MSG_IDS {
     REQUEST = 0,
     RTCP_REQUEST = 1,
     RTP_SEND_PKT = 2,
+    CLOSE = 3,
 };
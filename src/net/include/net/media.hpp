@@ -30,6 +30,7 @@ struct AVFrame
 	uint32_t size;				     /* 帧大小 */
 	uint8_t  type;				     /* 帧类型 */	
 	uint32_t timestamp;		  	     /* 时间戳 */
+	uint64_t trace_tsc = 0;		     /* 延时统计, 进入PushFrame的TSC, 0为不统计 */
 };
 
 static const int MAX_MEDIA_CHANNEL = 2;
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdio>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/* 简单的单元测试框架: TEST注册用例, CHECK失败时抛异常结束当前用例.
+ * 每个Test*.cpp是一组(suite), ctest按组分别运行 */
+struct TestFailure {
+    std::string message;
+};
+
+struct TestCase {
+    char const *suite;
+    char const *name;
+    std::function<void()> func;
+};
+
+std::vector<TestCase> &GetTests();
+
+struct TestRegistrar {
+    TestRegistrar(char const *suite, char const *name,
+                  std::function<void()> func) {
+        GetTests().push_back(TestCase{suite, name, std::move(func)});
+    }
+};
+
+#define TEST(suite, name)                                                     \
+    static void suite##_##name();                                             \
+    static TestRegistrar suite##_##name##_registrar(#suite, #name,            \
+                                                    suite##_##name);          \
+    static void suite##_##name()
+
+#define CHECK(cond)                                                           \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            std::ostringstream os_;                                           \
+            os_ << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ")";       \
+            throw TestFailure{os_.str()};                                     \
+        }                                                                     \
+    } while (0)
+
+// 失败时打印两边的值
+#define CHECK_OP(a, op, b)                                                    \
+    do {                                                                      \
+        auto const &a_ = (a);                                                 \
+        auto const &b_ = (b);                                                 \
+        if (!(a_ op b_)) {                                                    \
+            std::ostringstream os_;                                           \
+            os_ << __FILE__ << ":" << __LINE__ << ": CHECK(" #a " " #op " " #b \
+                << "), " << a_ << " vs " << b_;                               \
+            throw TestFailure{os_.str()};                                     \
+        }                                                                     \
+    } while (0)
+
+#define CHECK_EQ(a, b) CHECK_OP(a, ==, b)
+#define CHECK_LE(a, b) CHECK_OP(a, <=, b)
+#define CHECK_LT(a, b) CHECK_OP(a, <, b)
+#define CHECK_GE(a, b) CHECK_OP(a, >=, b)
+#define CHECK_GT(a, b) CHECK_OP(a, >, b)
@@ -0,0 +1,180 @@
+#include "Test.hpp"
+#include "net/FecEncoder.hpp"
+#include "net/Loopback.hpp"
+#include "net/Rtp.hpp"
+#include "net/RtpConnection.hpp"
+#include "net/RtpExtension.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+// 奇数个包, X恢复位才是1
+static const uint8_t kGroupSize = 5;
+static const uint8_t kPayloadType = 96;
+// 长度各不相同, 恢复时要靠长度恢复字段截掉补齐的部分
+static const uint32_t kSizes[kGroupSize] = {1200, 700, 1183, 333, 901};
+
+uint8_t Byte(std::string const &data, size_t i) {
+    return (uint8_t)data[i];
+}
+
+RtpPacket MakePacket(uint32_t timestamp, uint32_t payload_size, uint8_t seed,
+                     bool key, bool last) {
+    RtpPacket pkt;
+    pkt.size = RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE + payload_size;
+    pkt.timestamp = timestamp;
+    pkt.type = key ? VIDEO_FRAME_I : VIDEO_FRAME_P;
+    pkt.last = last ? 1 : 0;
+    for (uint32_t i = 0; i < payload_size; i++) {
+        pkt.Payload()[i] = (uint8_t)(seed + i * 7);
+    }
+    return pkt;
+}
+
+std::shared_ptr<RtpConnect>
+Connect(std::shared_ptr<CaptureTransport> transport, bool with_ext) {
+    auto conn = std::make_shared<RtpConnect>(nullptr);
+    conn->SetClockRate(channel0, 90000);
+    conn->SetPayloadType(channel0, kPayloadType);
+    conn->SetupRtpOverTransport(channel0, transport);
+    if (with_ext) {
+        RtpExtensionMap extensions;
+        extensions.Register(RtpExtensionType::ABS_SEND_TIME, 1);
+        extensions.Register(RtpExtensionType::TRANSPORT_SEQUENCE, 2);
+        conn->SetRtpExtensions(channel0, extensions);
+    }
+    conn->SetFecEnabled(channel0, true);
+    conn->Play();
+    return conn;
+}
+
+// RFC 5109的接收端: 用FEC包和同组其余的包恢复序号为seq的包
+std::string Recover(std::string const &fec,
+                    std::vector<std::string> const &received, uint16_t seq) {
+    uint8_t const *fec_header = (uint8_t const *)fec.data() + RTP_HEADER_SIZE;
+    uint8_t const *level = fec_header + FEC_HEADER_SIZE;
+    uint16_t protect_len = (uint16_t)(level[0] << 8 | level[1]);
+    size_t offset = RTP_HEADER_SIZE + FEC_HEADER_SIZE + FEC_LEVEL_HEADER_SIZE;
+    CHECK_EQ(fec.size(), offset + protect_len);
+
+    uint8_t bits[2] = {fec_header[0], fec_header[1]};
+    uint8_t ts[4] = {fec_header[4], fec_header[5], fec_header[6],
+                     fec_header[7]};
+    uint16_t length = (uint16_t)(fec_header[8] << 8 | fec_header[9]);
+    std::string protect = fec.substr(offset);
+    for (auto const &pkt: received) {
+        bits[0] ^= Byte(pkt, 0);
+        bits[1] ^= Byte(pkt, 1);
+        for (int i = 0; i < 4; i++) {
+            ts[i] ^= Byte(pkt, 4 + i);
+        }
+        // 固定头部之后的部分(扩展 + 负载)都受保护
+        size_t size = pkt.size() - RTP_HEADER_SIZE;
+        length ^= (uint16_t)size;
+        CHECK_LE(size, (size_t)protect_len);
+        for (size_t i = 0; i < size; i++) {
+            protect[i] ^= pkt[RTP_HEADER_SIZE + i];
+        }
+    }
+    CHECK_LE((size_t)length, (size_t)protect_len);
+
+    std::string result(RTP_HEADER_SIZE, '\0');
+    result[0] = (char)(RTP_VERSION << 6 | (bits[0] & 0x3f));
+    result[1] = (char)bits[1];
+    result[2] = (char)(seq >> 8);
+    result[3] = (char)(seq & 0xff);
+    for (int i = 0; i < 4; i++) {
+        result[4 + i] = (char)ts[i];
+        // SSRC不在保护范围内, 取同一个流的
+        result[8 + i] = received[0][8 + i];
+    }
+    result.append(protect, 0, length);
+    return result;
+}
+
+// 每个FEC包轮流丢掉组内的每一个媒体包, 恢复的包与发出的逐字节相同.
+// 返回检查过的FEC包数
+size_t CheckGroups(CaptureTransport const &capture, bool with_ext) {
+    std::vector<CaptureTransport::RtpRecord> media;
+    size_t fec_count = 0;
+    for (auto const &record: capture.rtp) {
+        if (record.payload_type == kPayloadType) {
+            media.push_back(record);
+            CHECK_EQ(record.header.size() > RTP_HEADER_SIZE, with_ext);
+            continue;
+        }
+        CHECK_EQ(record.payload_type, RTP_FEC_PAYLOAD_BASE + channel0);
+        fec_count++;
+        std::string fec = record.header + record.payload;
+        uint8_t const *fec_header =
+            (uint8_t const *)fec.data() + RTP_HEADER_SIZE;
+        uint8_t const *level = fec_header + FEC_HEADER_SIZE;
+        uint16_t sn_base = (uint16_t)(fec_header[2] << 8 | fec_header[3]);
+        uint16_t mask = (uint16_t)(level[2] << 8 | level[3]);
+        CHECK_EQ(mask, 0xffff << (16 - kGroupSize) & 0xffff);
+
+        // FEC紧跟在它保护的组后面, SN base是这个客户端自己的序号(各客户端随机)
+        CHECK_GE(media.size(), (size_t)kGroupSize);
+        size_t first = media.size() - kGroupSize;
+        CHECK_EQ(media[first].seq, sn_base);
+        std::vector<std::string> group;
+        for (size_t i = first; i < media.size(); i++) {
+            group.push_back(media[i].header + media[i].payload);
+        }
+        for (size_t drop = 0; drop < group.size(); drop++) {
+            std::vector<std::string> received;
+            for (size_t i = 0; i < group.size(); i++) {
+                if (i != drop) {
+                    received.push_back(group[i]);
+                }
+            }
+            uint16_t seq = (uint16_t)(sn_base + drop);
+            CHECK(Recover(fec, received, seq) == group[drop]);
+        }
+    }
+    return fec_count;
+}
+
+// 两组包经FecEncoder和各客户端的SendFecPacket发出, 每组是一个关键帧.
+// late在第一组中途加入, 这一组不能恢复, 不应收到它的FEC包
+void RunGroups(bool with_ext) {
+    auto early = std::make_shared<CaptureTransport>();
+    auto late = std::make_shared<CaptureTransport>();
+    std::vector<std::shared_ptr<RtpConnect>> conns;
+    conns.push_back(Connect(early, with_ext));
+
+    FecEncoder encoder(kGroupSize);
+    for (uint32_t n = 0; n < 2u * kGroupSize; n++) {
+        if (n == 1) {
+            conns.push_back(Connect(late, with_ext));
+        }
+        uint32_t index = n % kGroupSize;
+        RtpPacket pkt = MakePacket(3600 * (n / kGroupSize), kSizes[index],
+                                   (uint8_t)(n * 31), index == 0,
+                                   index == kGroupSize - 1u);
+        auto fec = encoder.Push(pkt, kPayloadType);
+        for (auto const &conn: conns) {
+            CHECK_EQ(conn->SendRtpPacket(channel0, pkt), 0);
+            if (fec) {
+                conn->SendFecPacket(channel0, *fec);
+            }
+        }
+    }
+
+    CHECK_EQ(CheckGroups(*early, with_ext), 2u);
+    CHECK_EQ(CheckGroups(*late, with_ext), 1u);
+}
+
+} // namespace
+
+TEST(FecRecovery, RecoversDroppedPacket) {
+    RunGroups(false);
+}
+
+// 带扩展时恢复的是扩展 + 负载: X位和长度恢复字段按扩展改写,
+// 负载异或前面接本客户端扩展的异或
+TEST(FecRecovery, RecoversDroppedPacketWithExtensions) {
+    RunGroups(true);
+}
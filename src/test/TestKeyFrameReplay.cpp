@@ -0,0 +1,79 @@
+#include "Test.hpp"
+#include "net/H264Source.hpp"
+#include "net/Loopback.hpp"
+#include "net/MediaSession.hpp"
+#include "net/RtpConnection.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+static const size_t kFrameSize = 4000;
+static const uint32_t kFrameTicks = 3600;
+
+std::shared_ptr<RtpConnect> AddClient(std::shared_ptr<MediaSession> session,
+                                      std::shared_ptr<CaptureTransport> link) {
+    auto conn = std::make_shared<RtpConnect>(nullptr);
+    conn->SetClockRate(channel0, 90000);
+    conn->SetPayloadType(channel0, 96);
+    conn->SetupRtpOverTransport(channel0, link);
+    session->AddClient(conn);
+    conn->Play();
+    return conn;
+}
+
+} // namespace
+
+// 文件源收到PLI后只补发缓存的IDR, 顶替当前帧并用当前帧的时间戳
+TEST(KeyFrameReplay, ReplacesCurrentFrameWithCachedIdr) {
+    auto session = MediaSession::GetInstance("test");
+    if (session->GetMediaSource(channel0) == nullptr) {
+        session->AddSource(channel0, new H264Source(25));
+    }
+    auto link_a = std::make_shared<CaptureTransport>();
+    auto link_b = std::make_shared<CaptureTransport>();
+    auto conn_a = AddClient(session, link_a);
+    auto conn_b = AddClient(session, link_b);
+
+    uint32_t base = 90000;
+    auto push = [&](size_t n, bool key) {
+        AVFrame frame = MakeH264Frame(key, kFrameSize, (uint8_t)(0x10 + n));
+        frame.timestamp = base + (uint32_t)n * kFrameTicks;
+        session->HandleFrame(channel0, frame);
+    };
+    push(0, true);
+    push(1, false);
+    push(2, false);
+    size_t gop_packets = link_a->rtp.size();
+
+    conn_b->RequestKeyFrameReplay(channel0);
+    push(3, false);
+    push(4, false);
+
+    session->RemoveClient(conn_a);
+    session->RemoveClient(conn_b);
+
+    auto key_a = link_a->WithTimestamp(base);
+    auto current_a = link_a->WithTimestamp(base + 3 * kFrameTicks);
+    auto current_b = link_b->WithTimestamp(base + 3 * kFrameTicks);
+    CHECK_GT(key_a.size(), 1u);
+
+    // A照常收到第3帧; B收到的是关键帧的负载, 没有第3帧的包
+    CHECK_EQ(link_a->rtp.size(), gop_packets + 2 * current_a.size());
+    CHECK_EQ(current_b.size(), key_a.size());
+    for (size_t i = 0; i < key_a.size(); i++) {
+        CHECK(current_b[i].payload == key_a[i].payload);
+        CHECK_EQ(current_b[i].marker, i + 1 == key_a.size());
+    }
+    CHECK_EQ(link_b->rtp.size(),
+             gop_packets + key_a.size() + current_a.size());
+
+    // B的序号连续, 时间戳不回退
+    for (size_t i = 1; i < link_b->rtp.size(); i++) {
+        auto const &prev = link_b->rtp[i - 1];
+        auto const &pkt = link_b->rtp[i];
+        CHECK_EQ(pkt.seq, (uint16_t)(prev.seq + 1));
+        CHECK_GE(pkt.timestamp, prev.timestamp);
+    }
+}
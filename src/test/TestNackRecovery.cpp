@@ -0,0 +1,110 @@
+#include "Test.hpp"
+#include "net/Clock.hpp"
+#include "net/H264Source.hpp"
+#include "net/Loopback.hpp"
+#include "net/MediaSession.hpp"
+#include "net/MemoryTransport.hpp"
+#include "net/RtpConnection.hpp"
+#include <memory>
+
+namespace {
+
+static const size_t kFrameSize = 4000;
+static const size_t kFrameCount = 500;
+static const int64_t kFrameUs = 40000;
+static const double kLoss = 0.05;
+
+struct LossRun {
+    uint64_t sent = 0;
+    uint64_t dropped = 0; // 链路上随机丢掉的RTP包, 包括重传包
+    uint64_t lost = 0;    // 最后仍没收到的
+    LoopbackReceiver client;
+};
+
+// 20ms单程时延、双向5%随机丢包, 25fps推20秒, 同一个种子丢包位置一样
+void RunLossyLink(bool nack, bool use_rtx, LossRun *run) {
+    Clock::UseVirtual();
+    auto session = MediaSession::GetInstance("test");
+    if (session->GetMediaSource(channel0) == nullptr) {
+        session->AddSource(channel0, new H264Source(25));
+    }
+    session->EnableRetransmission(1000, use_rtx);
+
+    MemoryNetwork network(7);
+    MemoryLinkConfig config;
+    config.latency_us = 20000;
+    config.loss = kLoss;
+    run->client.nack = nack;
+    run->client.link = network.CreateLink(config, &run->client);
+
+    auto conn = std::make_shared<RtpConnect>(nullptr);
+    conn->SetClockRate(channel0, 90000);
+    conn->SetPayloadType(channel0, 96);
+    conn->SetupRtpOverTransport(channel0, run->client.link);
+    conn->SetRtpHistory(channel0, session->GetRtpHistory(channel0), use_rtx);
+    run->client.link->Attach(conn);
+    session->AddClient(conn);
+    conn->Play();
+
+    int64_t start_us = Clock::NowUs();
+    int64_t end_us = start_us + kFrameCount * kFrameUs;
+    size_t next_frame = 0;
+    for (int64_t now_us = start_us; now_us <= end_us + 200000;
+         now_us += 1000) {
+        Clock::AdvanceTo(now_us);
+        if (next_frame < kFrameCount &&
+            start_us + (int64_t)next_frame * kFrameUs <= now_us) {
+            AVFrame frame = MakeH264Frame(next_frame % 25 == 0, kFrameSize);
+            frame.timestamp = (uint32_t)(next_frame * 3600);
+            session->HandleFrame(channel0, frame);
+            next_frame++;
+        }
+        network.Deliver(now_us);
+    }
+
+    session->RemoveClient(conn);
+    run->client.link->Close();
+    Clock::UseReal();
+
+    run->sent = run->client.link->GetStats().sent_packets;
+    run->dropped = run->client.link->GetStats().random_drops;
+    run->lost = run->client.Lost();
+}
+
+} // namespace
+
+// 不发NACK时丢多少就少多少, 作为对照
+TEST(NackRecovery, LossWithoutNack) {
+    LossRun run;
+    RunLossyLink(false, false, &run);
+    CHECK_GT(run.dropped, 0u);
+    CHECK_EQ(run.client.recovered, 0u);
+    CHECK_GT(run.lost, 0u);
+    CHECK_LE(run.lost + run.client.received, run.sent);
+}
+
+// 同一条链路发NACK: 丢掉的包大多在一个RTT后以原SSRC重传回来
+TEST(NackRecovery, NackRecoversDrops) {
+    LossRun plain;
+    RunLossyLink(false, false, &plain);
+    LossRun run;
+    RunLossyLink(true, false, &run);
+    CHECK_GT(run.client.nacks, 0u);
+    CHECK_GT(run.client.recovered, 0u);
+    CHECK_EQ(run.client.rtx_packets, 0u);
+    // NACK本身或重传包也可能再丢, 剩下的应在5%*2左右
+    CHECK_LE(run.lost * 5, plain.lost);
+}
+
+// RFC 4588 RTX: 重传包走单独的SSRC, 负载前的原始序号能补上缺口
+TEST(NackRecovery, RtxRecoversDrops) {
+    LossRun plain;
+    RunLossyLink(false, false, &plain);
+    LossRun run;
+    RunLossyLink(true, true, &run);
+    CHECK_GT(run.client.rtx_packets, 0u);
+    CHECK_EQ(run.client.rtx_ssrc_errors, 0u);
+    CHECK_GT(run.client.recovered, 0u);
+    CHECK_LE(run.client.recovered, run.client.rtx_packets);
+    CHECK_LE(run.lost * 5, plain.lost);
+}
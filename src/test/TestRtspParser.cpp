@@ -0,0 +1,161 @@
+#include "Test.hpp"
+#include "net/RtspParser.hpp"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace {
+
+char const kOptions[] = "OPTIONS rtsp://127.0.0.1:8554/live RTSP/1.0\r\n"
+                        "CSeq: 1\r\n"
+                        "\r\n";
+
+char const kSetup[] = "SETUP rtsp://127.0.0.1:8554/live/track0 RTSP/1.0\r\n"
+                      "CSeq: 2\r\n"
+                      "Transport: RTP/AVP/TCP;unicast;interleaved=0-1\r\n"
+                      "\r\n";
+
+char const kGetParameter[] =
+    "GET_PARAMETER rtsp://127.0.0.1:8554/live RTSP/1.0\r\n"
+    "CSeq: 3\r\n"
+    "Session: 12345678\r\n"
+    "Content-Length: 19\r\n"
+    "\r\n"
+    "param_a\r\nparam_bb\r\n";
+
+bool Append(RtspParser &parser, std::string_view data) {
+    return parser.Append(data.data(), data.size());
+}
+
+} // namespace
+
+// 一个请求在任意位置被拆成两次到达, 都只在第二次后得到完整的请求
+TEST(RtspParser, SplitAtEveryOffset) {
+    std::string_view msg(kSetup);
+    for (size_t split = 1; split < msg.size(); split++) {
+        RtspParser parser;
+        RtspRequest req;
+        CHECK(Append(parser, msg.substr(0, split)));
+        CHECK(parser.Next(&req) == RtspParser::Result::INCOMPLETE);
+        CHECK(Append(parser, msg.substr(split)));
+        CHECK(parser.Next(&req) == RtspParser::Result::COMPLETE);
+        CHECK(req.method == Method::SETUP);
+        CHECK_EQ(req.cseq, 2u);
+        CHECK(req.has_transport);
+        CHECK(req.transport == TransportMode::RTP_OVER_TCP);
+        CHECK_EQ((int)req.rtp_channel, 0);
+        CHECK_EQ((int)req.rtcp_channel, 1);
+        CHECK_EQ(parser.Pending(), 0u);
+    }
+}
+
+// 一次读到两个请求和一个$帧
+TEST(RtspParser, PipelinedRequests) {
+    RtspParser parser;
+    std::string data = std::string(kOptions) + kSetup;
+    data += std::string("$\x01\x00\x03", 4) + "abc";
+    CHECK(Append(parser, data));
+
+    RtspRequest req;
+    CHECK(parser.Next(&req) == RtspParser::Result::COMPLETE);
+    CHECK(req.method == Method::OPTIONS);
+    CHECK_EQ(req.cseq, 1u);
+    CHECK(parser.Next(&req) == RtspParser::Result::COMPLETE);
+    CHECK(req.method == Method::SETUP);
+    CHECK_EQ(req.cseq, 2u);
+    CHECK(parser.Next(&req) == RtspParser::Result::COMPLETE);
+    CHECK(req.method == Method::RTCP);
+    CHECK_EQ((int)req.interleaved_channel, 1);
+    CHECK(req.body == "abc");
+    CHECK(parser.Next(&req) == RtspParser::Result::INCOMPLETE);
+    CHECK_EQ(parser.Pending(), 0u);
+}
+
+// 头部已经完整, body分几次到达
+TEST(RtspParser, BodySplitAcrossReads) {
+    std::string_view msg(kGetParameter);
+    size_t head_size = msg.find("\r\n\r\n") + 4;
+    RtspParser parser;
+    RtspRequest req;
+    CHECK(Append(parser, msg.substr(0, head_size)));
+    CHECK(parser.Next(&req) == RtspParser::Result::INCOMPLETE);
+    CHECK(Append(parser, msg.substr(head_size, 5)));
+    CHECK(parser.Next(&req) == RtspParser::Result::INCOMPLETE);
+    CHECK(Append(parser, msg.substr(head_size + 5, 10)));
+    CHECK(parser.Next(&req) == RtspParser::Result::INCOMPLETE);
+    CHECK(Append(parser, msg.substr(head_size + 15)));
+    CHECK(parser.Next(&req) == RtspParser::Result::COMPLETE);
+    CHECK(req.method == Method::GET_PARAMETER);
+    CHECK(req.has_session);
+    CHECK_EQ(req.session_id, 12345678u);
+    CHECK_EQ(req.content_length, 19u);
+    CHECK(req.body == "param_a\r\nparam_bb\r\n");
+}
+
+// 一直收不到头部结束标记, 到上限后报错而不是无限缓存
+TEST(RtspParser, OversizedHeaderRejected) {
+    RtspParser parser;
+    RtspRequest req;
+    std::string line = "X-Padding: " + std::string(1000, 'a') + "\r\n";
+    CHECK(Append(parser, "OPTIONS rtsp://127.0.0.1:8554/live RTSP/1.0\r\n"));
+    RtspParser::Result ret = RtspParser::Result::INCOMPLETE;
+    while (ret == RtspParser::Result::INCOMPLETE) {
+        CHECK(Append(parser, line));
+        ret = parser.Next(&req);
+    }
+    CHECK(ret == RtspParser::Result::ERROR);
+    CHECK_LE(parser.Pending(), RTSP_MAX_MESSAGE_SIZE + line.size());
+}
+
+// Content-Length使整个消息超过上限时, 不等body到达就报错
+TEST(RtspParser, OversizedBodyRejected) {
+    RtspParser parser;
+    RtspRequest req;
+    std::string msg = "GET_PARAMETER rtsp://127.0.0.1:8554/live RTSP/1.0\r\n"
+                      "CSeq: 4\r\n"
+                      "Content-Length: " +
+                      std::to_string(RTSP_MAX_MESSAGE_SIZE) + "\r\n\r\n";
+    CHECK(Append(parser, msg));
+    CHECK(parser.Next(&req) == RtspParser::Result::ERROR);
+}
+
+// 长度字段为65535的$帧是合法的, 不受RTSP消息的上限限制
+TEST(RtspParser, LargestInterleavedFrame) {
+    std::string frame = std::string("$\x00\xff\xff", 4);
+    for (size_t n = 0; n < 0xffff; n++) {
+        frame.push_back((char)n);
+    }
+    CHECK_EQ(frame.size(), RTSP_MAX_FRAME_SIZE);
+    frame += kOptions;
+
+    // 和socket一样每次最多读2048字节
+    RtspParser parser;
+    RtspFrame out;
+    size_t offset = 0;
+    while (offset < RTSP_MAX_FRAME_SIZE) {
+        size_t size = std::min<size_t>(2048, frame.size() - offset);
+        memcpy(parser.Prepare(size), frame.data() + offset, size);
+        CHECK(parser.Commit(size));
+        offset += size;
+        if (offset < RTSP_MAX_FRAME_SIZE) {
+            CHECK(parser.NextFrame(&out) == RtspParser::Result::INCOMPLETE);
+        }
+    }
+    CHECK(parser.NextFrame(&out) == RtspParser::Result::COMPLETE);
+    CHECK(out.interleaved);
+    CHECK_EQ((int)out.channel, 0);
+    CHECK_EQ(out.size, (size_t)0xffff);
+    CHECK(memcmp(out.data, frame.data() + RTP_TCP_HEAD_SIZE, out.size) == 0);
+
+    CHECK(Append(parser, frame.substr(offset)));
+    RtspRequest req;
+    CHECK(parser.Next(&req) == RtspParser::Result::COMPLETE);
+    CHECK(req.method == Method::OPTIONS);
+
+    // 一次追加整个帧也可以
+    RtspParser whole;
+    CHECK(Append(whole, frame));
+    CHECK(whole.NextFrame(&out) == RtspParser::Result::COMPLETE);
+    CHECK_EQ(out.size, (size_t)0xffff);
+}
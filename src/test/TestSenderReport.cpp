@@ -0,0 +1,133 @@
+#include "Test.hpp"
+#include "net/Clock.hpp"
+#include "net/Loopback.hpp"
+#include "net/Rtcp.hpp"
+#include "net/Rtp.hpp"
+#include "net/RtpConnection.hpp"
+#include <memory>
+#include <string>
+
+namespace {
+
+uint32_t Get32(uint8_t const *p) {
+    return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+struct SenderReport {
+    uint32_t ssrc = 0;
+    uint64_t ntp_time = 0;
+    uint32_t rtp_ts = 0;
+    uint32_t packet_count = 0;
+    uint32_t octet_count = 0;
+    std::string cname;
+    uint32_t sdes_ssrc = 0;
+};
+
+// 复合包必须是SR后面跟一个只有CNAME的SDES
+bool ParseReport(std::string const &rtcp, SenderReport *report) {
+    uint8_t const *data = (uint8_t const *)rtcp.data();
+    size_t size = rtcp.size();
+    bool has_sr = false;
+    bool has_sdes = false;
+    RtcpPacketView pkt;
+    while (size > 0) {
+        size_t len = NextRtcpPacket(data, size, &pkt);
+        if (len == 0) {
+            return false;
+        }
+        if (pkt.type == RTCP_SR && pkt.body_size >= 24) {
+            has_sr = true;
+            report->ssrc = Get32(pkt.body);
+            report->ntp_time =
+                (uint64_t)Get32(pkt.body + 4) << 32 | Get32(pkt.body + 8);
+            report->rtp_ts = Get32(pkt.body + 12);
+            report->packet_count = Get32(pkt.body + 16);
+            report->octet_count = Get32(pkt.body + 20);
+        } else if (pkt.type == RTCP_SDES && pkt.count == 1 &&
+                   pkt.body_size >= 6 && pkt.body[4] == RTCP_SDES_CNAME &&
+                   6u + pkt.body[5] <= pkt.body_size) {
+            has_sdes = true;
+            report->sdes_ssrc = Get32(pkt.body);
+            report->cname.assign((char const *)pkt.body + 6, pkt.body[5]);
+        }
+        data += len;
+        size -= len;
+    }
+    return has_sr && has_sdes;
+}
+
+RtpPacket MakePacket(uint32_t timestamp, uint32_t payload_size, bool key,
+                     bool last) {
+    RtpPacket pkt;
+    pkt.size = RTP_TCP_HEAD_SIZE + RTP_HEADER_SIZE + payload_size;
+    pkt.timestamp = timestamp;
+    pkt.type = key ? VIDEO_FRAME_I : VIDEO_FRAME_P;
+    pkt.last = last ? 1 : 0;
+    return pkt;
+}
+
+int64_t NtpToUnixUs(uint64_t ntp_time) {
+    static const uint64_t kNtpUnixOffset = 2208988800ull;
+    int64_t sec = (int64_t)(ntp_time >> 32) - (int64_t)kNtpUnixOffset;
+    int64_t frac_us = (int64_t)(((ntp_time & 0xffffffffull) * 1000000) >> 32);
+    return sec * 1000000 + frac_us;
+}
+
+} // namespace
+
+// 25fps、每帧3个包推20秒: SR按RFC 3550的间隔发出, 计数与实际发出的一致,
+// NTP时间和RTP时间戳对应同一时刻, 后面跟着SDES CNAME
+TEST(SenderReport, CountersAndTimestampMapping) {
+    static const uint32_t kClockRate = 90000;
+    static const int64_t kFrameUs = 40000;
+    static const uint32_t kBaseTs = 123456;
+
+    Clock::UseVirtual();
+    auto client = std::make_shared<CaptureTransport>();
+    auto conn = std::make_shared<RtpConnect>(nullptr);
+    conn->SetClockRate(channel0, kClockRate);
+    conn->SetPayloadType(channel0, 96);
+    conn->SetupRtpOverTransport(channel0, client);
+    conn->Play();
+
+    int64_t start_wall_us = Clock::WallUs();
+    for (uint32_t n = 0; n < 500; n++) {
+        uint32_t ts = kBaseTs + n * (uint32_t)(kFrameUs * kClockRate / 1000000);
+        // 包在帧时刻之后陆续发出, SR推算RTP时间戳时要用真实经过的时间
+        for (uint32_t i = 0; i < 3; i++) {
+            conn->SendRtpPacket(channel0,
+                                MakePacket(ts, 500 + 100 * i + n % 7,
+                                           n % 25 == 0, i == 2));
+            Clock::Advance(1000);
+        }
+        Clock::Advance(kFrameUs - 3000);
+    }
+    Clock::UseReal();
+
+    CHECK_EQ(client->rtp.size(), 1500u);
+    // 第一个SR在2.5秒左右, 之后至少5秒一个(带随机化)
+    CHECK_GE(client->rtcp.size(), 3u);
+    CHECK_LE(client->rtcp.size(), 8u);
+
+    int64_t last_us = 0;
+    for (auto const &rtcp: client->rtcp) {
+        SenderReport sr;
+        CHECK(ParseReport(rtcp.data, &sr));
+        CHECK_EQ(sr.ssrc, client->rtp[0].ssrc);
+        CHECK_EQ(sr.sdes_ssrc, sr.ssrc);
+        CHECK(sr.cname == GetRtcpCname());
+        // SR在发完一个包后生成, 计数包括这个包
+        CHECK_EQ((uint64_t)sr.packet_count, (uint64_t)rtcp.rtp_packets);
+        CHECK_EQ((uint64_t)sr.octet_count, rtcp.rtp_payload);
+
+        int64_t wall_us = NtpToUnixUs(sr.ntp_time);
+        CHECK_GT(wall_us, last_us);
+        last_us = wall_us;
+        // 帧n在start + n * 40ms被采样, 时间戳为base + n * 3600
+        int64_t expected_ts =
+            kBaseTs + (wall_us - start_wall_us) * kClockRate / 1000000;
+        int64_t diff = (int64_t)sr.rtp_ts - expected_ts;
+        CHECK_LE(diff, 1);
+        CHECK_GE(diff, -1);
+    }
+}
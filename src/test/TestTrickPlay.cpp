@@ -0,0 +1,133 @@
+#include "Test.hpp"
+#include "net/H264File.hpp"
+#include "net/H264Source.hpp"
+#include "net/Loopback.hpp"
+#include "net/RtpConnection.hpp"
+#include "net/TrickPlay.hpp"
+#include <boost/asio/io_context.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct TrickRun {
+    size_t packets = 0;
+    size_t frames = 0;
+    double seconds = 0;
+    bool finished = false;
+};
+
+std::shared_ptr<H264File> OpenTestFile() {
+    auto file = std::make_shared<H264File>();
+    CHECK(file->Open((std::string(TEST_DATA_DIR) + "/test.h264").c_str()));
+    CHECK_GT(file->GetKeyFrameCount(), 2u);
+    return file;
+}
+
+/* 合成一个GOP为kGopFrames帧的文件, 关键帧和P帧一样大,
+ * 这样关键帧流的包速率应该正好是正常速率的1/GOP长度 */
+static const size_t kGopFrames = 10;
+static const size_t kGopCount = 40;
+static const size_t kFrameSize = 4000;
+
+std::shared_ptr<H264File> MakeGopFile(std::string const &path) {
+    std::vector<uint8_t> data;
+    for (size_t gop = 0; gop < kGopCount; gop++) {
+        for (size_t n = 0; n < kGopFrames; n++) {
+            AVFrame frame = MakeH264Frame(n == 0, kFrameSize);
+            data.insert(data.end(), frame.buffer.get(),
+                        frame.buffer.get() + frame.size);
+        }
+    }
+    FILE *fp = fopen(path.c_str(), "wb");
+    CHECK(fp != nullptr);
+    CHECK_EQ(fwrite(data.data(), 1, data.size(), fp), data.size());
+    fclose(fp);
+
+    auto file = std::make_shared<H264File>();
+    CHECK(file->Open(path.c_str()));
+    CHECK_EQ(file->GetFrameCount(), kGopCount * kGopFrames);
+    CHECK_EQ(file->GetKeyFrameCount(), kGopCount);
+    return file;
+}
+
+TrickRun RunTrickPlay(std::shared_ptr<H264File> file, double scale,
+                      size_t start_frame) {
+    auto transport = std::make_shared<CaptureTransport>();
+    auto conn = std::make_shared<RtpConnect>(nullptr);
+    conn->SetClockRate(channel0, 90000);
+    conn->SetPayloadType(channel0, 96);
+    conn->SetupRtpOverTransport(channel0, transport);
+    conn->Play();
+    conn->SetTrickPlay(true);
+
+    boost::asio::io_context ioc;
+    auto player = std::make_shared<TrickPlayer>(ioc.get_executor(), file, conn,
+                                                channel0, 25);
+    auto start = std::chrono::steady_clock::now();
+    player->Start(scale, start_frame);
+    // 到达文件另一头后没有定时器了, run自己返回; 绕回去的话会一直跑
+    ioc.run_for(std::chrono::seconds(20));
+
+    TrickRun run;
+    run.packets = transport->rtp.size();
+    run.frames = transport->CountFrames();
+    run.seconds = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+    run.finished = ioc.stopped();
+    return run;
+}
+
+} // namespace
+
+// 8倍速时每次跳8个GOP, 每个GOP时长只发一个关键帧
+TEST(TrickPlay, PacketRateBoundedAt8x) {
+    std::string path = "/tmp/rtsp_test_trick_" + std::to_string(getpid()) +
+                       ".h264";
+    auto file = MakeGopFile(path);
+    unlink(path.c_str());
+
+    // 正常播放的包速率
+    std::vector<char> buf(kFrameSize);
+    size_t normal_packets = 0;
+    for (size_t n = 0; n < file->GetFrameCount(); n++) {
+        int size = file->ReadFrameAt(n, buf.data(), (int)buf.size());
+        CHECK_EQ(size, (int)kFrameSize);
+        AVFrame frame(size);
+        memcpy(frame.buffer.get(), buf.data(), size);
+        frame.timestamp = 1;
+        H264Source::PacketizeFrame(channel0, frame,
+                                   [&](MediaChannelID, RtpPacket) -> bool {
+                                       normal_packets++;
+                                       return true;
+                                   });
+    }
+    double normal_pps = normal_packets * 25.0 / file->GetFrameCount();
+
+    TrickRun run = RunTrickPlay(file, 8, 0);
+    CHECK(run.finished);
+    // 0, 8, 16, 24, 32, 最后停在39
+    CHECK_EQ(run.frames, (kGopCount - 1 + 7) / 8 + 1);
+
+    // 最后一帧发出后就停了, 它不占发送间隔
+    double trick_pps =
+        (run.packets - run.packets / run.frames) / run.seconds;
+    double bound = normal_pps / kGopFrames;
+    CHECK_GT(trick_pps, 0.0);
+    CHECK_LE(trick_pps, bound * 1.25);
+}
+
+// 快退到第一个IDR后停下, 不绕到文件末尾
+TEST(TrickPlay, RewindStopsAtFirstKeyFrame) {
+    auto file = OpenTestFile();
+    size_t key_count = file->GetKeyFrameCount();
+    TrickRun run = RunTrickPlay(file, -8, file->GetFrameCount() - 1);
+    CHECK(run.finished);
+    CHECK_EQ(run.frames, (key_count - 1 + 7) / 8 + 1);
+}
@@ -0,0 +1,33 @@
+#include "Test.hpp"
+#include <cstdio>
+#include <cstring>
+
+std::vector<TestCase> &GetTests() {
+    static std::vector<TestCase> tests;
+    return tests;
+}
+
+// unit_tests [suite]: 不带参数时运行所有用例
+int main(int argc, char **argv) {
+    char const *suite = argc > 1 ? argv[1] : nullptr;
+    int run = 0;
+    int failed = 0;
+    for (TestCase const &test: GetTests()) {
+        if (suite != nullptr && strcmp(suite, test.suite) != 0) {
+            continue;
+        }
+        printf("[ RUN  ] %s.%s\n", test.suite, test.name);
+        fflush(stdout);
+        run++;
+        try {
+            test.func();
+            printf("[  OK  ] %s.%s\n", test.suite, test.name);
+        } catch (TestFailure const &failure) {
+            printf("%s\n[FAILED] %s.%s\n", failure.message.c_str(), test.suite,
+                   test.name);
+            failed++;
+        }
+    }
+    printf("%d tests, %d failed\n", run, failed);
+    return run > 0 && failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,389 @@
+#include "net/Clock.hpp"
+#include "net/FrameTrace.hpp"
+#include "net/H264File.hpp"
+#include "net/H264Source.hpp"
+#include "net/Loopback.hpp"
+#include "net/MediaSession.hpp"
+#include "net/MemoryTransport.hpp"
+#include "net/RtpConnection.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+/* 确定性的扇出仿真: 服务器的发送路径(打包、GOP缓存、NACK重传、拥塞控制、SR)
+ * 原样运行, 客户端和网络换成内存中的MemoryNetwork, 时间换成虚拟时钟.
+ * 每1ms推进一次时钟, 依次处理到时的加入、推一帧、交付到达的包、回RR.
+ * 上万个客户端的丢包、慢速链路(瓶颈带宽)、TCP(不丢包只排队)和集中加入
+ * 在几秒内跑完, 同样的参数和种子得到同样的结果(最后的digest相同).
+ * RTSP信令不在仿真范围内, 客户端直接加入会话, 与PLAY之后的状态相同 */
+
+enum class JoinMode {
+    STORM, // 所有客户端在同一时刻加入
+    RAMP,  // 在一段时间内均匀加入
+};
+
+struct SimOptions {
+    std::string path;
+    size_t clients = 1000;
+    double seconds = 10;
+    JoinMode join = JoinMode::STORM;
+    double join_at_s = 1;
+    double ramp_s = 5;
+    double loss = 0;          // 百分比
+    double slow = 0;          // 慢速客户端的比例
+    uint32_t slow_kbps = 500;
+    double tcp = 0;           // TCP客户端的比例
+    double latency_ms = 20;
+    uint32_t fps = 25;
+    uint64_t seed = 1;
+    bool nack = false;
+    bool pli = false;
+};
+
+enum ClientGroup {
+    GROUP_NORMAL = 0,
+    GROUP_SLOW,
+    GROUP_TCP,
+    GROUP_COUNT,
+};
+
+static char const *const kGroupNames[GROUP_COUNT] = {"normal", "slow", "tcp"};
+
+// 序号跟踪、NACK和RR都在LoopbackReceiver里, 这里只加分组和连接
+class SimClient : public LoopbackReceiver {
+public:
+    ClientGroup group = GROUP_NORMAL;
+    int64_t join_us = 0;
+    std::shared_ptr<RtpConnect> conn;
+};
+
+struct SimStream {
+    std::vector<AVFrame> frames;
+    std::vector<int64_t> offsets_us; // 相对第一帧
+    int64_t loop_us = 0;
+};
+
+static bool IsFrameTrace(std::string const &path) {
+    char magic[4] = {0};
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    bool ok = fread(magic, 1, 4, file) == 4 &&
+              memcmp(magic, FRAME_TRACE_MAGIC, 4) == 0;
+    fclose(file);
+    return ok;
+}
+
+// 帧轨迹(--record录下的)按记录的间隔, H264文件按fps
+static bool LoadStream(SimOptions const &options, SimStream *stream) {
+    if (IsFrameTrace(options.path)) {
+        FrameTraceReader reader;
+        if (!reader.Open(options.path.c_str())) {
+            return false;
+        }
+        size_t count = reader.GetFrameCount();
+        if (count == 0) {
+            return false;
+        }
+        uint64_t first_us = reader.GetRecord(0).time_us;
+        for (size_t i = 0; i < count; i++) {
+            AVFrame frame = reader.GetFrame(i);
+            // 拷出来, 时间戳由H264Source按虚拟时钟生成
+            AVFrame copy(frame.size);
+            memcpy(copy.buffer.get(), frame.buffer.get(), frame.size);
+            copy.type = frame.type;
+            copy.timestamp = 0;
+            stream->frames.push_back(copy);
+            stream->offsets_us.push_back(
+                (int64_t)(reader.GetRecord(i).time_us - first_us));
+        }
+        stream->loop_us = (int64_t)reader.GetLoopDurationUs();
+        return true;
+    }
+
+    H264File h264_file;
+    if (!h264_file.Open(options.path.c_str())) {
+        return false;
+    }
+    std::vector<char> buf(2'000'000);
+    int64_t interval_us = 1000000 / options.fps;
+    for (size_t n = 0; n < h264_file.GetFrameCount(); n++) {
+        int size = h264_file.ReadFrameAt(n, buf.data(), buf.size());
+        if (size <= 0) {
+            continue;
+        }
+        AVFrame frame(size);
+        memcpy(frame.buffer.get(), buf.data(), size);
+        frame.type = h264_file.IsKeyFrame(n) ? FrameType::VIDEO_FRAME_I
+                                             : FrameType::VIDEO_FRAME_P;
+        frame.timestamp = 0;
+        stream->offsets_us.push_back((int64_t)stream->frames.size() *
+                                     interval_us);
+        stream->frames.push_back(frame);
+    }
+    stream->loop_us = (int64_t)stream->frames.size() * interval_us;
+    return !stream->frames.empty();
+}
+
+static bool ParseOptions(int argc, char **argv, SimOptions *options) {
+    if (argc < 2) {
+        return false;
+    }
+    options->path = argv[1];
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string key = arg.substr(0, eq);
+        std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+        if (key == "--clients") {
+            options->clients = (size_t)atoll(value.c_str());
+        } else if (key == "--seconds") {
+            options->seconds = atof(value.c_str());
+        } else if (key == "--join") {
+            if (value == "storm") {
+                options->join = JoinMode::STORM;
+            } else if (value == "ramp") {
+                options->join = JoinMode::RAMP;
+            } else {
+                return false;
+            }
+        } else if (key == "--join-at") {
+            options->join_at_s = atof(value.c_str());
+        } else if (key == "--ramp") {
+            options->ramp_s = atof(value.c_str());
+        } else if (key == "--loss") {
+            options->loss = atof(value.c_str());
+        } else if (key == "--slow") {
+            options->slow = atof(value.c_str());
+        } else if (key == "--slow-kbps") {
+            options->slow_kbps = (uint32_t)atoi(value.c_str());
+        } else if (key == "--tcp") {
+            options->tcp = atof(value.c_str());
+        } else if (key == "--latency") {
+            options->latency_ms = atof(value.c_str());
+        } else if (key == "--fps") {
+            options->fps = (uint32_t)atoi(value.c_str());
+        } else if (key == "--seed") {
+            options->seed = (uint64_t)atoll(value.c_str());
+        } else if (key == "--nack") {
+            options->nack = true;
+        } else if (key == "--pli") {
+            options->pli = true;
+        } else {
+            return false;
+        }
+    }
+    return options->clients > 0 && options->seconds > 0 && options->fps > 0;
+}
+
+static double Percentile(std::vector<double> values, double pct) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(pct / 100 * (values.size() - 1) + 0.5);
+    return values[std::min(index, values.size() - 1)];
+}
+
+// FNV-1a, 只用来比较两次运行的结果是否一致
+static void Digest(uint64_t *hash, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        *hash ^= (value >> (i * 8)) & 0xff;
+        *hash *= 0x100000001b3ull;
+    }
+}
+
+int main(int argc, char **argv) {
+    SimOptions options;
+    if (!ParseOptions(argc, argv, &options)) {
+        fprintf(stderr,
+                "usage: %s <file.h264|file.frames> [--clients=N] "
+                "[--seconds=s] [--join=storm|ramp]\n"
+                "       [--join-at=s] [--ramp=s] [--loss=pct] "
+                "[--slow=fraction] [--slow-kbps=kbps]\n"
+                "       [--tcp=fraction] [--latency=ms] [--fps=N] "
+                "[--seed=N] [--nack] [--pli]\n"
+                "example: %s test.h264 --clients=10000 --loss=1 "
+                "--slow=0.1 --nack\n",
+                argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+    SimStream stream;
+    if (!LoadStream(options, &stream)) {
+        fprintf(stderr, "cannot load %s\n", options.path.c_str());
+        return EXIT_FAILURE;
+    }
+
+    Clock::UseVirtual();
+    int64_t wall_start_us = Clock::RealNowUs();
+    int64_t start_us = Clock::NowUs();
+    int64_t end_us = start_us + (int64_t)(options.seconds * 1e6);
+
+    auto session = MediaSession::GetInstance("sim");
+    session->AddSource(channel0, new H264Source(options.fps));
+    session->EnableRetransmission(1000);
+    session->EnableCongestionControl();
+
+    // 分组和链路参数由种子决定, 与网络的丢包用不同的随机数
+    MemoryNetwork network(options.seed);
+    std::mt19937_64 rng(options.seed * 0x9e3779b97f4a7c15ull + 1);
+    auto uniform = [&rng]() { return (double)(rng() >> 11) * 0x1.0p-53; };
+    std::vector<std::unique_ptr<SimClient>> clients;
+    for (size_t i = 0; i < options.clients; i++) {
+        std::unique_ptr<SimClient> client(new SimClient());
+        double u = uniform();
+        MemoryLinkConfig config;
+        if (u < options.tcp) {
+            client->group = GROUP_TCP;
+            config.reliable = true;
+        } else if (u < options.tcp + options.slow) {
+            client->group = GROUP_SLOW;
+            config.bandwidth_kbps = options.slow_kbps;
+        }
+        // 时延在[0.5, 1.5)倍之间分散开, 免得所有客户端的包同时到达
+        config.latency_us =
+            (int64_t)(options.latency_ms * 1000 * (0.5 + uniform()));
+        config.loss = client->group == GROUP_TCP ? 0 : options.loss / 100;
+        client->nack = options.nack;
+        if (options.join == JoinMode::STORM) {
+            client->join_us = start_us + (int64_t)(options.join_at_s * 1e6);
+        } else {
+            client->join_us =
+                start_us + (int64_t)(options.join_at_s * 1e6) +
+                (int64_t)(options.ramp_s * 1e6 * i / options.clients);
+        }
+        client->link = network.CreateLink(config, client.get());
+        clients.push_back(std::move(client));
+    }
+
+    // RR每秒一次, 各客户端错开到不同的毫秒
+    std::vector<std::vector<SimClient *>> report_slots(1000);
+    size_t next_join = 0;
+    size_t next_frame = 0;
+    int64_t loop_start_us = start_us;
+    uint64_t delivered = 0;
+    uint64_t frames_pushed = 0;
+    for (int64_t now_us = start_us; now_us <= end_us; now_us += 1000) {
+        Clock::AdvanceTo(now_us);
+
+        while (next_join < clients.size() &&
+               clients[next_join]->join_us <= now_us) {
+            SimClient *client = clients[next_join].get();
+            auto conn = std::make_shared<RtpConnect>(nullptr);
+            conn->SetClockRate(channel0, 90000);
+            conn->SetPayloadType(channel0, 96);
+            conn->SetupRtpOverTransport(channel0, client->link);
+            conn->SetRtpHistory(channel0, session->GetRtpHistory(channel0),
+                                false);
+            // 与RTSP SETUP一致, TCP客户端不做拥塞控制
+            conn->SetCongestionControl(channel0, client->group != GROUP_TCP);
+            client->link->Attach(conn);
+            session->AddClient(conn);
+            conn->Play();
+            if (options.pli) {
+                // 客户端一加入就要关键帧, 服务器没有编码器时补发缓存的关键帧.
+                // 还没收到包的客户端不知道SSRC, 发不出PLI, 直接走PLI的处理结果
+                conn->RequestKeyFrameReplay(channel0);
+            }
+            client->conn = conn;
+            report_slots[next_join * 7919 % 1000].push_back(client);
+            next_join++;
+        }
+
+        while (loop_start_us + stream.offsets_us[next_frame] <= now_us) {
+            session->HandleFrame(channel0, stream.frames[next_frame]);
+            frames_pushed++;
+            if (++next_frame == stream.frames.size()) {
+                next_frame = 0;
+                loop_start_us += stream.loop_us;
+            }
+        }
+
+        delivered += network.Deliver(now_us);
+
+        for (SimClient *client: report_slots[(now_us - start_us) / 1000 % 1000]) {
+            client->SendReport(channel0, now_us);
+        }
+    }
+    double wall_s = (Clock::RealNowUs() - wall_start_us) / 1e6;
+
+    printf("virtual %.1fs in %.2fs wall (%.1fx), %zu clients, %llu frames, "
+           "%llu packets delivered, %zu in flight\n",
+           options.seconds, wall_s, options.seconds / wall_s,
+           clients.size(), (unsigned long long)frames_pushed,
+           (unsigned long long)delivered, network.GetInFlight());
+    printf("%-7s %7s %10s %7s %9s %8s %7s %8s %8s %8s %9s %8s %8s\n", "group",
+           "clients", "received", "loss%", "recovered", "dups", "fps",
+           "ttff_p50", "ttff_p99", "thinned", "q_drops", "maxq_ms",
+           "rtt_p50");
+    uint64_t digest = 0xcbf29ce484222325ull;
+    for (int group = 0; group < GROUP_COUNT; group++) {
+        size_t count = 0;
+        uint64_t received = 0, lost = 0, recovered = 0, duplicates = 0;
+        uint64_t frames = 0, thinned = 0, queue_drops = 0;
+        int64_t max_queue_us = 0;
+        double playing_s = 0;
+        std::vector<double> ttff_ms;
+        std::vector<double> rtt_ms;
+        for (auto &client: clients) {
+            if (client->group != group || client->conn == nullptr) {
+                continue;
+            }
+            CongestionStats cc = client->conn->GetCongestionStats(channel0);
+            QosStats qos = client->conn->GetQosStats(channel0);
+            MemoryLinkStats const &link = client->link->GetStats();
+            count++;
+            received += client->received;
+            lost += client->Lost();
+            recovered += client->recovered;
+            duplicates += client->duplicates;
+            frames += client->frames;
+            thinned += cc.dropped_frames;
+            queue_drops += link.queue_drops;
+            max_queue_us = std::max(max_queue_us, link.max_queue_us);
+            playing_s += (end_us - client->join_us) / 1e6;
+            if (client->first_frame_us != 0) {
+                ttff_ms.push_back((client->first_frame_us - client->join_us) /
+                                  1000.0);
+            }
+            if (qos.rtt_us != 0) {
+                rtt_ms.push_back(qos.rtt_us / 1000.0);
+            }
+            Digest(&digest, client->received);
+            Digest(&digest, client->Lost());
+            Digest(&digest, client->recovered);
+            Digest(&digest, client->frames);
+            Digest(&digest, (uint64_t)client->first_frame_us);
+            Digest(&digest, cc.dropped_frames);
+            Digest(&digest, client->Bytes());
+        }
+        if (count == 0) {
+            continue;
+        }
+        printf("%-7s %7zu %10llu %7.2f %9llu %8llu %7.1f %8.1f %8.1f %8llu "
+               "%9llu %8.1f %8.1f\n",
+               kGroupNames[group], count, (unsigned long long)received,
+               received + lost ? lost * 100.0 / (received + lost) : 0.0,
+               (unsigned long long)recovered, (unsigned long long)duplicates,
+               playing_s > 0 ? frames / playing_s : 0.0,
+               Percentile(ttff_ms, 50), Percentile(ttff_ms, 99),
+               (unsigned long long)thinned, (unsigned long long)queue_drops,
+               max_queue_us / 1000.0, Percentile(rtt_ms, 50));
+    }
+    printf("digest %016llx\n", (unsigned long long)digest);
+
+    for (auto &client: clients) {
+        if (client->conn != nullptr) {
+            session->RemoveClient(client->conn);
+            client->link->Close();
+        }
+    }
+    return EXIT_SUCCESS;
+}
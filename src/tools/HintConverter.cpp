@@ -0,0 +1,32 @@
+#include "net/HintFile.hpp"
+#include <cstdio>
+#include <cstdlib>
+
+// 离线把裸H264文件转换成预打包的hint文件, 供Server直接映射发送
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <input.h264> <output.hint> [framerate]\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int framerate = argc > 3 ? atoi(argv[3]) : 25;
+    if (framerate <= 0) {
+        fprintf(stderr, "invalid framerate: %s\n", argv[3]);
+        return EXIT_FAILURE;
+    }
+
+    if (!HintFile::Convert(argv[1], argv[2], (uint32_t)framerate)) {
+        fprintf(stderr, "convert %s failed\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    HintFile hint_file;
+    if (!hint_file.Open(argv[2])) {
+        fprintf(stderr, "verify %s failed\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+    printf("%s: %zu frames, %zu packets\n", argv[2], hint_file.GetFrameCount(),
+           hint_file.GetPacketCount());
+    return 0;
+}
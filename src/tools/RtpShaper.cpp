@@ -0,0 +1,648 @@
+#include "net/Rtcp.hpp"
+#include <boost/asio/connect.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/streambuf.hpp>
+#include <boost/asio/write.hpp>
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <istream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* 本机上的瓶颈链路模拟(netem的替代), 用来观察服务器的拥塞控制.
+ * 作为RTSP客户端通过UDP拉流, 服务器到客户端方向的RTP和SR经过一条限速链路:
+ * 按码率排队, 队列超过queue_ms就尾部丢弃, 再加上固定延时和随机丢包.
+ * 收到的包按RFC 3550统计, 每秒经反向链路(只有固定延时)回一个RR,
+ * 同时打印这一秒的接收码率/帧率/丢包率.
+ * SDP里有传输序号扩展时, 每100ms再回一个transport-cc反馈 */
+
+using boost::asio::ip::tcp;
+using boost::asio::ip::udp;
+
+static int64_t NowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+struct RateStep {
+    double at_s;
+    uint32_t kbps;
+};
+
+struct DelayedPacket {
+    int64_t deliver_us;
+    bool is_rtcp;
+    std::vector<uint8_t> data;
+};
+
+class RtspClient {
+public:
+    RtspClient(boost::asio::io_context &ioc) : socket_(ioc) {}
+
+    bool Connect(std::string const &url) {
+        // rtsp://host:port/suffix
+        std::string rest = url.substr(url.find("://") + 3);
+        std::string host_port = rest.substr(0, rest.find('/'));
+        std::string host = host_port;
+        std::string port = "554";
+        size_t colon = host_port.find(':');
+        if (colon != std::string::npos) {
+            host = host_port.substr(0, colon);
+            port = host_port.substr(colon + 1);
+        }
+        boost::system::error_code ec;
+        tcp::resolver resolver(socket_.get_executor());
+        boost::asio::connect(socket_, resolver.resolve(host, port, ec), ec);
+        if (ec) {
+            fprintf(stderr, "connect %s failed: %s\n", url.c_str(),
+                    ec.message().c_str());
+            return false;
+        }
+        return true;
+    }
+
+    std::string Request(std::string const &method, std::string const &url,
+                        std::string const &headers = "") {
+        std::string req = method + " " + url + " RTSP/1.0\r\nCSeq: " +
+                          std::to_string(++cseq_) + "\r\n";
+        if (!session_.empty()) {
+            req += "Session: " + session_ + "\r\n";
+        }
+        req += headers + "\r\n";
+        boost::system::error_code ec;
+        boost::asio::write(socket_, boost::asio::buffer(req), ec);
+        if (ec) {
+            return "";
+        }
+        size_t n = boost::asio::read_until(socket_, buf_, "\r\n\r\n", ec);
+        if (ec) {
+            return "";
+        }
+        std::string res(boost::asio::buffers_begin(buf_.data()),
+                        boost::asio::buffers_begin(buf_.data()) + n);
+        buf_.consume(n);
+        size_t body_size = (size_t)atoi(Header(res, "Content-Length").c_str());
+        if (body_size > 0) {
+            if (buf_.size() < body_size) {
+                boost::asio::read(socket_, buf_,
+                                  boost::asio::transfer_exactly(
+                                      body_size - buf_.size()),
+                                  ec);
+            }
+            res.append(boost::asio::buffers_begin(buf_.data()),
+                       boost::asio::buffers_begin(buf_.data()) + body_size);
+            buf_.consume(body_size);
+        }
+        std::string session = Header(res, "Session");
+        if (!session.empty()) {
+            session_ = session.substr(0, session.find(';'));
+        }
+        return res;
+    }
+
+    static std::string Header(std::string const &res, std::string const &name) {
+        size_t pos = res.find(name + ":");
+        if (pos == std::string::npos) {
+            return "";
+        }
+        pos += name.size() + 1;
+        while (pos < res.size() && res[pos] == ' ') {
+            pos++;
+        }
+        return res.substr(pos, res.find("\r\n", pos) - pos);
+    }
+
+private:
+    tcp::socket socket_;
+    boost::asio::streambuf buf_;
+    std::string session_;
+    int cseq_ = 0;
+};
+
+class Shaper {
+public:
+    Shaper(boost::asio::io_context &ioc, std::vector<RateStep> rates,
+           uint32_t delay_ms, double loss, uint32_t queue_ms)
+        : rtp_socket_(ioc),
+          rtcp_socket_(ioc),
+          timer_(ioc),
+          rates_(std::move(rates)),
+          delay_us_((int64_t)delay_ms * 1000),
+          queue_us_((int64_t)queue_ms * 1000),
+          loss_(loss),
+          rng_(7) {}
+
+    // 绑定一对相邻的端口, 返回RTP端口
+    uint16_t Bind() {
+        for (uint16_t port = 40000; port < 60000; port += 2) {
+            boost::system::error_code ec;
+            rtp_socket_.open(udp::v4());
+            rtp_socket_.bind(udp::endpoint(udp::v4(), port), ec);
+            if (!ec) {
+                rtcp_socket_.open(udp::v4());
+                rtcp_socket_.bind(udp::endpoint(udp::v4(), port + 1), ec);
+                if (!ec) {
+                    return port;
+                }
+                rtcp_socket_.close();
+            }
+            rtp_socket_.close();
+        }
+        return 0;
+    }
+
+    // 传输序号扩展的ID, 0表示不发transport-cc反馈
+    void SetTransportSeqId(uint8_t id) {
+        transport_seq_id_ = id;
+    }
+
+    void Start(udp::endpoint server_rtcp, double duration_s) {
+        server_rtcp_ = server_rtcp;
+        start_us_ = NowUs();
+        end_us_ = start_us_ + (int64_t)(duration_s * 1000000);
+        next_report_us_ = start_us_ + 1000000;
+        next_feedback_us_ = start_us_ + 100000;
+        printf("%5s %8s %9s %5s %7s %7s %9s %8s\n", "time", "link", "recv",
+               "fps", "loss%", "drops", "jitter", "queue");
+        ReadRtp();
+        ReadRtcp();
+        Tick();
+    }
+
+private:
+    void ReadRtp() {
+        rtp_socket_.async_receive(
+            boost::asio::buffer(rtp_buf_),
+            [this](boost::system::error_code const &ec, size_t bytes) {
+                if (ec) {
+                    return;
+                }
+                Enqueue(rtp_buf_, bytes, false);
+                ReadRtp();
+            });
+    }
+
+    void ReadRtcp() {
+        rtcp_socket_.async_receive(
+            boost::asio::buffer(rtcp_buf_),
+            [this](boost::system::error_code const &ec, size_t bytes) {
+                if (ec) {
+                    return;
+                }
+                Enqueue(rtcp_buf_, bytes, true);
+                ReadRtcp();
+            });
+    }
+
+    uint32_t CurrentRate(int64_t now_us) const {
+        double t = (now_us - start_us_) / 1e6;
+        uint32_t kbps = rates_.front().kbps;
+        for (auto const &step: rates_) {
+            if (t >= step.at_s) {
+                kbps = step.kbps;
+            }
+        }
+        return kbps;
+    }
+
+    // 服务器发来的包进入瓶颈链路
+    void Enqueue(uint8_t const *data, size_t size, bool is_rtcp) {
+        int64_t now_us = NowUs();
+        if (std::uniform_real_distribution<double>(0, 1)(rng_) < loss_) {
+            link_drops_++;
+            return;
+        }
+        int64_t link_free_us = std::max(link_free_us_, now_us);
+        if (link_free_us - now_us > queue_us_) {
+            link_drops_++;
+            return;
+        }
+        uint32_t kbps = CurrentRate(now_us);
+        // 加上IP/UDP头, 按链路码率算发送完的时刻
+        link_free_us_ = link_free_us + (int64_t)(size + 28) * 8000 / kbps;
+        queue_delay_us_ = std::max(queue_delay_us_, link_free_us_ - now_us);
+        DelayedPacket pkt;
+        pkt.deliver_us = link_free_us_ + delay_us_;
+        pkt.is_rtcp = is_rtcp;
+        pkt.data.assign(data, data + size);
+        forward_.push_back(std::move(pkt));
+    }
+
+    void Tick() {
+        int64_t now_us = NowUs();
+        while (!forward_.empty() && forward_.front().deliver_us <= now_us) {
+            DelayedPacket &pkt = forward_.front();
+            if (pkt.is_rtcp) {
+                OnRtcp(pkt.data.data(), pkt.data.size(), now_us);
+            } else {
+                OnRtp(pkt.data.data(), pkt.data.size(), now_us);
+            }
+            forward_.pop_front();
+        }
+        while (!backward_.empty() && backward_.front().deliver_us <= now_us) {
+            boost::system::error_code ec;
+            rtcp_socket_.send_to(boost::asio::buffer(backward_.front().data),
+                                 server_rtcp_, 0, ec);
+            backward_.pop_front();
+        }
+        if (now_us >= next_report_us_) {
+            Report(now_us);
+            next_report_us_ += 1000000;
+        }
+        if (now_us >= next_feedback_us_) {
+            SendTransportFeedback(now_us);
+            next_feedback_us_ += 100000;
+        }
+        if (now_us >= end_us_) {
+            rtp_socket_.close();
+            rtcp_socket_.close();
+            return;
+        }
+        timer_.expires_after(std::chrono::milliseconds(1));
+        timer_.async_wait([this](boost::system::error_code const &ec) {
+            if (!ec) {
+                Tick();
+            }
+        });
+    }
+
+    void OnRtp(uint8_t const *data, size_t size, int64_t now_us) {
+        if (size < 12 || (data[0] >> 6) != 2) {
+            return;
+        }
+        uint8_t pt = data[1] & 0x7f;
+        if (pt >= 110) {
+            // RTX/FEC不统计
+            return;
+        }
+        uint16_t seq = (uint16_t)(data[2] << 8 | data[3]);
+        uint32_t ts = (uint32_t)(data[4] << 24 | data[5] << 16 |
+                                 data[6] << 8 | data[7]);
+        uint32_t ssrc = (uint32_t)(data[8] << 24 | data[9] << 16 |
+                                   data[10] << 8 | data[11]);
+        if (received_ == 0) {
+            ssrc_ = ssrc;
+            base_seq_ = seq;
+            max_seq_ = seq;
+        } else {
+            uint16_t delta = (uint16_t)(seq - max_seq_);
+            if (delta < 0x8000) {
+                if (seq < max_seq_) {
+                    cycles_ += 0x10000;
+                }
+                max_seq_ = seq;
+            }
+        }
+        received_++;
+        second_bytes_ += size;
+        if (transport_seq_id_ != 0 && (data[0] & 0x10)) {
+            RecordTransportSeq(data, size, now_us);
+        }
+        if (data[1] & 0x80) {
+            second_frames_++;
+        }
+
+        // RFC 3550 A.8的到达间隔抖动, 单位是RTP时钟
+        int64_t arrival = now_us * 90 / 1000;
+        int64_t transit = arrival - ts;
+        if (has_transit_) {
+            int64_t d = std::abs(transit - last_transit_);
+            jitter_ += (d - jitter_) / 16.0;
+        }
+        last_transit_ = transit;
+        has_transit_ = true;
+    }
+
+    void OnRtcp(uint8_t const *data, size_t size, int64_t now_us) {
+        RtcpPacketView pkt;
+        while (size > 0) {
+            size_t len = NextRtcpPacket(data, size, &pkt);
+            if (len == 0) {
+                return;
+            }
+            if (pkt.type == RTCP_SR && pkt.body_size >= 12) {
+                // LSR取NTP时间戳中间32位
+                last_sr_ = (uint32_t)(pkt.body[6] << 24 | pkt.body[7] << 16 |
+                                      pkt.body[8] << 8 | pkt.body[9]);
+                last_sr_us_ = now_us;
+            }
+            data += len;
+            size -= len;
+        }
+    }
+
+    void Report(int64_t now_us) {
+        // RFC 3550 A.3: 这个间隔内的丢包率和累计丢包数
+        uint32_t extended_max = cycles_ + max_seq_;
+        uint32_t expected = received_ ? extended_max - base_seq_ + 1 : 0;
+        int32_t lost = (int32_t)(expected - received_);
+        uint32_t expected_interval = expected - expected_prior_;
+        uint32_t received_interval = (uint32_t)(received_ - received_prior_);
+        expected_prior_ = expected;
+        received_prior_ = received_;
+        int32_t lost_interval =
+            (int32_t)expected_interval - (int32_t)received_interval;
+        uint8_t fraction = 0;
+        if (expected_interval != 0 && lost_interval > 0) {
+            fraction = (uint8_t)std::min<uint32_t>(
+                ((uint32_t)lost_interval << 8) / expected_interval, 255);
+        }
+
+        printf("%4.0fs %6ukbps %6.0fkbps %5u %6.1f%% %7llu %7.1fms %6.0fms\n",
+               (now_us - start_us_) / 1e6, CurrentRate(now_us),
+               second_bytes_ * 8 / 1000.0, second_frames_,
+               fraction * 100.0 / 256, (unsigned long long)link_drops_,
+               jitter_ / 90.0, queue_delay_us_ / 1000.0);
+        fflush(stdout);
+        second_bytes_ = 0;
+        second_frames_ = 0;
+        queue_delay_us_ = 0;
+
+        if (received_ == 0) {
+            return;
+        }
+        uint8_t rr[8 + RTCP_REPORT_BLOCK_SIZE];
+        rr[0] = 0x81;
+        rr[1] = RTCP_RR;
+        rr[2] = 0;
+        rr[3] = (uint8_t)(sizeof(rr) / 4 - 1);
+        uint32_t block[6];
+        block[0] = htonl(ssrc_);
+        block[1] = htonl((uint32_t)fraction << 24 |
+                         ((uint32_t)std::max(lost, 0) & 0xffffff));
+        block[2] = htonl(extended_max);
+        block[3] = htonl((uint32_t)jitter_);
+        block[4] = htonl(last_sr_);
+        block[5] = htonl(last_sr_ ? (uint32_t)(((now_us - last_sr_us_) << 16) /
+                                               1000000)
+                                  : 0);
+        uint32_t my_ssrc = htonl(0x5a5a0001);
+        memcpy(rr + 4, &my_ssrc, 4);
+        memcpy(rr + 8, block, sizeof(block));
+
+        DelayedPacket pkt;
+        pkt.deliver_us = now_us + delay_us_;
+        pkt.is_rtcp = true;
+        pkt.data.assign(rr, rr + sizeof(rr));
+        backward_.push_back(std::move(pkt));
+    }
+
+    // 在RFC 8285一字节头部扩展中找传输序号
+    void RecordTransportSeq(uint8_t const *data, size_t size, int64_t now_us) {
+        size_t offset = 12 + (data[0] & 0x0f) * 4;
+        if (offset + 4 > size || data[offset] != 0xbe ||
+            data[offset + 1] != 0xde) {
+            return;
+        }
+        size_t end = offset + 4 + (size_t)(data[offset + 2] << 8 |
+                                           data[offset + 3]) * 4;
+        end = std::min(end, size);
+        for (size_t i = offset + 4; i < end;) {
+            if (data[i] == 0) {
+                i++;
+                continue;
+            }
+            uint8_t id = data[i] >> 4;
+            size_t len = (data[i] & 0x0f) + 1;
+            if (id == 15 || i + 1 + len > end) {
+                return;
+            }
+            if (id == transport_seq_id_ && len == 2) {
+                uint16_t seq = (uint16_t)(data[i + 1] << 8 | data[i + 2]);
+                arrivals_.emplace_back(seq, now_us);
+                return;
+            }
+            i += 1 + len;
+        }
+    }
+
+    // 2位状态向量, 每块7个包; 到达间隔单位250us
+    void SendTransportFeedback(int64_t now_us) {
+        if (arrivals_.empty()) {
+            return;
+        }
+        size_t n = std::min<size_t>(arrivals_.size(), 200);
+        // 从上一个反馈之后开始, 两次反馈之间丢的包也要报告
+        uint16_t base_seq =
+            has_feedback_ ? next_feedback_seq_ : arrivals_.front().first;
+        uint16_t count = (uint16_t)(arrivals_[n - 1].first - base_seq + 1);
+        next_feedback_seq_ = (uint16_t)(arrivals_[n - 1].first + 1);
+        has_feedback_ = true;
+        int64_t reference = arrivals_.front().second / 64000;
+
+        std::vector<uint8_t> symbols(count, 0);
+        std::vector<uint8_t> deltas;
+        int64_t prev = reference * 256;
+        for (size_t i = 0; i < n; i++) {
+            uint16_t index = (uint16_t)(arrivals_[i].first - base_seq);
+            if (index >= count || symbols[index] != 0) {
+                continue;
+            }
+            int64_t t = arrivals_[i].second / 250;
+            int64_t delta = t - prev;
+            prev = t;
+            if (delta >= 0 && delta <= 255) {
+                symbols[index] = 1;
+                deltas.push_back((uint8_t)delta);
+            } else {
+                delta = std::max<int64_t>(std::min<int64_t>(delta, 32767),
+                                          -32768);
+                symbols[index] = 2;
+                deltas.push_back((uint8_t)((uint16_t)delta >> 8));
+                deltas.push_back((uint8_t)delta);
+            }
+        }
+        arrivals_.erase(arrivals_.begin(), arrivals_.begin() + n);
+
+        std::vector<uint8_t> fb(20, 0);
+        fb[0] = 0x80 | RTCP_FB_TRANSPORT_CC;
+        fb[1] = RTCP_RTPFB;
+        uint32_t my_ssrc = htonl(0x5a5a0001);
+        uint32_t media_ssrc = htonl(ssrc_);
+        memcpy(&fb[4], &my_ssrc, 4);
+        memcpy(&fb[8], &media_ssrc, 4);
+        fb[12] = (uint8_t)(base_seq >> 8);
+        fb[13] = (uint8_t)base_seq;
+        fb[14] = (uint8_t)(count >> 8);
+        fb[15] = (uint8_t)count;
+        fb[16] = (uint8_t)(reference >> 16);
+        fb[17] = (uint8_t)(reference >> 8);
+        fb[18] = (uint8_t)reference;
+        fb[19] = feedback_count_++;
+        for (size_t i = 0; i < count; i += 7) {
+            uint16_t chunk = 0xc000;
+            for (size_t j = 0; j < 7 && i + j < count; j++) {
+                chunk |= (uint16_t)(symbols[i + j] << (12 - 2 * j));
+            }
+            fb.push_back((uint8_t)(chunk >> 8));
+            fb.push_back((uint8_t)chunk);
+        }
+        fb.insert(fb.end(), deltas.begin(), deltas.end());
+        while (fb.size() % 4 != 0) {
+            fb.push_back(0);
+        }
+        fb[2] = (uint8_t)((fb.size() / 4 - 1) >> 8);
+        fb[3] = (uint8_t)(fb.size() / 4 - 1);
+
+        DelayedPacket pkt;
+        pkt.deliver_us = now_us + delay_us_;
+        pkt.is_rtcp = true;
+        pkt.data = std::move(fb);
+        backward_.push_back(std::move(pkt));
+    }
+
+    udp::socket rtp_socket_;
+    udp::socket rtcp_socket_;
+    boost::asio::steady_timer timer_;
+    udp::endpoint server_rtcp_;
+    uint8_t rtp_buf_[2048];
+    uint8_t rtcp_buf_[2048];
+
+    std::vector<RateStep> rates_;
+    int64_t delay_us_;
+    int64_t queue_us_;
+    double loss_;
+    std::mt19937 rng_;
+    std::deque<DelayedPacket> forward_;
+    std::deque<DelayedPacket> backward_;
+    int64_t link_free_us_ = 0;
+    int64_t queue_delay_us_ = 0;
+    uint64_t link_drops_ = 0;
+
+    int64_t start_us_ = 0;
+    int64_t end_us_ = 0;
+    int64_t next_report_us_ = 0;
+
+    uint32_t ssrc_ = 0;
+    uint64_t received_ = 0;
+    uint64_t received_prior_ = 0;
+    uint32_t expected_prior_ = 0;
+    uint16_t base_seq_ = 0;
+    uint16_t max_seq_ = 0;
+    uint32_t cycles_ = 0;
+    double jitter_ = 0;
+    int64_t last_transit_ = 0;
+    bool has_transit_ = false;
+    uint32_t last_sr_ = 0;
+    int64_t last_sr_us_ = 0;
+    uint64_t second_bytes_ = 0;
+    uint32_t second_frames_ = 0;
+
+    uint8_t transport_seq_id_ = 0;
+    uint8_t feedback_count_ = 0;
+    uint16_t next_feedback_seq_ = 0;
+    bool has_feedback_ = false;
+    int64_t next_feedback_us_ = 0;
+    std::vector<std::pair<uint16_t, int64_t>> arrivals_; // 传输序号, 到达时间
+};
+
+// "2000,300@10,2000@30": 开始2000kbps, 第10秒降到300kbps, 第30秒恢复
+static bool ParseRates(char const *arg, std::vector<RateStep> *rates) {
+    std::string spec(arg);
+    size_t pos = 0;
+    while (pos <= spec.size()) {
+        size_t end = spec.find(',', pos);
+        std::string item = spec.substr(pos, end - pos);
+        RateStep step{0, 0};
+        size_t at = item.find('@');
+        step.kbps = (uint32_t)atoi(item.substr(0, at).c_str());
+        if (at != std::string::npos) {
+            step.at_s = atof(item.substr(at + 1).c_str());
+        }
+        if (step.kbps == 0) {
+            return false;
+        }
+        rates->push_back(step);
+        if (end == std::string::npos) {
+            break;
+        }
+        pos = end + 1;
+    }
+    return !rates->empty();
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr,
+                "usage: %s <rtsp_url> <kbps[,kbps@sec...]> [delay_ms] "
+                "[loss_pct] [queue_ms] [seconds]\n"
+                "example: %s rtsp://127.0.0.1:8554/live 4000,400@10,4000@40 "
+                "20 0 200 60\n",
+                argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+    std::vector<RateStep> rates;
+    if (!ParseRates(argv[2], &rates)) {
+        fprintf(stderr, "invalid rate: %s\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+    uint32_t delay_ms = argc > 3 ? (uint32_t)atoi(argv[3]) : 20;
+    double loss = argc > 4 ? atof(argv[4]) / 100 : 0;
+    uint32_t queue_ms = argc > 5 ? (uint32_t)atoi(argv[5]) : 200;
+    double seconds = argc > 6 ? atof(argv[6]) : 30;
+
+    boost::asio::io_context ioc;
+    Shaper shaper(ioc, rates, delay_ms, loss, queue_ms);
+    uint16_t port = shaper.Bind();
+    if (port == 0) {
+        fprintf(stderr, "no free udp port\n");
+        return EXIT_FAILURE;
+    }
+
+    RtspClient client(ioc);
+    std::string url = argv[1];
+    if (!client.Connect(url)) {
+        return EXIT_FAILURE;
+    }
+    client.Request("OPTIONS", url);
+    std::string sdp =
+        client.Request("DESCRIBE", url, "Accept: application/sdp\r\n");
+    // a=extmap:<id> <uri>
+    size_t extmap = sdp.find("transport-wide-cc-extensions");
+    if (extmap != std::string::npos) {
+        size_t line = sdp.rfind("a=extmap:", extmap);
+        if (line != std::string::npos) {
+            shaper.SetTransportSeqId((uint8_t)atoi(sdp.c_str() + line + 9));
+            printf("transport-cc feedback enabled\n");
+        }
+    }
+    std::string res = client.Request(
+        "SETUP", url + "/track0",
+        "Transport: RTP/AVP;unicast;client_port=" + std::to_string(port) +
+            "-" + std::to_string(port + 1) + "\r\n");
+    std::string transport = RtspClient::Header(res, "Transport");
+    size_t server_port = transport.find("server_port=");
+    if (server_port == std::string::npos) {
+        fprintf(stderr, "setup failed:\n%s\n", res.c_str());
+        return EXIT_FAILURE;
+    }
+    std::string ports = transport.substr(server_port + 12);
+    uint16_t server_rtcp =
+        (uint16_t)atoi(ports.substr(ports.find('-') + 1).c_str());
+    client.Request("PLAY", url);
+
+    std::string host = url.substr(url.find("://") + 3);
+    host = host.substr(0, host.find_first_of(":/"));
+    udp::resolver resolver(ioc);
+    udp::endpoint server(*resolver.resolve(udp::v4(), host, "0").begin());
+    server.port(server_rtcp);
+    shaper.Start(server, seconds);
+    ioc.run();
+
+    client.Request("TEARDOWN", url);
+    return 0;
+}
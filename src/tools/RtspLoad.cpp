@@ -0,0 +1,1230 @@
+#include <boost/asio/connect.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/write.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <dirent.h>
+#include <memory>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/* 合成的RTSP负载, 用来在上线前测一台机器能带多少观众.
+ * 在若干个线程上开N个会话(TCP交织/UDP), 走完OPTIONS/DESCRIBE/SETUP/PLAY后
+ * 持续收流, 校验RTP(序号缺口、重复/乱序、时间戳回退、marker位、SSRC变化),
+ * 统计每个客户端的吞吐、丢包、抖动和首帧时间.
+ * 客户端数按steps逐级增加(已有的会话保留), 每级先预热再测量一段时间,
+ * 同时采样服务器进程的CPU和指标端点上服务器每秒发出的RTP包数,
+ * 每级输出一行, 得到随N变化的曲线.
+ * --soak模式维持N个会话不断新建和结束(TEARDOWN、直接断开、不再保活等服务器
+ * 回收三种方式轮流), 每秒采样服务器的fd数和RSS, 检查它们不随会话数增长 */
+
+using boost::asio::ip::tcp;
+using boost::asio::ip::udp;
+
+static int64_t NowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+enum class LoadTransport {
+    TCP = 0,
+    UDP,
+    MIX, // 奇偶交替
+};
+
+struct LoadOptions {
+    std::string url;
+    std::string host;
+    std::string port = "554";
+    std::vector<size_t> steps = {1, 10, 100, 1000};
+    LoadTransport transport = LoadTransport::UDP;
+    unsigned threads = 0;
+    double warmup_s = 3;
+    double seconds = 10;
+    double rate = 500; // 每秒新建的会话数
+    int pid = 0;       // 服务器进程, 用来采样CPU
+    std::string metrics = "127.0.0.1:9100";
+    std::string csv;
+    bool per_client = false;
+    double soak_s = 0; // 大于0时为浸泡模式, 并发数取steps的最后一级
+    double hold_s = 5; // 浸泡模式下会话平均播放的时长
+};
+
+enum class ClientState : int {
+    CONNECTING = 0,
+    HANDSHAKE,
+    PLAYING,
+    FAILED,
+    DONE, // 浸泡模式下按计划结束
+};
+
+// 浸泡模式下会话怎么结束
+enum class SessionEnd {
+    NONE = 0,
+    TEARDOWN, // 发TEARDOWN, 收到应答后断开
+    CLOSE,    // 直接断开TCP
+    ABANDON,  // 停止保活, 等服务器空闲回收后断开
+};
+
+/* 客户端的统计, 由所在的io线程写, 主线程按时读取做差 */
+struct ClientStats {
+    std::atomic<int> state{(int)ClientState::CONNECTING};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> packets{0};
+    std::atomic<uint64_t> expected{0}; // 扩展序号的范围
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> duplicates{0};
+    std::atomic<uint64_t> reordered{0};
+    std::atomic<uint64_t> ts_errors{0};     // 时间戳回退
+    std::atomic<uint64_t> marker_errors{0}; // 帧内时间戳变化但上个包没有marker
+    std::atomic<uint64_t> ssrc_changes{0};
+    std::atomic<uint32_t> jitter_us{0};  // RFC 3550的抖动
+    std::atomic<int64_t> ttff_us{-1};    // 开始连接到收完第一帧
+};
+
+static void Increment(std::atomic<uint64_t> &value, uint64_t n = 1) {
+    value.store(value.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+}
+
+/* 按RFC 3550 A.1/A.8校验和统计一路RTP */
+class RtpValidator {
+public:
+    void Init(uint8_t payload, uint32_t clock_rate) {
+        payload_ = payload;
+        clock_rate_ = clock_rate == 0 ? 90000 : clock_rate;
+    }
+
+    // 返回这个包是否结束了一帧
+    bool OnPacket(uint8_t const *data, size_t size, int64_t now_us,
+                  ClientStats &stats) {
+        if (size < 12 || (data[0] >> 6) != 2) {
+            return false;
+        }
+        if ((data[1] & 0x7f) != payload_) {
+            // RTX/FEC不统计
+            return false;
+        }
+        bool marker = (data[1] & 0x80) != 0;
+        uint16_t seq = (uint16_t)(data[2] << 8 | data[3]);
+        uint32_t ts = (uint32_t)(data[4] << 24 | data[5] << 16 |
+                                 data[6] << 8 | data[7]);
+        uint32_t ssrc = (uint32_t)(data[8] << 24 | data[9] << 16 |
+                                   data[10] << 8 | data[11]);
+        Increment(stats.packets);
+        Increment(stats.bytes, size);
+
+        if (!started_ || ssrc != ssrc_) {
+            if (started_) {
+                Increment(stats.ssrc_changes);
+            }
+            started_ = true;
+            ssrc_ = ssrc;
+            max_seq_ = (uint64_t)seq;
+            base_seq_ = max_seq_;
+            last_ts_ = ts;
+            last_marker_ = true;
+            has_transit_ = false;
+        } else {
+            // 扩展序号: 离上一个最大序号最近的那个
+            int16_t delta = (int16_t)(seq - (uint16_t)max_seq_);
+            uint64_t ext = max_seq_ + delta;
+            if (delta > 0) {
+                max_seq_ = ext;
+            } else if (delta == 0) {
+                Increment(stats.duplicates);
+                return false;
+            } else {
+                Increment(stats.reordered);
+            }
+            if (delta > 0 && ts != last_ts_) {
+                if ((int32_t)(ts - last_ts_) < 0) {
+                    Increment(stats.ts_errors);
+                }
+                // 连续的包换了时间戳, 说明上一帧结束了, 上个包应该带marker
+                if (delta == 1 && !last_marker_) {
+                    Increment(stats.marker_errors);
+                }
+            }
+            if (delta > 0) {
+                last_ts_ = ts;
+                last_marker_ = marker;
+            }
+        }
+        stats.expected.store(max_seq_ - base_seq_ + 1,
+                             std::memory_order_relaxed);
+
+        int64_t arrival = now_us * clock_rate_ / 1000000;
+        int64_t transit = arrival - ts;
+        if (has_transit_) {
+            int64_t d = std::abs(transit - last_transit_);
+            jitter_ += (d - jitter_) / 16.0;
+            stats.jitter_us.store((uint32_t)(jitter_ * 1e6 / clock_rate_),
+                                  std::memory_order_relaxed);
+        }
+        last_transit_ = transit;
+        has_transit_ = true;
+        if (marker) {
+            Increment(stats.frames);
+        }
+        return marker;
+    }
+
+private:
+    uint8_t payload_ = 96;
+    uint32_t clock_rate_ = 90000;
+    bool started_ = false;
+    uint32_t ssrc_ = 0;
+    uint64_t base_seq_ = 0;
+    uint64_t max_seq_ = 0;
+    uint32_t last_ts_ = 0;
+    bool last_marker_ = true;
+    double jitter_ = 0;
+    int64_t last_transit_ = 0;
+    bool has_transit_ = false;
+};
+
+// 所有UDP客户端共用的端口分配, 每个客户端占一对相邻端口
+static std::atomic<uint32_t> next_udp_port{30000};
+
+class LoadClient : public std::enable_shared_from_this<LoadClient> {
+public:
+    LoadClient(boost::asio::io_context &ioc, LoadOptions const &options,
+               bool use_tcp, SessionEnd end = SessionEnd::NONE,
+               double hold_s = 0)
+        : options_(options),
+          use_tcp_(use_tcp),
+          end_(end),
+          hold_s_(hold_s),
+          socket_(ioc),
+          rtp_socket_(ioc),
+          rtcp_socket_(ioc),
+          keepalive_(ioc),
+          end_timer_(ioc) {}
+
+    void Start() {
+        auto self = shared_from_this();
+        boost::asio::post(socket_.get_executor(), [self]() {
+            self->start_us_ = NowUs();
+            self->Connect();
+        });
+    }
+
+    void Stop() {
+        auto self = shared_from_this();
+        boost::asio::post(socket_.get_executor(), [self]() {
+            boost::system::error_code ec;
+            self->keepalive_.cancel();
+            self->end_timer_.cancel();
+            self->socket_.close(ec);
+            self->rtp_socket_.close(ec);
+            self->rtcp_socket_.close(ec);
+        });
+    }
+
+    bool IsTcp() const {
+        return use_tcp_;
+    }
+
+    SessionEnd GetEnd() const {
+        return end_;
+    }
+
+    ClientStats stats;
+
+private:
+    void Connect() {
+        boost::system::error_code ec;
+        tcp::resolver resolver(socket_.get_executor());
+        auto endpoints = resolver.resolve(options_.host, options_.port, ec);
+        if (ec) {
+            Fail("resolve", ec);
+            return;
+        }
+        auto self = shared_from_this();
+        boost::asio::async_connect(
+            socket_, endpoints,
+            [self](boost::system::error_code const &ec, tcp::endpoint const &) {
+                if (ec) {
+                    self->Fail("connect", ec);
+                    return;
+                }
+                boost::system::error_code ignored;
+                self->socket_.set_option(tcp::no_delay(true), ignored);
+                self->stats.state.store((int)ClientState::HANDSHAKE,
+                                        std::memory_order_relaxed);
+                self->Read();
+                self->Request("OPTIONS", self->options_.url);
+            });
+    }
+
+    void Fail(char const *what, boost::system::error_code const &ec) {
+        int state = stats.state.load(std::memory_order_relaxed);
+        if (state == (int)ClientState::FAILED ||
+            state == (int)ClientState::DONE) {
+            return;
+        }
+        if (ec != boost::asio::error::operation_aborted) {
+            // 同一原因的失败只打一次, 10k客户端时不刷屏
+            static std::atomic<int> reported{0};
+            if (reported.fetch_add(1, std::memory_order_relaxed) < 5) {
+                fprintf(stderr, "client failed at %s: %s\n", what,
+                        ec.message().c_str());
+            }
+        }
+        stats.state.store((int)ClientState::FAILED, std::memory_order_relaxed);
+        CloseAll();
+    }
+
+    void Finish() {
+        if (stats.state.load(std::memory_order_relaxed) ==
+            (int)ClientState::FAILED) {
+            return;
+        }
+        stats.state.store((int)ClientState::DONE, std::memory_order_relaxed);
+        CloseAll();
+    }
+
+    void CloseAll() {
+        boost::system::error_code ignored;
+        keepalive_.cancel();
+        end_timer_.cancel();
+        socket_.close(ignored);
+        rtp_socket_.close(ignored);
+        rtcp_socket_.close(ignored);
+    }
+
+    void Request(std::string const &method, std::string const &url,
+                 std::string const &headers = "") {
+        std::string req = method + " " + url + " RTSP/1.0\r\nCSeq: " +
+                          std::to_string(++cseq_) + "\r\n";
+        if (!session_.empty()) {
+            req += "Session: " + session_ + "\r\n";
+        }
+        req += "User-Agent: RtspLoad\r\n" + headers + "\r\n";
+        Write(std::move(req));
+    }
+
+    void Write(std::string data) {
+        out_.push_back(std::move(data));
+        if (out_.size() == 1) {
+            DoWrite();
+        }
+    }
+
+    void DoWrite() {
+        auto self = shared_from_this();
+        boost::asio::async_write(
+            socket_, boost::asio::buffer(out_.front()),
+            [self](boost::system::error_code const &ec, size_t) {
+                if (ec) {
+                    self->Fail("write", ec);
+                    return;
+                }
+                self->out_.pop_front();
+                if (!self->out_.empty()) {
+                    self->DoWrite();
+                }
+            });
+    }
+
+    void Read() {
+        if (in_.size() - in_end_ < 4096) {
+            // 先把已经处理掉的数据挪走, 还不够再扩容
+            if (in_begin_ > 0) {
+                memmove(in_.data(), in_.data() + in_begin_, in_end_ - in_begin_);
+                in_end_ -= in_begin_;
+                in_begin_ = 0;
+            }
+            if (in_.size() - in_end_ < 4096) {
+                in_.resize(std::max<size_t>(in_.size() * 2, 8192));
+            }
+        }
+        auto self = shared_from_this();
+        socket_.async_read_some(
+            boost::asio::buffer(in_.data() + in_end_, in_.size() - in_end_),
+            [self](boost::system::error_code const &ec, size_t bytes) {
+                if (ec) {
+                    if (self->ending_ && self->end_ == SessionEnd::ABANDON) {
+                        // 服务器回收了空闲连接
+                        self->Finish();
+                        return;
+                    }
+                    self->Fail("read", ec);
+                    return;
+                }
+                self->in_end_ += bytes;
+                if (!self->HandleInput()) {
+                    return;
+                }
+                self->Read();
+            });
+    }
+
+    // TCP上交织的$帧和RTSP应答
+    bool HandleInput() {
+        int64_t now_us = NowUs();
+        while (in_end_ > in_begin_) {
+            uint8_t const *data = in_.data() + in_begin_;
+            size_t size = in_end_ - in_begin_;
+            if (data[0] == '$') {
+                if (size < 4) {
+                    break;
+                }
+                size_t len = (size_t)(data[2] << 8 | data[3]);
+                if (size < 4 + len) {
+                    break;
+                }
+                if (data[1] == rtp_channel_) {
+                    OnRtp(data + 4, len, now_us);
+                }
+                in_begin_ += 4 + len;
+                continue;
+            }
+            std::string head((char const *)data, std::min<size_t>(size, 4096));
+            size_t head_end = head.find("\r\n\r\n");
+            if (head_end == std::string::npos) {
+                if (size >= 4096) {
+                    Fail("parse", boost::asio::error::message_size);
+                    return false;
+                }
+                break;
+            }
+            size_t body_size =
+                (size_t)atoi(Header(head.substr(0, head_end), "Content-Length")
+                                 .c_str());
+            size_t total = head_end + 4 + body_size;
+            if (size < total) {
+                break;
+            }
+            std::string response((char const *)data, total);
+            in_begin_ += total;
+            if (!OnResponse(response)) {
+                return false;
+            }
+        }
+        if (in_begin_ == in_end_) {
+            in_begin_ = in_end_ = 0;
+        }
+        return true;
+    }
+
+    static std::string Header(std::string const &res, std::string const &name) {
+        size_t pos = res.find(name + ":");
+        if (pos == std::string::npos) {
+            return "";
+        }
+        pos += name.size() + 1;
+        while (pos < res.size() && res[pos] == ' ') {
+            pos++;
+        }
+        return res.substr(pos, res.find("\r\n", pos) - pos);
+    }
+
+    bool OnResponse(std::string const &res) {
+        if (res.compare(0, 12, "RTSP/1.0 200") != 0) {
+            Fail("response", boost::asio::error::invalid_argument);
+            return false;
+        }
+        std::string session = Header(res, "Session");
+        if (!session.empty()) {
+            session_ = session.substr(0, session.find(';'));
+            // 按服务器给的超时保活, 超时的三分之一发一次
+            size_t timeout = session.find("timeout=");
+            if (timeout != std::string::npos) {
+                keepalive_s_ =
+                    std::max(1, atoi(session.c_str() + timeout + 8) / 3);
+            }
+        }
+        if (ending_ && end_ == SessionEnd::TEARDOWN &&
+            atoi(Header(res, "CSeq").c_str()) == teardown_cseq_) {
+            Finish();
+            return false;
+        }
+        switch (step_++) {
+        case 0:
+            Request("DESCRIBE", options_.url, "Accept: application/sdp\r\n");
+            break;
+        case 1:
+            ParseSdp(res);
+            return Setup();
+        case 2:
+            if (!use_tcp_ && !StartUdp(res)) {
+                return false;
+            }
+            Request("PLAY", options_.url);
+            break;
+        case 3:
+            stats.state.store((int)ClientState::PLAYING,
+                              std::memory_order_relaxed);
+            KeepAlive();
+            if (end_ != SessionEnd::NONE) {
+                ScheduleEnd();
+            }
+            break;
+        default:
+            // 保活的应答
+            break;
+        }
+        return true;
+    }
+
+    void ParseSdp(std::string const &sdp) {
+        // a=rtpmap:96 H264/90000
+        size_t pos = sdp.find("a=rtpmap:");
+        if (pos == std::string::npos) {
+            return;
+        }
+        int payload = atoi(sdp.c_str() + pos + 9);
+        size_t slash = sdp.find('/', pos);
+        uint32_t clock = slash == std::string::npos
+                             ? 90000
+                             : (uint32_t)atoi(sdp.c_str() + slash + 1);
+        validator_.Init((uint8_t)payload, clock);
+    }
+
+    bool Setup() {
+        std::string transport;
+        if (use_tcp_) {
+            transport = "RTP/AVP/TCP;unicast;interleaved=0-1";
+            rtp_channel_ = 0;
+        } else {
+            uint16_t port = BindUdp();
+            if (port == 0) {
+                Fail("bind", boost::asio::error::address_in_use);
+                return false;
+            }
+            transport = "RTP/AVP;unicast;client_port=" + std::to_string(port) +
+                        "-" + std::to_string(port + 1);
+        }
+        Request("SETUP", options_.url + "/track0",
+                "Transport: " + transport + "\r\n");
+        return true;
+    }
+
+    uint16_t BindUdp() {
+        for (int attempt = 0; attempt < 2000; attempt++) {
+            uint32_t port = next_udp_port.fetch_add(2);
+            if (port > 64000) {
+                // 用完一轮从头再找
+                next_udp_port.store(30000);
+                continue;
+            }
+            boost::system::error_code ec;
+            rtp_socket_.open(udp::v4(), ec);
+            rtp_socket_.bind(udp::endpoint(udp::v4(), (uint16_t)port), ec);
+            if (!ec) {
+                rtcp_socket_.open(udp::v4(), ec);
+                rtcp_socket_.bind(udp::endpoint(udp::v4(), (uint16_t)port + 1),
+                                  ec);
+                if (!ec) {
+                    // 关键帧一下来几十个包, 接收缓冲区给大一些
+                    rtp_socket_.set_option(
+                        udp::socket::receive_buffer_size(1 << 20), ec);
+                    return (uint16_t)port;
+                }
+                rtcp_socket_.close(ec);
+            }
+            rtp_socket_.close(ec);
+        }
+        return 0;
+    }
+
+    bool StartUdp(std::string const &res) {
+        if (Header(res, "Transport").find("server_port=") ==
+            std::string::npos) {
+            Fail("setup", boost::asio::error::invalid_argument);
+            return false;
+        }
+        ReadRtp();
+        ReadRtcp();
+        return true;
+    }
+
+    void ReadRtp() {
+        auto self = shared_from_this();
+        rtp_socket_.async_receive(
+            boost::asio::buffer(rtp_buf_),
+            [self](boost::system::error_code const &ec, size_t bytes) {
+                if (ec) {
+                    return;
+                }
+                self->OnRtp(self->rtp_buf_, bytes, NowUs());
+                self->ReadRtp();
+            });
+    }
+
+    // SR只收不处理, 不读的话内核缓冲区满了也只是丢
+    void ReadRtcp() {
+        auto self = shared_from_this();
+        rtcp_socket_.async_receive(
+            boost::asio::buffer(rtcp_buf_),
+            [self](boost::system::error_code const &ec, size_t) {
+                if (!ec) {
+                    self->ReadRtcp();
+                }
+            });
+    }
+
+    void OnRtp(uint8_t const *data, size_t size, int64_t now_us) {
+        if (validator_.OnPacket(data, size, now_us, stats) &&
+            stats.ttff_us.load(std::memory_order_relaxed) < 0) {
+            stats.ttff_us.store(now_us - start_us_, std::memory_order_relaxed);
+        }
+    }
+
+    // 默认的会话超时是60秒, 每20秒发一次GET_PARAMETER
+    void KeepAlive() {
+        auto self = shared_from_this();
+        keepalive_.expires_after(std::chrono::seconds(keepalive_s_));
+        keepalive_.async_wait([self](boost::system::error_code const &ec) {
+            if (ec) {
+                return;
+            }
+            self->Request("GET_PARAMETER", self->options_.url);
+            self->KeepAlive();
+        });
+    }
+
+    void ScheduleEnd() {
+        auto self = shared_from_this();
+        end_timer_.expires_after(
+            std::chrono::microseconds((int64_t)(hold_s_ * 1e6)));
+        end_timer_.async_wait([self](boost::system::error_code const &ec) {
+            if (ec) {
+                return;
+            }
+            self->ending_ = true;
+            switch (self->end_) {
+            case SessionEnd::TEARDOWN:
+                self->keepalive_.cancel();
+                self->Request("TEARDOWN", self->options_.url);
+                self->teardown_cseq_ = self->cseq_;
+                break;
+            case SessionEnd::CLOSE:
+                self->Finish();
+                break;
+            default:
+                // 不再发任何东西, 继续收流直到服务器断开
+                self->keepalive_.cancel();
+                break;
+            }
+        });
+    }
+
+    LoadOptions const &options_;
+    bool use_tcp_;
+    SessionEnd end_;
+    double hold_s_;
+    tcp::socket socket_;
+    udp::socket rtp_socket_;
+    udp::socket rtcp_socket_;
+    boost::asio::steady_timer keepalive_;
+    boost::asio::steady_timer end_timer_;
+    int64_t start_us_ = 0;
+    int keepalive_s_ = 20;
+    bool ending_ = false;
+    int teardown_cseq_ = 0;
+
+    int cseq_ = 0;
+    int step_ = 0;
+    std::string session_;
+    std::deque<std::string> out_;
+    std::vector<uint8_t> in_;
+    size_t in_begin_ = 0;
+    size_t in_end_ = 0;
+    uint8_t rtp_channel_ = 0;
+
+    RtpValidator validator_;
+    uint8_t rtp_buf_[2048];
+    uint8_t rtcp_buf_[2048];
+};
+
+/* 测量区间开始时的计数, 结束时做差 */
+struct ClientSnapshot {
+    uint64_t bytes = 0;
+    uint64_t packets = 0;
+    uint64_t expected = 0;
+    uint64_t frames = 0;
+    uint64_t errors = 0;
+};
+
+static ClientSnapshot TakeSnapshot(ClientStats const &stats) {
+    ClientSnapshot snap;
+    snap.bytes = stats.bytes.load(std::memory_order_relaxed);
+    snap.packets = stats.packets.load(std::memory_order_relaxed);
+    snap.expected = stats.expected.load(std::memory_order_relaxed);
+    snap.frames = stats.frames.load(std::memory_order_relaxed);
+    snap.errors = stats.duplicates.load(std::memory_order_relaxed) +
+                  stats.reordered.load(std::memory_order_relaxed) +
+                  stats.ts_errors.load(std::memory_order_relaxed) +
+                  stats.marker_errors.load(std::memory_order_relaxed) +
+                  stats.ssrc_changes.load(std::memory_order_relaxed);
+    return snap;
+}
+
+// /proc/<pid>/stat里的utime+stime, 单位是时钟滴答, 失败返回-1
+static int64_t ReadCpuTicks(int pid) {
+    std::string path =
+        pid > 0 ? "/proc/" + std::to_string(pid) + "/stat" : "/proc/self/stat";
+    FILE *file = fopen(path.c_str(), "r");
+    if (file == nullptr) {
+        return -1;
+    }
+    char buf[1024];
+    size_t n = fread(buf, 1, sizeof(buf) - 1, file);
+    fclose(file);
+    buf[n] = '\0';
+    // 进程名可能带空格, 从最后一个')'之后开始数, 第一个字段是state(3号)
+    char const *p = strrchr(buf, ')');
+    if (p == nullptr) {
+        return -1;
+    }
+    unsigned long long utime = 0, stime = 0;
+    if (sscanf(p + 2,
+               "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+               &utime, &stime) != 2) {
+        return -1;
+    }
+    return (int64_t)(utime + stime);
+}
+
+// /proc/<pid>/fd下的条目数, 失败返回-1
+static int64_t CountFds(int pid) {
+    std::string path = "/proc/" + std::to_string(pid) + "/fd";
+    DIR *dir = opendir(path.c_str());
+    if (dir == nullptr) {
+        return -1;
+    }
+    int64_t count = 0;
+    while (dirent *entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+            count++;
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+// /proc/<pid>/status里的VmRSS(kB), 失败返回-1
+static int64_t ReadRssKb(int pid) {
+    std::string path = "/proc/" + std::to_string(pid) + "/status";
+    FILE *file = fopen(path.c_str(), "r");
+    if (file == nullptr) {
+        return -1;
+    }
+    char line[256];
+    int64_t rss = -1;
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        if (strncmp(line, "VmRSS:", 6) == 0) {
+            rss = atoll(line + 6);
+            break;
+        }
+    }
+    fclose(file);
+    return rss;
+}
+
+// 服务器指标端点上rtp_packets_sent_total(各传输方式)的和, 失败返回-1
+static int64_t ScrapeServerPackets(std::string const &address) {
+    size_t colon = address.find(':');
+    if (colon == std::string::npos) {
+        return -1;
+    }
+    boost::asio::io_context ioc;
+    tcp::socket socket(ioc);
+    boost::system::error_code ec;
+    tcp::resolver resolver(ioc);
+    boost::asio::connect(socket,
+                         resolver.resolve(address.substr(0, colon),
+                                          address.substr(colon + 1), ec),
+                         ec);
+    if (ec) {
+        return -1;
+    }
+    std::string req = "GET /metrics HTTP/1.0\r\nHost: " + address + "\r\n\r\n";
+    boost::asio::write(socket, boost::asio::buffer(req), ec);
+    std::string body;
+    char buf[8192];
+    for (;;) {
+        size_t n = socket.read_some(boost::asio::buffer(buf), ec);
+        body.append(buf, n);
+        if (ec) {
+            break;
+        }
+    }
+    int64_t total = -1;
+    size_t pos = 0;
+    while ((pos = body.find("\nrtp_packets_sent_total", pos)) !=
+           std::string::npos) {
+        size_t end = body.find('\n', pos + 1);
+        size_t space = body.rfind(' ', end);
+        total = (total < 0 ? 0 : total) + atoll(body.c_str() + space + 1);
+        pos = end;
+    }
+    return total;
+}
+
+static double Percentile(std::vector<double> values, double pct) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(pct / 100 * (values.size() - 1) + 0.5);
+    return values[std::min(index, values.size() - 1)];
+}
+
+static void SleepFor(double seconds) {
+    std::this_thread::sleep_for(
+        std::chrono::microseconds((int64_t)(seconds * 1e6)));
+}
+
+// 10k客户端要3万个以上的fd, 软限制提到硬限制
+static void RaiseFileLimit(size_t clients) {
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+        return;
+    }
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    getrlimit(RLIMIT_NOFILE, &limit);
+    if (limit.rlim_cur < clients * 3 + 64) {
+        fprintf(stderr,
+                "warning: open file limit %llu is too low for %zu clients\n",
+                (unsigned long long)limit.rlim_cur, clients);
+    }
+}
+
+static bool ParseOptions(int argc, char **argv, LoadOptions *options) {
+    if (argc < 2) {
+        return false;
+    }
+    options->url = argv[1];
+    size_t scheme = options->url.find("://");
+    if (scheme == std::string::npos) {
+        return false;
+    }
+    std::string rest = options->url.substr(scheme + 3);
+    std::string host_port = rest.substr(0, rest.find('/'));
+    size_t colon = host_port.find(':');
+    options->host = host_port.substr(0, colon);
+    if (colon != std::string::npos) {
+        options->port = host_port.substr(colon + 1);
+    }
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string key = arg.substr(0, eq);
+        std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+        if (key == "--steps") {
+            options->steps.clear();
+            size_t pos = 0;
+            while (pos < value.size()) {
+                size_t end = value.find(',', pos);
+                size_t n = (size_t)atoll(value.substr(pos, end - pos).c_str());
+                if (n == 0) {
+                    return false;
+                }
+                options->steps.push_back(n);
+                pos = end == std::string::npos ? value.size() : end + 1;
+            }
+            std::sort(options->steps.begin(), options->steps.end());
+        } else if (key == "--transport") {
+            if (value == "tcp") {
+                options->transport = LoadTransport::TCP;
+            } else if (value == "udp") {
+                options->transport = LoadTransport::UDP;
+            } else if (value == "mix") {
+                options->transport = LoadTransport::MIX;
+            } else {
+                return false;
+            }
+        } else if (key == "--threads") {
+            options->threads = (unsigned)atoi(value.c_str());
+        } else if (key == "--warmup") {
+            options->warmup_s = atof(value.c_str());
+        } else if (key == "--seconds") {
+            options->seconds = atof(value.c_str());
+        } else if (key == "--rate") {
+            options->rate = atof(value.c_str());
+        } else if (key == "--pid") {
+            options->pid = atoi(value.c_str());
+        } else if (key == "--metrics") {
+            options->metrics = value;
+        } else if (key == "--csv") {
+            options->csv = value;
+        } else if (key == "--per-client") {
+            options->per_client = true;
+        } else if (key == "--soak") {
+            options->soak_s = atof(value.c_str());
+        } else if (key == "--hold") {
+            options->hold_s = atof(value.c_str());
+        } else {
+            return false;
+        }
+    }
+    if (options->soak_s > 0 && (options->pid <= 0 || options->hold_s <= 0)) {
+        // 浸泡模式要采样服务器进程
+        return false;
+    }
+    return !options->steps.empty() && options->seconds > 0 &&
+           options->rate > 0;
+}
+
+/* 浸泡: 会话结束一个就补一个, 三种结束方式轮流. 每秒输出一行.
+ * 第一轮会话全部换过之后记下RSS作为基准, 结束时RSS超过基准的10%(至少4MB)
+ * 算作泄漏; 停止所有客户端后服务器的fd数要回到开始前的值 */
+static bool RunSoak(
+    LoadOptions const &options,
+    std::vector<std::unique_ptr<boost::asio::io_context>> &services) {
+    static const SessionEnd kEnds[] = {SessionEnd::TEARDOWN, SessionEnd::CLOSE,
+                                       SessionEnd::ABANDON};
+    size_t target = options.steps.back();
+    int64_t base_fds = CountFds(options.pid);
+    int64_t base_rss = ReadRssKb(options.pid);
+    if (base_fds < 0 || base_rss < 0) {
+        fprintf(stderr, "cannot read /proc/%d\n", options.pid);
+        return false;
+    }
+    printf("server pid %d: %lld fds, %.1f MB rss before soak\n", options.pid,
+           (long long)base_fds, base_rss / 1024.0);
+    printf("%7s %7s %8s %8s %7s %7s %6s %7s %8s\n", "elapsed", "playing",
+           "sessions", "teardown", "close", "reaped", "failed", "srv_fds",
+           "rss_mb");
+
+    std::vector<std::shared_ptr<LoadClient>> clients(target);
+    size_t started = 0;
+    uint64_t ended[4] = {0};
+    uint64_t failed = 0;
+    int64_t warm_rss = -1;
+    uint64_t warm_sessions = 0;
+    int64_t last_rss = base_rss;
+    uint64_t last_sessions = 0;
+    double credit = 0;
+    int64_t start_us = NowUs();
+    int64_t next_sample_us = start_us + 1000000;
+    for (;;) {
+        int64_t now_us = NowUs();
+        double elapsed = (now_us - start_us) / 1e6;
+        if (elapsed >= options.soak_s) {
+            break;
+        }
+        // 按rate补上已经结束的会话
+        credit = std::min(credit + options.rate * 0.1, (double)target);
+        size_t playing = 0;
+        for (auto &client: clients) {
+            if (client) {
+                int state = client->stats.state.load(std::memory_order_relaxed);
+                if (state == (int)ClientState::DONE) {
+                    ended[(int)client->GetEnd()]++;
+                    client.reset();
+                } else if (state == (int)ClientState::FAILED) {
+                    failed++;
+                    client.reset();
+                } else if (state == (int)ClientState::PLAYING) {
+                    playing++;
+                }
+            }
+            if (!client && credit >= 1) {
+                credit -= 1;
+                size_t index = started++;
+                bool use_tcp =
+                    options.transport == LoadTransport::TCP ||
+                    (options.transport == LoadTransport::MIX && index % 2 == 0);
+                // 播放时长在[0.5, 1.5)倍之间分散开, 结束时刻不扎堆
+                double hold =
+                    options.hold_s * (0.5 + fmod(index * 0.618034, 1.0));
+                client = std::make_shared<LoadClient>(
+                    *services[index % services.size()], options, use_tcp,
+                    kEnds[index / 2 % 3], hold);
+                client->Start();
+            }
+        }
+
+        if (now_us >= next_sample_us) {
+            next_sample_us += 1000000;
+            uint64_t sessions = ended[1] + ended[2] + ended[3];
+            int64_t fds = CountFds(options.pid);
+            last_rss = ReadRssKb(options.pid);
+            last_sessions = sessions;
+            if (warm_rss < 0 && sessions >= target &&
+                elapsed >= options.warmup_s) {
+                warm_rss = last_rss;
+                warm_sessions = sessions;
+            }
+            printf("%6.0fs %7zu %8llu %8llu %7llu %7llu %6llu %7lld %8.1f\n",
+                   elapsed, playing, (unsigned long long)sessions,
+                   (unsigned long long)ended[1], (unsigned long long)ended[2],
+                   (unsigned long long)ended[3], (unsigned long long)failed,
+                   (long long)fds, last_rss / 1024.0);
+            fflush(stdout);
+        }
+        SleepFor(0.1);
+    }
+
+    // 剩下的会话直接断开, 等服务器清理完
+    for (auto &client: clients) {
+        if (client) {
+            client->Stop();
+        }
+    }
+    int64_t end_fds = CountFds(options.pid);
+    for (int i = 0; i < 100 && end_fds > base_fds; i++) {
+        SleepFor(0.1);
+        end_fds = CountFds(options.pid);
+    }
+    int64_t end_rss = ReadRssKb(options.pid);
+
+    bool ok = true;
+    printf("fds: %lld before, %lld after\n", (long long)base_fds,
+           (long long)end_fds);
+    if (end_fds > base_fds) {
+        printf("FAIL: server leaked %lld fds\n", (long long)(end_fds - base_fds));
+        ok = false;
+    }
+    if (warm_rss < 0) {
+        printf("FAIL: fewer than %zu sessions ended, run longer\n", target);
+        return false;
+    }
+    int64_t growth = last_rss - warm_rss;
+    uint64_t sessions = last_sessions - warm_sessions;
+    printf("rss: %.1f MB after warm-up, %.1f MB at end of load, %.1f MB "
+           "drained; %+.1f kB per 1000 sessions over %llu sessions\n",
+           warm_rss / 1024.0, last_rss / 1024.0, end_rss / 1024.0,
+           sessions > 0 ? growth * 1000.0 / sessions : 0.0,
+           (unsigned long long)sessions);
+    if (growth > std::max<int64_t>(warm_rss / 10, 4096)) {
+        printf("FAIL: server rss grew %.1f MB during soak\n", growth / 1024.0);
+        ok = false;
+    }
+    if (failed > 0) {
+        printf("FAIL: %llu sessions failed\n", (unsigned long long)failed);
+        ok = false;
+    }
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    LoadOptions options;
+    if (!ParseOptions(argc, argv, &options)) {
+        fprintf(stderr,
+                "usage: %s <rtsp_url> [--steps=1,10,100,1000] "
+                "[--transport=udp|tcp|mix]\n"
+                "       [--threads=N] [--warmup=s] [--seconds=s] "
+                "[--rate=sessions/s] [--pid=server_pid]\n"
+                "       [--metrics=host:port] [--csv=path] [--per-client]\n"
+                "       [--soak=s --hold=s --pid=server_pid]\n"
+                "example: %s rtsp://127.0.0.1:8554/live "
+                "--steps=1,10,100,1000,10000 --transport=mix "
+                "--pid=$(pgrep -x Server)\n"
+                "soak:    %s rtsp://127.0.0.1:8554/live --steps=50 "
+                "--transport=mix --soak=120 --hold=3 "
+                "--pid=$(pgrep -x Server)\n"
+                "         (server started with --idle-timeout=2 so idle "
+                "sessions are reaped quickly)\n",
+                argv[0], argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+    RaiseFileLimit(options.steps.back());
+    if (options.threads == 0) {
+        options.threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    using WorkGuard =
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type>;
+    std::vector<std::unique_ptr<boost::asio::io_context>> services;
+    std::vector<WorkGuard> guards;
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < options.threads; i++) {
+        services.emplace_back(new boost::asio::io_context(1));
+        guards.push_back(boost::asio::make_work_guard(*services.back()));
+    }
+    for (unsigned i = 0; i < options.threads; i++) {
+        boost::asio::io_context *ioc = services[i].get();
+        threads.emplace_back([ioc]() { ioc->run(); });
+    }
+
+    if (options.soak_s > 0) {
+        bool ok = RunSoak(options, services);
+        for (auto &guard: guards) {
+            guard.reset();
+        }
+        for (auto &thread: threads) {
+            thread.join();
+        }
+        return ok ? 0 : EXIT_FAILURE;
+    }
+
+    FILE *csv = nullptr;
+    if (!options.csv.empty()) {
+        csv = fopen(options.csv.c_str(), "w");
+        if (csv == nullptr) {
+            fprintf(stderr, "cannot open %s\n", options.csv.c_str());
+            return EXIT_FAILURE;
+        }
+        fprintf(csv, "clients,playing,failed,server_cpu_pct,server_pps,"
+                     "load_cpu_pct,rx_pps,kbps_avg,kbps_min,loss_pct,"
+                     "jitter_p50_ms,jitter_p99_ms,ttff_p50_ms,ttff_p99_ms,"
+                     "errors\n");
+    }
+
+    printf("%7s %7s %6s %7s %9s %7s %9s %8s %8s %6s %8s %8s %8s %8s %7s\n",
+           "clients", "playing", "failed", "srv_cpu", "srv_pps", "own_cpu",
+           "rx_pps", "kbps_avg", "kbps_min", "loss%", "jit_p50", "jit_p99",
+           "ttff_p50", "ttff_p99", "errors");
+    double ticks_per_s = (double)sysconf(_SC_CLK_TCK);
+    std::vector<std::shared_ptr<LoadClient>> clients;
+    for (size_t target: options.steps) {
+        // 按rate逐个建立, 避免把服务器的accept队列一下子打满
+        while (clients.size() < target) {
+            size_t index = clients.size();
+            bool use_tcp =
+                options.transport == LoadTransport::TCP ||
+                (options.transport == LoadTransport::MIX && index % 2 == 0);
+            auto client = std::make_shared<LoadClient>(
+                *services[index % services.size()], options, use_tcp);
+            client->Start();
+            clients.push_back(client);
+            SleepFor(1.0 / options.rate);
+        }
+        SleepFor(options.warmup_s);
+
+        std::vector<ClientSnapshot> begin(clients.size());
+        for (size_t i = 0; i < clients.size(); i++) {
+            begin[i] = TakeSnapshot(clients[i]->stats);
+        }
+        int64_t server_ticks = ReadCpuTicks(options.pid);
+        int64_t own_ticks = ReadCpuTicks(0);
+        int64_t server_packets = ScrapeServerPackets(options.metrics);
+        int64_t begin_us = NowUs();
+        SleepFor(options.seconds);
+        double elapsed = (NowUs() - begin_us) / 1e6;
+        int64_t server_ticks_end = ReadCpuTicks(options.pid);
+        int64_t own_ticks_end = ReadCpuTicks(0);
+        int64_t server_packets_end = ScrapeServerPackets(options.metrics);
+
+        size_t playing = 0, failed = 0;
+        uint64_t rx_packets = 0, expected = 0, errors = 0;
+        std::vector<double> kbps, jitter_ms, ttff_ms;
+        if (options.per_client) {
+            printf("  %6s %5s %8s %9s %6s %6s %8s %9s %7s\n", "client",
+                   "trans", "state", "kbps", "fps", "loss%", "jitter", "ttff",
+                   "errors");
+        }
+        for (size_t i = 0; i < clients.size(); i++) {
+            ClientStats const &stats = clients[i]->stats;
+            ClientSnapshot end = TakeSnapshot(stats);
+            int state = stats.state.load(std::memory_order_relaxed);
+            if (state == (int)ClientState::FAILED) {
+                failed++;
+                continue;
+            }
+            if (state != (int)ClientState::PLAYING) {
+                continue;
+            }
+            playing++;
+            uint64_t packets = end.packets - begin[i].packets;
+            uint64_t client_expected = end.expected - begin[i].expected;
+            double client_kbps =
+                (end.bytes - begin[i].bytes) * 8 / 1000.0 / elapsed;
+            double client_jitter =
+                stats.jitter_us.load(std::memory_order_relaxed) / 1000.0;
+            int64_t ttff = stats.ttff_us.load(std::memory_order_relaxed);
+            rx_packets += packets;
+            expected += std::max(client_expected, packets);
+            errors += end.errors - begin[i].errors;
+            kbps.push_back(client_kbps);
+            jitter_ms.push_back(client_jitter);
+            if (ttff >= 0) {
+                ttff_ms.push_back(ttff / 1000.0);
+            }
+            if (options.per_client) {
+                double loss =
+                    client_expected > packets
+                        ? (client_expected - packets) * 100.0 / client_expected
+                        : 0;
+                printf("  %6zu %5s %8s %9.1f %6.1f %5.2f%% %6.1fms %7.1fms "
+                       "%7llu\n",
+                       i, clients[i]->IsTcp() ? "tcp" : "udp", "playing",
+                       client_kbps, (end.frames - begin[i].frames) / elapsed,
+                       loss, client_jitter, ttff >= 0 ? ttff / 1000.0 : -1.0,
+                       (unsigned long long)(end.errors - begin[i].errors));
+            }
+        }
+
+        double server_cpu =
+            server_ticks >= 0 && server_ticks_end >= 0
+                ? (server_ticks_end - server_ticks) / ticks_per_s / elapsed *
+                      100
+                : -1;
+        double own_cpu = (own_ticks_end - own_ticks) / ticks_per_s / elapsed *
+                         100;
+        double server_pps =
+            server_packets >= 0 && server_packets_end >= 0
+                ? (server_packets_end - server_packets) / elapsed
+                : -1;
+        double loss = expected > 0
+                          ? (expected - rx_packets) * 100.0 / expected
+                          : 0;
+        double kbps_avg = 0;
+        for (double k: kbps) {
+            kbps_avg += k;
+        }
+        kbps_avg = kbps.empty() ? 0 : kbps_avg / kbps.size();
+        double kbps_min =
+            kbps.empty() ? 0 : *std::min_element(kbps.begin(), kbps.end());
+
+        // 没有采样到的列输出-1
+        printf("%7zu %7zu %6zu %6.1f%% %9.0f %6.1f%% %9.0f %8.1f %8.1f "
+               "%5.2f%% %6.1fms %6.1fms %6.0fms %6.0fms %7llu\n",
+               clients.size(), playing, failed, server_cpu, server_pps,
+               own_cpu, rx_packets / elapsed, kbps_avg, kbps_min, loss,
+               Percentile(jitter_ms, 50), Percentile(jitter_ms, 99),
+               Percentile(ttff_ms, 50), Percentile(ttff_ms, 99),
+               (unsigned long long)errors);
+        fflush(stdout);
+        if (csv != nullptr) {
+            fprintf(csv,
+                    "%zu,%zu,%zu,%.1f,%.0f,%.1f,%.0f,%.1f,%.1f,%.3f,%.2f,"
+                    "%.2f,%.1f,%.1f,%llu\n",
+                    clients.size(), playing, failed, server_cpu, server_pps,
+                    own_cpu, rx_packets / elapsed, kbps_avg, kbps_min, loss,
+                    Percentile(jitter_ms, 50), Percentile(jitter_ms, 99),
+                    Percentile(ttff_ms, 50), Percentile(ttff_ms, 99),
+                    (unsigned long long)errors);
+            fflush(csv);
+        }
+    }
+
+    for (auto &client: clients) {
+        client->Stop();
+    }
+    for (auto &guard: guards) {
+        guard.reset();
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    if (csv != nullptr) {
+        fclose(csv);
+    }
+    return 0;
+}